@@ -0,0 +1,95 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include <dlisio/ext/subset.hpp>
+
+namespace {
+
+void usage( const char* name ) {
+    std::fprintf( stderr,
+        "usage: %s [options] SOURCE TARGET\n"
+        "\n"
+        "Write the selected records of SOURCE to a new file TARGET. Records\n"
+        "are copied verbatim, without decoding.\n"
+        "\n"
+        "options:\n"
+        "  -l, --logical-file N  keep logical file N (counting from 0)\n"
+        "  -t, --type TYPE       keep EFLRs with set type TYPE\n"
+        "  -f, --frame NAME      keep the frame data of frame NAME\n"
+        "\n"
+        "All options can be repeated, and no options selects everything.\n"
+        "FILE-HEADER records are always kept.\n",
+        name );
+}
+
+bool option( const char* arg, const char* shortopt, const char* longopt ) {
+    return std::strcmp( arg, shortopt ) == 0
+        || std::strcmp( arg, longopt ) == 0;
+}
+
+}
+
+int main( int args, char** argv ) {
+    dl::subset_selection sel;
+    std::vector< std::string > paths;
+
+    for( int i = 1; i < args; ++i ) {
+        const char* arg = argv[ i ];
+
+        if( option( arg, "-h", "--help" ) ) {
+            usage( argv[ 0 ] );
+            return 0;
+        }
+
+        const bool takes_value = option( arg, "-l", "--logical-file" )
+                              || option( arg, "-t", "--type" )
+                              || option( arg, "-f", "--frame" );
+
+        if( !takes_value ) {
+            paths.push_back( arg );
+            continue;
+        }
+
+        if( i + 1 == args ) {
+            std::fprintf( stderr, "%s: missing value for %s\n", argv[ 0 ], arg );
+            return 2;
+        }
+
+        const char* value = argv[ ++i ];
+        if( option( arg, "-l", "--logical-file" ) ) {
+            char* end;
+            const long lf = std::strtol( value, &end, 10 );
+            if( *end != '\0' || lf < 0 ) {
+                std::fprintf( stderr, "%s: invalid logical file '%s'\n",
+                                      argv[ 0 ], value );
+                return 2;
+            }
+            sel.logical_files.push_back( int( lf ) );
+        }
+
+        if( option( arg, "-t", "--type" ) )  sel.types.push_back( value );
+        if( option( arg, "-f", "--frame" ) ) sel.frames.push_back( value );
+    }
+
+    if( paths.size() != 2 ) {
+        usage( argv[ 0 ] );
+        return 2;
+    }
+
+    try {
+        const auto result = dl::write_subset( paths[ 0 ], paths[ 1 ], sel );
+        std::printf( "records: %d\n"
+                     "bytes: %lld\n"
+                     "verbatim-bytes: %lld\n",
+                     result.records,
+                     result.bytes,
+                     result.verbatim );
+    } catch( const std::exception& e ) {
+        std::fprintf( stderr, "%s: %s\n", argv[ 0 ], e.what() );
+        return 1;
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef DLISIO_EXT_ARROW_HPP
+#define DLISIO_EXT_ARROW_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <dlisio/ext/types.hpp>
+
+/*
+ * The Arrow C data interface, as given in the specification
+ *
+ * https://arrow.apache.org/docs/format/CDataInterface.html
+ *
+ * The structs are part of the ABI and meant to be copied verbatim, so that no
+ * arrow library is needed to produce or consume them.
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema {
+    // Array type description
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+struct ArrowArray {
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+}
+
+#endif // ARROW_C_DATA_INTERFACE
+
+namespace dl {
+
+/*
+ * Export to Arrow
+ *
+ * Both exports produce a struct array (a record batch) and its schema. The
+ * caller owns the exported structs, and must call their release callbacks
+ * when done, as per the C data interface. On failure nothing is exported,
+ * and the structs are left untouched.
+ *
+ * export_columns exports the columns of a column cache (see cache.hpp)
+ * without copying them - the buffers point straight into the memory mapped
+ * cache file, which is kept mapped until the last of the arrays is released.
+ * names are the column names, in the order of the columns in the cache.
+ * Columns are mapped to arrow types as:
+ *
+ *  integers and floats     the same arrow type
+ *  dtime                   timestamp[ns], without time zone. Times that are
+ *                          not valid dates (NaT in the cache) are null
+ *  csingl, cdoubl          fixed_size_list<float, 2>, i.e. [real, imag]
+ *
+ * and channels with more than one element per frame are fixed size lists of
+ * elements.
+ *
+ * export_objects exports the objects of type (e.g. CHANNEL) in sets as a
+ * table, with a row per object, and the columns
+ *
+ *  id, origin, copynumber  the object name
+ *  <label>...              every attribute label, in order of appearance
+ *
+ * Attribute values are lists, null when the attribute is absent. Elements
+ * are mapped to arrow types as for export_columns, and in addition:
+ *
+ *  ident, ascii, units     utf8, where strings that are not UTF-8 are read
+ *                          as latin-1
+ *  fsing1, fdoub2 etc.     fixed_size_list<float, 2 or 3>, i.e. [V, A(, B)]
+ *  obname                  struct<id, origin, copynumber>
+ *  objref                  struct<type, name: obname>
+ *  attref                  struct<type, name: obname, label>
+ *  dtime                   as above, and null if not a valid date
+ *
+ * An attribute with values of different types in different objects is
+ * exported as utf8, with the value as JSON (see json.hpp).
+ */
+void export_columns( const std::string& path,
+                     const std::vector< std::string >& names,
+                     ArrowSchema*,
+                     ArrowArray* )
+noexcept (false);
+
+void export_objects( const std::vector< object_set >& sets,
+                     const std::string& type,
+                     ArrowSchema*,
+                     ArrowArray* )
+noexcept (false);
+
+}
+
+#endif //DLISIO_EXT_ARROW_HPP
@@ -0,0 +1,81 @@
+#ifndef DLISIO_EXT_BATCH_HPP
+#define DLISIO_EXT_BATCH_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * The result of loading a single file: the storage label, the record index
+ * and the parsed (unencrypted) EFLRs, i.e. what dlisio.load needs. If loading
+ * failed, ok is false and error holds the message, and the other fields are
+ * unspecified.
+ */
+struct loaded_file {
+    std::string path;
+    bool ok;
+    std::string error;
+
+    long long sul;
+    std::string label;
+    stream_offsets offsets;
+    std::vector< object_set > sets;
+};
+
+loaded_file load_file( const std::string& path ) noexcept (true);
+
+/*
+ * Load many files on a bounded pool of worker threads
+ *
+ * The workers pick paths in order and load them with load_file, and the
+ * results are returned by next() in order of completion. A failing file does
+ * not affect the others. To bound memory use, workers stop picking new files
+ * while 2 * workers results are waiting to be consumed.
+ *
+ * Destroying the loader stops the workers after the files in progress.
+ */
+class batch_loader {
+public:
+    batch_loader( std::vector< std::string > paths, int workers )
+    noexcept (false);
+    ~batch_loader();
+
+    batch_loader( const batch_loader& ) = delete;
+    batch_loader& operator = ( const batch_loader& ) = delete;
+
+    /*
+     * Block until the next file is loaded. Returns false when all files have
+     * been returned.
+     */
+    bool next( loaded_file& ) noexcept (false);
+
+    std::size_t size() const noexcept (true);
+
+private:
+    void work() noexcept (true);
+
+    std::vector< std::string > paths;
+    std::size_t capacity;
+    std::size_t cursor = 0;
+    std::size_t returned = 0;
+    bool stopped = false;
+
+    std::deque< loaded_file > done;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::condition_variable room;
+    std::vector< std::thread > threads;
+};
+
+}
+
+#endif //DLISIO_EXT_BATCH_HPP
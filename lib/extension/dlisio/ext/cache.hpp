@@ -0,0 +1,85 @@
+#ifndef DLISIO_EXT_CACHE_HPP
+#define DLISIO_EXT_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * A cheap identity of a file, good enough to detect that a cache is stale.
+ *
+ * The hash covers the size, the first and last 64K, and a handful of evenly
+ * spaced 4K blocks in between, so computing it costs a few reads regardless of
+ * file size. An in-place edit that keeps the size and misses all the sampled
+ * blocks goes unnoticed.
+ */
+struct fingerprint {
+    std::uint64_t size;
+    std::uint64_t hash;
+
+    bool operator == ( const fingerprint& rhs ) const noexcept (true) {
+        return this->size == rhs.size && this->hash == rhs.hash;
+    }
+};
+
+fingerprint file_fingerprint( const std::string& path ) noexcept (false);
+
+/*
+ * Decoded-column cache
+ *
+ * All the frames of a frame, decoded and written column-wise to a file that
+ * can be memory-mapped and used directly as arrays. Every channel is a single
+ * column of rows x elements values, native-endian and aligned to 64 bytes.
+ * The frame numbers are stored as the column with channel == -1.
+ *
+ * The validated floats (fsing1, fdoub2 etc.) are stored as the value
+ * component only, and times (dtime) as int64 nanoseconds since epoch, i.e.
+ * "=M8[ns]". Channels without a fixed-size numerical representation
+ * (strings, object names) are not cached.
+ *
+ * The dtype of a column is a numpy-style type string, e.g. "=f4". The cache
+ * file is tied to the platform that wrote it, and readers should check the
+ * fingerprint and frame before trusting the content.
+ */
+void write_column_cache( const std::string& path,
+                         const fingerprint& source,
+                         stream&,
+                         const std::vector< int >& records,
+                         const dl::obname& frame,
+                         const std::string& fmt,
+                         const std::vector< int >& dimensions )
+noexcept (false);
+
+struct cache_column {
+    int channel;
+    int position;
+    int elements;
+    std::string dtype;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+class column_cache {
+public:
+    explicit column_cache( const std::string& path ) noexcept (false);
+
+    const dl::fingerprint& source() const noexcept (true);
+    const dl::obname& frame() const noexcept (true);
+    std::int64_t rows() const noexcept (true);
+    const std::vector< cache_column >& columns() const noexcept (true);
+
+private:
+    dl::fingerprint fp;
+    dl::obname name;
+    std::int64_t nrows;
+    std::vector< cache_column > cols;
+};
+
+}
+
+#endif //DLISIO_EXT_CACHE_HPP
@@ -0,0 +1,151 @@
+#ifndef DLISIO_EXT_CATALOG_HPP
+#define DLISIO_EXT_CATALOG_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mio/mio.hpp>
+
+#include <dlisio/ext/cache.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * Cross-file metadata catalog
+ *
+ * A catalog summarises the frames, channels and parameters of many files,
+ * and has an inverted index from object names to where they are, so that
+ * questions like "which files have a channel DTCO" are answered without
+ * opening any of the files.
+ *
+ * Logical files are numbered from 0 within a physical file, and every
+ * FILE-HEADER after the first starts a new one. The frame of a channel is an
+ * index into the frames of the same catalog_file, or -1 if no frame in the
+ * logical file lists the channel.
+ */
+struct catalog_frame {
+    dl::obname name;
+    int logical_file;
+};
+
+struct catalog_channel {
+    dl::obname name;
+    int logical_file;
+    std::string units;
+    int reprc;
+    std::vector< int > dimension;
+    int frame;
+};
+
+struct catalog_parameter {
+    dl::obname name;
+    int logical_file;
+};
+
+struct catalog_file {
+    std::string path;
+    dl::fingerprint fingerprint;
+    int logical_files;
+    std::vector< catalog_frame > frames;
+    std::vector< catalog_channel > channels;
+    std::vector< catalog_parameter > parameters;
+};
+
+/*
+ * Summarise the parsed metadata of a file, in file order
+ */
+catalog_file catalog_entry( const std::string& path,
+                            const dl::fingerprint&,
+                            const std::vector< object_set >& )
+noexcept (false);
+
+void write_catalog( const std::string& path,
+                    const std::vector< catalog_file >& )
+noexcept (false);
+
+enum class catalog_kind : int {
+    channel   = 0,
+    parameter = 1,
+    frame     = 2,
+};
+
+/*
+ * A match in the inverted index. The row is the index of the object among
+ * the channels, parameters or frames (depending on kind) of the file.
+ */
+struct catalog_hit {
+    catalog_kind kind;
+    std::uint32_t file;
+    std::uint32_t row;
+    int logical_file;
+    dl::obname name;
+};
+
+/*
+ * A memory mapped catalog. The strings are stored sorted and de-duplicated,
+ * so a lookup is a binary search over the names followed by a scan of the
+ * matches, without reading anything else.
+ */
+class catalog {
+public:
+    explicit catalog( const std::string& path ) noexcept (false);
+
+    std::size_t size() const noexcept (true);
+    std::string path( std::size_t file ) const noexcept (false);
+    dl::fingerprint fingerprint( std::size_t file ) const noexcept (false);
+
+    /* decode all the entries of a single file */
+    catalog_file file( std::size_t ) const noexcept (false);
+
+    std::vector< catalog_hit > lookup( const std::string& name ) const
+    noexcept (false);
+
+private:
+    struct section {
+        std::uint64_t count;
+        std::uint64_t offset;
+    };
+
+    std::string string( std::uint32_t ) const noexcept (false);
+    const char* row( const section&, std::size_t size, std::size_t i ) const
+    noexcept (false);
+
+    mio::mmap_source data;
+    section strings;
+    section chars;
+    section files;
+    section frames;
+    section channels;
+    section parameters;
+    section dimensions;
+    section postings;
+    section hits;
+};
+
+/*
+ * Bring the catalog at path up to date with the files in paths. Files that
+ * are already in the catalog with an unchanged fingerprint are kept as they
+ * are, and only new and changed files are loaded (on a pool of workers, as
+ * with batch_loader). Files no longer in paths are dropped. Files that fail
+ * to load are left out, and reported in failed.
+ *
+ * The catalog is written to a temporary file and moved in place.
+ */
+struct catalog_update {
+    int loaded;
+    int unchanged;
+    int removed;
+    std::vector< std::pair< std::string, std::string > > failed;
+};
+
+catalog_update update_catalog( const std::string& path,
+                               const std::vector< std::string >& paths,
+                               int workers )
+noexcept (false);
+
+}
+
+#endif //DLISIO_EXT_CATALOG_HPP
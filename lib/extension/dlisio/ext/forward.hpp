@@ -0,0 +1,70 @@
+#ifndef DLISIO_EXT_FORWARD_HPP
+#define DLISIO_EXT_FORWARD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * A source of bytes that can only be read front to back, e.g. a pipe. It
+ * should copy at most n bytes to dst, and return the number of bytes copied,
+ * which is 0 only at end-of-file.
+ */
+using byte_source = std::function< std::size_t (char* dst, std::size_t n) >;
+
+/*
+ * The callbacks of read_forward. All are optional, and the arguments are only
+ * valid for the duration of the call.
+ *
+ * label      - the raw storage unit label
+ * objects    - every (unencrypted) explicitly formatted record, parsed
+ * frame      - every frame in the FDATA records, as written by
+ *              dlis_packf( fmt ), where fmt is the format string of the frame
+ * record     - every other record, i.e. encrypted records, records of other
+ *              types than FDATA, and FDATA of frames whose FRAME and CHANNEL
+ *              objects have not been seen, or if frame is not set
+ */
+struct forward_handler {
+    std::function< void (const std::string& label) > label;
+    std::function< void (const object_set&) > objects;
+    std::function< void (const obname& frame,
+                         const std::string& fmt,
+                         std::int32_t frame_number,
+                         const char* packed,
+                         std::size_t size) > frame;
+    std::function< void (const record&) > record;
+};
+
+struct forward_result {
+    int records;
+    int frames;
+    long long bytes;
+};
+
+/*
+ * Read a file front to back from a byte source that cannot seek, e.g. a pipe
+ * or stdin, and emit its contents through the callbacks as they are read
+ *
+ * Only a small, bounded buffer of the source is kept, large enough for the
+ * largest visible record, in addition to the record being read. The FRAME
+ * and CHANNEL objects are kept as they go by, so that the frames in the FDATA
+ * records can be decoded. They are forgotten at every FILE-HEADER, since
+ * names are only unique within a logical file. Frame data that cannot be
+ * decoded, e.g. of unknown frames or frames with channels of unknown
+ * representation codes, is passed on as records.
+ *
+ * Damage is not recovered from, and throws like indexing the file would. In
+ * that case, the callbacks have seen everything up to the damaged record.
+ */
+forward_result read_forward( const byte_source&, const forward_handler& )
+noexcept (false);
+
+}
+
+#endif //DLISIO_EXT_FORWARD_HPP
@@ -0,0 +1,151 @@
+#ifndef DLISIO_EXT_FRAME_HPP
+#define DLISIO_EXT_FRAME_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * The value of an integer attribute, e.g. DIMENSION, regardless of which of
+ * the integral representation codes it was written with. An absent attribute
+ * is empty, and non-integral values are rejected with std::invalid_argument.
+ */
+std::vector< int > integer_attribute( const basic_object&,
+                                      const std::string& label )
+noexcept (false);
+
+/*
+ * The dlis_packf format specifier (DLIS_FMT_*) for a representation code
+ */
+char fmtchr( representation_code ) noexcept (false);
+
+/*
+ * Build the dlis_packf format string of a frame, i.e. the layout of a single
+ * frame in an FDATA record, sans the leading frame number.
+ *
+ * The frame's CHANNELS attribute decides the order, and every channel
+ * contributes one specifier per element (the product of its DIMENSION). The
+ * channels argument must contain all the channels listed in the frame, but
+ * can contain others too, in any order.
+ */
+std::string fmtstr( const basic_object& frame,
+                    const object_vector& channels ) noexcept (false);
+
+/*
+ * Interpret a single packed (i.e. dlis_packf output) numerical value as a
+ * double. For the validated floats (fsing1, fdoub2 etc.) this is the V
+ * component. Complex, string, object-reference and time types have no useful
+ * ordering and are rejected with std::invalid_argument.
+ */
+double packed_double( char fmt, const char* packed ) noexcept (false);
+
+/*
+ * The offsets of every value in a packed frame. The fmt must be fixed-size,
+ * i.e. dlis_pack_varsize( fmt ) must be false.
+ */
+std::vector< std::size_t > packed_offsets( const std::string& fmt )
+noexcept (false);
+
+/*
+ * The offsets of every value in a packed frame, for any fmt. For fixed-size
+ * formats the offsets are computed once, but variable-size values (strings,
+ * object names) move everything after them from frame to frame, and then
+ * at() walks the length prefixes of the packed frame to find the offsets.
+ *
+ * The reference returned by at() is valid until the next call.
+ */
+class packed_layout {
+public:
+    explicit packed_layout( const std::string& fmt ) noexcept (false);
+
+    const std::vector< std::size_t >& at( const char* packed )
+    noexcept (false);
+
+private:
+    std::string fmt;
+    std::vector< int > sizes;
+    std::vector< std::size_t > offsets;
+    bool varsize;
+};
+
+/*
+ * The columns (positions in fmt) that have an ordering, as interpreted by
+ * packed_double. Columns out of range are rejected with std::out_of_range,
+ * while strings, object names, complex values and times are left out.
+ */
+std::vector< int > orderable_columns( const std::string& fmt,
+                                      const std::vector< int >& columns )
+noexcept (false);
+
+/*
+ * Walk all frames in the FDATA records, and call visit for every frame that
+ * belongs to the frame named frame. The records are indices into the stream,
+ * and records that are not (unencrypted) FDATA are skipped. The packed
+ * argument is the frame as written by dlis_packf( fmt ), and only valid for
+ * the duration of the call.
+ */
+using frame_visitor = std::function< void (int record,
+                                           std::int32_t frame_number,
+                                           const char* packed) >;
+
+void foreach_frame( stream&,
+                    const std::vector< int >& records,
+                    const dl::obname& frame,
+                    const std::string& fmt,
+                    const frame_visitor& visit )
+noexcept (false);
+
+/*
+ * A zone map is a per-record summary of the FDATA records of a single frame.
+ * Every zone knows the range of frame numbers and the [min, max] of a set of
+ * selected values (columns) in its record, so that queries like "frames where
+ * GR > 150" can skip records whose values can never match, without decoding
+ * them.
+ *
+ * The columns are positions in the frame's format string, i.e. the n-th value
+ * of the frame. Position 0 is always the index channel. NaNs do not contribute
+ * to the ranges, and if a column has no values in a record, min > max.
+ * Columns without an ordering, e.g. strings, are not summarised, and are not
+ * in zonemap.columns, but they do not stop the other columns of the frame
+ * from being summarised.
+ */
+struct zone {
+    int record;
+    int frames;
+    std::int32_t first;
+    std::int32_t last;
+    std::vector< double > min;
+    std::vector< double > max;
+};
+
+struct zonemap {
+    dl::obname frame;
+    std::string fmt;
+    std::vector< int > columns;
+    std::vector< zone > zones;
+
+    /*
+     * The records where column may have values in [lo, hi]. The column is a
+     * position in the format string, and must be one of the summarised
+     * columns.
+     */
+    std::vector< int > candidates( int column, double lo, double hi ) const
+    noexcept (false);
+};
+
+zonemap build_zonemap( stream&,
+                       const std::vector< int >& records,
+                       const dl::obname& frame,
+                       const std::string& fmt,
+                       const std::vector< int >& columns )
+noexcept (false);
+
+}
+
+#endif //DLISIO_EXT_FRAME_HPP
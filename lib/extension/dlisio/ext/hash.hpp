@@ -0,0 +1,39 @@
+#ifndef DLISIO_EXT_HASH_HPP
+#define DLISIO_EXT_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dl {
+
+/*
+ * XXH64, the 64-bit xxHash by Yann Collet, for fast, non-cryptographic
+ * content hashing. This is a small, portable implementation of the
+ * streaming interface - it is byte order independent, and produces the same
+ * digests as the reference implementation.
+ *
+ * https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ */
+class xxh64 {
+public:
+    explicit xxh64( std::uint64_t seed = 0 ) noexcept (true);
+
+    void update( const char* data, std::size_t size ) noexcept (true);
+    std::uint64_t digest() const noexcept (true);
+
+private:
+    std::uint64_t acc[ 4 ];
+    std::uint64_t seed;
+    std::uint64_t total = 0;
+    unsigned char buffer[ 32 ];
+    std::size_t buffered = 0;
+};
+
+std::uint64_t xxh64sum( const char* data,
+                        std::size_t size,
+                        std::uint64_t seed = 0 )
+noexcept (true);
+
+}
+
+#endif //DLISIO_EXT_HASH_HPP
@@ -2,7 +2,10 @@
 #define DLISIO_PYTHON_IO_HPP
 
 #include <array>
+#include <cstdint>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -13,6 +16,8 @@
 
 namespace dl {
 
+struct zindex;
+
 struct record {
     bool isexplicit()  const noexcept (true);
     bool isencrypted() const noexcept (true);
@@ -23,6 +28,69 @@ struct record {
     std::vector< char > data;
 };
 
+/*
+ * A random-access view of a DLIS byte stream that is stored differently in
+ * the file, e.g. wrapped in tape marks or compressed. Offsets are in the DLIS
+ * stream, not in the file.
+ */
+class logical_file {
+public:
+    virtual ~logical_file() = default;
+
+    virtual long long size() const noexcept (true) = 0;
+
+    /* copy n bytes at offset, or throw if the stream ends first */
+    virtual void read( char* dst, long long offset, std::size_t n )
+        noexcept (false) = 0;
+};
+
+/*
+ * TIF-wrapped (tape image) files
+ *
+ * A tape image wraps every physical tape record in a 12-byte tape mark of
+ * three little-endian uint32: the type (0 for data, 1 for a tape mark) and
+ * the file offsets of the previous and the next tape mark. The DLIS byte
+ * stream is the data records concatenated, without the marks.
+ *
+ * Rather than unwrapping the file into a copy, the tapeimage builds a chunk
+ * translation table from the tape marks, and translates offsets in the DLIS
+ * stream (logical) to offsets in the file (physical). Offsets are only 32
+ * bits in the tape marks, and are assumed to wrap around in larger files.
+ *
+ * The tapeimage reads directly from the memory mapped file, which must
+ * outlive it.
+ */
+struct tapeimage_chunk {
+    long long logical;
+    long long physical;
+    long long size;
+};
+
+bool istapeimage( const mio::mmap_source& ) noexcept (true);
+
+class tapeimage : public logical_file {
+public:
+    explicit tapeimage( const mio::mmap_source& ) noexcept (false);
+
+    /* size of the DLIS stream, i.e. without the tape marks */
+    long long size() const noexcept (true) override;
+
+    long long physical( long long logical ) const noexcept (false);
+
+    /* copy n bytes from the DLIS stream, across chunks as needed */
+    void read( char* dst, long long logical, std::size_t n )
+        noexcept (false) override;
+
+    const std::vector< tapeimage_chunk >& chunks() const noexcept (true);
+
+private:
+    std::vector< tapeimage_chunk >::const_iterator
+    find( long long logical ) const noexcept (false);
+
+    const char* data;
+    std::vector< tapeimage_chunk > table;
+};
+
 class stream {
 public:
     explicit stream( const std::string& path ) noexcept (false);
@@ -34,15 +102,49 @@ public:
                   std::vector< int > )
         noexcept (false);
 
+    /*
+     * Read the file through the chunk table of a tape image, so that tells
+     * and offsets are in the DLIS stream, not in the file
+     */
+    void remap( const tapeimage& ) noexcept (false);
+
+    /*
+     * Read the decompressed stream of a compressed file, through its zindex
+     */
+    void remap( const zindex& ) noexcept (false);
+
     void close();
 
     void read( char* dst, long long offset, int n );
 
+    /* the tells and residuals, as given to reindex */
+    const std::vector< long long >& record_tells() const noexcept (true);
+    const std::vector< int >& record_residuals() const noexcept (true);
+
+    /* true if the tells are offsets in a tape image or compressed stream */
+    bool remapped() const noexcept (true);
+
 private:
+    void seek( long long offset ) noexcept (false);
+    void next( char* dst, long long n ) noexcept (false);
+
+    std::string path;
     std::fstream fs;
     std::vector< long long > tells;
     std::vector< int > residuals;
 
+    /*
+     * the chunk table of tape images, and the read position, both in the
+     * DLIS stream and in the file. If chunks is empty, the file is read
+     * as-is
+     */
+    std::vector< tapeimage_chunk > chunks;
+    long long position = 0;
+    long long physical = -1;
+
+    /* if set, all reads go through view, e.g. to decompress */
+    std::unique_ptr< logical_file > view;
+
     /*
      * if this is true, there are no gaps inbetween tells, i.e. the file
      * pointer should be at the next tell after reading. When stream is indexed
@@ -53,23 +155,236 @@ private:
 };
 
 
+/*
+ * Encrypted records
+ *
+ * The indexers note the encrypted records from the header of their first
+ * segment, which they read anyway, so that encrypted records can be left out
+ * before they are read. If the record has an encryption packet, its company
+ * code (of the producer that encrypted it) and size (without the 4-byte
+ * header) are noted too, otherwise company is -1. Most files have no
+ * encrypted records at all, so only the encrypted ones are listed.
+ */
+struct encrypted_record {
+    int record;
+    int company;
+    int packet;
+};
+
 struct stream_offsets {
     std::vector< long long > tells;
     std::vector< int > residuals;
     std::vector< int > explicits;
+    std::vector< encrypted_record > encrypted;
 
     void resize( std::size_t ) noexcept (false);
 };
 
+/*
+ * The encrypted records as runs [begin, end) of consecutive records with the
+ * same company code, to triage files without reading any payload
+ */
+struct encrypted_range {
+    int begin;
+    int end;
+    int company;
+};
+
+std::vector< encrypted_range >
+encrypted_ranges( const std::vector< encrypted_record >& ) noexcept (false);
+
 void map_source( mio::mmap_source&, const std::string& ) noexcept (false);
 
+/*
+ * Search for the storage unit label and the first visible record in a plain
+ * buffer, which should hold at least the first 200 bytes past from
+ */
+long long findsul( const char* data, std::size_t size ) noexcept (false);
+long long findvrl( const char* data, std::size_t size, long long from )
+noexcept (false);
+
 long long findsul( mio::mmap_source& file ) noexcept (false);
 long long findvrl( mio::mmap_source& path, long long from ) noexcept (false);
 
+long long findsul( logical_file& file ) noexcept (false);
+long long findvrl( logical_file& file, long long from ) noexcept (false);
+
 stream_offsets findoffsets( mio::mmap_source& path,
                             long long from )
 noexcept (false);
 
+/*
+ * Index a tape image or compressed file. The tells are offsets in the DLIS
+ * stream. Only the visible record and segment headers are read, the records
+ * themselves are skipped.
+ */
+stream_offsets findoffsets( logical_file& file, long long from )
+noexcept (false);
+
+/*
+ * Concatenated storage units
+ *
+ * Some files are several storage units, each with its own storage unit
+ * label, copied back to back into one physical file. The storage units are
+ * independent, and are indexed and read like separate files.
+ *
+ * findunits follows the visible record lengths from the first storage unit
+ * label. When a visible record label does not parse, the next storage unit
+ * label is searched for from the last good visible record, so that the next
+ * storage unit is found even when this one ends in a truncated visible
+ * record. Whether the records of the truncated storage unit can be indexed
+ * is up to findoffsets. A label is only accepted if dlis_sul parses it and a
+ * visible record follows within 200 bytes, like for the first label.
+ * Garbage between the last visible record and the next label belongs to
+ * neither storage unit.
+ *
+ * The last storage unit always ends at end-of-file, so damage after the last
+ * label is left for findoffsets to report.
+ */
+struct storage_unit {
+    long long sul;
+    long long vrl;
+    /* one-past-the-end of the storage unit */
+    long long end;
+};
+
+std::vector< storage_unit > findunits( mio::mmap_source& file )
+noexcept (false);
+
+/*
+ * Index the visible records in [from, to), i.e. a single storage unit
+ */
+stream_offsets findoffsets( mio::mmap_source& file,
+                            long long from,
+                            long long to )
+noexcept (false);
+
+/*
+ * Index all the storage units, on up to workers threads. If workers is 0,
+ * one thread per cpu is used.
+ *
+ * The storage units are independent, and one that fails to index, e.g.
+ * because it is cut off in the middle of a segment, does not fail the
+ * others. Its offsets are empty, and errors[i] describes the problem.
+ * errors[i] is empty for the storage units that index fine.
+ */
+std::vector< stream_offsets > findoffsets( mio::mmap_source& file,
+                                           const std::vector< storage_unit >&,
+                                           int workers,
+                                           std::vector< std::string >& errors )
+noexcept (false);
+
+/*
+ * Content hashes (XXH64) of the logical records and logical files
+ *
+ * The hash of a logical record covers its type, its formatting and
+ * encryption attributes and the concatenated segment bodies, without
+ * headers, trailers and padding, so it does not depend on how the record is
+ * split into segments and visible records. A new logical file starts at
+ * every FILE-HEADER record, and its hash is the hash of the hashes of its
+ * records. Records before the first FILE-HEADER belong to logical file 0.
+ *
+ * Identical hashes mean identical content (with overwhelming probability),
+ * which is enough to find duplicates and skip unchanged logical files
+ * without parsing anything.
+ */
+struct record_hashes {
+    std::vector< std::uint64_t > records;
+    /* the first record of every logical file */
+    std::vector< int > logical_files;
+    std::vector< std::uint64_t > files;
+};
+
+/*
+ * Index the file like findoffsets, and hash the records as they are indexed,
+ * while the pages are still hot.
+ */
+stream_offsets findoffsets( mio::mmap_source& path,
+                            long long from,
+                            record_hashes& hashes )
+noexcept (false);
+
+/*
+ * A record index that is built on demand
+ *
+ * Where findoffsets indexes the whole file up front, the record_index only
+ * scans as far as needed to serve the highest record asked for. Since the
+ * file is memory mapped, pages past the scanned part are never touched, so
+ * reading the metadata at the front of a huge file is cheap. The rest of the
+ * file can be indexed later, on demand or in a background thread - all
+ * member functions are thread safe.
+ */
+class record_index {
+public:
+    record_index( const std::string& path, long long from ) noexcept (false);
+
+    /*
+     * Index records until record i is indexed, or the file is exhausted.
+     * Returns the number of indexed records.
+     */
+    int extend_to( int i ) noexcept (false);
+
+    /*
+     * Index records until the first implicitly formatted record (IFLR) is
+     * indexed, or the file is exhausted, i.e. the logical file header.
+     * Returns the number of indexed records.
+     */
+    int extend_to_implicit() noexcept (false);
+
+    void index_all() noexcept (false);
+
+    bool complete() const noexcept (true);
+    int size() const noexcept (true);
+
+    /*
+     * A copy of the offsets of all records indexed so far, with tells
+     * relative to the start of the file.
+     */
+    stream_offsets offsets() const noexcept (false);
+
+private:
+    void step( std::size_t n ) noexcept (false);
+
+    mio::mmap_source file;
+    stream_offsets ofs;
+    const char* next;
+    int residual = 0;
+    int count = 0;
+    bool done = false;
+    mutable std::mutex lock;
+};
+
+/*
+ * Quick-scan of the logical file header, for cataloging
+ *
+ * Read the storage unit label and the explicitly formatted logical records
+ * (EFLR) up to the first indirectly formatted one (IFLR), with small
+ * positional reads and without mapping or indexing the rest of the file.
+ * Only the sets of the given types are parsed and returned, and the other
+ * records are skipped by seeking past them. If types is non-empty, the crawl
+ * stops as soon as all the types have been seen.
+ *
+ * A non-zero limit stops the crawl at that file offset, to bound the work
+ * per file when cataloging damaged or unusual files. complete is false if
+ * the crawl was cut short by the limit.
+ *
+ * The label is the raw storage unit label, records the number of EFLRs
+ * visited, and bytes the number of bytes actually read from the file.
+ */
+struct crawl_result {
+    long long sul;
+    std::string label;
+    std::vector< object_set > sets;
+    int records;
+    long long bytes;
+    bool complete;
+};
+
+crawl_result crawl( const std::string& path,
+                    const std::vector< std::string >& types,
+                    long long limit )
+noexcept (false);
+
 }
 
 #endif // DLISIO_PYTHON_IO_HPP
@@ -0,0 +1,79 @@
+#ifndef DLISIO_EXT_JSON_HPP
+#define DLISIO_EXT_JSON_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * JSON export of object sets
+ *
+ * Every object set is written as a JSON object:
+ *
+ *  {"type": "CHANNEL", "name": "",
+ *   "objects": [{"name": {"id": "TDEP", "origin": 2, "copynumber": 0},
+ *                "attributes": {"UNITS": {"count": 1, "reprc": "ident",
+ *                                         "units": "", "value": ["0.1 in"]},
+ *                               ...}}, ...]}
+ *
+ * Attributes are keyed by their label, in template order. The value is null
+ * when absent, and otherwise an array of elements:
+ *
+ *  numbers             numbers, NaN and infinities as null
+ *  fsing1, fdoub1 etc  [V, A] or [V, A, B]
+ *  csingl, cdoubl      [real, imag]
+ *  strings             strings. Strings that are not UTF-8 are read as
+ *                      latin-1, which covers the usual degree symbol
+ *  dtime               "YYYY-MM-DDTHH:MM:SS.mmm", with a trailing Z when the
+ *                      time zone is GMT, and naive (local time) otherwise
+ *  obname              {"id", "origin", "copynumber"}
+ *  objref              {"type", "name": obname}
+ *  attref              {"type", "name": obname, "label"}
+ *
+ * A document is a JSON array of all the sets, and lines is NDJSON, one set
+ * per line. The output is passed to sink in pieces of roughly chunksize
+ * bytes, as it is written, so it is never built in memory in full.
+ */
+enum class json_layout {
+    document = 0,
+    lines    = 1,
+};
+
+using json_sink = std::function< void (const char*, std::size_t) >;
+
+void write_json( const std::vector< object_set >&,
+                 json_layout,
+                 const json_sink&,
+                 std::size_t chunksize = 1 << 16 )
+noexcept (false);
+
+std::string to_json( const std::vector< object_set >&, json_layout )
+noexcept (false);
+
+/* write to the file descriptor fd, at its current position */
+void write_json( const std::vector< object_set >&, json_layout, int fd )
+noexcept (false);
+
+/*
+ * The JSON of a single attribute value, as written for "value" above, for
+ * embedding in other formats
+ */
+std::string to_json( const value_vector& ) noexcept (false);
+
+/* xs as UTF-8 - strings that are not UTF-8 are read as latin-1 */
+std::string as_utf8( const std::string& xs ) noexcept (false);
+
+/*
+ * Strict UTF-8, like python's decoder: no overlong forms, no surrogates and
+ * nothing past U+10FFFF
+ */
+bool isutf8( const char* xs, std::size_t n ) noexcept (true);
+
+}
+
+#endif //DLISIO_EXT_JSON_HPP
@@ -0,0 +1,116 @@
+#ifndef DLISIO_EXT_LOD_HPP
+#define DLISIO_EXT_LOD_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <mio/mio.hpp>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * Level-of-detail (LOD) pyramids for drawing curves
+ *
+ * A pyramid is a multi-resolution summary of a single value (column) in a
+ * frame. Level 0 bins fanout consecutive samples, and every level above bins
+ * fanout bins of the level below, so level n bins fanout^(n+1) samples. Every
+ * bin holds the min, max and mean of its samples, ignoring NaNs. A bin with
+ * only NaNs is all-NaN. The last bin of a level covers the remaining samples,
+ * and can be partial.
+ *
+ * The pyramids are written to a compact, memory-mappable sidecar file. Bins
+ * are stored as native-endian float32 triplets (min, max, mean), i.e. the
+ * sidecar is a cache and not portable between platforms of different
+ * endianness. Drawing any window at screen resolution then reads O(pixels)
+ * bins from the sidecar, instead of decoding O(samples) values.
+ */
+struct lod_bin {
+    float min;
+    float max;
+    float mean;
+};
+
+struct lod_pyramid {
+    int column;
+    int fanout;
+    std::int64_t samples;
+    std::vector< std::vector< lod_bin > > levels;
+};
+
+/*
+ * Build a pyramid per column of the frame in a single pass over the FDATA
+ * records. Columns are positions in the frame's format string, as for
+ * build_zonemap, and columns without an ordering, e.g. strings, get no
+ * pyramid.
+ */
+std::vector< lod_pyramid > build_pyramids( stream&,
+                                           const std::vector< int >& records,
+                                           const dl::obname& frame,
+                                           const std::string& fmt,
+                                           const std::vector< int >& columns,
+                                           int fanout )
+noexcept (false);
+
+void write_pyramids( const std::string& path,
+                     const dl::obname& frame,
+                     const std::vector< lod_pyramid >& )
+noexcept (false);
+
+/*
+ * The bins of a single level that cover a window of samples. The bin
+ * bins[i] covers the samples [first + i*span, first + (i+1)*span).
+ */
+struct lod_window {
+    int level;
+    std::int64_t span;
+    std::int64_t first;
+    std::vector< lod_bin > bins;
+};
+
+class lod_file {
+public:
+    explicit lod_file( const std::string& path ) noexcept (false);
+
+    const dl::obname& frame() const noexcept (true);
+    const std::vector< int >& columns() const noexcept (true);
+    std::int64_t samples( int column ) const noexcept (false);
+
+    /*
+     * The bins of the coarsest level that still has at least pixels bins in
+     * the samples [begin, end) of column. If level 0 has fewer than pixels
+     * bins, the window is from level 0, and the caller should consider
+     * reading the samples directly instead.
+     */
+    lod_window window( int column,
+                       std::int64_t begin,
+                       std::int64_t end,
+                       int pixels ) const noexcept (false);
+
+private:
+    struct level {
+        std::int64_t size;
+        std::int64_t offset;
+    };
+
+    struct entry {
+        int column;
+        int fanout;
+        std::int64_t samples;
+        std::vector< level > levels;
+    };
+
+    const entry& find( int column ) const noexcept (false);
+
+    mio::mmap_source file;
+    dl::obname name;
+    std::vector< int > cols;
+    std::vector< entry > entries;
+};
+
+}
+
+#endif //DLISIO_EXT_LOD_HPP
@@ -0,0 +1,71 @@
+#ifndef DLISIO_EXT_NOFORMAT_HPP
+#define DLISIO_EXT_NOFORMAT_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <mio/mio.hpp>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * NOFORMAT payloads
+ *
+ * NOFORMAT records (IFLR type 1) carry the binary payload of a NO-FORMAT
+ * object, e.g. images, vendor documents or raw tool dumps. Every record starts
+ * with the name (obname) of its NO-FORMAT object, and the payload of an object
+ * is the rest of the bodies of its records, concatenated in file order.
+ *
+ * findnoformat groups the NOFORMAT records among records, typically the
+ * implicitly formatted records of a file, by object. Only the segment headers
+ * and the names at the start of the records are read, not the payloads.
+ * Encrypted records are left out.
+ */
+struct noformat_object {
+    obname name;
+    std::vector< int > records;
+    /* size of the concatenated payload */
+    long long size;
+};
+
+std::vector< noformat_object > findnoformat( const mio::mmap_source&,
+                                             const stream_offsets&,
+                                             const std::vector< int >& records )
+noexcept (false);
+
+/*
+ * Stream the payload of object to sink, in pieces of at most chunksize
+ * bytes, without ever assembling it in memory. The pieces point straight
+ * into the memory mapped file, and are only valid for the duration of the
+ * call. Returns the number of bytes written.
+ */
+using noformat_sink = std::function< void (const char*, std::size_t) >;
+
+long long read_noformat( const mio::mmap_source&,
+                         const stream_offsets&,
+                         const noformat_object&,
+                         const noformat_sink&,
+                         std::size_t chunksize )
+noexcept (false);
+
+/*
+ * Write the payload of object to the file descriptor fd, at its current
+ * position. The payload is copied in the kernel with copy_file_range when
+ * available, one call per segment, and with plain writes otherwise. The file
+ * at path must be the file that is memory mapped.
+ */
+long long copy_noformat( const std::string& path,
+                         const mio::mmap_source&,
+                         const stream_offsets&,
+                         const noformat_object&,
+                         int fd )
+noexcept (false);
+
+}
+
+#endif //DLISIO_EXT_NOFORMAT_HPP
@@ -0,0 +1,48 @@
+#ifndef DLISIO_EXT_REPAIR_HPP
+#define DLISIO_EXT_REPAIR_HPP
+
+#include <string>
+
+namespace dl {
+
+/*
+ * Summary of a repair. dropped is the number of bytes of source that did not
+ * make it into the repaired file, not counting segment headers, trailers and
+ * padding. truncated is the number of records that were too large to hold
+ * back, and were cut short by damage.
+ */
+struct repair_result {
+    int records;
+    int events;
+    int truncated;
+    long long dropped;
+    long long bytes;
+};
+
+/*
+ * Rewrite a damaged file into a clean, fully indexable one
+ *
+ * The source is streamed once, front to back. Everything that does not
+ * parse as visible records of consistent segments is dropped, and the reader
+ * resynchronises on the next plausible visible record header. Records that
+ * are damaged, or that are missing their first or last segments, are
+ * dropped, and the remaining records are re-segmented to fill the visible
+ * records of the target. Checksums and trailing lengths are removed,
+ * padding is recomputed, and the segment attributes are made consistent.
+ *
+ * Memory use is constant. Records are held back until complete, so that
+ * damaged records can be dropped, but records larger than a few megabytes
+ * are written as they are read, and if damaged they are cut short instead
+ * of dropped.
+ *
+ * Every repair is described with its offset in source in the log at
+ * logpath, if logpath is non-empty.
+ */
+repair_result repair( const std::string& source,
+                      const std::string& target,
+                      const std::string& logpath )
+noexcept (false);
+
+}
+
+#endif //DLISIO_EXT_REPAIR_HPP
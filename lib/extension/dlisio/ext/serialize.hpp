@@ -0,0 +1,87 @@
+#ifndef DLISIO_EXT_SERIALIZE_HPP
+#define DLISIO_EXT_SERIALIZE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * Binary serialisation of parsed objects
+ *
+ * A compact native encoding of the parsed types, for sending them between
+ * processes and caching them, that is much cheaper to decode than parsing
+ * the records again. Everything is written depth-first and without padding:
+ *
+ *  set         role i32, type str, name str,
+ *              template u32 + attribute * n, objects u32 + object * n
+ *  object      obname, u32 + attribute * n
+ *  attribute   label str, count i32, reprc u8, units str, invariant u8,
+ *              value
+ *  value       index u8 (in value_vector), and unless empty,
+ *              u32 + element * n
+ *  record      type i32, attributes u8, consistent u8, u32 + char * n
+ *  str         u32 + char * n
+ *
+ * Numbers are stored as their C++ type, native-endian, and the compound types
+ * (obname, objref, attref, dtime, the validated and complex numbers) member
+ * by member.
+ *
+ * encode appends the bare encoding to out, and decode reads it back from
+ * [begin, end) and returns the position after it, for embedding in other
+ * formats. serialize and deserialize work on self-contained buffers, that
+ * start with a version and a tag for the type, and deserialize checks both.
+ */
+void encode( std::string& out, const dl::obname& )           noexcept (false);
+void encode( std::string& out, const dl::objref& )           noexcept (false);
+void encode( std::string& out, const dl::attref& )           noexcept (false);
+void encode( std::string& out, const dl::object_attribute& ) noexcept (false);
+void encode( std::string& out, const dl::basic_object& )     noexcept (false);
+void encode( std::string& out, const dl::object_set& )       noexcept (false);
+void encode( std::string& out, const dl::record& )           noexcept (false);
+
+const char* decode( const char* begin, const char* end, dl::obname& )
+noexcept (false);
+const char* decode( const char* begin, const char* end, dl::objref& )
+noexcept (false);
+const char* decode( const char* begin, const char* end, dl::attref& )
+noexcept (false);
+const char* decode( const char* begin, const char* end, dl::object_attribute& )
+noexcept (false);
+const char* decode( const char* begin, const char* end, dl::basic_object& )
+noexcept (false);
+const char* decode( const char* begin, const char* end, dl::object_set& )
+noexcept (false);
+const char* decode( const char* begin, const char* end, dl::record& )
+noexcept (false);
+
+std::string serialize( const dl::obname& )                   noexcept (false);
+std::string serialize( const dl::objref& )                   noexcept (false);
+std::string serialize( const dl::attref& )                   noexcept (false);
+std::string serialize( const dl::object_attribute& )         noexcept (false);
+std::string serialize( const dl::basic_object& )             noexcept (false);
+std::string serialize( const dl::object_set& )               noexcept (false);
+std::string serialize( const dl::record& )                   noexcept (false);
+std::string serialize( const std::vector< dl::object_set >& ) noexcept (false);
+
+void deserialize( const char*, std::size_t, dl::obname& ) noexcept (false);
+void deserialize( const char*, std::size_t, dl::objref& ) noexcept (false);
+void deserialize( const char*, std::size_t, dl::attref& ) noexcept (false);
+void deserialize( const char*, std::size_t, dl::object_attribute& )
+noexcept (false);
+void deserialize( const char*, std::size_t, dl::basic_object& )
+noexcept (false);
+void deserialize( const char*, std::size_t, dl::object_set& )
+noexcept (false);
+void deserialize( const char*, std::size_t, dl::record& ) noexcept (false);
+void deserialize( const char*, std::size_t, std::vector< dl::object_set >& )
+noexcept (false);
+
+}
+
+#endif //DLISIO_EXT_SERIALIZE_HPP
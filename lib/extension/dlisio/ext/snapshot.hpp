@@ -0,0 +1,95 @@
+#ifndef DLISIO_EXT_SNAPSHOT_HPP
+#define DLISIO_EXT_SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <dlisio/ext/cache.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+/*
+ * Snapshots of loaded files
+ *
+ * A snapshot is the record index and the parsed object sets of a file,
+ * serialised to a single flat buffer. The buffer has no pointers, only
+ * offsets relative to its start, so it can be put anywhere - in shared
+ * memory, a memory mapped file or a bytes object - and be read in place by
+ * other processes, without indexing or parsing the file again.
+ *
+ * The index arrays are stored as plain native arrays, and the object sets in
+ * a compact native encoding that is decoded without any of the DLIS parsing,
+ * i.e. without templates, representation codes or validation. Like the
+ * other caches, a snapshot is native-endian and tied to the platform that
+ * wrote it, and to the file it was taken from by the fingerprint.
+ *
+ * The explicits and implicits are the indices of the explicitly and
+ * implicitly formatted records, as they were partitioned when the file was
+ * loaded.
+ */
+struct snapshot {
+    dl::fingerprint source;
+    long long sul_offset;
+    std::vector< long long > tells;
+    std::vector< int > residuals;
+    std::vector< int > explicits;
+    std::vector< int > implicits;
+    std::vector< encrypted_record > encrypted;
+    std::vector< object_set > sets;
+};
+
+std::string write_snapshot( const snapshot& ) noexcept (false);
+
+/*
+ * A read-only view of a snapshot in memory that is owned by someone else.
+ * The constructor only checks the header and the section bounds, and
+ * nothing is copied until asked for. The memory must outlive the view.
+ */
+class snapshot_view {
+public:
+    snapshot_view( const char* data, std::size_t size ) noexcept (false);
+
+    const dl::fingerprint& source() const noexcept (true);
+    long long sul_offset() const noexcept (true);
+
+    std::vector< long long > tells() const noexcept (false);
+    std::vector< int > residuals() const noexcept (false);
+    std::vector< int > explicits() const noexcept (false);
+    std::vector< int > implicits() const noexcept (false);
+    std::vector< encrypted_record > encrypted() const noexcept (false);
+
+    /* number of object sets */
+    std::size_t size() const noexcept (true);
+    object_set set( std::size_t ) const noexcept (false);
+    std::vector< object_set > sets() const noexcept (false);
+
+    /* everything, decoded */
+    snapshot decode() const noexcept (false);
+
+private:
+    struct section {
+        std::uint64_t count;
+        std::uint64_t offset;
+    };
+
+    const char* data;
+    std::size_t bytes;
+    dl::fingerprint fp;
+    long long sul;
+
+    section sec_tells;
+    section sec_residuals;
+    section sec_explicits;
+    section sec_implicits;
+    section sec_encrypted;
+    section sec_sets;
+    section sec_heap;
+};
+
+}
+
+#endif //DLISIO_EXT_SNAPSHOT_HPP
@@ -0,0 +1,66 @@
+#ifndef DLISIO_EXT_SUBSET_HPP
+#define DLISIO_EXT_SUBSET_HPP
+
+#include <string>
+#include <vector>
+
+#include <mio/mio.hpp>
+
+#include <dlisio/ext/io.hpp>
+
+namespace dl {
+
+/*
+ * Which records to keep when extracting a subset of a file. Empty means no
+ * restriction.
+ *
+ * logical_files - logical files by number, counting from 0. Every
+ *                 FILE-HEADER after the first starts a new logical file.
+ * types         - set types of the explicitly formatted records (EFLR) to
+ *                 keep. FILE-HEADER records are always kept, so that the
+ *                 logical files of the subset are well-formed. Encrypted
+ *                 EFLRs, whose type cannot be read, are dropped.
+ * frames        - names (identifiers) of the frames whose indirectly
+ *                 formatted records (FDATA, end-of-data etc.) to keep.
+ *                 Encrypted IFLRs are dropped.
+ */
+struct subset_selection {
+    std::vector< int > logical_files;
+    std::vector< std::string > types;
+    std::vector< std::string > frames;
+};
+
+/*
+ * The indices of the records of file that match the selection, in order
+ */
+std::vector< int > select_records( const mio::mmap_source& file,
+                                   const stream_offsets&,
+                                   const subset_selection& )
+noexcept (false);
+
+struct subset_result {
+    int records;
+    long long bytes;
+    /* bytes copied as whole, unmodified visible records */
+    long long verbatim;
+};
+
+/*
+ * Write a new file with the storage unit label of source, followed by the
+ * selected records of source
+ *
+ * The record segments are copied verbatim, and never decoded or re-encoded.
+ * Visible records of source that only hold selected segments are copied
+ * as-is, and the remaining segments are re-wrapped in fresh visible records
+ * no longer than the maximum record length of the storage unit label. The
+ * copying is done in the kernel with copy_file_range when available, so
+ * long runs of selected records are copied at disk speed.
+ */
+subset_result write_subset( const std::string& source,
+                            const std::string& target,
+                            const subset_selection& )
+noexcept (false);
+
+}
+
+#endif //DLISIO_EXT_SUBSET_HPP
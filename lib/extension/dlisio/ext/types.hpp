@@ -4,6 +4,7 @@
 #include <complex>
 #include <cstdint>
 #include <exception>
+#include <string>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -416,6 +417,59 @@ const char* parse_template( const char* begin,
 
 object_set parse_objects( const char*, const char* ) noexcept (false);
 
+/*
+ * Diagnostics from parsing damaged object sets
+ *
+ * parse_objects throws on the first problem, and the whole set is lost. With
+ * a diagnostics collector, problems are recorded instead, with the record
+ * and the offset in the record body, and parsing carries on:
+ *
+ *  protocol    - a protocol violation that is worked around, e.g. a label in
+ *                an object attribute. Parsing continues as usual
+ *  unsupported - an attribute that cannot be read, but can be skipped. The
+ *                attribute is dropped from its object
+ *  truncated   - the record ends in the middle of a component
+ *  invalid     - anything else in the data, e.g. a component descriptor with
+ *                the wrong role, or an unknown representation code
+ *
+ * After truncated and invalid there is no telling where the next
+ * component starts, so the set ends there. The objects parsed so far are
+ * kept. Problems that are not about the data, e.g. running out of memory,
+ * are still thrown.
+ *
+ * The collector is meant to live for a session, e.g. loading a file or a
+ * batch of files, and the caller keeps record up to date.
+ */
+enum class diagnostic_code : int {
+    protocol    = 1,
+    unsupported = 2,
+    truncated   = 3,
+    invalid     = 4,
+};
+
+struct diagnostic {
+    int record;
+    long long offset;
+    diagnostic_code code;
+    std::string message;
+};
+
+struct diagnostics {
+    /* the record being parsed, copied into new diagnostics */
+    int record = -1;
+    std::vector< diagnostic > entries;
+};
+
+/*
+ * Parse the set in [begin, end), and record problems in diag. Returns false
+ * if the set header or template is unreadable, in which case there is no set
+ * at all.
+ */
+bool parse_objects( const char* begin,
+                    const char* end,
+                    object_set& out,
+                    diagnostics& diag ) noexcept (false);
+
 }
 
 #endif //DLISIO_EXT_TYPES_HPP
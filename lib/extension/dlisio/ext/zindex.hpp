@@ -0,0 +1,99 @@
+#ifndef DLISIO_EXT_ZINDEX_HPP
+#define DLISIO_EXT_ZINDEX_HPP
+
+#include <cstddef>
+#include <fstream>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mio/mio.hpp>
+
+#include <dlisio/ext/cache.hpp>
+#include <dlisio/ext/io.hpp>
+
+namespace dl {
+
+/*
+ * Random access into zlib and gzip compressed files
+ *
+ * A deflate stream can only be decompressed from the start, so reading a
+ * single frame from a compressed archive normally means decompressing
+ * everything before it. The zindex is a list of checkpoints, like in zlib's
+ * examples/zran.c: positions in the compressed and uncompressed data at
+ * deflate block boundaries, and the 32K window needed to resume
+ * decompression there. Reading at an offset then only decompresses from the
+ * closest checkpoint before it.
+ *
+ * Building the index decompresses the whole file once. It can be written to
+ * a file, and read back instead of rebuilt, as long as the fingerprint of
+ * the compressed file still matches. The windows are stored compressed, so
+ * the index is small compared to the file. Concatenated gzip members, e.g.
+ * from pigz, are supported.
+ *
+ * dlisio can be built without zlib, in which case iscompressed still works,
+ * but everything else throws dl::not_implemented.
+ */
+bool iscompressed( const mio::mmap_source& ) noexcept (true);
+
+struct zcheckpoint {
+    /* offset of the first whole byte in the compressed file */
+    long long in;
+    /* offset in the uncompressed stream */
+    long long out;
+    /* number of bits of the byte before in that belong to the next block */
+    int bits;
+    /*
+     * if true, this is the start of a gzip member, and decompression starts
+     * over at in, without a window
+     */
+    bool header;
+    /* the window, deflated */
+    std::string window;
+};
+
+struct zindex {
+    dl::fingerprint source;
+    long long size;
+    long long span;
+    std::vector< zcheckpoint > checkpoints;
+};
+
+/*
+ * Build the index, with checkpoints roughly every span bytes of uncompressed
+ * data. Smaller spans make reads cheaper, and the index larger.
+ */
+zindex build_zindex( const std::string& path, long long span )
+noexcept (false);
+
+void write_zindex( const std::string& path, const zindex& ) noexcept (false);
+zindex read_zindex( const std::string& path ) noexcept (false);
+
+/*
+ * Reads the uncompressed stream of a compressed file, by decompressing the
+ * blocks between checkpoints. The most recently used blocks are cached, so
+ * reading records front to back decompresses every block once.
+ */
+class zreader : public logical_file {
+public:
+    zreader( const std::string& path, const zindex&, int blocks = 8 )
+        noexcept (false);
+
+    long long size() const noexcept (true) override;
+
+    void read( char* dst, long long offset, std::size_t n )
+        noexcept (false) override;
+
+private:
+    const std::string& block( std::size_t checkpoint ) noexcept (false);
+
+    std::ifstream fs;
+    zindex index;
+    std::size_t capacity;
+    std::list< std::pair< std::size_t, std::string > > cache;
+};
+
+}
+
+#endif //DLISIO_EXT_ZINDEX_HPP
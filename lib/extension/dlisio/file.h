@@ -0,0 +1,183 @@
+#ifndef DLISIO_FILE_H
+#define DLISIO_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <dlisio/dlisio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * File-level access to frame data
+ *
+ * The dlis_file functions index a file, find its frames and decode ranges of
+ * frames into caller-provided buffers - the building blocks for reading
+ * curves from services and languages other than Python. They are implemented
+ * in the dlisio-extension library, which must be linked in, and this header
+ * is installed with it, but this interface is stable and C-only: no
+ * exceptions cross it, the handle owns and frees all the memory it
+ * allocates, and decoded data is only ever written to caller-provided
+ * memory.
+ *
+ * All functions return DLIS_OK on success, or one of the DLIS_ERRCODE error
+ * codes, most notably:
+ *
+ *  DLIS_INVALID_ARGS       bad index, null pointer, or too small buffer
+ *  DLIS_IO_ERROR           the file could not be opened or read
+ *  DLIS_NOT_FOUND          a channel listed by a frame is not in its
+ *                          logical file
+ *  DLIS_NOT_IMPLEMENTED    e.g. frames with strings, or compressed files
+ *  DLIS_BAD_ALLOC          out of memory
+ *  DLIS_UNEXPECTED_VALUE   the file is broken in some other way
+ *
+ * and dlis_file_errmsg describes the last error. On error, output arguments
+ * are untouched unless noted otherwise. A handle must not be used from more
+ * than one thread at a time, but separate handles are independent.
+ *
+ * The handle covers the whole file, i.e. all its logical files, in the same
+ * way as dlisio.load does in Python. The frames of all logical files are
+ * listed together, but every frame only uses the channels and frame data of
+ * its own logical file, so logical files that reuse frame and channel names
+ * do not mix. Tape image (TIF) files are read through their tape marks.
+ * Encrypted records are indexed, but never read.
+ *
+ * Example, reading the first channel of the first frame:
+ *
+ * dlis_file* f;
+ * if (dlis_file_open( path, &f ) != DLIS_OK) {
+ *     fprintf( stderr, "%s\n", dlis_file_errmsg( f ) );
+ *     dlis_file_close( f );
+ *     exit( EXIT_FAILURE );
+ * }
+ *
+ * int64_t rows;
+ * char fmt;
+ * int elements;
+ * size_t itemsize;
+ * dlis_file_frame_rows( f, 0, &rows );
+ * dlis_file_channel( f, 0, 0, NULL, 0, NULL, NULL, NULL,
+ *                    &fmt, &elements, &itemsize );
+ *
+ * size_t size = rows * elements * itemsize;
+ * void* index = malloc( size );
+ * int channel = 0;
+ * int64_t nread;
+ * dlis_file_read( f, 0, 0, rows, 1, &channel, &index, &size, &nread );
+ * dlis_file_close( f );
+ */
+typedef struct dlis_file dlis_file;
+
+/*
+ * Open and index the file at path
+ *
+ * *f is set even when opening fails, so that the error message can be read,
+ * and must always be closed with dlis_file_close. The only exception is
+ * DLIS_BAD_ALLOC, where *f may be NULL. Closing NULL is a no-op.
+ */
+int dlis_file_open( const char* path, dlis_file** f );
+void dlis_file_close( dlis_file* f );
+
+/*
+ * The message of the last error, or the empty string. The message is valid
+ * until the next call with f.
+ */
+const char* dlis_file_errmsg( const dlis_file* f );
+
+/*
+ * The logical record index, as from dlis_index_records, with tells as
+ * offsets from the start of the file (or the DLIS stream of a tape image).
+ * The arrays must have room for dlis_file_nrecords records. Any of the
+ * arrays can be NULL.
+ */
+int dlis_file_nrecords( const dlis_file* f, int* count );
+int dlis_file_records( const dlis_file* f,
+                       size_t allocsize,
+                       long long* tells,
+                       int* residuals,
+                       int* explicits );
+
+/*
+ * The frames of the file, in the order they are defined, and their names.
+ *
+ * The id is written zero-terminated to id, which has room for idsize bytes,
+ * and its length, sans terminator, to idlen. If id is too small, only idlen
+ * is written, and DLIS_INVALID_ARGS returned - query the length first by
+ * passing id = NULL. The out arguments are all optional, and can be NULL.
+ */
+int dlis_file_nframes( const dlis_file* f, int* count );
+int dlis_file_frame_name( const dlis_file* f,
+                          int frame,
+                          char* id,
+                          size_t idsize,
+                          size_t* idlen,
+                          int32_t* origin,
+                          uint8_t* copynumber );
+
+/*
+ * The channels of a frame, in frame order
+ *
+ * The channel is described by its name (as for dlis_file_frame_name), its
+ * format specifier (DLIS_FMT_*), the number of elements per frame, i.e. the
+ * product of its dimensions, and the size in bytes of a single element as
+ * written by dlis_packf. The itemsize is 0 for variable-size types, e.g.
+ * strings.
+ *
+ * The channel index -1 is the frame number (int32_t, DLIS_FMT_UVARI), which
+ * is present in every frame. Its name is empty, with origin and copynumber 0.
+ */
+int dlis_file_frame_nchannels( dlis_file* f, int frame, int* count );
+int dlis_file_channel( dlis_file* f,
+                       int frame,
+                       int channel,
+                       char* id,
+                       size_t idsize,
+                       size_t* idlen,
+                       int32_t* origin,
+                       uint8_t* copynumber,
+                       char* fmt,
+                       int* elements,
+                       size_t* itemsize );
+
+/*
+ * The number of rows of a frame, i.e. the number of frames in its frame data
+ * (FDATA) records. The first call for a frame scans all its records, and
+ * later calls are free.
+ */
+int dlis_file_frame_rows( dlis_file* f, int frame, int64_t* rows );
+
+/*
+ * Decode count rows, starting at row first, of the channels of a frame
+ *
+ * For every channel in channels (indices into the frame, or -1 for the frame
+ * number), the values of the rows are written to dst[i], in row order and
+ * packed as by dlis_packf, i.e. elements * itemsize bytes per row. The
+ * dstsize[i] is the size of dst[i] in bytes.
+ *
+ * Reading past the last row is not an error - nread is set to the number of
+ * rows actually read, which is less than count only at the end of the frame.
+ * If any buffer is too small for the rows to read, nothing is read and
+ * DLIS_INVALID_ARGS is returned. Only the records that hold the rows are
+ * read, and all channels are decoded in the same pass, so reading many
+ * channels at once is much cheaper than reading them one by one.
+ *
+ * Frames with variable-size values (strings, object names) cannot be read,
+ * and give DLIS_NOT_IMPLEMENTED.
+ */
+int dlis_file_read( dlis_file* f,
+                    int frame,
+                    int64_t first,
+                    int64_t count,
+                    int nchannels,
+                    const int* channels,
+                    void* const* dst,
+                    const size_t* dstsize,
+                    int64_t* nread );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DLISIO_FILE_H
@@ -206,6 +206,23 @@ int dlis_pack_varsize( const char* fmt, int* out );
 
 int dlis_pack_size( const char* fmt, int* size );
 
+/*
+ * Compute the number of bytes read and written by dlis_packf
+ *
+ * Unlike dlis_pack_size, this function considers the source bytes, so it
+ * works for variable-size format strings too. nread is the number of bytes
+ * dlis_packf would consume from src, nwrite the number of bytes it would write
+ * to dst. This makes it possible to both allocate a large enough dst, and to
+ * step over a packed value (e.g. a frame) in a larger byte sequence.
+ *
+ * nread and nwrite are optional, and can be NULL.
+ *
+ * Returns DLIS_OK on success, and DLIS_INVALID_ARGS if the format string
+ * contains any invalid format specifier. If the function fails, the output
+ * variables are untouched.
+ */
+int dlis_packflen( const char* fmt, const void* src, int* nread, int* nwrite );
+
 /*
  * A table of the record attributes, high bit first:
  *
@@ -402,6 +419,10 @@ enum DLIS_ERRCODE {
     DLIS_UNEXPECTED_VALUE,
     DLIS_INVALID_ARGS,
     DLIS_TRUNCATED,
+    DLIS_IO_ERROR,
+    DLIS_NOT_FOUND,
+    DLIS_NOT_IMPLEMENTED,
+    DLIS_BAD_ALLOC,
 };
 
 enum dlis_eflr_type_code {
@@ -44,6 +44,15 @@ const char* dlis_cdoubl( const char*, double* R, double* I );
 
 const char* dlis_uvari( const char*, int32_t* out );
 
+/*
+ * Decode or skip n consecutive uvaris, e.g. arrays of uvari and origin. The
+ * length of every uvari depends on the one before it, but runs of one-byte
+ * uvaris, which are by far the most common, are recognised and handled eight
+ * at a time.
+ */
+const char* dlis_uvaris( const char*, int n, int32_t* out );
+const char* dlis_skipuvaris( const char*, int n );
+
 const char* dlis_ident( const char*, int32_t* len, char* out );
 const char* dlis_ascii( const char*, int32_t* len, char* out );
 
@@ -63,6 +72,21 @@ const char* dlis_dtime( const char*, int* Y,
                                      int* S,
                                      int* MS );
 
+/*
+ * Nanoseconds since 1970-01-01T00:00:00, e.g. for numpy datetime64[ns], of the
+ * dtime fields as returned by dlis_dtime (Y is NOT adjusted with dlis_year).
+ *
+ * The file does not tell what the local time zone is, so the timestamps are
+ * naive. Local daylight savings time (DLIS_TZ_DST) is moved back one hour, to
+ * local standard time, so that all local times in a file are on the same
+ * clock. Local standard time and GMT are used as-is. Fields that do not make
+ * a valid date and time, e.g. February 29th in a non-leap year, an hour past
+ * 23 or a second past 59, give DLIS_NAT.
+ */
+#define DLIS_NAT INT64_MIN
+int64_t dlis_dtime_ns( int Y, int TZ, int M, int D, int H, int MN, int S,
+                       int MS );
+
 const char* dlis_origin( const char*, int32_t* out );
 
 /* obname = { origin, ushort, ident } */
@@ -0,0 +1,624 @@
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include <mio/mio.hpp>
+#include <mpark/variant.hpp>
+
+#include <dlisio/types.h>
+
+#include <dlisio/ext/arrow.hpp>
+#include <dlisio/ext/cache.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/json.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+namespace {
+
+/*
+ * An arrow array under construction, and its type. The layout (and number of
+ * buffers) follows from the format:
+ *
+ *  +s              struct          validity
+ *  +w:n            fixed list      validity
+ *  +l              list            validity, offsets
+ *  u               utf8            validity, offsets, values
+ *  anything else   primitive       validity, values
+ *
+ * The validity bitmap is only allocated once there is a null. The values of
+ * a primitive are either owned, or external, i.e. borrowed from a mapped
+ * file that is kept alive by the exported array.
+ */
+struct node {
+    std::string format;
+    std::string name;
+    bool nullable = true;
+
+    std::int64_t length = 0;
+    std::int64_t null_count = 0;
+    std::vector< std::uint8_t > validity;
+    std::vector< std::int32_t > offsets;
+    std::vector< char > values;
+    const void* external = nullptr;
+
+    std::vector< node > children;
+};
+
+node make( const std::string& format, const std::string& name = "" )
+noexcept (false) {
+    node n;
+    n.format = format;
+    n.name = name;
+    if (format == "u" or format == "+l") n.offsets.push_back( 0 );
+    return n;
+}
+
+int bufferscount( const node& n ) noexcept (true) {
+    if (n.format == "u")  return 3;
+    if (n.format == "+l") return 2;
+    if (n.format[ 0 ] == '+') return 1;
+    return 2;
+}
+
+void append_valid( node& n, bool ok ) noexcept (false) {
+    if (not ok and n.validity.empty()) {
+        n.validity.assign( n.length / 8 + 1, 0 );
+        for (std::int64_t i = 0; i < n.length; ++i)
+            n.validity[ i / 8 ] |= std::uint8_t( 1 << (i % 8) );
+    }
+
+    if (not n.validity.empty()) {
+        n.validity.resize( n.length / 8 + 1, 0 );
+        if (ok) n.validity[ n.length / 8 ] |= std::uint8_t( 1 << (n.length % 8) );
+        else    n.null_count += 1;
+    }
+
+    n.length += 1;
+}
+
+std::int32_t offset32( std::size_t x ) noexcept (false) {
+    if (x > std::size_t( (std::numeric_limits< std::int32_t >::max)() ))
+        throw std::length_error( "arrow: column too large for 32-bit offsets" );
+    return std::int32_t( x );
+}
+
+/*
+ * The layout and appending of elements, by (decayed) element type
+ */
+template < typename T > struct tag {};
+
+const char* arrowtype( tag< float > )         { return "f"; }
+const char* arrowtype( tag< double > )        { return "g"; }
+const char* arrowtype( tag< std::int8_t > )   { return "c"; }
+const char* arrowtype( tag< std::uint8_t > )  { return "C"; }
+const char* arrowtype( tag< std::int16_t > )  { return "s"; }
+const char* arrowtype( tag< std::uint16_t > ) { return "S"; }
+const char* arrowtype( tag< std::int32_t > )  { return "i"; }
+const char* arrowtype( tag< std::uint32_t > ) { return "I"; }
+
+template < typename T >
+typename std::enable_if< std::is_arithmetic< T >::value, node >::type
+layout( tag< T > t, const std::string& name ) noexcept (false) {
+    return make( arrowtype( t ), name );
+}
+
+node layout( tag< std::string >, const std::string& name ) noexcept (false) {
+    return make( "u", name );
+}
+
+template < typename T, int N >
+node layout( tag< validated< T, N > >, const std::string& name )
+noexcept (false) {
+    auto n = make( fmt::format( "+w:{}", N ), name );
+    n.children.push_back( layout( tag< T >(), "item" ) );
+    return n;
+}
+
+template < typename T >
+node layout( tag< std::complex< T > >, const std::string& name )
+noexcept (false) {
+    auto n = make( "+w:2", name );
+    n.children.push_back( layout( tag< T >(), "item" ) );
+    return n;
+}
+
+node layout( tag< dl::dtime >, const std::string& name ) noexcept (false) {
+    return make( "tsn:", name );
+}
+
+node layout( tag< dl::obname >, const std::string& name ) noexcept (false) {
+    auto n = make( "+s", name );
+    n.children.push_back( make( "u", "id" ) );
+    n.children.push_back( make( "i", "origin" ) );
+    n.children.push_back( make( "C", "copynumber" ) );
+    return n;
+}
+
+node layout( tag< dl::objref >, const std::string& name ) noexcept (false) {
+    auto n = make( "+s", name );
+    n.children.push_back( make( "u", "type" ) );
+    n.children.push_back( layout( tag< dl::obname >(), "name" ) );
+    return n;
+}
+
+node layout( tag< dl::attref >, const std::string& name ) noexcept (false) {
+    auto n = make( "+s", name );
+    n.children.push_back( make( "u", "type" ) );
+    n.children.push_back( layout( tag< dl::obname >(), "name" ) );
+    n.children.push_back( make( "u", "label" ) );
+    return n;
+}
+
+template < typename T >
+typename std::enable_if< std::is_arithmetic< T >::value >::type
+push( node& n, T x ) noexcept (false) {
+    const auto* src = reinterpret_cast< const char* >( &x );
+    n.values.insert( n.values.end(), src, src + sizeof( x ) );
+    append_valid( n, true );
+}
+
+void push( node& n, const std::string& x ) noexcept (false) {
+    const auto utf8 = as_utf8( x );
+    n.values.insert( n.values.end(), utf8.begin(), utf8.end() );
+    n.offsets.push_back( offset32( n.values.size() ) );
+    append_valid( n, true );
+}
+
+template < typename T >
+void push( node& n, const validated< T, 2 >& x ) noexcept (false) {
+    push( n.children[ 0 ], x.V );
+    push( n.children[ 0 ], x.A );
+    append_valid( n, true );
+}
+
+template < typename T >
+void push( node& n, const validated< T, 3 >& x ) noexcept (false) {
+    push( n.children[ 0 ], x.V );
+    push( n.children[ 0 ], x.A );
+    push( n.children[ 0 ], x.B );
+    append_valid( n, true );
+}
+
+template < typename T >
+void push( node& n, const std::complex< T >& x ) noexcept (false) {
+    push( n.children[ 0 ], x.real() );
+    push( n.children[ 0 ], x.imag() );
+    append_valid( n, true );
+}
+
+void push( node& n, const dl::dtime& x ) noexcept (false) {
+    const std::int64_t ns = dlis_dtime_ns( x.Y - DLIS_YEAR_ZERO, x.TZ, x.M,
+                                           x.D, x.H, x.MN, x.S, x.MS );
+    const std::int64_t value = ns == DLIS_NAT ? 0 : ns;
+    const auto* src = reinterpret_cast< const char* >( &value );
+    n.values.insert( n.values.end(), src, src + sizeof( value ) );
+    append_valid( n, ns != DLIS_NAT );
+}
+
+void push( node& n, const dl::obname& x ) noexcept (false) {
+    push( n.children[ 0 ], decay( x.id ) );
+    push( n.children[ 1 ], decay( x.origin ) );
+    push( n.children[ 2 ], x.copy );
+    append_valid( n, true );
+}
+
+void push( node& n, const dl::objref& x ) noexcept (false) {
+    push( n.children[ 0 ], decay( x.type ) );
+    push( n.children[ 1 ], x.name );
+    append_valid( n, true );
+}
+
+void push( node& n, const dl::attref& x ) noexcept (false) {
+    push( n.children[ 0 ], decay( x.type ) );
+    push( n.children[ 1 ], x.name );
+    push( n.children[ 2 ], decay( x.label ) );
+    append_valid( n, true );
+}
+
+template < typename T >
+using underlying = typename std::decay<
+    decltype( decay( std::declval< const T& >() ) )
+>::type;
+
+/*
+ * The list<element> column of the attribute values, and appending values to
+ * it. The column layout is taken from the first present value, and is never
+ * made from an absent (monostate) one.
+ */
+struct list_layout {
+    const std::string& name;
+
+    node operator () ( const mpark::monostate& ) const noexcept (false) {
+        throw std::logic_error( "arrow: no layout of absent value" );
+    }
+
+    template < typename T >
+    node operator () ( const std::vector< T >& ) const noexcept (false) {
+        auto n = make( "+l", this->name );
+        n.children.push_back( layout( tag< underlying< T > >(), "item" ) );
+        return n;
+    }
+};
+
+struct list_push {
+    node& column;
+
+    void operator () ( const mpark::monostate& ) const noexcept (false) {
+        this->column.offsets.push_back( this->column.offsets.back() );
+        append_valid( this->column, false );
+    }
+
+    template < typename T >
+    void operator () ( const std::vector< T >& xs ) const noexcept (false) {
+        auto& items = this->column.children.front();
+        for (const auto& x : xs) push( items, decay( x ) );
+        this->column.offsets.push_back( offset32( items.length ) );
+        append_valid( this->column, true );
+    }
+};
+
+void push_null( node& n ) noexcept (false) {
+    if (n.format == "u" or n.format == "+l")
+        n.offsets.push_back( n.offsets.back() );
+    append_valid( n, false );
+}
+
+/*
+ * Export of the nodes. The arrays share ownership of the built nodes (and
+ * whatever they keep alive), so that children moved out of their parent by
+ * the consumer stay valid, as the interface requires. The private data
+ * releases the children it still owns on destruction, which also cleans up
+ * partially exported arrays on failure.
+ */
+struct owner {
+    node root;
+    std::shared_ptr< const void > keepalive;
+};
+
+struct array_private {
+    std::shared_ptr< const owner > data;
+    std::vector< const void* > buffers;
+    std::vector< ArrowArray > children;
+    std::vector< ArrowArray* > pointers;
+
+    ~array_private() {
+        for (auto* child : this->pointers)
+            if (child->release) child->release( child );
+    }
+};
+
+struct schema_private {
+    std::string format;
+    std::string name;
+    std::vector< ArrowSchema > children;
+    std::vector< ArrowSchema* > pointers;
+
+    ~schema_private() {
+        for (auto* child : this->pointers)
+            if (child->release) child->release( child );
+    }
+};
+
+void release_array( ArrowArray* array ) noexcept (true) {
+    delete static_cast< array_private* >( array->private_data );
+    array->release = nullptr;
+}
+
+void release_schema( ArrowSchema* schema ) noexcept (true) {
+    delete static_cast< schema_private* >( schema->private_data );
+    schema->release = nullptr;
+}
+
+/*
+ * Empty buffers are not null, and consumers may assume even those to be
+ * aligned
+ */
+const void* nonnull( const void* p ) noexcept (true) {
+    alignas( 64 ) static const std::int64_t empty[ 8 ] = {};
+    return p ? p : empty;
+}
+
+void fill( ArrowArray* out,
+           const node& n,
+           const std::shared_ptr< const owner >& data )
+noexcept (false) {
+    std::unique_ptr< array_private > priv( new array_private() );
+    priv->data = data;
+
+    priv->buffers.push_back( n.validity.empty() ? nullptr : n.validity.data() );
+    const auto buffers = bufferscount( n );
+    if (buffers == 3) {
+        priv->buffers.push_back( n.offsets.data() );
+        priv->buffers.push_back( nonnull( n.values.data() ) );
+    } else if (buffers == 2 and n.format == "+l") {
+        priv->buffers.push_back( n.offsets.data() );
+    } else if (buffers == 2) {
+        const void* values = n.external ? n.external : n.values.data();
+        priv->buffers.push_back( nonnull( values ) );
+    }
+
+    priv->children.resize( n.children.size() );
+    for (std::size_t i = 0; i < n.children.size(); ++i) {
+        priv->pointers.push_back( &priv->children[ i ] );
+        fill( &priv->children[ i ], n.children[ i ], data );
+    }
+
+    out->length     = n.length;
+    out->null_count = n.null_count;
+    out->offset     = 0;
+    out->n_buffers  = std::int64_t( priv->buffers.size() );
+    out->n_children = std::int64_t( priv->pointers.size() );
+    out->buffers    = priv->buffers.data();
+    out->children   = priv->pointers.data();
+    out->dictionary = nullptr;
+    out->release    = release_array;
+    out->private_data = priv.release();
+}
+
+void fill( ArrowSchema* out, const node& n ) noexcept (false) {
+    std::unique_ptr< schema_private > priv( new schema_private() );
+    priv->format = n.format;
+    priv->name = n.name;
+
+    priv->children.resize( n.children.size() );
+    for (std::size_t i = 0; i < n.children.size(); ++i) {
+        priv->pointers.push_back( &priv->children[ i ] );
+        fill( &priv->children[ i ], n.children[ i ] );
+    }
+
+    out->format     = priv->format.c_str();
+    out->name       = priv->name.c_str();
+    out->metadata   = nullptr;
+    out->flags      = n.nullable ? ARROW_FLAG_NULLABLE : 0;
+    out->n_children = std::int64_t( priv->pointers.size() );
+    out->children   = priv->pointers.data();
+    out->dictionary = nullptr;
+    out->release    = release_schema;
+    out->private_data = priv.release();
+}
+
+void export_owner( std::shared_ptr< const owner > data,
+                   ArrowSchema* schema,
+                   ArrowArray* array )
+noexcept (false) {
+    ArrowSchema s;
+    fill( &s, data->root );
+
+    ArrowArray a;
+    try {
+        fill( &a, data->root, data );
+    } catch (...) {
+        s.release( &s );
+        throw;
+    }
+
+    *schema = s;
+    *array = a;
+}
+
+/*
+ * The cache stores timestamps that do not make a valid date (see
+ * dlis_dtime_ns) as DLIS_NAT. Arrow has no NaT, so they are marked null in
+ * a validity bitmap instead, which is only allocated if there are any. The
+ * values themselves are still borrowed from the cache.
+ */
+void nat_validity( node& n, const char* values ) noexcept (false) {
+    for (std::int64_t i = 0; i < n.length; ++i) {
+        std::int64_t x;
+        std::memcpy( &x, values + i * sizeof( x ), sizeof( x ) );
+        if (x != DLIS_NAT) continue;
+
+        if (n.validity.empty())
+            n.validity.assign( std::size_t( n.length / 8 + 1 ), 0xFF );
+
+        n.validity[ i / 8 ] &= std::uint8_t( ~(1 << (i % 8)) );
+        n.null_count += 1;
+    }
+}
+
+/*
+ * The arrow type of a column in the column cache, see cache.hpp
+ */
+bool columnformat( const std::string& dtype,
+                   const char*& format,
+                   bool& complex )
+noexcept (true) {
+    complex = false;
+    if (dtype == "=f4")     { format = "f";    return true; }
+    if (dtype == "=f8")     { format = "g";    return true; }
+    if (dtype == "=i1")     { format = "c";    return true; }
+    if (dtype == "=i2")     { format = "s";    return true; }
+    if (dtype == "=i4")     { format = "i";    return true; }
+    if (dtype == "=i8")     { format = "l";    return true; }
+    if (dtype == "=u1")     { format = "C";    return true; }
+    if (dtype == "=u2")     { format = "S";    return true; }
+    if (dtype == "=u4")     { format = "I";    return true; }
+    if (dtype == "=u8")     { format = "L";    return true; }
+    if (dtype == "=M8[ns]") { format = "tsn:"; return true; }
+
+    complex = true;
+    if (dtype == "=c8")     { format = "f";    return true; }
+    if (dtype == "=c16")    { format = "g";    return true; }
+    return false;
+}
+
+}
+
+void export_columns( const std::string& path,
+                     const std::vector< std::string >& names,
+                     ArrowSchema* schema,
+                     ArrowArray* array )
+noexcept (false) {
+    const column_cache cache( path );
+    const auto& columns = cache.columns();
+    if (names.size() != columns.size()) {
+        const auto msg = "export_columns: got {} names for {} columns";
+        throw std::invalid_argument(
+            fmt::format( msg, names.size(), columns.size() )
+        );
+    }
+
+    auto file = std::make_shared< mio::mmap_source >();
+    map_source( *file, path );
+
+    auto data = std::make_shared< owner >();
+    data->keepalive = file;
+    data->root = make( "+s" );
+    data->root.nullable = false;
+    data->root.length = cache.rows();
+
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+        const auto& col = columns[ i ];
+
+        const char* format;
+        bool complex;
+        if (not columnformat( col.dtype, format, complex )) {
+            const auto msg = "export_columns: unsupported dtype '{}' "
+                             "(column {})";
+            throw dl::not_implemented( fmt::format( msg, col.dtype, i ) );
+        }
+
+        /*
+         * Build the column inside-out, from the values up through the
+         * [real, imag] pairs and the elements of multi-dimensional channels
+         */
+        auto column = make( format, "item" );
+        column.nullable = false;
+        column.external = file->data() + col.offset;
+        column.length = cache.rows() * col.elements * (complex ? 2 : 1);
+
+        if (col.dtype == "=M8[ns]") {
+            column.nullable = true;
+            nat_validity( column, file->data() + col.offset );
+        }
+
+        if (complex) {
+            auto pair = make( "+w:2", "item" );
+            pair.nullable = false;
+            pair.length = cache.rows() * col.elements;
+            pair.children.push_back( std::move( column ) );
+            column = std::move( pair );
+        }
+
+        if (col.elements > 1) {
+            auto list = make( fmt::format( "+w:{}", col.elements ), "item" );
+            list.nullable = false;
+            list.length = cache.rows();
+            list.children.push_back( std::move( column ) );
+            column = std::move( list );
+        }
+
+        column.name = names[ i ];
+        data->root.children.push_back( std::move( column ) );
+    }
+
+    export_owner( std::move( data ), schema, array );
+}
+
+void export_objects( const std::vector< object_set >& sets,
+                     const std::string& type,
+                     ArrowSchema* schema,
+                     ArrowArray* array )
+noexcept (false) {
+    std::vector< const basic_object* > objects;
+    for (const auto& set : sets) {
+        if (decay( set.type ) != type) continue;
+        for (const auto& object : set.objects)
+            objects.push_back( &object );
+    }
+
+    /*
+     * The labels in order of first appearance, and the type of their values.
+     * A label is mixed if its values are of different types, or never
+     * present, so that there is no single element type for it
+     */
+    struct label {
+        std::string name;
+        const value_vector* sample;
+        bool mixed;
+    };
+
+    std::vector< label > labels;
+    std::map< std::string, std::size_t > positions;
+    std::vector< std::vector< const object_attribute* > > cells;
+    cells.reserve( objects.size() );
+
+    for (const auto* object : objects) {
+        cells.emplace_back( labels.size(), nullptr );
+        auto& row = cells.back();
+        for (const auto& attr : object->attributes) {
+            const auto& name = decay( attr.label );
+            auto itr = positions.find( name );
+            if (itr == positions.end()) {
+                itr = positions.emplace( name, labels.size() ).first;
+                labels.push_back( label{ name, nullptr, false } );
+                row.push_back( nullptr );
+            }
+
+            const auto pos = itr->second;
+            if (row[ pos ]) continue;
+            row[ pos ] = &attr;
+
+            if (attr.value.index() == 0) continue;
+            auto& lbl = labels[ pos ];
+            if (not lbl.sample) lbl.sample = &attr.value;
+            else if (lbl.sample->index() != attr.value.index()) lbl.mixed = true;
+        }
+    }
+
+    auto data = std::make_shared< owner >();
+    data->root = make( "+s" );
+    data->root.nullable = false;
+    data->root.length = std::int64_t( objects.size() );
+
+    auto id         = make( "u", "id" );
+    auto origin     = make( "i", "origin" );
+    auto copynumber = make( "C", "copynumber" );
+    id.nullable = origin.nullable = copynumber.nullable = false;
+    for (const auto* object : objects) {
+        push( id,         decay( object->object_name.id ) );
+        push( origin,     decay( object->object_name.origin ) );
+        push( copynumber, object->object_name.copy );
+    }
+
+    data->root.children.push_back( std::move( id ) );
+    data->root.children.push_back( std::move( origin ) );
+    data->root.children.push_back( std::move( copynumber ) );
+
+    for (std::size_t i = 0; i < labels.size(); ++i) {
+        const auto& lbl = labels[ i ];
+        const bool json = lbl.mixed or not lbl.sample;
+
+        auto column = json ? make( "u", lbl.name )
+                           : mpark::visit( list_layout{ lbl.name },
+                                           *lbl.sample );
+
+        for (const auto& row : cells) {
+            const auto* attr = i < row.size() ? row[ i ] : nullptr;
+            if (not attr or attr->value.index() == 0) {
+                push_null( column );
+            } else if (json) {
+                push( column, to_json( attr->value ) );
+            } else {
+                mpark::visit( list_push{ column }, attr->value );
+            }
+        }
+
+        data->root.children.push_back( std::move( column ) );
+    }
+
+    export_owner( std::move( data ), schema, array );
+}
+
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include <mio/mio.hpp>
+
+#include <dlisio/dlisio.h>
+
+#include <dlisio/ext/batch.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+loaded_file load_file( const std::string& path ) noexcept (true) {
+    loaded_file result;
+    result.path = path;
+    result.ok = false;
+    result.sul = 0;
+
+    try {
+        mio::mmap_source file;
+        map_source( file, path );
+
+        result.sul = findsul( file );
+        if (std::size_t(result.sul + DLIS_SUL_SIZE) > file.size())
+            throw std::runtime_error( "file truncated in storage label" );
+
+        result.label.assign( file.data() + result.sul, DLIS_SUL_SIZE );
+
+        const auto vrl = findvrl( file, result.sul + DLIS_SUL_SIZE );
+        result.offsets = findoffsets( file, vrl );
+
+        stream s( path );
+        s.reindex( result.offsets.tells, result.offsets.residuals );
+
+        record rec;
+        const auto& explicits = result.offsets.explicits;
+        const auto& encrypted = result.offsets.encrypted;
+        auto enc = encrypted.begin();
+        for (std::size_t i = 0; i < explicits.size(); ++i) {
+            if (not explicits[ i ]) continue;
+
+            /* encrypted records are sorted, and skipped without reading */
+            while (enc != encrypted.end() and enc->record < int(i)) ++enc;
+            if (enc != encrypted.end() and enc->record == int(i)) continue;
+
+            s.at( i, rec );
+
+            const auto* begin = rec.data.data();
+            const auto* end = begin + rec.data.size();
+            result.sets.push_back( parse_objects( begin, end ) );
+        }
+
+        s.close();
+        result.ok = true;
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    } catch (...) {
+        result.error = "unknown error";
+    }
+
+    return result;
+}
+
+batch_loader::batch_loader( std::vector< std::string > paths, int workers )
+noexcept (false) :
+    paths( std::move( paths ) )
+{
+    if (workers < 0) {
+        const auto msg = "batch_loader: expected workers >= 0, was {}";
+        throw std::invalid_argument( fmt::format( msg, workers ) );
+    }
+
+    /* 0 means pick a default, but hardware_concurrency may also return 0 */
+    if (workers == 0) workers = std::thread::hardware_concurrency();
+    if (workers == 0) workers = 4;
+
+    const auto n = (std::min)( std::size_t( workers ), this->paths.size() );
+    this->capacity = 2 * std::size_t( workers );
+
+    try {
+        for (std::size_t i = 0; i < n; ++i)
+            this->threads.emplace_back( &batch_loader::work, this );
+    } catch (...) {
+        /*
+         * the destructor is not run when the constructor throws, so stop the
+         * already started workers here, or their std::thread destructors
+         * terminate the program
+         */
+        {
+            std::lock_guard< std::mutex > guard( this->lock );
+            this->stopped = true;
+        }
+        this->room.notify_all();
+        for (auto& worker : this->threads) worker.join();
+        throw;
+    }
+}
+
+batch_loader::~batch_loader() {
+    {
+        std::lock_guard< std::mutex > guard( this->lock );
+        this->stopped = true;
+    }
+    this->room.notify_all();
+
+    for (auto& worker : this->threads)
+        worker.join();
+}
+
+void batch_loader::work() noexcept (true) {
+    while (true) {
+        std::string path;
+        {
+            std::unique_lock< std::mutex > guard( this->lock );
+            this->room.wait( guard, [this] {
+                return this->stopped
+                    or this->done.size() < this->capacity;
+            });
+
+            if (this->stopped) return;
+            if (this->cursor == this->paths.size()) return;
+            path = this->paths[ this->cursor++ ];
+        }
+
+        auto result = load_file( path );
+
+        {
+            std::lock_guard< std::mutex > guard( this->lock );
+            this->done.push_back( std::move( result ) );
+        }
+        this->ready.notify_one();
+    }
+}
+
+bool batch_loader::next( loaded_file& out ) noexcept (false) {
+    std::unique_lock< std::mutex > guard( this->lock );
+    if (this->returned == this->paths.size()) return false;
+
+    this->ready.wait( guard, [this] { return not this->done.empty(); } );
+
+    out = std::move( this->done.front() );
+    this->done.pop_front();
+    this->returned += 1;
+
+    guard.unlock();
+    this->room.notify_one();
+    return true;
+}
+
+std::size_t batch_loader::size() const noexcept (true) {
+    return this->paths.size();
+}
+
+}
@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <mio/mio.hpp>
+
+#include <dlisio/dlisio.h>
+#include <dlisio/types.h>
+
+#include <dlisio/ext/cache.hpp>
+#include <dlisio/ext/frame.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+namespace {
+
+/*
+ * The cache layout, all integers native-endian:
+ *
+ *  magic       char[8]     "dliscol" + version byte
+ *  byteorder   u32         0x01020304 as written
+ *  codec       u32         0 (raw) - reserved for compressed columns
+ *  size        u64         fingerprint of the source file
+ *  hash        u64
+ *  origin      i32
+ *  copy        u32
+ *  idlen       u32
+ *  reserved    u32
+ *  id          char[idlen], padded with zeros to a multiple of 8
+ *  rows        i64
+ *  columns     u32
+ *  reserved    u32
+ *
+ * followed by a directory entry per column:
+ *
+ *  channel     i32         -1 for the frame numbers
+ *  position    i32         position in the frame's format string
+ *  elements    i32
+ *  itemsize    u32
+ *  dtype       char[8]     numpy type string, zero padded
+ *  offset      u64
+ *  size        u64
+ *
+ * and then the columns, every column starting at a multiple of 64.
+ */
+const char magic[] = { 'd', 'l', 'i', 's', 'c', 'o', 'l', 2 };
+const std::uint32_t byteorder = 0x01020304;
+const std::uint32_t raw = 0;
+const std::uint64_t alignment = 64;
+
+template < typename T >
+void put( std::ofstream& fs, const T& x ) noexcept (false) {
+    fs.write( reinterpret_cast< const char* >( &x ), sizeof( x ) );
+}
+
+std::uint64_t padded( std::uint64_t n, std::uint64_t to ) noexcept (true) {
+    return (n + to - 1) / to * to;
+}
+
+std::uint64_t fnv1a( std::uint64_t hash, const char* xs, std::size_t n )
+noexcept (true) {
+    for (std::size_t i = 0; i < n; ++i) {
+        hash ^= std::uint8_t(xs[ i ]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*
+ * The column type of a single value in a packed frame, or false if the
+ * format has no fixed-size numerical representation. The validated floats
+ * are packed as (V, A[, B]), so the value is always the leading itemsize
+ * bytes. Times are packed as eight ints, and are converted to nanoseconds
+ * since epoch, see dlis_dtime_ns.
+ */
+bool columntype( char fmt, const char*& dtype, int& itemsize )
+noexcept (true) {
+    switch (fmt) {
+        case DLIS_FMT_FSHORT:
+        case DLIS_FMT_FSINGL:
+        case DLIS_FMT_FSING1:
+        case DLIS_FMT_FSING2:
+        case DLIS_FMT_ISINGL:
+        case DLIS_FMT_VSINGL: dtype = "=f4";  itemsize = 4;  return true;
+        case DLIS_FMT_FDOUBL:
+        case DLIS_FMT_FDOUB1:
+        case DLIS_FMT_FDOUB2: dtype = "=f8";  itemsize = 8;  return true;
+        case DLIS_FMT_CSINGL: dtype = "=c8";  itemsize = 8;  return true;
+        case DLIS_FMT_CDOUBL: dtype = "=c16"; itemsize = 16; return true;
+        case DLIS_FMT_SSHORT: dtype = "=i1";  itemsize = 1;  return true;
+        case DLIS_FMT_SNORM:  dtype = "=i2";  itemsize = 2;  return true;
+        case DLIS_FMT_SLONG:  dtype = "=i4";  itemsize = 4;  return true;
+        case DLIS_FMT_USHORT: dtype = "=u1";  itemsize = 1;  return true;
+        case DLIS_FMT_UNORM:  dtype = "=u2";  itemsize = 2;  return true;
+        case DLIS_FMT_ULONG:  dtype = "=u4";  itemsize = 4;  return true;
+        case DLIS_FMT_UVARI:
+        case DLIS_FMT_ORIGIN: dtype = "=i4";  itemsize = 4;  return true;
+        case DLIS_FMT_STATUS: dtype = "=u1";  itemsize = 1;  return true;
+        case DLIS_FMT_DTIME:  dtype = "=M8[ns]"; itemsize = 8; return true;
+        default:
+            return false;
+    }
+}
+
+struct column {
+    cache_column meta;
+    int itemsize;
+    bool dtime;
+    std::vector< char > data;
+};
+
+void append_dtime( std::vector< char >& dst, const char* packed )
+noexcept (false) {
+    int f[ 8 ];
+    std::memcpy( f, packed, sizeof( f ) );
+    const auto ns = dlis_dtime_ns( f[ 0 ], f[ 1 ], f[ 2 ], f[ 3 ],
+                                   f[ 4 ], f[ 5 ], f[ 6 ], f[ 7 ] );
+    const auto* src = reinterpret_cast< const char* >( &ns );
+    dst.insert( dst.end(), src, src + sizeof( ns ) );
+}
+
+class cursor {
+public:
+    cursor( const char* begin, std::size_t size ) :
+        pos( begin ), end( begin + size )
+    {}
+
+    template < typename T >
+    T get() noexcept (false) {
+        T x;
+        this->copy( &x, sizeof( x ) );
+        return x;
+    }
+
+    void copy( void* dst, std::size_t n ) noexcept (false) {
+        if (std::size_t(this->end - this->pos) < n)
+            throw std::runtime_error( "column_cache: unexpected end-of-file" );
+
+        std::memcpy( dst, this->pos, n );
+        this->pos += n;
+    }
+
+    void skip( std::size_t n ) noexcept (false) {
+        if (std::size_t(this->end - this->pos) < n)
+            throw std::runtime_error( "column_cache: unexpected end-of-file" );
+
+        this->pos += n;
+    }
+
+private:
+    const char* pos;
+    const char* end;
+};
+
+}
+
+fingerprint file_fingerprint( const std::string& path ) noexcept (false) {
+    std::ifstream fs;
+    fs.exceptions( fs.exceptions()
+                 | std::ios_base::failbit
+                 | std::ios_base::badbit
+    );
+    fs.open( path, std::ios::binary | std::ios::ate );
+
+    fingerprint fp;
+    fp.size = std::uint64_t( fs.tellg() );
+
+    const std::uint64_t edge = 64 * 1024;
+    const std::uint64_t block = 4 * 1024;
+    const int samples = 16;
+
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = fnv1a( hash, reinterpret_cast< const char* >( &fp.size ),
+                        sizeof( fp.size ) );
+
+    std::vector< char > buffer( edge );
+    const auto digest = [&]( std::uint64_t from, std::uint64_t n ) {
+        n = (std::min)( n, fp.size - from );
+        fs.seekg( from );
+        fs.read( buffer.data(), n );
+        hash = fnv1a( hash, buffer.data(), n );
+    };
+
+    if (fp.size <= 2 * edge) {
+        for (std::uint64_t pos = 0; pos < fp.size; pos += edge)
+            digest( pos, edge );
+    } else {
+        digest( 0, edge );
+        const auto stride = (fp.size - 2 * edge) / (samples + 1);
+        for (int i = 1; i <= samples; ++i)
+            digest( edge + i * stride, block );
+        digest( fp.size - edge, edge );
+    }
+
+    fp.hash = hash;
+    return fp;
+}
+
+void write_column_cache( const std::string& path,
+                         const fingerprint& source,
+                         stream& file,
+                         const std::vector< int >& records,
+                         const dl::obname& frame,
+                         const std::string& fmt,
+                         const std::vector< int >& dimensions )
+noexcept (false) {
+    packed_layout layout( fmt );
+
+    std::vector< column > columns;
+    columns.emplace_back();
+    columns.back().meta.channel = -1;
+    columns.back().meta.position = -1;
+    columns.back().meta.elements = 1;
+    columns.back().meta.dtype = "=i4";
+    columns.back().itemsize = sizeof( std::int32_t );
+    columns.back().dtime = false;
+
+    int position = 0;
+    for (std::size_t i = 0; i < dimensions.size(); ++i) {
+        const auto elements = dimensions[ i ];
+        if (elements < 1 || position + elements > int(fmt.size())) {
+            const auto msg = "write_column_cache: dimensions (channel {}) "
+                             "inconsistent with format string '{}'";
+            throw std::invalid_argument( fmt::format( msg, i, fmt ) );
+        }
+
+        const char* dtype;
+        int itemsize;
+        if (columntype( fmt[ position ], dtype, itemsize )) {
+            column col;
+            col.meta.channel = int(i);
+            col.meta.position = position;
+            col.meta.elements = elements;
+            col.meta.dtype = dtype;
+            col.itemsize = itemsize;
+            col.dtime = fmt[ position ] == DLIS_FMT_DTIME;
+            columns.push_back( std::move( col ) );
+        }
+
+        position += elements;
+    }
+
+    if (position != int(fmt.size())) {
+        const auto msg = "write_column_cache: dimensions sum to {}, "
+                         "but format string '{}' has {} values";
+        throw std::invalid_argument(
+            fmt::format( msg, position, fmt, fmt.size() )
+        );
+    }
+
+    std::int64_t rows = 0;
+    const auto visit = [&]( int, std::int32_t frame_number,
+                            const char* packed ) {
+        auto& framenos = columns.front().data;
+        const auto* fno = reinterpret_cast< const char* >( &frame_number );
+        framenos.insert( framenos.end(), fno, fno + sizeof( frame_number ) );
+
+        const auto& offsets = layout.at( packed );
+
+        for (auto itr = columns.begin() + 1; itr != columns.end(); ++itr) {
+            for (int k = 0; k < itr->meta.elements; ++k) {
+                const auto* src = packed + offsets[ itr->meta.position + k ];
+                if (itr->dtime) {
+                    append_dtime( itr->data, src );
+                    continue;
+                }
+                itr->data.insert( itr->data.end(), src, src + itr->itemsize );
+            }
+        }
+
+        rows += 1;
+    };
+
+    foreach_frame( file, records, frame, fmt, visit );
+
+    const auto& id = dl::decay( frame.id );
+    std::uint64_t offset = sizeof( magic )
+                         + 2 * sizeof( std::uint32_t )
+                         + 2 * sizeof( std::uint64_t )
+                         + 4 * sizeof( std::uint32_t )
+                         + padded( id.size(), 8 )
+                         + sizeof( std::int64_t )
+                         + 2 * sizeof( std::uint32_t )
+                         + columns.size() * 40
+    ;
+
+    for (auto& col : columns) {
+        offset = padded( offset, alignment );
+        col.meta.offset = offset;
+        col.meta.size = col.data.size();
+        offset += col.data.size();
+    }
+
+    std::ofstream fs;
+    fs.exceptions( fs.exceptions()
+                 | std::ios_base::failbit
+                 | std::ios_base::badbit
+    );
+    fs.open( path, std::ios::binary | std::ios::trunc );
+
+    const char zeros[ alignment ] = {};
+
+    fs.write( magic, sizeof( magic ) );
+    put( fs, byteorder );
+    put( fs, raw );
+    put( fs, source.size );
+    put( fs, source.hash );
+    put( fs, std::int32_t( dl::decay( frame.origin ) ) );
+    put( fs, std::uint32_t( dl::decay( frame.copy ) ) );
+    put( fs, std::uint32_t( id.size() ) );
+    put( fs, std::uint32_t( 0 ) );
+    fs.write( id.data(), id.size() );
+    fs.write( zeros, padded( id.size(), 8 ) - id.size() );
+    put( fs, rows );
+    put( fs, std::uint32_t( columns.size() ) );
+    put( fs, std::uint32_t( 0 ) );
+
+    for (const auto& col : columns) {
+        char dtype[ 8 ] = {};
+        std::copy( col.meta.dtype.begin(), col.meta.dtype.end(), dtype );
+
+        put( fs, std::int32_t( col.meta.channel ) );
+        put( fs, std::int32_t( col.meta.position ) );
+        put( fs, std::int32_t( col.meta.elements ) );
+        put( fs, std::uint32_t( col.itemsize ) );
+        fs.write( dtype, sizeof( dtype ) );
+        put( fs, col.meta.offset );
+        put( fs, col.meta.size );
+    }
+
+    for (const auto& col : columns) {
+        const auto pos = std::uint64_t( fs.tellp() );
+        fs.write( zeros, col.meta.offset - pos );
+        fs.write( col.data.data(), col.data.size() );
+    }
+}
+
+column_cache::column_cache( const std::string& path ) noexcept (false) {
+    mio::mmap_source file;
+    map_source( file, path );
+    cursor cur( file.data(), file.size() );
+
+    char mgc[ sizeof( magic ) ];
+    cur.copy( mgc, sizeof( mgc ) );
+    if (std::memcmp( mgc, magic, sizeof( magic ) ) != 0)
+        throw std::runtime_error( "column_cache: not a cache file, bad magic" );
+
+    if (cur.get< std::uint32_t >() != byteorder)
+        throw std::runtime_error( "column_cache: byte order mismatch" );
+
+    const auto codec = cur.get< std::uint32_t >();
+    if (codec != raw) {
+        const auto msg = "column_cache: unsupported codec {}";
+        throw dl::not_implemented( fmt::format( msg, codec ) );
+    }
+
+    this->fp.size = cur.get< std::uint64_t >();
+    this->fp.hash = cur.get< std::uint64_t >();
+
+    this->name.origin = dl::origin{ cur.get< std::int32_t >() };
+    this->name.copy = dl::ushort( cur.get< std::uint32_t >() );
+    const auto idlen = cur.get< std::uint32_t >();
+    cur.skip( sizeof( std::uint32_t ) );
+    std::string id( idlen, '\0' );
+    cur.copy( &id[ 0 ], idlen );
+    cur.skip( padded( idlen, 8 ) - idlen );
+    this->name.id = dl::ident{ std::move( id ) };
+
+    this->nrows = cur.get< std::int64_t >();
+    const auto count = cur.get< std::uint32_t >();
+    cur.skip( sizeof( std::uint32_t ) );
+
+    if (this->nrows < 0)
+        throw std::runtime_error( "column_cache: corrupt header" );
+
+    const auto size = std::uint64_t( file.size() );
+    for (std::uint32_t i = 0; i < count; ++i) {
+        cache_column col;
+        col.channel  = cur.get< std::int32_t >();
+        col.position = cur.get< std::int32_t >();
+        col.elements = cur.get< std::int32_t >();
+        const auto itemsize = cur.get< std::uint32_t >();
+
+        char dtype[ 9 ] = {};
+        cur.copy( dtype, 8 );
+        col.dtype = dtype;
+        col.offset = cur.get< std::uint64_t >();
+        col.size   = cur.get< std::uint64_t >();
+
+        const auto expected = std::uint64_t( this->nrows )
+                            * std::uint64_t( col.elements )
+                            * itemsize;
+
+        if (col.elements < 1 || col.size != expected
+                             || col.offset > size
+                             || col.size > size - col.offset) {
+            const auto msg = "column_cache: column {} (channel {}) corrupt "
+                             "or out of bounds of file";
+            throw std::runtime_error( fmt::format( msg, i, col.channel ) );
+        }
+
+        this->cols.push_back( std::move( col ) );
+    }
+}
+
+const dl::fingerprint& column_cache::source() const noexcept (true) {
+    return this->fp;
+}
+
+const dl::obname& column_cache::frame() const noexcept (true) {
+    return this->name;
+}
+
+std::int64_t column_cache::rows() const noexcept (true) {
+    return this->nrows;
+}
+
+const std::vector< cache_column >& column_cache::columns() const
+noexcept (true) {
+    return this->cols;
+}
+
+}
@@ -0,0 +1,823 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <fmt/core.h>
+#include <mio/mio.hpp>
+#include <mpark/variant.hpp>
+
+#include <dlisio/ext/batch.hpp>
+#include <dlisio/ext/cache.hpp>
+#include <dlisio/ext/catalog.hpp>
+#include <dlisio/ext/frame.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+namespace {
+
+/*
+ * The catalog layout, all integers native-endian:
+ *
+ *  magic       char[8]     "dliscat" + version byte
+ *  byteorder   u32         0x01020304 as written
+ *  reserved    u32
+ *  sections    { count u64, offset u64 } * 9
+ *
+ * The sections, in order, each starting at a multiple of 8:
+ *
+ *  strings     u64[count + 1]      offsets into chars, sorted strings
+ *  chars       char[count]
+ *  files       { path, logical-files u32, size, hash u64,
+ *                frames, channels, parameters { begin, count u32 } }
+ *  frames      { file, logical-file u32, origin i32, copy, name u32 }
+ *  channels    { file, logical-file u32, origin i32, copy, name, units,
+ *                reprc, dimension-begin, dimension-count u32, frame i32 }
+ *  parameters  { file, logical-file u32, origin i32, copy, name u32 }
+ *  dimensions  u32[count]
+ *  postings    u32[count]          offsets into hits, one per string + 1
+ *  hits        { kind, row u32 }   rows are global, not per file
+ *
+ * Strings (paths, names, units) are referred to by their index in strings.
+ */
+const char magic[] = { 'd', 'l', 'i', 's', 'c', 'a', 't', 1 };
+const std::uint32_t byteorder = 0x01020304;
+
+const std::size_t filesize      = 48;
+const std::size_t framesize     = 20;
+const std::size_t channelsize   = 40;
+const std::size_t parametersize = 20;
+const std::size_t sections      = 9;
+const std::size_t headersize    = 16 + sections * 16;
+
+template < typename T >
+void put( std::ofstream& fs, const T& x ) noexcept (false) {
+    fs.write( reinterpret_cast< const char* >( &x ), sizeof( x ) );
+}
+
+template < typename T >
+T load( const char* xs ) noexcept (true) {
+    T x;
+    std::memcpy( &x, xs, sizeof( x ) );
+    return x;
+}
+
+std::uint64_t padded( std::uint64_t n ) noexcept (true) {
+    return (n + 7) & ~std::uint64_t(7);
+}
+
+struct strings {
+    template < typename T >
+    std::string operator () ( const std::vector< T >& ) const {
+        return "";
+    }
+
+    std::string operator () ( const mpark::monostate& ) const {
+        return "";
+    }
+
+    std::string operator () ( const std::vector< dl::ident >& x ) const {
+        return x.empty() ? "" : dl::decay( x.front() );
+    }
+    std::string operator () ( const std::vector< dl::ascii >& x ) const {
+        return x.empty() ? "" : dl::decay( x.front() );
+    }
+    std::string operator () ( const std::vector< dl::units >& x ) const {
+        return x.empty() ? "" : dl::decay( x.front() );
+    }
+};
+
+std::string string_attribute( const basic_object& obj,
+                              const std::string& label )
+noexcept (false) {
+    try {
+        return mpark::visit( strings(), obj.at( label ).value );
+    } catch (const std::out_of_range&) {
+        return "";
+    }
+}
+
+/*
+ * The catalog should describe what is there, not fail on attributes with
+ * unexpected types, so treat those as absent
+ */
+std::vector< int > lenient_integers( const basic_object& obj,
+                                     const std::string& label )
+noexcept (false) {
+    try {
+        return integer_attribute( obj, label );
+    } catch (const std::invalid_argument&) {
+        return {};
+    }
+}
+
+std::vector< dl::obname > obnames( const basic_object& obj,
+                                   const std::string& label )
+noexcept (false) {
+    try {
+        const auto& value = obj.at( label ).value;
+        const auto* names = mpark::get_if< std::vector< dl::obname > >( &value );
+        if (names) return *names;
+    } catch (const std::out_of_range&) {}
+    return {};
+}
+
+struct interned {
+    std::vector< std::string > strings;
+
+    void add( const std::string& x ) {
+        this->strings.push_back( x );
+    }
+
+    void seal() {
+        std::sort( this->strings.begin(), this->strings.end() );
+        const auto last = std::unique( this->strings.begin(),
+                                       this->strings.end() );
+        this->strings.erase( last, this->strings.end() );
+    }
+
+    std::uint32_t operator [] ( const std::string& x ) const {
+        const auto itr = std::lower_bound( this->strings.begin(),
+                                           this->strings.end(),
+                                           x );
+        return std::uint32_t( std::distance( this->strings.begin(), itr ) );
+    }
+};
+
+void replace_file( const std::string& src, const std::string& dst )
+noexcept (false) {
+    if (std::rename( src.c_str(), dst.c_str() ) == 0) return;
+
+    /* windows does not rename over existing files */
+    std::remove( dst.c_str() );
+    if (std::rename( src.c_str(), dst.c_str() ) == 0) return;
+
+    const auto err = errno;
+    std::remove( src.c_str() );
+    throw std::system_error( err, std::generic_category(),
+                             fmt::format( "unable to write '{}'", dst ) );
+}
+
+/*
+ * A temporary file name next to path, unique to this process and call, so
+ * that concurrent updates of the same catalog do not write to the same file
+ * before it is moved in place
+ */
+std::string tempname( const std::string& path ) noexcept (false) {
+#ifdef _WIN32
+    const auto pid = _getpid();
+#else
+    const auto pid = getpid();
+#endif
+    static std::atomic< unsigned > counter( 0 );
+    return fmt::format( "{}.{}.{}.tmp", path, pid, counter++ );
+}
+
+}
+
+catalog_file catalog_entry( const std::string& path,
+                            const dl::fingerprint& fp,
+                            const std::vector< object_set >& sets )
+noexcept (false) {
+    catalog_file entry;
+    entry.path = path;
+    entry.fingerprint = fp;
+    entry.logical_files = sets.empty() ? 0 : 1;
+
+    std::vector< std::vector< dl::obname > > framechannels;
+
+    int lf = -1;
+    for (const auto& set : sets) {
+        const auto& type = dl::decay( set.type );
+        if (type == "FILE-HEADER") lf += 1;
+        const auto logical_file = (std::max)( lf, 0 );
+        entry.logical_files = (std::max)( entry.logical_files, lf + 1 );
+
+        if (type == "FRAME") {
+            for (const auto& obj : set.objects) {
+                entry.frames.push_back( { obj.object_name, logical_file } );
+                framechannels.push_back( obnames( obj, "CHANNELS" ) );
+            }
+        }
+
+        if (type == "CHANNEL") {
+            for (const auto& obj : set.objects) {
+                catalog_channel ch;
+                ch.name = obj.object_name;
+                ch.logical_file = logical_file;
+                ch.units = string_attribute( obj, "UNITS" );
+                const auto reprc = lenient_integers( obj, "REPRESENTATION-CODE" );
+                ch.reprc = reprc.empty() ? 0 : reprc.front();
+                ch.dimension = lenient_integers( obj, "DIMENSION" );
+                ch.frame = -1;
+                entry.channels.push_back( std::move( ch ) );
+            }
+        }
+
+        if (type == "PARAMETER") {
+            for (const auto& obj : set.objects)
+                entry.parameters.push_back( { obj.object_name, logical_file } );
+        }
+    }
+
+    /* the first frame in the same logical file that lists the channel */
+    for (auto& ch : entry.channels) {
+        for (std::size_t i = 0; i < entry.frames.size(); ++i) {
+            if (entry.frames[ i ].logical_file != ch.logical_file) continue;
+
+            const auto& names = framechannels[ i ];
+            if (std::find( names.begin(), names.end(), ch.name ) == names.end())
+                continue;
+
+            ch.frame = int(i);
+            break;
+        }
+    }
+
+    return entry;
+}
+
+void write_catalog( const std::string& path,
+                    const std::vector< catalog_file >& files )
+noexcept (false) {
+    interned strs;
+    std::uint64_t nframes = 0;
+    std::uint64_t nchannels = 0;
+    std::uint64_t nparameters = 0;
+    std::uint64_t ndimensions = 0;
+
+    for (const auto& file : files) {
+        strs.add( file.path );
+        for (const auto& x : file.frames)     strs.add( dl::decay( x.name.id ) );
+        for (const auto& x : file.parameters) strs.add( dl::decay( x.name.id ) );
+        for (const auto& x : file.channels) {
+            strs.add( dl::decay( x.name.id ) );
+            strs.add( x.units );
+            ndimensions += x.dimension.size();
+        }
+
+        nframes     += file.frames.size();
+        nchannels   += file.channels.size();
+        nparameters += file.parameters.size();
+    }
+    strs.seal();
+
+    /*
+     * The inverted index, built by sorting (name, kind, row) triplets, so
+     * that the hits of a name are contiguous and in file order
+     */
+    struct posting {
+        std::uint32_t name;
+        std::uint32_t kind;
+        std::uint32_t row;
+
+        bool operator < ( const posting& rhs ) const noexcept (true) {
+            if (this->name != rhs.name) return this->name < rhs.name;
+            if (this->kind != rhs.kind) return this->kind < rhs.kind;
+            return this->row < rhs.row;
+        }
+    };
+
+    std::vector< posting > hits;
+    hits.reserve( nframes + nchannels + nparameters );
+    {
+        std::uint32_t frame = 0, channel = 0, parameter = 0;
+        for (const auto& file : files) {
+            for (const auto& x : file.channels) {
+                const auto name = strs[ dl::decay( x.name.id ) ];
+                hits.push_back( { name, std::uint32_t(catalog_kind::channel),
+                                        channel++ } );
+            }
+            for (const auto& x : file.parameters) {
+                const auto name = strs[ dl::decay( x.name.id ) ];
+                hits.push_back( { name, std::uint32_t(catalog_kind::parameter),
+                                        parameter++ } );
+            }
+            for (const auto& x : file.frames) {
+                const auto name = strs[ dl::decay( x.name.id ) ];
+                hits.push_back( { name, std::uint32_t(catalog_kind::frame),
+                                        frame++ } );
+            }
+        }
+    }
+    std::sort( hits.begin(), hits.end() );
+
+    std::uint64_t nchars = 0;
+    for (const auto& x : strs.strings) nchars += x.size();
+
+    const std::uint64_t nstrings = strs.strings.size();
+    const std::uint64_t counts[ sections ] = {
+        nstrings,
+        nchars,
+        files.size(),
+        nframes,
+        nchannels,
+        nparameters,
+        ndimensions,
+        nstrings + 1,
+        hits.size(),
+    };
+    const std::uint64_t sizes[ sections ] = {
+        (nstrings + 1) * sizeof( std::uint64_t ),
+        nchars,
+        files.size() * filesize,
+        nframes * framesize,
+        nchannels * channelsize,
+        nparameters * parametersize,
+        ndimensions * sizeof( std::uint32_t ),
+        (nstrings + 1) * sizeof( std::uint32_t ),
+        hits.size() * 2 * sizeof( std::uint32_t ),
+    };
+
+    std::uint64_t offsets[ sections ];
+    std::uint64_t offset = headersize;
+    for (std::size_t i = 0; i < sections; ++i) {
+        offsets[ i ] = offset;
+        offset = padded( offset + sizes[ i ] );
+    }
+
+    std::ofstream fs;
+    fs.exceptions( fs.exceptions()
+                 | std::ios_base::failbit
+                 | std::ios_base::badbit
+    );
+    fs.open( path, std::ios::binary | std::ios::trunc );
+
+    const char zeros[ 8 ] = {};
+    const auto align = [&]( std::size_t section ) {
+        const auto pos = std::uint64_t( fs.tellp() );
+        fs.write( zeros, offsets[ section ] - pos );
+    };
+
+    fs.write( magic, sizeof( magic ) );
+    put( fs, byteorder );
+    put( fs, std::uint32_t( 0 ) );
+    for (std::size_t i = 0; i < sections; ++i) {
+        put( fs, counts[ i ] );
+        put( fs, offsets[ i ] );
+    }
+
+    align( 0 );
+    {
+        std::uint64_t pos = 0;
+        for (const auto& x : strs.strings) {
+            put( fs, pos );
+            pos += x.size();
+        }
+        put( fs, pos );
+    }
+
+    align( 1 );
+    for (const auto& x : strs.strings)
+        fs.write( x.data(), x.size() );
+
+    align( 2 );
+    {
+        std::uint32_t frame = 0, channel = 0, parameter = 0;
+        for (const auto& file : files) {
+            put( fs, strs[ file.path ] );
+            put( fs, std::uint32_t( file.logical_files ) );
+            put( fs, file.fingerprint.size );
+            put( fs, file.fingerprint.hash );
+            put( fs, frame );
+            put( fs, std::uint32_t( file.frames.size() ) );
+            put( fs, channel );
+            put( fs, std::uint32_t( file.channels.size() ) );
+            put( fs, parameter );
+            put( fs, std::uint32_t( file.parameters.size() ) );
+
+            frame     += file.frames.size();
+            channel   += file.channels.size();
+            parameter += file.parameters.size();
+        }
+    }
+
+    const auto put_object = [&]( std::uint32_t file,
+                                 int logical_file,
+                                 const dl::obname& name ) {
+        put( fs, file );
+        put( fs, std::uint32_t( logical_file ) );
+        put( fs, std::int32_t( dl::decay( name.origin ) ) );
+        put( fs, std::uint32_t( name.copy ) );
+        put( fs, strs[ dl::decay( name.id ) ] );
+    };
+
+    align( 3 );
+    for (std::uint32_t i = 0; i < files.size(); ++i) {
+        for (const auto& x : files[ i ].frames)
+            put_object( i, x.logical_file, x.name );
+    }
+
+    align( 4 );
+    {
+        std::uint32_t dimension = 0;
+        for (std::uint32_t i = 0; i < files.size(); ++i) {
+            for (const auto& x : files[ i ].channels) {
+                put_object( i, x.logical_file, x.name );
+                put( fs, strs[ x.units ] );
+                put( fs, std::uint32_t( x.reprc ) );
+                put( fs, dimension );
+                put( fs, std::uint32_t( x.dimension.size() ) );
+                put( fs, std::int32_t( x.frame ) );
+                dimension += x.dimension.size();
+            }
+        }
+    }
+
+    align( 5 );
+    for (std::uint32_t i = 0; i < files.size(); ++i) {
+        for (const auto& x : files[ i ].parameters)
+            put_object( i, x.logical_file, x.name );
+    }
+
+    align( 6 );
+    for (const auto& file : files) {
+        for (const auto& x : file.channels) {
+            for (const auto dim : x.dimension)
+                put( fs, std::uint32_t( dim ) );
+        }
+    }
+
+    align( 7 );
+    {
+        std::size_t k = 0;
+        for (std::uint32_t name = 0; name <= nstrings; ++name) {
+            while (k < hits.size() and hits[ k ].name < name) ++k;
+            put( fs, std::uint32_t( k ) );
+        }
+    }
+
+    align( 8 );
+    for (const auto& hit : hits) {
+        put( fs, hit.kind );
+        put( fs, hit.row );
+    }
+}
+
+catalog::catalog( const std::string& path ) noexcept (false) {
+    map_source( this->data, path );
+
+    const auto size = std::uint64_t( this->data.size() );
+    if (size < headersize)
+        throw std::runtime_error( "catalog: file truncated" );
+
+    const auto* xs = this->data.data();
+    if (std::memcmp( xs, magic, sizeof( magic ) ) != 0)
+        throw std::runtime_error( "catalog: not a catalog, bad magic" );
+
+    if (load< std::uint32_t >( xs + 8 ) != byteorder)
+        throw std::runtime_error( "catalog: byte order mismatch" );
+
+    section* all[ sections ] = {
+        &this->strings,
+        &this->chars,
+        &this->files,
+        &this->frames,
+        &this->channels,
+        &this->parameters,
+        &this->dimensions,
+        &this->postings,
+        &this->hits,
+    };
+
+    for (std::size_t i = 0; i < sections; ++i) {
+        all[ i ]->count  = load< std::uint64_t >( xs + 16 + i * 16 );
+        all[ i ]->offset = load< std::uint64_t >( xs + 16 + i * 16 + 8 );
+    }
+
+    const std::pair< const section*, std::uint64_t > extents[] = {
+        { &this->strings,    (this->strings.count + 1) * 8 },
+        { &this->chars,      this->chars.count },
+        { &this->files,      this->files.count * filesize },
+        { &this->frames,     this->frames.count * framesize },
+        { &this->channels,   this->channels.count * channelsize },
+        { &this->parameters, this->parameters.count * parametersize },
+        { &this->dimensions, this->dimensions.count * 4 },
+        { &this->postings,   this->postings.count * 4 },
+        { &this->hits,       this->hits.count * 8 },
+    };
+
+    for (const auto& extent : extents) {
+        const auto& sec = *extent.first;
+        if (sec.offset > size or extent.second > size - sec.offset)
+            throw std::runtime_error( "catalog: section out of bounds" );
+    }
+
+    if (this->postings.count != this->strings.count + 1)
+        throw std::runtime_error( "catalog: corrupt inverted index" );
+}
+
+std::size_t catalog::size() const noexcept (true) {
+    return this->files.count;
+}
+
+const char* catalog::row( const section& sec,
+                          std::size_t size,
+                          std::size_t i ) const noexcept (false) {
+    if (i >= sec.count) {
+        const auto msg = "catalog: row {} out of range (size = {})";
+        throw std::out_of_range( fmt::format( msg, i, sec.count ) );
+    }
+
+    return this->data.data() + sec.offset + i * size;
+}
+
+std::string catalog::string( std::uint32_t i ) const noexcept (false) {
+    if (i >= this->strings.count) {
+        const auto msg = "catalog: string {} out of range (size = {})";
+        throw std::runtime_error( fmt::format( msg, i, this->strings.count ) );
+    }
+
+    const auto* offsets = this->data.data() + this->strings.offset;
+    const auto begin = load< std::uint64_t >( offsets + i * 8 );
+    const auto end   = load< std::uint64_t >( offsets + i * 8 + 8 );
+
+    if (begin > end or end > this->chars.count)
+        throw std::runtime_error( "catalog: corrupt string table" );
+
+    const auto* chars = this->data.data() + this->chars.offset;
+    return std::string( chars + begin, chars + end );
+}
+
+std::string catalog::path( std::size_t file ) const noexcept (false) {
+    return this->string( load< std::uint32_t >(
+        this->row( this->files, filesize, file )
+    ));
+}
+
+dl::fingerprint catalog::fingerprint( std::size_t file ) const
+noexcept (false) {
+    const auto* xs = this->row( this->files, filesize, file );
+    dl::fingerprint fp;
+    fp.size = load< std::uint64_t >( xs + 8 );
+    fp.hash = load< std::uint64_t >( xs + 16 );
+    return fp;
+}
+
+namespace {
+
+dl::obname object_name( const char* xs ) noexcept (true) {
+    dl::obname name;
+    name.origin = dl::origin{ load< std::int32_t >( xs + 8 ) };
+    name.copy   = dl::ushort( load< std::uint32_t >( xs + 12 ) );
+    return name;
+}
+
+}
+
+catalog_file catalog::file( std::size_t i ) const noexcept (false) {
+    const auto* xs = this->row( this->files, filesize, i );
+
+    catalog_file entry;
+    entry.path = this->string( load< std::uint32_t >( xs ) );
+    entry.logical_files = load< std::uint32_t >( xs + 4 );
+    entry.fingerprint = this->fingerprint( i );
+
+    const auto frame_begin     = load< std::uint32_t >( xs + 24 );
+    const auto frame_count     = load< std::uint32_t >( xs + 28 );
+    const auto channel_begin   = load< std::uint32_t >( xs + 32 );
+    const auto channel_count   = load< std::uint32_t >( xs + 36 );
+    const auto parameter_begin = load< std::uint32_t >( xs + 40 );
+    const auto parameter_count = load< std::uint32_t >( xs + 44 );
+
+    for (std::uint32_t k = 0; k < frame_count; ++k) {
+        const auto* r = this->row( this->frames, framesize, frame_begin + k );
+        catalog_frame frame;
+        frame.name = object_name( r );
+        frame.name.id = dl::ident{ this->string( load< std::uint32_t >( r + 16 ) ) };
+        frame.logical_file = load< std::uint32_t >( r + 4 );
+        entry.frames.push_back( std::move( frame ) );
+    }
+
+    for (std::uint32_t k = 0; k < channel_count; ++k) {
+        const auto* r = this->row( this->channels, channelsize,
+                                   channel_begin + k );
+        catalog_channel ch;
+        ch.name = object_name( r );
+        ch.name.id = dl::ident{ this->string( load< std::uint32_t >( r + 16 ) ) };
+        ch.logical_file = load< std::uint32_t >( r + 4 );
+        ch.units = this->string( load< std::uint32_t >( r + 20 ) );
+        ch.reprc = load< std::uint32_t >( r + 24 );
+        ch.frame = load< std::int32_t >( r + 36 );
+
+        const auto dim_begin = load< std::uint32_t >( r + 28 );
+        const auto dim_count = load< std::uint32_t >( r + 32 );
+        for (std::uint32_t d = 0; d < dim_count; ++d) {
+            const auto* dim = this->row( this->dimensions, 4, dim_begin + d );
+            ch.dimension.push_back( load< std::uint32_t >( dim ) );
+        }
+
+        entry.channels.push_back( std::move( ch ) );
+    }
+
+    for (std::uint32_t k = 0; k < parameter_count; ++k) {
+        const auto* r = this->row( this->parameters, parametersize,
+                                   parameter_begin + k );
+        catalog_parameter param;
+        param.name = object_name( r );
+        param.name.id = dl::ident{ this->string( load< std::uint32_t >( r + 16 ) ) };
+        param.logical_file = load< std::uint32_t >( r + 4 );
+        entry.parameters.push_back( std::move( param ) );
+    }
+
+    return entry;
+}
+
+std::vector< catalog_hit > catalog::lookup( const std::string& name ) const
+noexcept (false) {
+    /*
+     * Binary search the sorted string table, comparing directly against the
+     * mapped bytes to avoid building strings
+     */
+    const auto* offsets = this->data.data() + this->strings.offset;
+    const auto* chars   = this->data.data() + this->chars.offset;
+
+    const auto compare = [&]( std::uint64_t i ) {
+        const auto begin = load< std::uint64_t >( offsets + i * 8 );
+        const auto end   = load< std::uint64_t >( offsets + i * 8 + 8 );
+        if (begin > end or end > this->chars.count)
+            throw std::runtime_error( "catalog: corrupt string table" );
+
+        const auto len = end - begin;
+        const auto n = (std::min)( std::uint64_t( name.size() ), len );
+        const auto cmp = std::memcmp( chars + begin, name.data(), n );
+        if (cmp != 0) return cmp;
+        if (len < name.size()) return -1;
+        if (len > name.size()) return  1;
+        return 0;
+    };
+
+    std::uint64_t lo = 0;
+    std::uint64_t hi = this->strings.count;
+    while (lo < hi) {
+        const auto mid = lo + (hi - lo) / 2;
+        if (compare( mid ) < 0) lo = mid + 1;
+        else                    hi = mid;
+    }
+
+    std::vector< catalog_hit > result;
+    if (lo == this->strings.count or compare( lo ) != 0) return result;
+
+    const auto* post = this->data.data() + this->postings.offset;
+    const auto first = load< std::uint32_t >( post + lo * 4 );
+    const auto last  = load< std::uint32_t >( post + lo * 4 + 4 );
+
+    for (auto k = first; k < last; ++k) {
+        const auto* hit = this->row( this->hits, 8, k );
+        const auto kind = load< std::uint32_t >( hit );
+        const auto global = load< std::uint32_t >( hit + 4 );
+
+        const char* r = nullptr;
+        std::size_t beginfield = 0;
+        switch (kind) {
+            case std::uint32_t(catalog_kind::channel):
+                r = this->row( this->channels, channelsize, global );
+                beginfield = 32;
+                break;
+            case std::uint32_t(catalog_kind::parameter):
+                r = this->row( this->parameters, parametersize, global );
+                beginfield = 40;
+                break;
+            case std::uint32_t(catalog_kind::frame):
+                r = this->row( this->frames, framesize, global );
+                beginfield = 24;
+                break;
+            default:
+                throw std::runtime_error( "catalog: corrupt inverted index" );
+        }
+
+        catalog_hit h;
+        h.kind = catalog_kind( kind );
+        h.file = load< std::uint32_t >( r );
+        h.logical_file = load< std::uint32_t >( r + 4 );
+        h.name = object_name( r );
+        h.name.id = dl::ident{ name };
+
+        const auto* file = this->row( this->files, filesize, h.file );
+        h.row = global - load< std::uint32_t >( file + beginfield );
+        result.push_back( std::move( h ) );
+    }
+
+    return result;
+}
+
+catalog_update update_catalog( const std::string& path,
+                               const std::vector< std::string >& paths,
+                               int workers )
+noexcept (false) {
+    catalog_update update;
+    update.loaded = 0;
+    update.unchanged = 0;
+    update.removed = 0;
+
+    /*
+     * An unreadable or corrupt catalog is not an error, it is just rebuilt
+     * from scratch
+     */
+    std::map< std::string, catalog_file > existing;
+    {
+        std::ifstream probe( path, std::ios::binary );
+        if (probe.good()) {
+            try {
+                const catalog cat( path );
+                for (std::size_t i = 0; i < cat.size(); ++i) {
+                    auto entry = cat.file( i );
+                    auto key = entry.path;
+                    existing.emplace( std::move( key ), std::move( entry ) );
+                }
+            } catch (const std::exception&) {
+                existing.clear();
+            }
+        }
+    }
+
+    std::map< std::string, catalog_file > current;
+    std::map< std::string, dl::fingerprint > fingerprints;
+    std::vector< std::string > stale;
+
+    for (const auto& p : paths) {
+        if (current.count( p ) or fingerprints.count( p )) continue;
+
+        dl::fingerprint fp;
+        try {
+            fp = file_fingerprint( p );
+        } catch (const std::exception& e) {
+            update.failed.emplace_back( p, e.what() );
+            continue;
+        }
+
+        const auto itr = existing.find( p );
+        if (itr != existing.end() and itr->second.fingerprint == fp) {
+            current.emplace( p, std::move( itr->second ) );
+            update.unchanged += 1;
+            continue;
+        }
+
+        fingerprints.emplace( p, fp );
+        stale.push_back( p );
+    }
+
+    const std::unordered_set< std::string > wanted( paths.begin(),
+                                                    paths.end() );
+    for (const auto& entry : existing) {
+        if (not wanted.count( entry.first ))
+            update.removed += 1;
+    }
+
+    if (not stale.empty()) {
+        batch_loader loader( stale, workers );
+        loaded_file f;
+        while (loader.next( f )) {
+            if (not f.ok) {
+                update.failed.emplace_back( f.path, f.error );
+                continue;
+            }
+
+            auto entry = catalog_entry( f.path,
+                                        fingerprints.at( f.path ),
+                                        f.sets );
+            current.emplace( f.path, std::move( entry ) );
+            update.loaded += 1;
+        }
+    }
+
+    std::vector< catalog_file > files;
+    files.reserve( current.size() );
+    for (const auto& p : paths) {
+        auto itr = current.find( p );
+        if (itr == current.end()) continue;
+        files.push_back( std::move( itr->second ) );
+        current.erase( itr );
+    }
+
+    const auto tmp = tempname( path );
+    try {
+        write_catalog( tmp, files );
+    } catch (...) {
+        std::remove( tmp.c_str() );
+        throw;
+    }
+    replace_file( tmp, path );
+
+    return update;
+}
+
+}
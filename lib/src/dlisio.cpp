@@ -681,6 +681,210 @@ int dlis_pack_size( const char* fmt, int* size ) {
     }
 }
 
+int dlis_packflen( const char* fmt, const void* src, int* nread, int* nwrite ) {
+    const char* xs = static_cast< const char* >( src );
+    int read = 0;
+    int write = 0;
+
+    while (true) {
+        switch (*fmt++) {
+            case DLIS_FMT_EOL:
+                if (nread)  *nread = read;
+                if (nwrite) *nwrite = write;
+                return DLIS_OK;
+
+            case DLIS_FMT_FSHORT:
+                read  += DLIS_SIZEOF_FSHORT;
+                write += sizeof(float);
+                break;
+
+            case DLIS_FMT_FSINGL:
+                read  += DLIS_SIZEOF_FSINGL;
+                write += sizeof(float);
+                break;
+
+            case DLIS_FMT_FSING1:
+                read  += DLIS_SIZEOF_FSING1;
+                write += sizeof(float) * 2;
+                break;
+
+            case DLIS_FMT_FSING2:
+                read  += DLIS_SIZEOF_FSING2;
+                write += sizeof(float) * 3;
+                break;
+
+            case DLIS_FMT_ISINGL:
+                read  += DLIS_SIZEOF_ISINGL;
+                write += sizeof(float);
+                break;
+
+            case DLIS_FMT_VSINGL:
+                read  += DLIS_SIZEOF_VSINGL;
+                write += sizeof(float);
+                break;
+
+            case DLIS_FMT_FDOUBL:
+                read  += DLIS_SIZEOF_FDOUBL;
+                write += sizeof(double);
+                break;
+
+            case DLIS_FMT_FDOUB1:
+                read  += DLIS_SIZEOF_FDOUB1;
+                write += sizeof(double) * 2;
+                break;
+
+            case DLIS_FMT_FDOUB2:
+                read  += DLIS_SIZEOF_FDOUB2;
+                write += sizeof(double) * 3;
+                break;
+
+            case DLIS_FMT_CSINGL:
+                read  += DLIS_SIZEOF_CSINGL;
+                write += sizeof(float) * 2;
+                break;
+
+            case DLIS_FMT_CDOUBL:
+                read  += DLIS_SIZEOF_CDOUBL;
+                write += sizeof(double) * 2;
+                break;
+
+            case DLIS_FMT_SSHORT:
+                read  += DLIS_SIZEOF_SSHORT;
+                write += sizeof(std::int8_t);
+                break;
+
+            case DLIS_FMT_SNORM:
+                read  += DLIS_SIZEOF_SNORM;
+                write += sizeof(std::int16_t);
+                break;
+
+            case DLIS_FMT_SLONG:
+                read  += DLIS_SIZEOF_SLONG;
+                write += sizeof(std::int32_t);
+                break;
+
+            case DLIS_FMT_USHORT:
+                read  += DLIS_SIZEOF_USHORT;
+                write += sizeof(std::uint8_t);
+                break;
+
+            case DLIS_FMT_UNORM:
+                read  += DLIS_SIZEOF_UNORM;
+                write += sizeof(std::uint16_t);
+                break;
+
+            case DLIS_FMT_ULONG:
+                read  += DLIS_SIZEOF_ULONG;
+                write += sizeof(std::uint32_t);
+                break;
+
+            case DLIS_FMT_DTIME:
+                read  += DLIS_SIZEOF_DTIME;
+                write += sizeof(int) * 8;
+                break;
+
+            case DLIS_FMT_STATUS:
+                read  += DLIS_SIZEOF_STATUS;
+                write += sizeof(std::uint8_t);
+                break;
+
+            /*
+             * The variable-length types must be inspected to figure out how
+             * many bytes they span. The out-parameters are NULL, so the
+             * dlis_* functions only compute the distance. Multi-dimensional
+             * uvari channels are a run of uvaris in the format string, which
+             * are skipped together.
+             */
+            case DLIS_FMT_UVARI:
+            case DLIS_FMT_ORIGIN: {
+                int n = 1;
+                while (*fmt == DLIS_FMT_UVARI || *fmt == DLIS_FMT_ORIGIN) {
+                    ++fmt;
+                    ++n;
+                }
+                const auto* next = dlis_skipuvaris( xs + read, n );
+                read  += next - (xs + read);
+                write += sizeof(std::int32_t) * n;
+                break;
+            }
+
+            case DLIS_FMT_IDENT:
+            case DLIS_FMT_UNITS: {
+                std::int32_t len;
+                dlis_ident( xs + read, &len, nullptr );
+                read  += DLIS_SIZEOF_USHORT + len;
+                write += sizeof(std::int32_t) + len;
+                break;
+            }
+
+            case DLIS_FMT_ASCII: {
+                std::int32_t len;
+                const auto* next = dlis_ascii( xs + read, &len, nullptr );
+                read  += next - (xs + read);
+                write += sizeof(std::int32_t) + len;
+                break;
+            }
+
+            case DLIS_FMT_OBNAME: {
+                std::int32_t origin, len;
+                std::uint8_t copy;
+                const auto* next = dlis_obname( xs + read, &origin,
+                                                           &copy,
+                                                           &len,
+                                                           nullptr );
+                read  += next - (xs + read);
+                write += sizeof(std::int32_t)
+                       + sizeof(std::uint8_t)
+                       + sizeof(std::int32_t) + len
+                       ;
+                break;
+            }
+
+            case DLIS_FMT_OBJREF: {
+                std::int32_t iden_len, origin, name_len;
+                std::uint8_t copy;
+                const auto* next = dlis_objref( xs + read, &iden_len,
+                                                           nullptr,
+                                                           &origin,
+                                                           &copy,
+                                                           &name_len,
+                                                           nullptr );
+                read  += next - (xs + read);
+                write += sizeof(std::int32_t) + iden_len
+                       + sizeof(std::int32_t)
+                       + sizeof(std::uint8_t)
+                       + sizeof(std::int32_t) + name_len
+                       ;
+                break;
+            }
+
+            case DLIS_FMT_ATTREF: {
+                std::int32_t iden1_len, origin, name_len, iden2_len;
+                std::uint8_t copy;
+                const auto* next = dlis_attref( xs + read, &iden1_len,
+                                                           nullptr,
+                                                           &origin,
+                                                           &copy,
+                                                           &name_len,
+                                                           nullptr,
+                                                           &iden2_len,
+                                                           nullptr );
+                read  += next - (xs + read);
+                write += sizeof(std::int32_t) + iden1_len
+                       + sizeof(std::int32_t)
+                       + sizeof(std::uint8_t)
+                       + sizeof(std::int32_t) + name_len
+                       + sizeof(std::int32_t) + iden2_len
+                       ;
+                break;
+            }
+
+            default:
+                return DLIS_INVALID_ARGS;
+        }
+    }
+}
+
 int dlis_index_records( const char* begin,
                         const char* end,
                         std::size_t allocsize,
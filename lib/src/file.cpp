@@ -0,0 +1,604 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <ios>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fmt/core.h>
+#include <mio/mio.hpp>
+
+#include <dlisio/dlisio.h>
+#include <dlisio/file.h>
+
+#include <dlisio/ext/frame.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+#include <dlisio/ext/zindex.hpp>
+
+namespace {
+
+struct channel_info {
+    dl::obname name;
+    char fmt;
+    int elements;
+    /* the size of an element, and the offset of the first in the frame */
+    std::size_t itemsize;
+    std::size_t offset;
+};
+
+/*
+ * The channels and frame data (implicit) records of a logical file, which
+ * starts at a FILE-HEADER. Channel and frame names are commonly reused
+ * between the logical files of a file, so a frame is only ever resolved
+ * against the channels and records of its own logical file.
+ */
+struct logical_file {
+    dl::object_vector channels;
+    std::vector< int > implicits;
+};
+
+/*
+ * A frame and its layout, which is worked out on first access, so that a
+ * broken frame does not break the file. The rows are indexed on first read:
+ * starts[i] is the first row in records[i], and starts.back() the number of
+ * rows.
+ */
+struct frame_info {
+    dl::basic_object object;
+    std::size_t file = 0;
+
+    bool prepared = false;
+    std::string fmt;
+    bool varsize = false;
+    std::vector< channel_info > channels;
+
+    bool indexed = false;
+    std::vector< int > records;
+    std::vector< std::int64_t > starts;
+};
+
+}
+
+struct dlis_file {
+    mutable std::string error;
+
+    mio::mmap_source file;
+    std::unique_ptr< dl::tapeimage > tif;
+    std::unique_ptr< dl::stream > stream;
+    dl::stream_offsets offsets;
+
+    std::vector< logical_file > files;
+    std::vector< frame_info > frames;
+};
+
+namespace {
+
+int fail( const dlis_file* f, int err, const char* msg ) noexcept (true) {
+    try {
+        f->error = msg;
+    } catch (...) {
+        f->error.clear();
+    }
+    return err;
+}
+
+/*
+ * Run body, and translate exceptions to error codes, as nothing may be
+ * thrown across the C interface
+ */
+template < typename Body >
+int guard( const dlis_file* f, const Body& body ) noexcept (true) {
+    if (not f) return DLIS_INVALID_ARGS;
+    f->error.clear();
+
+    try {
+        return body();
+    } catch (const std::bad_alloc& e) {
+        return fail( f, DLIS_BAD_ALLOC, e.what() );
+    } catch (const dl::not_found& e) {
+        return fail( f, DLIS_NOT_FOUND, e.what() );
+    } catch (const dl::not_implemented& e) {
+        return fail( f, DLIS_NOT_IMPLEMENTED, e.what() );
+    } catch (const std::invalid_argument& e) {
+        return fail( f, DLIS_INVALID_ARGS, e.what() );
+    } catch (const std::out_of_range& e) {
+        return fail( f, DLIS_INVALID_ARGS, e.what() );
+    } catch (const std::ios_base::failure& e) {
+        return fail( f, DLIS_IO_ERROR, e.what() );
+    } catch (const std::system_error& e) {
+        return fail( f, DLIS_IO_ERROR, e.what() );
+    } catch (const std::exception& e) {
+        return fail( f, DLIS_UNEXPECTED_VALUE, e.what() );
+    } catch (...) {
+        return fail( f, DLIS_UNEXPECTED_VALUE, "unknown error" );
+    }
+}
+
+frame_info& getframe( dlis_file* f, int frame ) noexcept (false) {
+    if (frame < 0 or frame >= int(f->frames.size())) {
+        const auto msg = "frame {} out of range (frames = {})";
+        throw std::out_of_range( fmt::format( msg, frame, f->frames.size() ) );
+    }
+    return f->frames[ frame ];
+}
+
+const frame_info& getframe( const dlis_file* f, int frame ) noexcept (false) {
+    return getframe( const_cast< dlis_file* >( f ), frame );
+}
+
+/*
+ * Work out the format string and channels of the frame, see dl::fmtstr
+ */
+frame_info& prepare( dlis_file* f, int frame ) noexcept (false) {
+    auto& info = getframe( f, frame );
+    if (info.prepared) return info;
+
+    const auto& lfchannels = f->files[ info.file ].channels;
+
+    /* a frame without channels is odd, but not broken */
+    const auto& attrs = info.object.attributes;
+    const auto haschannels = std::any_of(
+        attrs.begin(),
+        attrs.end(),
+        []( const dl::object_attribute& x ) {
+            return dl::decay( x.label ) == "CHANNELS";
+        }
+    );
+
+    const auto fmt = haschannels ? dl::fmtstr( info.object, lfchannels )
+                                 : std::string();
+    int varsize;
+    if (dlis_pack_varsize( fmt.c_str(), &varsize ) != DLIS_OK) {
+        const auto msg = "frame {} has invalid format string '{}'";
+        throw std::runtime_error( fmt::format( msg, frame, fmt ) );
+    }
+
+    std::vector< std::size_t > offsets;
+    if (not varsize) {
+        offsets = dl::packed_offsets( fmt );
+        int size;
+        dlis_pack_size( fmt.c_str(), &size );
+        offsets.push_back( size );
+    }
+
+    std::vector< channel_info > channels;
+    const std::vector< dl::obname >* names = nullptr;
+    if (haschannels) {
+        const auto& value = info.object.at( "CHANNELS" ).value;
+        names = mpark::get_if< std::vector< dl::obname > >( &value );
+    }
+
+    std::size_t position = 0;
+    if (names) for (const auto& name : *names) {
+        const auto eq = [&name]( const dl::basic_object& ch ) {
+            return ch.object_name == name;
+        };
+        const auto ch = std::find_if( lfchannels.begin(),
+                                      lfchannels.end(),
+                                      eq );
+
+        int elements = 1;
+        for (auto dim : dl::integer_attribute( *ch, "DIMENSION" ))
+            elements *= dim;
+
+        if (elements < 1) {
+            const auto msg = "channel {} of frame {} has {} elements, "
+                             "expected at least 1";
+            throw std::runtime_error(
+                fmt::format( msg, dl::decay( name.id ), frame, elements )
+            );
+        }
+
+        channel_info ci;
+        ci.name = name;
+        ci.fmt = fmt[ position ];
+        ci.elements = elements;
+        ci.itemsize = 0;
+        ci.offset = 0;
+        if (not varsize) {
+            ci.offset = offsets[ position ];
+            ci.itemsize = (offsets[ position + elements ] - ci.offset)
+                        / elements;
+        } else {
+            /*
+             * The offsets vary from frame to frame, but the fixed-size
+             * channels still have an itemsize
+             */
+            const char single[] = { ci.fmt, DLIS_FMT_EOL };
+            int size;
+            if (dlis_pack_size( single, &size ) == DLIS_OK)
+                ci.itemsize = std::size_t( size );
+        }
+
+        channels.push_back( std::move( ci ) );
+        position += elements;
+    }
+
+    info.fmt = fmt;
+    info.varsize = varsize;
+    info.channels = std::move( channels );
+    info.prepared = true;
+    return info;
+}
+
+/*
+ * Count the frames in every FDATA record of the frame, so that rows can be
+ * found without decoding the records before them
+ */
+frame_info& index( dlis_file* f, int frame ) noexcept (false) {
+    auto& info = prepare( f, frame );
+    if (info.indexed) return info;
+
+    std::vector< int > records;
+    std::vector< std::int64_t > starts;
+    std::int64_t rows = 0;
+    const auto count = [&]( int record, std::int32_t, const char* ) {
+        if (records.empty() or records.back() != record) {
+            records.push_back( record );
+            starts.push_back( rows );
+        }
+        rows += 1;
+    };
+
+    dl::foreach_frame( *f->stream,
+                       f->files[ info.file ].implicits,
+                       info.object.object_name,
+                       info.fmt,
+                       count );
+    starts.push_back( rows );
+
+    info.records = std::move( records );
+    info.starts = std::move( starts );
+    info.indexed = true;
+    return info;
+}
+
+void copy_name( const dl::obname& name,
+                char* id,
+                std::size_t idsize,
+                std::size_t* idlen,
+                std::int32_t* origin,
+                std::uint8_t* copynumber )
+noexcept (false) {
+    const auto& str = dl::decay( name.id );
+    if (idlen) *idlen = str.size();
+
+    if (id and idsize <= str.size()) {
+        const auto msg = "id buffer too small, was {}, needs {} "
+                         "(including terminator)";
+        throw std::invalid_argument(
+            fmt::format( msg, idsize, str.size() + 1 )
+        );
+    }
+
+    if (id) {
+        std::memcpy( id, str.data(), str.size() );
+        id[ str.size() ] = '\0';
+    }
+
+    if (origin)     *origin = dl::decay( name.origin );
+    if (copynumber) *copynumber = name.copy;
+}
+
+}
+
+int dlis_file_open( const char* path, dlis_file** out ) {
+    if (not path or not out) return DLIS_INVALID_ARGS;
+
+    dlis_file* f = new (std::nothrow) dlis_file();
+    *out = f;
+    if (not f) return DLIS_BAD_ALLOC;
+
+    return guard( f, [f, path] {
+        dl::map_source( f->file, path );
+        if (dl::iscompressed( f->file )) {
+            throw dl::not_implemented(
+                "compressed files, decompress before opening"
+            );
+        }
+
+        f->stream.reset( new dl::stream( path ) );
+        if (dl::istapeimage( f->file )) {
+            f->tif.reset( new dl::tapeimage( f->file ) );
+            const auto sul = dl::findsul( *f->tif );
+            const auto vrl = dl::findvrl( *f->tif, sul + 80 );
+            f->offsets = dl::findoffsets( *f->tif, vrl );
+            f->stream->remap( *f->tif );
+        } else {
+            const auto sul = dl::findsul( f->file );
+            const auto vrl = dl::findvrl( f->file, sul + 80 );
+            f->offsets = dl::findoffsets( f->file, vrl );
+        }
+        f->stream->reindex( f->offsets.tells, f->offsets.residuals );
+
+        std::vector< bool > encrypted( f->offsets.tells.size(), false );
+        for (const auto& x : f->offsets.encrypted)
+            encrypted[ x.record ] = true;
+
+        /*
+         * Records before the first FILE-HEADER are put in the first logical
+         * file, so a new one is only started when the current one has seen
+         * a record
+         */
+        f->files.emplace_back();
+        bool seen = false;
+
+        dl::record rec;
+        for (std::size_t i = 0; i < f->offsets.tells.size(); ++i) {
+            if (encrypted[ i ]) continue;
+            if (not f->offsets.explicits[ i ]) {
+                f->files.back().implicits.push_back( int(i) );
+                seen = true;
+                continue;
+            }
+
+            f->stream->at( int(i), rec );
+            if (rec.isencrypted()) continue;
+
+            auto set = dl::parse_objects( rec.data.data(),
+                                          rec.data.data() + rec.data.size() );
+            const auto& type = dl::decay( set.type );
+            if (type == "FILE-HEADER" and seen)
+                f->files.emplace_back();
+            seen = true;
+
+            auto& lf = f->files.back();
+            for (auto& object : set.objects) {
+                if (type == "CHANNEL") {
+                    lf.channels.push_back( std::move( object ) );
+                } else if (type == "FRAME") {
+                    f->frames.emplace_back();
+                    f->frames.back().object = std::move( object );
+                    f->frames.back().file = f->files.size() - 1;
+                }
+            }
+        }
+
+        return DLIS_OK;
+    });
+}
+
+void dlis_file_close( dlis_file* f ) {
+    delete f;
+}
+
+const char* dlis_file_errmsg( const dlis_file* f ) {
+    if (not f) return "";
+    return f->error.c_str();
+}
+
+int dlis_file_nrecords( const dlis_file* f, int* count ) {
+    return guard( f, [f, count] {
+        if (not count) throw std::invalid_argument( "count is NULL" );
+        *count = int(f->offsets.tells.size());
+        return DLIS_OK;
+    });
+}
+
+int dlis_file_records( const dlis_file* f,
+                       size_t allocsize,
+                       long long* tells,
+                       int* residuals,
+                       int* explicits ) {
+    return guard( f, [=] {
+        const auto& offsets = f->offsets;
+        const auto n = offsets.tells.size();
+        if (allocsize < n) {
+            const auto msg = "allocsize too small, was {}, needs {}";
+            throw std::invalid_argument( fmt::format( msg, allocsize, n ) );
+        }
+
+        if (tells)
+            std::copy( offsets.tells.begin(), offsets.tells.end(), tells );
+        if (residuals)
+            std::copy( offsets.residuals.begin(), offsets.residuals.end(),
+                       residuals );
+        if (explicits)
+            std::copy( offsets.explicits.begin(), offsets.explicits.end(),
+                       explicits );
+        return DLIS_OK;
+    });
+}
+
+int dlis_file_nframes( const dlis_file* f, int* count ) {
+    return guard( f, [f, count] {
+        if (not count) throw std::invalid_argument( "count is NULL" );
+        *count = int(f->frames.size());
+        return DLIS_OK;
+    });
+}
+
+int dlis_file_frame_name( const dlis_file* f,
+                          int frame,
+                          char* id,
+                          size_t idsize,
+                          size_t* idlen,
+                          int32_t* origin,
+                          uint8_t* copynumber ) {
+    return guard( f, [=] {
+        const auto& info = getframe( f, frame );
+        copy_name( info.object.object_name,
+                   id, idsize, idlen, origin, copynumber );
+        return DLIS_OK;
+    });
+}
+
+int dlis_file_frame_nchannels( dlis_file* f, int frame, int* count ) {
+    return guard( f, [=] {
+        if (not count) throw std::invalid_argument( "count is NULL" );
+        *count = int(prepare( f, frame ).channels.size());
+        return DLIS_OK;
+    });
+}
+
+int dlis_file_channel( dlis_file* f,
+                       int frame,
+                       int channel,
+                       char* id,
+                       size_t idsize,
+                       size_t* idlen,
+                       int32_t* origin,
+                       uint8_t* copynumber,
+                       char* fmt,
+                       int* elements,
+                       size_t* itemsize ) {
+    return guard( f, [=] {
+        const auto& info = prepare( f, frame );
+        const auto nchannels = int(info.channels.size());
+        if (channel < -1 or channel >= nchannels) {
+            const auto msg = "channel {} out of range (channels = {})";
+            throw std::out_of_range(
+                fmt::format( msg, channel, nchannels )
+            );
+        }
+
+        if (channel == -1) {
+            copy_name( dl::obname{}, id, idsize, idlen, origin, copynumber );
+            if (fmt)      *fmt = DLIS_FMT_UVARI;
+            if (elements) *elements = 1;
+            if (itemsize) *itemsize = sizeof( std::int32_t );
+            return DLIS_OK;
+        }
+
+        const auto& ch = info.channels[ channel ];
+        copy_name( ch.name, id, idsize, idlen, origin, copynumber );
+        if (fmt)      *fmt = ch.fmt;
+        if (elements) *elements = ch.elements;
+        if (itemsize) *itemsize = ch.itemsize;
+        return DLIS_OK;
+    });
+}
+
+int dlis_file_frame_rows( dlis_file* f, int frame, int64_t* rows ) {
+    return guard( f, [=] {
+        if (not rows) throw std::invalid_argument( "rows is NULL" );
+        *rows = index( f, frame ).starts.back();
+        return DLIS_OK;
+    });
+}
+
+int dlis_file_read( dlis_file* f,
+                    int frame,
+                    int64_t first,
+                    int64_t count,
+                    int nchannels,
+                    const int* channels,
+                    void* const* dst,
+                    const size_t* dstsize,
+                    int64_t* nread ) {
+    return guard( f, [=] {
+        if (nchannels < 0 or first < 0 or count < 0)
+            throw std::invalid_argument( "expected non-negative "
+                                         "first, count and nchannels" );
+
+        if (nchannels > 0 and (not channels or not dst or not dstsize))
+            throw std::invalid_argument( "channels, dst or dstsize is NULL" );
+
+        const auto& info = index( f, frame );
+        if (info.varsize) {
+            const auto msg = "reading frames with variable-size values, "
+                             "format '{}'";
+            throw dl::not_implemented( fmt::format( msg, info.fmt ) );
+        }
+
+        const auto rows = info.starts.back();
+        if (first > rows) {
+            const auto msg = "first row {} out of range (rows = {})";
+            throw std::out_of_range( fmt::format( msg, first, rows ) );
+        }
+        const auto last = first + (std::min)( count, rows - first );
+
+        /*
+         * the size and offset of every value to read, in the packed frame.
+         * The frame number is not in the packed frame, so it is marked by
+         * the offset -1
+         */
+        struct column {
+            std::size_t size;
+            std::ptrdiff_t offset;
+            char* dst;
+        };
+
+        std::vector< column > columns;
+        for (int i = 0; i < nchannels; ++i) {
+            const auto ch = channels[ i ];
+            if (ch < -1 or ch >= int(info.channels.size())) {
+                const auto msg = "channel {} out of range (channels = {})";
+                throw std::out_of_range(
+                    fmt::format( msg, ch, info.channels.size() )
+                );
+            }
+
+            column col;
+            col.dst = static_cast< char* >( dst[ i ] );
+            if (ch == -1) {
+                col.size = sizeof( std::int32_t );
+                col.offset = -1;
+            } else {
+                const auto& chinfo = info.channels[ ch ];
+                col.size = chinfo.itemsize * chinfo.elements;
+                col.offset = std::ptrdiff_t( chinfo.offset );
+            }
+
+            const auto needs = std::uint64_t( col.size )
+                             * std::uint64_t( last - first );
+            if (not col.dst or dstsize[ i ] < needs) {
+                const auto msg = "buffer {} (channel {}) too small, "
+                                 "was {}, needs {}";
+                throw std::invalid_argument(
+                    fmt::format( msg, i, ch, dstsize[ i ], needs )
+                );
+            }
+
+            columns.push_back( col );
+        }
+
+        if (last > first) {
+            /*
+             * the records that hold [first, last). Every indexed record has
+             * at least one frame, so the starts are strictly increasing
+             */
+            const auto begin = std::upper_bound( info.starts.begin(),
+                                                 info.starts.end() - 1,
+                                                 first ) - 1;
+            const auto end = std::lower_bound( info.starts.begin(),
+                                               info.starts.end() - 1,
+                                               last );
+            const auto from = begin - info.starts.begin();
+            const auto to = end - info.starts.begin();
+
+            const std::vector< int > records( info.records.begin() + from,
+                                              info.records.begin() + to );
+
+            auto row = info.starts[ from ];
+            const auto visit = [&]( int, std::int32_t frame_number,
+                                    const char* packed ) {
+                if (row >= first and row < last) {
+                    const auto k = std::size_t( row - first );
+                    for (const auto& col : columns) {
+                        const char* src = col.offset < 0
+                            ? reinterpret_cast< const char* >( &frame_number )
+                            : packed + col.offset;
+                        std::memcpy( col.dst + k * col.size, src, col.size );
+                    }
+                }
+                row += 1;
+            };
+
+            dl::foreach_frame( *f->stream,
+                               records,
+                               info.object.object_name,
+                               info.fmt,
+                               visit );
+        }
+
+        if (nread) *nread = last - first;
+        return DLIS_OK;
+    });
+}
@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <dlisio/dlisio.h>
+#include <dlisio/types.h>
+
+#include <dlisio/ext/forward.hpp>
+#include <dlisio/ext/frame.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+namespace {
+
+/* larger than the largest visible record, so a whole segment always fits */
+const std::size_t buffer_size = 128 * 1024;
+
+/*
+ * The bounded buffer over the source. Bytes are consumed from the front, and
+ * the remaining bytes are moved back to the start before refilling
+ */
+class reader {
+public:
+    explicit reader( const byte_source& source ) noexcept (false) :
+        source( source ),
+        buffer( buffer_size )
+    {}
+
+    /* make n bytes available, or false if the source ends first */
+    bool fill( std::size_t n ) noexcept (false) {
+        if (this->available() >= n) return true;
+
+        if (this->head > 0) {
+            std::memmove( this->buffer.data(),
+                          this->buffer.data() + this->head,
+                          this->available() );
+            this->tail -= this->head;
+            this->head = 0;
+        }
+
+        while (this->available() < n and not this->eof) {
+            auto* dst = this->buffer.data() + this->tail;
+            const auto got = this->source( dst, this->buffer.size() - this->tail );
+            if (got == 0) this->eof = true;
+
+            this->tail += got;
+            this->bytes += got;
+        }
+
+        return this->available() >= n;
+    }
+
+    const char* data() const noexcept (true) {
+        return this->buffer.data() + this->head;
+    }
+
+    std::size_t available() const noexcept (true) {
+        return this->tail - this->head;
+    }
+
+    void consume( std::size_t n ) noexcept (true) {
+        this->head += n;
+    }
+
+    long long bytes = 0;
+
+private:
+    const byte_source& source;
+    std::vector< char > buffer;
+    std::size_t head = 0;
+    std::size_t tail = 0;
+    bool eof = false;
+};
+
+/*
+ * The FRAME objects seen so far, and the format strings of their frames,
+ * which are built when their first FDATA arrives
+ */
+struct frameinfo {
+    basic_object frame;
+    std::string fmt;
+    bool resolved = false;
+};
+
+class frames {
+public:
+    void add( const object_set& set ) noexcept (false) {
+        const auto& type = dl::decay( set.type );
+
+        /*
+         * Object names are only unique within a logical file, so a new
+         * logical file starts with no frames or channels, and frames are
+         * never decoded with channels of earlier logical files
+         */
+        if (type == "FILE-HEADER") {
+            this->known.clear();
+            this->channels.clear();
+            return;
+        }
+
+        if (type != "FRAME" and type != "CHANNEL") return;
+
+        /* new channels may complete frames that could not be resolved */
+        for (auto& info : this->known) info.resolved = false;
+
+        if (type == "CHANNEL") {
+            for (const auto& obj : set.objects) {
+                const auto eq = [&obj]( const basic_object& ch ) {
+                    return ch.object_name == obj.object_name;
+                };
+                auto itr = std::find_if( this->channels.begin(),
+                                         this->channels.end(),
+                                         eq );
+
+                if (itr == this->channels.end()) this->channels.push_back( obj );
+                else                             *itr = obj;
+            }
+            return;
+        }
+
+        for (const auto& obj : set.objects) {
+            const auto itr = this->find( obj.object_name );
+            frameinfo info;
+            info.frame = obj;
+
+            if (itr == this->known.end()) this->known.push_back( info );
+            else                          *itr = info;
+        }
+    }
+
+    /* the frame named name, or nullptr if it is unknown or incomplete */
+    const frameinfo* get( const obname& name ) noexcept (false) {
+        const auto itr = this->find( name );
+        if (itr == this->known.end()) return nullptr;
+
+        auto& info = *itr;
+        if (not info.resolved) {
+            /*
+             * Frames with missing channels, or channels with unknown
+             * representation codes, are not decoded, and their records are
+             * passed on as they are
+             */
+            try {
+                info.fmt = fmtstr( info.frame, this->channels );
+            } catch (const dl::not_found&) {
+                info.fmt.clear();
+            } catch (const std::invalid_argument&) {
+                info.fmt.clear();
+            }
+            info.resolved = true;
+        }
+
+        if (info.fmt.empty()) return nullptr;
+        return &info;
+    }
+
+private:
+    std::vector< frameinfo >::iterator find( const obname& name )
+    noexcept (true) {
+        const auto eq = [&name]( const frameinfo& info ) {
+            return info.frame.object_name == name;
+        };
+        return std::find_if( this->known.begin(), this->known.end(), eq );
+    }
+
+    std::vector< frameinfo > known;
+    object_vector channels;
+};
+
+/* the size of the uvari at xs, from the high bits of its first byte */
+std::ptrdiff_t uvarilen( const char* xs ) noexcept (true) {
+    const auto x = std::uint8_t( *xs );
+    if (not (x & 0x80)) return 1;
+    if (not (x & 0x40)) return 2;
+    return 4;
+}
+
+/* the size of the obname at xs, or 0 if it does not fit before end */
+std::ptrdiff_t obnamelen( const char* xs, const char* end ) noexcept (true) {
+    if (xs >= end) return 0;
+
+    /* origin, copy number and the length of the identifier */
+    const auto origin = uvarilen( xs );
+    if (std::distance( xs, end ) < origin + 2) return 0;
+
+    const auto len = origin + 2 + std::uint8_t( xs[ origin + 1 ] );
+    if (std::distance( xs, end ) < len) return 0;
+    return len;
+}
+
+void index_error( int err, int count ) noexcept (false) {
+    switch (err) {
+        case DLIS_TRUNCATED:
+            throw std::runtime_error( "file truncated" );
+
+        case DLIS_UNEXPECTED_VALUE: {
+            const auto msg = "record-length in record {} corrupted";
+            throw std::runtime_error(fmt::format(msg, count));
+        }
+
+        default:
+            throw std::runtime_error( "inconsistensies in record sizes" );
+    }
+}
+
+}
+
+forward_result read_forward( const byte_source& source,
+                             const forward_handler& handler )
+noexcept (false) {
+    reader in( source );
+
+    forward_result result;
+    result.records = 0;
+    result.frames = 0;
+
+    /*
+     * The storage unit label is within the first 200 bytes, and the first
+     * visible record within 200 bytes of the label
+     */
+    in.fill( 200 + DLIS_SUL_SIZE + 200 );
+    const auto sul = findsul( in.data(), in.available() );
+    if (std::size_t(sul) + DLIS_SUL_SIZE > in.available())
+        index_error( DLIS_TRUNCATED, 0 );
+
+    if (handler.label)
+        handler.label( std::string( in.data() + sul, DLIS_SUL_SIZE ) );
+
+    const auto vrl = findvrl( in.data(), in.available(), sul + DLIS_SUL_SIZE );
+    in.consume( vrl );
+
+    frames known;
+    std::vector< char > packed;
+
+    const auto decode = [&]( const record& rec ) {
+        const char* cur = rec.data.data();
+        const char* end = cur + rec.data.size();
+
+        /* records too short for the frame name are passed on as they are */
+        if (obnamelen( cur, end ) == 0) return false;
+
+        std::int32_t origin;
+        std::uint8_t copy;
+        std::int32_t idlen;
+        char id[ 256 ];
+        cur = dlis_obname( cur, &origin, &copy, &idlen, id );
+
+        const auto name = dl::obname {
+            dl::origin{ origin },
+            dl::ushort{ copy },
+            dl::ident{ std::string( id, id + idlen ) },
+        };
+
+        const auto* info = known.get( name );
+        if (not info) return false;
+
+        const auto& fmt = info->fmt;
+        while (cur < end) {
+            if (std::distance( cur, end ) < uvarilen( cur )) {
+                const auto msg = "read_forward: frame number in record {} "
+                                 "truncated"
+                ;
+                throw std::runtime_error(fmt::format(msg, result.records));
+            }
+
+            std::int32_t frame_number;
+            cur = dlis_uvari( cur, &frame_number );
+
+            int nread, nwrite;
+            dlis_packflen( fmt.c_str(), cur, &nread, &nwrite );
+
+            if (std::distance( cur, end ) < nread) {
+                const auto msg = "read_forward: frame {} in record {} "
+                                 "truncated, expected {} bytes, was {}"
+                ;
+                const auto left = std::distance( cur, end );
+                throw std::runtime_error(
+                    fmt::format(msg, frame_number, result.records, nread, left)
+                );
+            }
+
+            packed.resize( nwrite );
+            dlis_packf( fmt.c_str(), cur, packed.data() );
+            handler.frame( name, fmt, frame_number, packed.data(), nwrite );
+            result.frames += 1;
+            cur += nread;
+        }
+
+        return true;
+    };
+
+    const auto emit = [&]( const record& rec ) {
+        if (rec.isencrypted()) {
+            if (handler.record) handler.record( rec );
+            return;
+        }
+
+        if (rec.isexplicit()) {
+            if (not handler.objects and not handler.frame) return;
+
+            const auto* begin = rec.data.data();
+            const auto set = parse_objects( begin, begin + rec.data.size() );
+            if (handler.frame)   known.add( set );
+            if (handler.objects) handler.objects( set );
+            return;
+        }
+
+        if (rec.type == 0 and handler.frame and decode( rec )) return;
+        if (handler.record) handler.record( rec );
+    };
+
+    static const auto fmtenc = DLIS_SEGATTR_EXFMTLR | DLIS_SEGATTR_ENCRYPT;
+
+    record rec;
+    rec.data.reserve( 8192 );
+    rec.consistent = true;
+
+    int remaining = 0;
+    bool inrecord = false;
+
+    while (true) {
+        /*
+         * Like indexing, a visible record cut short by end-of-file is fine,
+         * as long as it ends between records
+         */
+        if (not inrecord and not in.fill( 1 )) break;
+
+        if (remaining == 0) {
+            if (not in.fill( DLIS_VRL_SIZE ))
+                index_error( DLIS_TRUNCATED, result.records );
+
+            int len, version;
+            const auto err = dlis_vrl( in.data(), &len, &version );
+            if (err) index_error( DLIS_INCONSISTENT, result.records );
+            if (len < 20) index_error( DLIS_UNEXPECTED_VALUE, result.records );
+
+            remaining = len - DLIS_VRL_SIZE;
+            in.consume( DLIS_VRL_SIZE );
+        }
+
+        if (not in.fill( DLIS_LRSH_SIZE ))
+            index_error( DLIS_TRUNCATED, result.records );
+
+        int len, type;
+        std::uint8_t attrs;
+        const auto err = dlis_lrsh( in.data(), &len, &attrs, &type );
+        if (err) index_error( DLIS_INCONSISTENT, result.records );
+        if (len < 16) index_error( DLIS_UNEXPECTED_VALUE, result.records );
+        if (len > remaining) index_error( DLIS_INCONSISTENT, result.records );
+
+        if (not in.fill( len ))
+            index_error( DLIS_TRUNCATED, result.records );
+
+        if (not inrecord) {
+            rec.type = type;
+            rec.attributes = attrs & fmtenc;
+            rec.data.clear();
+            inrecord = true;
+        }
+
+        const auto* body = in.data() + DLIS_LRSH_SIZE;
+        int size = len - DLIS_LRSH_SIZE;
+        if (attrs & DLIS_SEGATTR_TRAILEN) size -= 2;
+        if (attrs & DLIS_SEGATTR_CHCKSUM) size -= 2;
+        if ((attrs & DLIS_SEGATTR_PADDING) and size > 0) {
+            std::uint8_t padcount = 0;
+            dlis_ushort( body + size - 1, &padcount );
+            size -= padcount;
+        }
+
+        if (size > 0) rec.data.insert( rec.data.end(), body, body + size );
+
+        in.consume( len );
+        remaining -= len;
+
+        if (attrs & DLIS_SEGATTR_SUCCSEG) continue;
+
+        emit( rec );
+        result.records += 1;
+        inrecord = false;
+    }
+
+    result.bytes = in.bytes;
+    return result;
+}
+
+}
@@ -0,0 +1,662 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <dlisio/dlisio.h>
+#include <dlisio/types.h>
+
+#include <dlisio/ext/frame.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+char fmtchr( representation_code reprc ) noexcept (false) {
+    using rpc = dl::representation_code;
+    switch (reprc) {
+        case rpc::fshort: return DLIS_FMT_FSHORT;
+        case rpc::fsingl: return DLIS_FMT_FSINGL;
+        case rpc::fsing1: return DLIS_FMT_FSING1;
+        case rpc::fsing2: return DLIS_FMT_FSING2;
+        case rpc::isingl: return DLIS_FMT_ISINGL;
+        case rpc::vsingl: return DLIS_FMT_VSINGL;
+        case rpc::fdoubl: return DLIS_FMT_FDOUBL;
+        case rpc::fdoub1: return DLIS_FMT_FDOUB1;
+        case rpc::fdoub2: return DLIS_FMT_FDOUB2;
+        case rpc::csingl: return DLIS_FMT_CSINGL;
+        case rpc::cdoubl: return DLIS_FMT_CDOUBL;
+        case rpc::sshort: return DLIS_FMT_SSHORT;
+        case rpc::snorm:  return DLIS_FMT_SNORM;
+        case rpc::slong:  return DLIS_FMT_SLONG;
+        case rpc::ushort: return DLIS_FMT_USHORT;
+        case rpc::unorm:  return DLIS_FMT_UNORM;
+        case rpc::ulong:  return DLIS_FMT_ULONG;
+        case rpc::uvari:  return DLIS_FMT_UVARI;
+        case rpc::ident:  return DLIS_FMT_IDENT;
+        case rpc::ascii:  return DLIS_FMT_ASCII;
+        case rpc::dtime:  return DLIS_FMT_DTIME;
+        case rpc::origin: return DLIS_FMT_ORIGIN;
+        case rpc::obname: return DLIS_FMT_OBNAME;
+        case rpc::objref: return DLIS_FMT_OBJREF;
+        case rpc::attref: return DLIS_FMT_ATTREF;
+        case rpc::status: return DLIS_FMT_STATUS;
+        case rpc::units:  return DLIS_FMT_UNITS;
+        default: {
+            const auto msg = "fmtchr: unknown representation code {}";
+            const auto code = static_cast< int >(reprc);
+            throw std::invalid_argument(fmt::format(msg, code));
+        }
+    }
+}
+
+namespace {
+
+/*
+ * Get the value of an integral attribute, regardless of which of the integral
+ * representation codes it was written with. Writers aren't very consistent in
+ * what they use for REPRESENTATION-CODE and DIMENSION.
+ */
+struct integers {
+    template < typename T >
+    std::vector< int > operator () ( const std::vector< T >& xs ) const {
+        std::vector< int > out;
+        for (const auto& x : xs) out.push_back( dl::decay( x ) );
+        return out;
+    }
+
+    std::vector< int > operator () ( const mpark::monostate& ) const {
+        return {};
+    }
+
+    template < typename T >
+    std::vector< int > unsupported( const std::vector< T >& ) const {
+        const auto msg = "expected integer attribute, was {}";
+        const char* name = dl::typeinfo< T >::name;
+        throw std::invalid_argument(fmt::format(msg, name));
+    }
+
+    std::vector< int > operator () ( const std::vector< dl::ident >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::ascii >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::units >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::dtime >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::obname >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::objref >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::attref >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::csingl >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::cdoubl >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::fsing1 >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::fsing2 >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::fdoub1 >& x ) const {
+        return unsupported( x );
+    }
+    std::vector< int > operator () ( const std::vector< dl::fdoub2 >& x ) const {
+        return unsupported( x );
+    }
+};
+
+}
+
+std::vector< int > integer_attribute( const basic_object& obj,
+                                      const std::string& label )
+noexcept (false) {
+    try {
+        return mpark::visit( integers(), obj.at( label ).value );
+    } catch (const std::out_of_range&) {
+        return {};
+    }
+}
+
+std::string fmtstr( const basic_object& frame,
+                    const object_vector& channels ) noexcept (false) {
+    const auto& attr = frame.at( "CHANNELS" );
+    const auto* names = mpark::get_if< std::vector< dl::obname > >(
+        &attr.value
+    );
+
+    if (!names) return "";
+
+    std::string fmt;
+    for (const auto& name : *names) {
+        const auto eq = [&name]( const basic_object& ch ) {
+            return ch.object_name == name;
+        };
+
+        const auto ch = std::find_if( channels.begin(), channels.end(), eq );
+        if (ch == channels.end()) {
+            const auto msg = "fmtstr: channel {} (origin {}, copy {}) "
+                             "not found"
+            ;
+            throw dl::not_found(fmt::format(msg, dl::decay(name.id),
+                                                 dl::decay(name.origin),
+                                                 int(name.copy)));
+        }
+
+        /*
+         * 5.5.1 Static and Frame Data, CHANNEL objects
+         *  REPRESENTATION-CODE is required for channels in frames, but absent
+         *  DIMENSION means a single value
+         */
+        const auto reprc = integer_attribute( *ch, "REPRESENTATION-CODE" );
+        if (reprc.empty()) {
+            const auto msg = "fmtstr: channel {} has no representation code";
+            throw std::invalid_argument(fmt::format(msg, dl::decay(name.id)));
+        }
+
+        if (reprc.front() < DLIS_FSHORT || reprc.front() > DLIS_UNITS) {
+            const auto msg = "fmtstr: channel {} has invalid "
+                             "representation code {}"
+            ;
+            throw std::invalid_argument(fmt::format(msg, dl::decay(name.id),
+                                                         reprc.front()));
+        }
+
+        int elements = 1;
+        for (auto dim : integer_attribute( *ch, "DIMENSION" ))
+            elements *= dim;
+
+        const auto code = static_cast< representation_code >( reprc.front() );
+        fmt.append( elements, fmtchr( code ) );
+    }
+
+    return fmt;
+}
+
+namespace {
+
+template < typename T >
+double get( const char* packed ) noexcept (true) {
+    T x;
+    std::memcpy( &x, packed, sizeof( x ) );
+    return double( x );
+}
+
+}
+
+double packed_double( char fmt, const char* packed ) noexcept (false) {
+    switch (fmt) {
+        case DLIS_FMT_FSHORT:
+        case DLIS_FMT_FSINGL:
+        case DLIS_FMT_FSING1:
+        case DLIS_FMT_FSING2:
+        case DLIS_FMT_ISINGL:
+        case DLIS_FMT_VSINGL: return get< float >( packed );
+        case DLIS_FMT_FDOUBL:
+        case DLIS_FMT_FDOUB1:
+        case DLIS_FMT_FDOUB2: return get< double >( packed );
+        case DLIS_FMT_SSHORT: return get< std::int8_t >( packed );
+        case DLIS_FMT_SNORM:  return get< std::int16_t >( packed );
+        case DLIS_FMT_SLONG:  return get< std::int32_t >( packed );
+        case DLIS_FMT_USHORT: return get< std::uint8_t >( packed );
+        case DLIS_FMT_UNORM:  return get< std::uint16_t >( packed );
+        case DLIS_FMT_ULONG:  return get< std::uint32_t >( packed );
+        case DLIS_FMT_UVARI:
+        case DLIS_FMT_ORIGIN: return get< std::int32_t >( packed );
+        case DLIS_FMT_STATUS: return get< std::uint8_t >( packed );
+
+        default: {
+            const auto msg = "packed_double: format '{}' is not orderable";
+            throw std::invalid_argument(fmt::format(msg, fmt));
+        }
+    }
+}
+
+std::vector< std::size_t > packed_offsets( const std::string& fmt )
+noexcept (false) {
+    std::vector< std::size_t > offsets;
+    offsets.reserve( fmt.size() );
+
+    std::size_t offset = 0;
+    for (const auto f : fmt) {
+        const char spec[] = { f, DLIS_FMT_EOL };
+        int size;
+        const auto err = dlis_pack_size( spec, &size );
+
+        if (err) {
+            const auto msg = "packed_offsets: expected fixed-size format, "
+                             "but '{}' in '{}' is variable-size or invalid"
+            ;
+            throw std::invalid_argument(fmt::format(msg, f, fmt));
+        }
+
+        offsets.push_back( offset );
+        offset += size;
+    }
+
+    return offsets;
+}
+
+packed_layout::packed_layout( const std::string& fmt ) noexcept (false) :
+    fmt( fmt ), varsize( false )
+{
+    this->sizes.reserve( fmt.size() );
+    for (const auto f : fmt) {
+        const char spec[] = { f, DLIS_FMT_EOL };
+        int size;
+        const auto err = dlis_pack_size( spec, &size );
+
+        switch (err) {
+            case DLIS_OK:
+                this->sizes.push_back( size );
+                break;
+
+            case DLIS_INCONSISTENT:
+                this->sizes.push_back( -1 );
+                this->varsize = true;
+                break;
+
+            default: {
+                const auto msg = "packed_layout: invalid format '{}' in '{}'";
+                throw std::invalid_argument(fmt::format(msg, f, fmt));
+            }
+        }
+    }
+
+    this->offsets.resize( fmt.size() );
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < fmt.size(); ++i) {
+        this->offsets[ i ] = offset;
+        if (this->sizes[ i ] < 0) break;
+        offset += this->sizes[ i ];
+    }
+}
+
+const std::vector< std::size_t >& packed_layout::at( const char* packed )
+noexcept (false) {
+    if (!this->varsize) return this->offsets;
+
+    /*
+     * dlis_packf writes strings as an int32 length followed by the bytes, and
+     * object names as origin (int32), copy (uint8) and the ident string
+     */
+    std::size_t offset = 0;
+    const auto skipstr = [packed, &offset] {
+        std::int32_t len;
+        std::memcpy( &len, packed + offset, sizeof( len ) );
+        offset += sizeof( len ) + len;
+    };
+    const auto skipname = [&skipstr, &offset] {
+        offset += sizeof( std::int32_t ) + sizeof( std::uint8_t );
+        skipstr();
+    };
+
+    for (std::size_t i = 0; i < this->fmt.size(); ++i) {
+        this->offsets[ i ] = offset;
+
+        if (this->sizes[ i ] >= 0) {
+            offset += this->sizes[ i ];
+            continue;
+        }
+
+        switch (this->fmt[ i ]) {
+            case DLIS_FMT_IDENT:
+            case DLIS_FMT_ASCII:
+            case DLIS_FMT_UNITS:
+                skipstr();
+                break;
+
+            case DLIS_FMT_OBNAME:
+                skipname();
+                break;
+
+            case DLIS_FMT_OBJREF:
+                skipstr();
+                skipname();
+                break;
+
+            case DLIS_FMT_ATTREF:
+                skipstr();
+                skipname();
+                skipstr();
+                break;
+
+            default: {
+                const auto msg = "packed_layout: unexpected variable-size "
+                                 "format '{}'"
+                ;
+                throw std::invalid_argument(fmt::format(msg, this->fmt[ i ]));
+            }
+        }
+    }
+
+    return this->offsets;
+}
+
+std::vector< int > orderable_columns( const std::string& fmt,
+                                      const std::vector< int >& columns )
+noexcept (false) {
+    std::vector< int > orderable;
+    for (const auto col : columns) {
+        if (col < 0 || std::size_t(col) >= fmt.size()) {
+            const auto msg = "column {} out of range, "
+                             "expected 0 <= column < {}"
+            ;
+            throw std::out_of_range(fmt::format(msg, col, fmt.size()));
+        }
+
+        const char zeros[ sizeof(double) * 3 ] = {};
+        try {
+            packed_double( fmt[ col ], zeros );
+        } catch (const std::invalid_argument&) {
+            continue;
+        }
+
+        orderable.push_back( col );
+    }
+
+    return orderable;
+}
+
+namespace {
+
+/* the size of the uvari at xs, from the high bits of its first byte */
+std::ptrdiff_t uvarilen( const char* xs ) noexcept (true) {
+    const auto x = std::uint8_t( *xs );
+    if (not (x & 0x80)) return 1;
+    if (not (x & 0x40)) return 2;
+    return 4;
+}
+
+/* the size of the ident at xs, or 0 if it does not fit before end */
+std::ptrdiff_t identlen( const char* xs, const char* end ) noexcept (true) {
+    if (xs >= end) return 0;
+
+    const auto len = 1 + std::uint8_t( *xs );
+    if (std::distance( xs, end ) < len) return 0;
+    return len;
+}
+
+/* the size of the obname at xs, or 0 if it does not fit before end */
+std::ptrdiff_t obnamelen( const char* xs, const char* end ) noexcept (true) {
+    if (xs >= end) return 0;
+
+    /* origin, copy number and the length of the identifier */
+    const auto origin = uvarilen( xs );
+    if (std::distance( xs, end ) < origin + 2) return 0;
+
+    const auto len = origin + 2 + std::uint8_t( xs[ origin + 1 ] );
+    if (std::distance( xs, end ) < len) return 0;
+    return len;
+}
+
+/*
+ * Check that the frame at xs, formatted as fmt, fits before end. The size of
+ * uvaris and variable-size values is read from the values themselves, which
+ * dlis_packflen does without knowing where the record ends, so this must be
+ * checked before calling it.
+ */
+bool fits( const char* fmt, const char* xs, const char* end ) noexcept (true) {
+    for (; *fmt != DLIS_FMT_EOL; ++fmt) {
+        std::ptrdiff_t len = 0;
+        switch (*fmt) {
+            case DLIS_FMT_UVARI:
+            case DLIS_FMT_ORIGIN:
+                if (xs >= end) return false;
+                len = uvarilen( xs );
+                break;
+
+            case DLIS_FMT_IDENT:
+            case DLIS_FMT_UNITS:
+                len = identlen( xs, end );
+                if (len == 0) return false;
+                break;
+
+            case DLIS_FMT_ASCII: {
+                if (xs >= end) return false;
+                if (std::distance( xs, end ) < uvarilen( xs )) return false;
+                std::int32_t size;
+                const auto* cur = dlis_uvari( xs, &size );
+                len = std::distance( xs, cur ) + size;
+                break;
+            }
+
+            case DLIS_FMT_OBNAME:
+                len = obnamelen( xs, end );
+                if (len == 0) return false;
+                break;
+
+            case DLIS_FMT_OBJREF: {
+                const auto type = identlen( xs, end );
+                if (type == 0) return false;
+                const auto name = obnamelen( xs + type, end );
+                if (name == 0) return false;
+                len = type + name;
+                break;
+            }
+
+            case DLIS_FMT_ATTREF: {
+                const auto type = identlen( xs, end );
+                if (type == 0) return false;
+                const auto name = obnamelen( xs + type, end );
+                if (name == 0) return false;
+                const auto label = identlen( xs + type + name, end );
+                if (label == 0) return false;
+                len = type + name + label;
+                break;
+            }
+
+            default: {
+                /* fixed size, so the source is not read */
+                const char spec[] = { *fmt, DLIS_FMT_EOL };
+                int nread;
+                if (dlis_packflen( spec, xs, &nread, nullptr ) != DLIS_OK)
+                    return false;
+                len = nread;
+                break;
+            }
+        }
+
+        if (std::distance( xs, end ) < len) return false;
+        xs += len;
+    }
+
+    return true;
+}
+
+}
+
+void foreach_frame( stream& file,
+                    const std::vector< int >& records,
+                    const dl::obname& frame,
+                    const std::string& fmt,
+                    const frame_visitor& visit )
+noexcept (false) {
+    int varsize;
+    if (dlis_pack_varsize( fmt.c_str(), &varsize ) != DLIS_OK) {
+        const auto msg = "foreach_frame: invalid format string '{}'";
+        throw std::invalid_argument(fmt::format(msg, fmt));
+    }
+
+    /*
+     * For fixed-size frames the packed size is known up front, and only the
+     * source length (which depends on uvaris) must be computed per frame
+     */
+    int packsize = 0;
+    if (!varsize) dlis_pack_size( fmt.c_str(), &packsize );
+    std::vector< char > packed( packsize );
+
+    /*
+     * Frames with uvaris or variable-size values must be checked against the
+     * end of the record before dlis_packflen reads their sizes
+     */
+    const auto prefixed = varsize
+                       or fmt.find( DLIS_FMT_UVARI )  != std::string::npos
+                       or fmt.find( DLIS_FMT_ORIGIN ) != std::string::npos
+    ;
+
+    record rec;
+    rec.data.reserve( 8192 );
+
+    for (const auto i : records) {
+        file.at( i, rec );
+
+        if (rec.isexplicit())  continue;
+        if (rec.isencrypted()) continue;
+        if (rec.type != 0)     continue;
+
+        const char* cur = rec.data.data();
+        const char* end = cur + rec.data.size();
+        if (cur == end) continue;
+
+        if (obnamelen( cur, end ) == 0) {
+            const auto msg = "foreach_frame: frame name in record {} truncated";
+            throw std::runtime_error(fmt::format(msg, i));
+        }
+
+        std::int32_t origin;
+        std::uint8_t copy;
+        std::int32_t idlen;
+        char id[ 256 ];
+        cur = dlis_obname( cur, &origin, &copy, &idlen, id );
+
+        const auto name = dl::obname {
+            dl::origin{ origin },
+            dl::ushort{ copy },
+            dl::ident{ std::string( id, id + idlen ) },
+        };
+
+        if (!(name == frame)) continue;
+
+        while (cur < end) {
+            if (std::distance( cur, end ) < uvarilen( cur )) {
+                const auto msg = "foreach_frame: frame number in record {} "
+                                 "truncated"
+                ;
+                throw std::runtime_error(fmt::format(msg, i));
+            }
+
+            std::int32_t frame_number;
+            cur = dlis_uvari( cur, &frame_number );
+
+            if (prefixed and not fits( fmt.c_str(), cur, end )) {
+                const auto msg = "foreach_frame: frame {} in record {} "
+                                 "truncated"
+                ;
+                throw std::runtime_error(fmt::format(msg, frame_number, i));
+            }
+
+            int nread, nwrite;
+            const auto err = dlis_packflen( fmt.c_str(), cur, &nread, &nwrite );
+            if (err != DLIS_OK) {
+                const auto msg = "foreach_frame: invalid format string '{}'";
+                throw std::invalid_argument(fmt::format(msg, fmt));
+            }
+
+            if (std::distance( cur, end ) < nread) {
+                const auto msg = "foreach_frame: frame {} in record {} "
+                                 "truncated, expected {} bytes, was {}"
+                ;
+                const auto left = std::distance( cur, end );
+                throw std::runtime_error(
+                    fmt::format(msg, frame_number, i, nread, left)
+                );
+            }
+
+            if (varsize) packed.resize( nwrite );
+            dlis_packf( fmt.c_str(), cur, packed.data() );
+            visit( i, frame_number, packed.data() );
+            cur += nread;
+        }
+    }
+}
+
+std::vector< int > zonemap::candidates( int column,
+                                        double lo,
+                                        double hi ) const noexcept (false) {
+    const auto itr = std::find( this->columns.begin(),
+                                this->columns.end(),
+                                column );
+
+    if (itr == this->columns.end()) {
+        const auto msg = "candidates: column {} is not in the zone map";
+        throw std::out_of_range(fmt::format(msg, column));
+    }
+
+    const auto pos = std::distance( this->columns.begin(), itr );
+
+    std::vector< int > records;
+    for (const auto& z : this->zones) {
+        if (z.max[ pos ] < lo) continue;
+        if (z.min[ pos ] > hi) continue;
+        records.push_back( z.record );
+    }
+
+    return records;
+}
+
+zonemap build_zonemap( stream& file,
+                       const std::vector< int >& records,
+                       const dl::obname& frame,
+                       const std::string& fmt,
+                       const std::vector< int >& selected )
+noexcept (false) {
+    packed_layout layout( fmt );
+    const auto columns = orderable_columns( fmt, selected );
+
+    zonemap zm;
+    zm.frame = frame;
+    zm.fmt = fmt;
+    zm.columns = columns;
+
+    const auto inf = std::numeric_limits< double >::infinity();
+
+    const auto visit = [&]( int record,
+                            std::int32_t frame_number,
+                            const char* packed ) {
+        if (zm.zones.empty() || zm.zones.back().record != record) {
+            zone z;
+            z.record = record;
+            z.frames = 0;
+            z.first = frame_number;
+            z.last = frame_number;
+            z.min.assign( columns.size(),  inf );
+            z.max.assign( columns.size(), -inf );
+            zm.zones.push_back( std::move( z ) );
+        }
+
+        auto& z = zm.zones.back();
+        z.frames += 1;
+        z.last = frame_number;
+
+        const auto& offsets = layout.at( packed );
+        for (std::size_t i = 0; i < columns.size(); ++i) {
+            const auto col = columns[ i ];
+            const auto x = packed_double( fmt[ col ], packed + offsets[ col ] );
+            if (std::isnan( x )) continue;
+            z.min[ i ] = (std::min)( z.min[ i ], x );
+            z.max[ i ] = (std::max)( z.max[ i ], x );
+        }
+    };
+
+    foreach_frame( file, records, frame, fmt, visit );
+    return zm;
+}
+
+}
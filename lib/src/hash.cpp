@@ -0,0 +1,151 @@
+#include <cstdint>
+#include <cstring>
+
+#include <dlisio/ext/hash.hpp>
+
+namespace dl {
+
+namespace {
+
+const std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+const std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+const std::uint64_t prime3 = 0x165667B19E3779F9ULL;
+const std::uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+const std::uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+std::uint64_t rotl( std::uint64_t x, int r ) noexcept (true) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/*
+ * The input is read as little-endian words, regardless of the host. The
+ * shifts are recognised by compilers and become plain loads on
+ * little-endian machines.
+ */
+std::uint64_t read64( const unsigned char* p ) noexcept (true) {
+    return std::uint64_t(p[0])       | std::uint64_t(p[1]) <<  8
+         | std::uint64_t(p[2]) << 16 | std::uint64_t(p[3]) << 24
+         | std::uint64_t(p[4]) << 32 | std::uint64_t(p[5]) << 40
+         | std::uint64_t(p[6]) << 48 | std::uint64_t(p[7]) << 56;
+}
+
+std::uint64_t read32( const unsigned char* p ) noexcept (true) {
+    return std::uint64_t(p[0])       | std::uint64_t(p[1]) <<  8
+         | std::uint64_t(p[2]) << 16 | std::uint64_t(p[3]) << 24;
+}
+
+std::uint64_t mix( std::uint64_t acc, std::uint64_t input ) noexcept (true) {
+    acc += input * prime2;
+    acc  = rotl( acc, 31 );
+    return acc * prime1;
+}
+
+std::uint64_t merge( std::uint64_t acc, std::uint64_t val ) noexcept (true) {
+    acc ^= mix( 0, val );
+    return acc * prime1 + prime4;
+}
+
+const unsigned char* stripes( std::uint64_t* acc,
+                              const unsigned char* p,
+                              const unsigned char* end )
+noexcept (true) {
+    while (end - p >= 32) {
+        acc[ 0 ] = mix( acc[ 0 ], read64( p +  0 ) );
+        acc[ 1 ] = mix( acc[ 1 ], read64( p +  8 ) );
+        acc[ 2 ] = mix( acc[ 2 ], read64( p + 16 ) );
+        acc[ 3 ] = mix( acc[ 3 ], read64( p + 24 ) );
+        p += 32;
+    }
+    return p;
+}
+
+}
+
+xxh64::xxh64( std::uint64_t seed ) noexcept (true) : seed( seed ) {
+    this->acc[ 0 ] = seed + prime1 + prime2;
+    this->acc[ 1 ] = seed + prime2;
+    this->acc[ 2 ] = seed;
+    this->acc[ 3 ] = seed - prime1;
+}
+
+void xxh64::update( const char* data, std::size_t size ) noexcept (true) {
+    if (size == 0) return;
+
+    auto p = reinterpret_cast< const unsigned char* >( data );
+    const auto end = p + size;
+    this->total += size;
+
+    if (this->buffered + size < 32) {
+        std::memcpy( this->buffer + this->buffered, p, size );
+        this->buffered += size;
+        return;
+    }
+
+    if (this->buffered > 0) {
+        const auto fill = 32 - this->buffered;
+        std::memcpy( this->buffer + this->buffered, p, fill );
+        stripes( this->acc, this->buffer, this->buffer + 32 );
+        p += fill;
+        this->buffered = 0;
+    }
+
+    p = stripes( this->acc, p, end );
+
+    this->buffered = end - p;
+    if (this->buffered > 0)
+        std::memcpy( this->buffer, p, this->buffered );
+}
+
+std::uint64_t xxh64::digest() const noexcept (true) {
+    std::uint64_t h;
+
+    if (this->total >= 32) {
+        const auto* acc = this->acc;
+        h = rotl( acc[ 0 ],  1 ) + rotl( acc[ 1 ],  7 )
+          + rotl( acc[ 2 ], 12 ) + rotl( acc[ 3 ], 18 );
+        h = merge( h, acc[ 0 ] );
+        h = merge( h, acc[ 1 ] );
+        h = merge( h, acc[ 2 ] );
+        h = merge( h, acc[ 3 ] );
+    } else {
+        h = this->seed + prime5;
+    }
+
+    h += this->total;
+
+    const auto* p = this->buffer;
+    const auto* end = this->buffer + this->buffered;
+
+    for (; end - p >= 8; p += 8) {
+        h ^= mix( 0, read64( p ) );
+        h  = rotl( h, 27 ) * prime1 + prime4;
+    }
+
+    for (; end - p >= 4; p += 4) {
+        h ^= read32( p ) * prime1;
+        h  = rotl( h, 23 ) * prime2 + prime3;
+    }
+
+    for (; p < end; ++p) {
+        h ^= *p * prime5;
+        h  = rotl( h, 11 ) * prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::uint64_t xxh64sum( const char* data,
+                        std::size_t size,
+                        std::uint64_t seed )
+noexcept (true) {
+    xxh64 h( seed );
+    h.update( data, size );
+    return h.digest();
+}
+
+}
@@ -1,9 +1,15 @@
 #include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <ciso646>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <fstream>
+#include <iterator>
 #include <string>
 #include <system_error>
+#include <thread>
 #include <vector>
 
 #include <fmt/core.h>
@@ -13,7 +19,9 @@
 #include <dlisio/dlisio.h>
 #include <dlisio/types.h>
 
+#include <dlisio/ext/hash.hpp>
 #include <dlisio/ext/io.hpp>
+#include <dlisio/ext/zindex.hpp>
 
 namespace dl {
 
@@ -32,7 +40,12 @@ void map_source( mio::mmap_source& file, const std::string& path ) noexcept (fal
         throw std::invalid_argument( "non-existent or empty file" );
 }
 
-long long findsul( mio::mmap_source& file ) noexcept (false) {
+/*
+ * The searches for the SUL and first VRL work on plain buffers, so that they
+ * can be shared by the memory mapped file and the readers that read small
+ * blocks
+ */
+long long findsul( const char* first, std::size_t size ) noexcept (false) {
     /*
      * search at most 200 bytes, looking for the SUL
      *
@@ -45,8 +58,7 @@ long long findsul( mio::mmap_source& file ) noexcept (false) {
     static const auto needle = "RECORD";
     static const std::size_t search_limit = 200;
 
-    const auto first = file.data();
-    const auto last = first + (std::min)( file.size(), search_limit );
+    const auto last = first + (std::min)( size, search_limit );
     auto itr = std::search( first, last, needle, needle + 6 );
 
     if (itr == last) {
@@ -66,10 +78,11 @@ long long findsul( mio::mmap_source& file ) noexcept (false) {
         throw std::runtime_error(fmt::format(msg, pos));
     }
 
-    return std::distance( file.data(), itr - structure_offset );
+    return std::distance( first, itr - structure_offset );
 }
 
-long long findvrl( mio::mmap_source& file, long long from ) noexcept (false) {
+long long findvrl( const char* data, std::size_t size, long long from )
+noexcept (false) {
     /*
      * The first VRL does sometimes not immediately follow the SUL (or whatever
      * came before it), but according to spec it should be a triple of
@@ -85,17 +98,17 @@ long long findvrl( mio::mmap_source& file, long long from ) noexcept (false) {
         throw std::out_of_range(fmt::format(msg, from));
     }
 
-    if (std::size_t(from) > file.size()) {
+    if (std::size_t(from) > size) {
         const auto msg = "expected from (which is {}) "
                          "<= file.size() (which is {})"
         ;
-        throw std::out_of_range(fmt::format(msg, from, file.size()));
+        throw std::out_of_range(fmt::format(msg, from, size));
     }
 
     static const unsigned char needle[] = { 0xFF, 0x01 };
     static const auto search_limit = 200;
 
-    const auto limit = std::min< long long >(file.size() - from, search_limit);
+    const auto limit = std::min< long long >(size - from, search_limit);
 
     /*
      * reinterpret the bytes as usigned char*. This is compatible and fine.
@@ -104,7 +117,7 @@ long long findvrl( mio::mmap_source& file, long long from ) noexcept (false) {
      * to int, so all of a sudden (char)0xFF != (unsigned char)0xFF. Forcing
      * the pointer to be unsigend char fixes this issue.
      */
-    const auto front = reinterpret_cast< const unsigned char* >(file.data());
+    const auto front = reinterpret_cast< const unsigned char* >(data);
     const auto first = front + from;
     const auto last = first + limit;
     const auto itr = std::search(first, last, needle, needle + sizeof(needle));
@@ -129,15 +142,377 @@ long long findvrl( mio::mmap_source& file, long long from ) noexcept (false) {
     return std::distance(front, itr - DLIS_SIZEOF_UNORM);
 }
 
-stream_offsets findoffsets( mio::mmap_source& file, long long from )
+long long findsul( mio::mmap_source& file ) noexcept (false) {
+    return findsul( file.data(), file.size() );
+}
+
+long long findvrl( mio::mmap_source& file, long long from ) noexcept (false) {
+    return findvrl( file.data(), file.size(), from );
+}
+
+namespace {
+
+struct tapemark {
+    std::uint32_t type;
+    std::uint32_t prev;
+    std::uint32_t next;
+};
+
+const long long tapemark_size = 12;
+
+tapemark read_tapemark( const char* xs ) noexcept (true) {
+    /* tape marks are little-endian, regardless of the host */
+    const auto u32 = []( const char* p ) {
+        const auto* u = reinterpret_cast< const unsigned char* >( p );
+        return std::uint32_t( u[ 0 ] )
+             | std::uint32_t( u[ 1 ] ) << 8
+             | std::uint32_t( u[ 2 ] ) << 16
+             | std::uint32_t( u[ 3 ] ) << 24
+        ;
+    };
+
+    tapemark mark;
+    mark.type = u32( xs );
+    mark.prev = u32( xs + 4 );
+    mark.next = u32( xs + 8 );
+    return mark;
+}
+
+}
+
+bool istapeimage( const mio::mmap_source& file ) noexcept (true) {
+    /*
+     * A DLIS file starts with the storage unit label, which is ascii, and
+     * its bytes 4-7 can never be all zero like the first tape mark's
+     * previous-offset. Check that the second tape mark points back to the
+     * first too, to be sure
+     */
+    const auto size = (long long)file.size();
+    if (size < 2 * tapemark_size) return false;
+
+    const auto head = read_tapemark( file.data() );
+    if (head.type > 1 or head.prev != 0) return false;
+    if (head.next < tapemark_size) return false;
+    if (head.next + tapemark_size > size) return false;
+
+    const auto second = read_tapemark( file.data() + head.next );
+    return second.type <= 1 and second.prev == 0;
+}
+
+tapeimage::tapeimage( const mio::mmap_source& file ) noexcept (false) :
+    data( file.data() )
+{
+    if (not istapeimage( file ))
+        throw std::invalid_argument( "file is not a tape image (TIF)" );
+
+    const auto size = (long long)file.size();
+    const auto low = 0xFFFFFFFFLL;
+
+    long long pos = 0;
+    long long prev = 0;
+    long long logical = 0;
+
+    while (pos + tapemark_size <= size) {
+        const auto mark = read_tapemark( this->data + pos );
+
+        if (mark.type > 1) {
+            const auto msg = "tapeimage: invalid tape mark type {} at {}";
+            throw std::runtime_error(fmt::format(msg, mark.type, pos));
+        }
+
+        if (mark.prev != (prev & low)) {
+            const auto msg = "tapeimage: tape mark at {} points back to {}, "
+                             "expected {}"
+            ;
+            const auto expected = prev & low;
+            throw std::runtime_error(fmt::format(msg, pos, mark.prev, expected));
+        }
+
+        /* the offsets are 32-bit, so restore the high bits in large files */
+        auto next = (pos & ~low) | mark.next;
+        if (next < pos + tapemark_size) next += low + 1;
+
+        /*
+         * Trailing tape marks often point past end-of-file. A data record
+         * that does is truncated, so keep what is there, and leave it to
+         * indexing to decide if the DLIS stream is complete
+         */
+        const auto end = (std::min)( next, size );
+        const auto len = end - (pos + tapemark_size);
+
+        if (mark.type == 0 and len > 0) {
+            tapeimage_chunk chunk;
+            chunk.logical = logical;
+            chunk.physical = pos + tapemark_size;
+            chunk.size = len;
+            this->table.push_back( chunk );
+            logical += len;
+        }
+
+        prev = pos;
+        pos = next;
+    }
+
+    if (this->table.empty())
+        throw std::runtime_error( "tapeimage: no data records" );
+}
+
+long long tapeimage::size() const noexcept (true) {
+    const auto& last = this->table.back();
+    return last.logical + last.size;
+}
+
+std::vector< tapeimage_chunk >::const_iterator
+tapeimage::find( long long logical ) const noexcept (false) {
+    if (logical < 0 or logical >= this->size()) {
+        const auto msg = "expected 0 <= offset (which is {}) < size "
+                         "(which is {})"
+        ;
+        throw std::out_of_range(fmt::format(msg, logical, this->size()));
+    }
+
+    const auto cmp = []( long long x, const tapeimage_chunk& chunk ) {
+        return x < chunk.logical;
+    };
+
+    auto itr = std::upper_bound( this->table.begin(),
+                                 this->table.end(),
+                                 logical,
+                                 cmp );
+    return std::prev( itr );
+}
+
+long long tapeimage::physical( long long logical ) const noexcept (false) {
+    const auto chunk = this->find( logical );
+    return chunk->physical + (logical - chunk->logical);
+}
+
+void tapeimage::read( char* dst, long long logical, std::size_t n )
+noexcept (false) {
+    if (n == 0) return;
+
+    if (logical + (long long)n > this->size()) {
+        const auto msg = "tapeimage: read of {} bytes at {} past end (at {})";
+        throw std::out_of_range(fmt::format(msg, n, logical, this->size()));
+    }
+
+    auto chunk = this->find( logical );
+    while (n > 0) {
+        const auto skip = logical - chunk->logical;
+        const auto len = std::size_t( (std::min)( chunk->size - skip,
+                                                  (long long)n ) );
+        std::copy_n( this->data + chunk->physical + skip, len, dst );
+
+        dst += len;
+        logical += len;
+        n -= len;
+        ++chunk;
+    }
+}
+
+const std::vector< tapeimage_chunk >& tapeimage::chunks() const
+noexcept (true) {
+    return this->table;
+}
+
+/*
+ * The storage unit label and first visible record are close to the start of
+ * the DLIS stream, so search a small copy of it
+ */
+long long findsul( logical_file& file ) noexcept (false) {
+    std::vector< char > head( (std::min)( file.size(), 200LL ) );
+    file.read( head.data(), 0, head.size() );
+    return findsul( head.data(), head.size() );
+}
+
+long long findvrl( logical_file& file, long long from ) noexcept (false) {
+    const auto size = (std::min)( file.size(), (std::max)( from, 0LL ) + 200 );
+    std::vector< char > head( size );
+    file.read( head.data(), 0, head.size() );
+    return findvrl( head.data(), head.size(), from );
+}
+
+namespace {
+
+void check_index_error( int err, int count ) noexcept (false) {
+    switch (err) {
+        case DLIS_OK: return;
+
+        case DLIS_TRUNCATED:
+            throw std::runtime_error( "file truncated" );
+
+        case DLIS_INCONSISTENT:
+            throw std::runtime_error( "inconsistensies in record sizes" );
+
+        case DLIS_UNEXPECTED_VALUE: {
+            // TODO: interrogate more?
+            const auto msg = "record-length in record {} corrupted";
+            throw std::runtime_error(fmt::format(msg, count));
+        }
+
+        default: {
+            const auto msg = "dlis_index_records: unknown error {}";
+            throw std::runtime_error(fmt::format(msg, err));
+        }
+    }
+}
+
+}
+
+namespace {
+
+struct hashed_record {
+    std::uint64_t hash;
+    int type;
+    bool isexplicit;
+};
+
+/*
+ * Hash the logical record starting at ptr, with remaining bytes left of the
+ * visible record. The record has already been indexed (and its segments
+ * verified to be within the file) by dlis_index_records, so this follows the
+ * same segment lengths without checking them again.
+ */
+hashed_record hash_record( const char* ptr, int remaining ) noexcept (true) {
+    static const auto fmtenc = DLIS_SEGATTR_EXFMTLR | DLIS_SEGATTR_ENCRYPT;
+
+    xxh64 h;
+    hashed_record rec;
+    bool first = true;
+
+    while (true) {
+        if (remaining == 0) {
+            int len, version;
+            dlis_vrl( ptr, &len, &version );
+            remaining = len - DLIS_VRL_SIZE;
+            ptr += DLIS_VRL_SIZE;
+        }
+
+        int len, type;
+        std::uint8_t attrs;
+        dlis_lrsh( ptr, &len, &attrs, &type );
+
+        if (first) {
+            const char header[] = { char(type), char(attrs & fmtenc) };
+            h.update( header, sizeof( header ) );
+            rec.type = type;
+            rec.isexplicit = attrs & DLIS_SEGATTR_EXFMTLR;
+            first = false;
+        }
+
+        const auto* body = ptr + DLIS_LRSH_SIZE;
+        int size = len - DLIS_LRSH_SIZE;
+        if (attrs & DLIS_SEGATTR_TRAILEN) size -= 2;
+        if (attrs & DLIS_SEGATTR_CHCKSUM) size -= 2;
+        if ((attrs & DLIS_SEGATTR_PADDING) and size > 0) {
+            std::uint8_t padcount = 0;
+            dlis_ushort( body + size - 1, &padcount );
+            size -= padcount;
+        }
+
+        if (size > 0) h.update( body, size );
+
+        ptr += len;
+        remaining -= len;
+        if (not (attrs & DLIS_SEGATTR_SUCCSEG)) break;
+    }
+
+    rec.hash = h.digest();
+    return rec;
+}
+
+/*
+ * Accumulates the record hashes, and the logical file hashes over them, as
+ * records are indexed
+ */
+class record_hasher {
+public:
+    explicit record_hasher( record_hashes& out ) noexcept (true) : out( out ) {}
+
+    void add( const char* ptr, int remaining ) noexcept (false) {
+        const auto rec = hash_record( ptr, remaining );
+        const auto i = int(this->out.records.size());
+
+        const auto fileheader = rec.isexplicit and rec.type == DLIS_FHLR;
+        if (i == 0 or (fileheader and i != this->first)) {
+            if (i != 0) this->out.files.push_back( this->file.digest() );
+            this->out.logical_files.push_back( i );
+            this->file = xxh64();
+            this->first = i;
+        }
+
+        /* fixed byte order, so logical file hashes are portable */
+        char bytes[ sizeof( rec.hash ) ];
+        for (std::size_t k = 0; k < sizeof( bytes ); ++k)
+            bytes[ k ] = char(rec.hash >> (8 * k));
+
+        this->file.update( bytes, sizeof( bytes ) );
+        this->out.records.push_back( rec.hash );
+    }
+
+    void finish() noexcept (false) {
+        if (not this->out.records.empty())
+            this->out.files.push_back( this->file.digest() );
+    }
+
+private:
+    record_hashes& out;
+    xxh64 file;
+    int first = 0;
+};
+
+/*
+ * Note the record if it is encrypted. lrsh is the header of its first
+ * segment, followed by at least 4 bytes of body, which always holds since
+ * segments are at least 16 bytes
+ */
+void note_encrypted( const char* lrsh,
+                     int record,
+                     std::vector< encrypted_record >& out )
+noexcept (false) {
+    int len, type;
+    std::uint8_t attrs;
+    dlis_lrsh( lrsh, &len, &attrs, &type );
+    if (not (attrs & DLIS_SEGATTR_ENCRYPT)) return;
+
+    encrypted_record rec;
+    rec.record = record;
+    rec.company = -1;
+    rec.packet = 0;
+
+    if (attrs & DLIS_SEGATTR_ENCRPKT) {
+        int size, company;
+        const auto* packet = lrsh + DLIS_LRSH_SIZE;
+        const auto err = dlis_encryption_packet_info( packet, &size, &company );
+        if (not err) {
+            rec.company = company;
+            rec.packet = size;
+        }
+    }
+
+    out.push_back( rec );
+}
+
+stream_offsets findoffsets( mio::mmap_source& file,
+                            long long from,
+                            long long to,
+                            record_hasher* hasher )
 noexcept (false)
 {
+    if (from < 0 or to < from or std::size_t(to) > file.size()) {
+        const auto msg = "expected 0 <= from (which is {}) <= to (which is {}) "
+                         "<= file.size() (which is {})"
+        ;
+        throw std::out_of_range(fmt::format(msg, from, to, file.size()));
+    }
+
     const auto* begin = file.data() + from;
-    const auto* end = file.data() + file.size();
+    const auto* end = file.data() + to;
 
     // by default, assume ~4K per segment on average. This should be fairly few
-    // reallocations, without overshooting too much
-    std::size_t alloc_size = file.size() / 4196;
+    // reallocations, without overshooting too much. Small files and storage
+    // units still need room to grow, as 1 * 1.5 is 1
+    std::size_t alloc_size = (std::max)( (to - from) / 4196, 64LL );
 
     stream_offsets ofs;
     ofs.resize( alloc_size );
@@ -151,6 +526,7 @@ noexcept (false)
     int initial_residual = 0;
 
     while (true) {
+        const auto prev = count;
         err = dlis_index_records( begin,
                                   end,
                                   alloc_size,
@@ -161,25 +537,21 @@ noexcept (false)
                                   count + residuals.data(),
                                   count + explicits.data() );
 
-        switch (err) {
-            case DLIS_OK: break;
+        check_index_error( err, count );
 
-            case DLIS_TRUNCATED:
-                throw std::runtime_error( "file truncated" );
-
-            case DLIS_INCONSISTENT:
-                throw std::runtime_error( "inconsistensies in record sizes" );
-
-            case DLIS_UNEXPECTED_VALUE: {
-                // TODO: interrogate more?
-                const auto msg = "record-length in record {} corrupted";
-                throw std::runtime_error(fmt::format(msg, count));
-            }
+        /*
+         * hash the records of this round right away, as they were just read
+         * by dlis_index_records. The tells are still relative to end
+         */
+        if (hasher) {
+            for (int i = prev; i < count; ++i)
+                hasher->add( end + tells[ i ], residuals[ i ] );
+        }
 
-            default: {
-                const auto msg = "dlis_index_records: unknown error {}";
-                throw std::runtime_error(fmt::format(msg, err));
-            }
+        for (int i = prev; i < count; ++i) {
+            const auto* lrsh = end + tells[ i ];
+            if (residuals[ i ] == 0) lrsh += DLIS_VRL_SIZE;
+            note_encrypted( lrsh, i, ofs.encrypted );
         }
 
         if (next == end) break;
@@ -195,12 +567,429 @@ noexcept (false)
 
     ofs.resize( count );
 
-    const auto dist = file.size();
+    const auto dist = to;
     for (auto& tell : tells) tell += dist;
 
+    if (hasher) hasher->finish();
     return ofs;
 }
 
+}
+
+stream_offsets findoffsets( mio::mmap_source& file, long long from )
+noexcept (false)
+{
+    return findoffsets( file, from, file.size(), nullptr );
+}
+
+stream_offsets findoffsets( mio::mmap_source& file,
+                            long long from,
+                            long long to )
+noexcept (false)
+{
+    return findoffsets( file, from, to, nullptr );
+}
+
+stream_offsets findoffsets( mio::mmap_source& file,
+                            long long from,
+                            record_hashes& hashes )
+noexcept (false)
+{
+    hashes = record_hashes();
+    record_hasher hasher( hashes );
+    return findoffsets( file, from, file.size(), &hasher );
+}
+
+stream_offsets findoffsets( logical_file& file, long long from )
+noexcept (false)
+{
+    /*
+     * Records may straddle chunks, so dlis_index_records, which needs the
+     * records in contiguous memory, cannot be used directly. Walk the
+     * headers instead, with the same checks as dlis_index_records. The
+     * headers are copied out, the rest is skipped.
+     */
+    stream_offsets ofs;
+    const auto end = file.size();
+
+    auto pos = from;
+    int remaining = 0;
+    int count = 0;
+
+    while (pos < end) {
+        const auto tell = pos;
+        const auto residual = remaining;
+        int isexplicit = 0;
+        bool first = true;
+
+        while (true) {
+            if (remaining == 0) {
+                if (end - DLIS_VRL_SIZE < pos)
+                    check_index_error( DLIS_TRUNCATED, count );
+
+                char vrl[ DLIS_VRL_SIZE ];
+                file.read( vrl, pos, DLIS_VRL_SIZE );
+
+                int len, version;
+                const auto err = dlis_vrl( vrl, &len, &version );
+                if (err) check_index_error( DLIS_INCONSISTENT, count );
+                if (len < 20) check_index_error( DLIS_UNEXPECTED_VALUE, count );
+
+                remaining = len - DLIS_VRL_SIZE;
+                pos += DLIS_VRL_SIZE;
+            }
+
+            if (end - DLIS_LRSH_SIZE < pos)
+                check_index_error( DLIS_TRUNCATED, count );
+
+            char lrsh[ DLIS_LRSH_SIZE ];
+            file.read( lrsh, pos, DLIS_LRSH_SIZE );
+
+            int len, type;
+            std::uint8_t attrs;
+            const auto err = dlis_lrsh( lrsh, &len, &attrs, &type );
+
+            if (end - len < pos) check_index_error( DLIS_TRUNCATED, count );
+            if (len < 16) check_index_error( DLIS_UNEXPECTED_VALUE, count );
+            if (err) check_index_error( DLIS_INCONSISTENT, count );
+
+            if (first and (attrs & DLIS_SEGATTR_ENCRYPT)) {
+                char header[ DLIS_LRSH_SIZE + 4 ];
+                file.read( header, pos, sizeof( header ) );
+                note_encrypted( header, count, ofs.encrypted );
+            }
+            first = false;
+
+            pos += len;
+            remaining -= len;
+
+            isexplicit = attrs & DLIS_SEGATTR_EXFMTLR;
+            if (not (attrs & DLIS_SEGATTR_SUCCSEG)) break;
+        }
+
+        ofs.tells.push_back( tell );
+        ofs.residuals.push_back( residual );
+        ofs.explicits.push_back( isexplicit );
+        ++count;
+    }
+
+    return ofs;
+}
+
+namespace {
+
+/*
+ * A storage unit label, as in the first label of a file: it parses, and a
+ * visible record follows within 200 bytes
+ */
+bool islabel( const char* sul, const char* last ) noexcept (true) {
+    if (last - sul < DLIS_SUL_SIZE + DLIS_VRL_SIZE) return false;
+
+    int seqnum, major, minor, layout;
+    std::int64_t maxlen;
+    char id[ 61 ] = {};
+    const auto err = dlis_sul( sul, &seqnum, &major, &minor,
+                                    &layout, &maxlen, id );
+    if (err != DLIS_OK and err != DLIS_INCONSISTENT) return false;
+
+    try {
+        const auto vrl = findvrl( sul, last - sul, DLIS_SUL_SIZE );
+        int len, version;
+        return dlis_vrl( sul + vrl, &len, &version ) == DLIS_OK and len >= 20;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+/*
+ * Search [first, last) for a storage unit label, by its structure field
+ * RECORD at byte 9. memchr is vectorised in the C libraries, so most of the
+ * time goes into skipping to the next R. Returns last if there is none.
+ */
+const char* findlabel( const char* first, const char* last ) noexcept (true) {
+    static const char needle[] = "RECORD";
+    static const auto structure_offset = 9;
+    static const auto tail = DLIS_SUL_SIZE - structure_offset;
+
+    auto* cur = first + structure_offset;
+    while (last - cur >= tail) {
+        const auto n = std::size_t( (last - cur) - tail + 1 );
+        const auto* hit = static_cast< const char* >( std::memchr( cur, 'R', n ) );
+        if (not hit) break;
+
+        const auto* sul = hit - structure_offset;
+        if (std::memcmp( hit, needle, 6 ) == 0 and islabel( sul, last ))
+            return sul;
+
+        cur = hit + 1;
+    }
+
+    return last;
+}
+
+}
+
+std::vector< storage_unit > findunits( mio::mmap_source& file )
+noexcept (false) {
+    const auto* data = file.data();
+    const auto* end = data + file.size();
+    const auto size = (long long)file.size();
+
+    std::vector< storage_unit > units;
+
+    storage_unit unit;
+    unit.sul = findsul( file );
+    unit.vrl = findvrl( file, unit.sul + DLIS_SUL_SIZE );
+
+    /* the start of the last visible record with a sound label */
+    auto last = unit.vrl;
+    auto pos = unit.vrl;
+
+    while (true) {
+        if (pos == size) {
+            unit.end = size;
+            units.push_back( unit );
+            break;
+        }
+
+        /*
+         * dlis_vrl does not check the 0xFF 0x01, but it is what tells a
+         * visible record label from the ascii of a storage unit label
+         */
+        int len = 0, version;
+        const auto* vrl = reinterpret_cast< const unsigned char* >( data + pos );
+        const auto sound = size - pos >= DLIS_VRL_SIZE
+                       and vrl[ 2 ] == 0xFF
+                       and vrl[ 3 ] == 0x01
+                       and dlis_vrl( data + pos, &len, &version ) == DLIS_OK
+                       and len >= 20
+                       and len <= size - pos;
+
+        if (sound) {
+            last = pos;
+            pos += len;
+            continue;
+        }
+
+        /*
+         * Not a visible record, so either the next storage unit, or damage.
+         * If the last visible record was cut short, the next label is inside
+         * it, so search from the start of its body
+         */
+        const auto* sul = findlabel( data + last + DLIS_VRL_SIZE, end );
+        if (sul == end) {
+            unit.end = size;
+            units.push_back( unit );
+            break;
+        }
+
+        /*
+         * Garbage between the last visible record and the next label belongs
+         * to neither storage unit
+         */
+        unit.end = (std::min)( pos, (long long)(sul - data) );
+        units.push_back( unit );
+
+        unit.sul = sul - data;
+        unit.vrl = findvrl( file, unit.sul + DLIS_SUL_SIZE );
+        last = unit.vrl;
+        pos = unit.vrl;
+    }
+
+    return units;
+}
+
+std::vector< stream_offsets > findoffsets( mio::mmap_source& file,
+                                           const std::vector< storage_unit >& units,
+                                           int workers,
+                                           std::vector< std::string >& errors )
+noexcept (false) {
+    if (workers < 0) {
+        const auto msg = "findoffsets: expected workers >= 0, was {}";
+        throw std::invalid_argument( fmt::format( msg, workers ) );
+    }
+
+    /* 0 means pick a default, but hardware_concurrency may also return 0 */
+    if (workers == 0) workers = std::thread::hardware_concurrency();
+    if (workers == 0) workers = 4;
+
+    std::vector< stream_offsets > offsets( units.size() );
+    std::vector< std::string > messages( units.size() );
+    std::atomic< std::size_t > cursor( 0 );
+
+    const auto work = [&] {
+        while (true) {
+            const auto i = cursor++;
+            if (i >= units.size()) return;
+
+            try {
+                const auto& unit = units[ i ];
+                offsets[ i ] = findoffsets( file, unit.vrl, unit.end );
+            } catch (const std::exception& e) {
+                offsets[ i ] = stream_offsets();
+                messages[ i ] = e.what();
+            } catch (...) {
+                offsets[ i ] = stream_offsets();
+                messages[ i ] = "findoffsets: unknown error";
+            }
+        }
+    };
+
+    const auto n = (std::min)( std::size_t( workers ), units.size() );
+    std::vector< std::thread > threads;
+    try {
+        for (std::size_t i = 1; i < n; ++i)
+            threads.emplace_back( work );
+    } catch (const std::system_error&) {
+        /*
+         * out of threads - the units are handed out through the shared
+         * cursor, so the threads that did start, and this one, still cover
+         * all of them
+         */
+    }
+
+    work();
+    for (auto& thread : threads) thread.join();
+
+    errors.swap( messages );
+    return offsets;
+}
+
+std::vector< encrypted_range >
+encrypted_ranges( const std::vector< encrypted_record >& records )
+noexcept (false) {
+    std::vector< encrypted_range > ranges;
+    for (const auto& rec : records) {
+        if (not ranges.empty()) {
+            auto& last = ranges.back();
+            if (last.end == rec.record and last.company == rec.company) {
+                last.end += 1;
+                continue;
+            }
+        }
+
+        encrypted_range range;
+        range.begin = rec.record;
+        range.end = rec.record + 1;
+        range.company = rec.company;
+        ranges.push_back( range );
+    }
+
+    return ranges;
+}
+
+record_index::record_index( const std::string& path, long long from )
+noexcept (false) {
+    map_source( this->file, path );
+
+    if (from < 0 or std::size_t(from) > this->file.size()) {
+        const auto msg = "expected 0 <= from (which is {}) <= file.size() "
+                         "(which is {})"
+        ;
+        throw std::out_of_range(fmt::format(msg, from, this->file.size()));
+    }
+
+    this->next = this->file.data() + from;
+    this->done = std::size_t(from) == this->file.size();
+}
+
+void record_index::step( std::size_t n ) noexcept (false) {
+    if (this->done) return;
+
+    const auto* end = this->file.data() + this->file.size();
+    const auto prev = this->count;
+    this->ofs.resize( prev + n );
+
+    const auto err = dlis_index_records( this->next,
+                                         end,
+                                         n,
+                                         &this->residual,
+                                         &this->next,
+                                         &this->count,
+                                         prev + this->ofs.tells.data(),
+                                         prev + this->ofs.residuals.data(),
+                                         prev + this->ofs.explicits.data() );
+
+    this->ofs.resize( this->count );
+
+    /* the tells are relative to end-of-file, like in findoffsets */
+    const auto dist = this->file.size();
+    for (auto i = prev; i < this->count; ++i) {
+        const auto* lrsh = end + this->ofs.tells[ i ];
+        if (this->ofs.residuals[ i ] == 0) lrsh += DLIS_VRL_SIZE;
+        note_encrypted( lrsh, i, this->ofs.encrypted );
+
+        this->ofs.tells[ i ] += dist;
+    }
+
+    check_index_error( err, this->count );
+    if (this->next == end) this->done = true;
+}
+
+int record_index::extend_to( int i ) noexcept (false) {
+    std::lock_guard< std::mutex > guard( this->lock );
+
+    while (not this->done and this->count <= i) {
+        /*
+         * grow geometrically, so that repeatedly asking for the next record
+         * doesn't degrade into indexing one record at a time
+         */
+        const auto needed = std::size_t( i + 1 - this->count );
+        const auto grow = (std::max)( std::size_t( this->count / 2 ),
+                                      std::size_t( 256 ) );
+        this->step( (std::max)( needed, grow ) );
+    }
+
+    return this->count;
+}
+
+int record_index::extend_to_implicit() noexcept (false) {
+    std::lock_guard< std::mutex > guard( this->lock );
+
+    const auto& explicits = this->ofs.explicits;
+    int from = 0;
+    while (true) {
+        const auto itr = std::find( explicits.begin() + from,
+                                    explicits.end(),
+                                    0 );
+        if (itr != explicits.end() or this->done) break;
+
+        from = this->count;
+        this->step( 64 );
+    }
+
+    return this->count;
+}
+
+void record_index::index_all() noexcept (false) {
+    std::lock_guard< std::mutex > guard( this->lock );
+
+    /* same initial guess as findoffsets, ~4K per record */
+    const auto estimate = this->file.size() / 4196;
+    auto n = (std::max)( estimate, std::size_t( this->count ) );
+    n = (std::max)( n, std::size_t( 256 ) );
+
+    while (not this->done) {
+        this->step( n );
+        n = std::size_t( this->count / 2 ) + 256;
+    }
+}
+
+bool record_index::complete() const noexcept (true) {
+    std::lock_guard< std::mutex > guard( this->lock );
+    return this->done;
+}
+
+int record_index::size() const noexcept (true) {
+    std::lock_guard< std::mutex > guard( this->lock );
+    return this->count;
+}
+
+stream_offsets record_index::offsets() const noexcept (false) {
+    std::lock_guard< std::mutex > guard( this->lock );
+    return this->ofs;
+}
+
 bool record::isexplicit() const noexcept (true) {
     return this->attributes & DLIS_SEGATTR_EXFMTLR;
 }
@@ -209,7 +998,8 @@ bool record::isencrypted() const noexcept (true) {
     return this->attributes & DLIS_SEGATTR_ENCRYPT;
 }
 
-stream::stream( const std::string& path ) noexcept (false)
+stream::stream( const std::string& path ) noexcept (false) :
+    path( path )
 {
     this->fs.exceptions( fs.exceptions()
                        | std::ios::eofbit
@@ -277,7 +1067,13 @@ record& stream::at( int i, record& rec ) noexcept (false) {
     shortvec< int > types;
     bool consistent = true;
 
-    this->fs.seekg( tell );
+    /*
+     * the record is an output buffer, and is likely re-used between calls, so
+     * only keep its allocated capacity
+     */
+    rec.data.clear();
+
+    this->seek( tell );
 
     const auto chop = [](std::vector< char >& vec, int bytes) {
         const int size = vec.size();
@@ -295,7 +1091,7 @@ record& stream::at( int i, record& rec ) noexcept (false) {
             int len, type;
             std::uint8_t attrs;
             char buffer[ DLIS_LRSH_SIZE ];
-            this->fs.read( buffer, DLIS_LRSH_SIZE );
+            this->next( buffer, DLIS_LRSH_SIZE );
             const auto err = dlis_lrsh( buffer, &len, &attrs, &type );
 
             remaining -= len;
@@ -303,6 +1099,7 @@ record& stream::at( int i, record& rec ) noexcept (false) {
 
             if (err) consistent = false;
             attributes.push_back( attrs );
+            types.push_back( type );
 
             int explicit_formatting = 0;
             int has_predecessor = 0;
@@ -329,7 +1126,7 @@ record& stream::at( int i, record& rec ) noexcept (false) {
                  */
 
                 const auto vrl_len = remaining + len;
-                const auto tell = std::int64_t(this->fs.tellg()) - DLIS_LRSH_SIZE;
+                const auto tell = this->position - DLIS_LRSH_SIZE;
                 consistent = false;
                 const auto msg = "visible record/segment inconsistency: "
                                  "segment (which is {}) "
@@ -342,7 +1139,7 @@ record& stream::at( int i, record& rec ) noexcept (false) {
 
             const auto prevsize = rec.data.size();
             rec.data.resize( prevsize + len );
-            this->fs.read( rec.data.data() + prevsize, len );
+            this->next( rec.data.data() + prevsize, len );
 
             /*
              * chop off trailing length and checksum for now
@@ -361,7 +1158,7 @@ record& stream::at( int i, record& rec ) noexcept (false) {
             if (has_successor) continue;
 
             /* read last segment - check consistency and wrap up */
-            if (this->contiguous and not consumed_record( this->fs.tellg(),
+            if (this->contiguous and not consumed_record( this->position,
                                                           this->tells,
                                                           i )) {
                 /*
@@ -379,7 +1176,7 @@ record& stream::at( int i, record& rec ) noexcept (false) {
 
                 const auto tell1 = this->tells.at(i);
                 const auto tell2 = this->tells.at(i + 1);
-                const auto at    = this->fs.tellg();
+                const auto at    = this->position;
                 const auto str   = fmt::format(msg, i, tell1, at, i+1, tell2);
                 throw std::runtime_error(msg);
             }
@@ -402,7 +1199,7 @@ record& stream::at( int i, record& rec ) noexcept (false) {
 
         int len, version;
         char buffer[ DLIS_VRL_SIZE ];
-        this->fs.read( buffer, DLIS_VRL_SIZE );
+        this->next( buffer, DLIS_VRL_SIZE );
         const auto err = dlis_vrl( buffer, &len, &version );
 
         if (err) consistent = false;
@@ -433,10 +1230,91 @@ void stream::reindex( std::vector< long long > tells,
     this->residuals = residuals;
 }
 
+void stream::remap( const tapeimage& file ) noexcept (false) {
+    this->chunks = file.chunks();
+    this->physical = -1;
+    this->view.reset();
+}
+
+void stream::remap( const zindex& index ) noexcept (false) {
+    this->view.reset( new zreader( this->path, index ) );
+    this->chunks.clear();
+    this->physical = -1;
+}
+
 void stream::close() {
     this->fs.close();
 }
 
+const std::vector< long long >& stream::record_tells() const noexcept (true) {
+    return this->tells;
+}
+
+const std::vector< int >& stream::record_residuals() const noexcept (true) {
+    return this->residuals;
+}
+
+bool stream::remapped() const noexcept (true) {
+    return this->view or not this->chunks.empty();
+}
+
+void stream::seek( long long offset ) noexcept (false) {
+    this->position = offset;
+    if (this->view) return;
+    if (this->chunks.empty()) this->fs.seekg( offset );
+}
+
+void stream::next( char* dst, long long n ) noexcept (false) {
+    if (this->view) {
+        this->view->read( dst, this->position, std::size_t( n ) );
+        this->position += n;
+        return;
+    }
+
+    if (this->chunks.empty()) {
+        this->fs.read( dst, n );
+        this->position += n;
+        return;
+    }
+
+    const auto cmp = []( long long x, const tapeimage_chunk& chunk ) {
+        return x < chunk.logical;
+    };
+
+    while (n > 0) {
+        auto itr = std::upper_bound( this->chunks.begin(),
+                                     this->chunks.end(),
+                                     this->position,
+                                     cmp );
+
+        const auto past_end = [this] {
+            const auto msg = "read past end of tape image (at {})";
+            return std::runtime_error(fmt::format(msg, this->position));
+        };
+
+        if (itr == this->chunks.begin()) throw past_end();
+        const auto& chunk = *std::prev( itr );
+        const auto skip = this->position - chunk.logical;
+        if (skip >= chunk.size) throw past_end();
+
+        /*
+         * seeking the fstream throws away its buffer, so only seek when
+         * crossing into a new chunk, or when the stream was moved
+         */
+        const auto physical = chunk.physical + skip;
+        if (physical != this->physical) this->fs.seekg( physical );
+
+        const auto len = (std::min)( chunk.size - skip, n );
+        this->physical = -1;
+        this->fs.read( dst, len );
+        this->physical = physical + len;
+
+        dst += len;
+        n -= len;
+        this->position += len;
+    }
+}
+
 void stream::read( char* dst, long long offset, int n ) {
     if (n < 0) {
         const auto msg = "expected n (which is {}) >= 0";
@@ -448,8 +1326,249 @@ void stream::read( char* dst, long long offset, int n ) {
         throw std::invalid_argument(fmt::format(msg, offset));
     }
 
-    this->fs.seekg( offset );
-    this->fs.read( dst, n );
+    this->seek( offset );
+    this->next( dst, n );
+}
+
+namespace {
+
+/*
+ * Positional reads on a plain ifstream, which keep count of the bytes read.
+ * Reading past end-of-file is not an error, but gives a short read.
+ */
+class preader {
+public:
+    explicit preader( const std::string& path ) noexcept (false) {
+        this->fs.open( path, std::ios::binary | std::ios::in );
+        if (!this->fs.good())
+            throw fmt::system_error(errno, "cannot to open file '{}'", path);
+    }
+
+    std::size_t read( char* dst, long long offset, std::size_t n )
+    noexcept (false) {
+        this->fs.clear();
+        this->fs.seekg( offset );
+        this->fs.read( dst, n );
+        const auto count = std::size_t( this->fs.gcount() );
+        this->bytes += count;
+
+        if (this->fs.bad())
+            throw std::runtime_error( "crawl: unable to read file" );
+
+        return count;
+    }
+
+    long long bytes = 0;
+
+private:
+    std::ifstream fs;
+};
+
+/*
+ * The set type of an EFLR, from the set component in the first bytes of its
+ * body. Returns false if the body is too short to tell.
+ */
+bool peek_set_type( const std::vector< char >& body, std::string& type )
+noexcept (true) {
+    if (body.size() < DLIS_DESCRIPTOR_SIZE + 1) return false;
+
+    const auto descriptor = std::uint8_t( body.front() );
+    int role, has_type, has_name;
+    dlis_component( descriptor, &role );
+    const auto err = dlis_component_set( descriptor, role, &has_type,
+                                                           &has_name );
+    if (err or not has_type) return false;
+
+    const auto* xs = body.data() + DLIS_DESCRIPTOR_SIZE;
+    const auto len = std::size_t( std::uint8_t( *xs ) );
+    if (body.size() < DLIS_DESCRIPTOR_SIZE + 1 + len) return false;
+
+    type.assign( xs + 1, len );
+    return true;
+}
+
+}
+
+crawl_result crawl( const std::string& path,
+                    const std::vector< std::string >& types,
+                    long long limit )
+noexcept (false) {
+    preader file( path );
+    crawl_result result;
+    result.records = 0;
+    result.complete = true;
+
+    /*
+     * The SUL is searched for in the first 200 bytes, followed by 80 bytes of
+     * label and a 200 byte search for the first visible record, so a single
+     * read of the first 512 bytes covers both
+     */
+    char head[ 512 ];
+    const auto headsize = file.read( head, 0, sizeof( head ) );
+    result.sul = findsul( head, headsize );
+
+    if (std::size_t(result.sul + DLIS_SUL_SIZE) > headsize)
+        throw std::runtime_error( "crawl: file truncated in storage label" );
+
+    result.label.assign( head + result.sul, DLIS_SUL_SIZE );
+    long long pos = findvrl( head, headsize, result.sul + DLIS_SUL_SIZE );
+
+    const auto wanted = [&types]( const std::string& type ) {
+        if (types.empty()) return true;
+        return std::find( types.begin(), types.end(), type ) != types.end();
+    };
+
+    std::vector< std::string > seen;
+    const auto all_seen = [&]() {
+        if (types.empty()) return false;
+        for (const auto& type : types) {
+            if (std::find( seen.begin(), seen.end(), type ) == seen.end())
+                return false;
+        }
+        return true;
+    };
+
+    std::vector< char > data;
+    std::vector< char > segment;
+    bool collecting = false;
+    bool successor = false;
+    int vr_remaining = 0;
+
+    while (true) {
+        if (limit > 0 and pos >= limit) {
+            result.complete = false;
+            break;
+        }
+
+        if (vr_remaining == 0) {
+            char buffer[ DLIS_VRL_SIZE ];
+            const auto n = file.read( buffer, pos, DLIS_VRL_SIZE );
+            if (n == 0) break;
+            if (n < DLIS_VRL_SIZE)
+                throw std::runtime_error( "crawl: file truncated" );
+
+            int len, version;
+            const auto err = dlis_vrl( buffer, &len, &version );
+            if (err or len < DLIS_VRL_SIZE + DLIS_LRSH_SIZE) {
+                const auto msg = "crawl: corrupt visible record at tell {}";
+                throw std::runtime_error( fmt::format( msg, pos ) );
+            }
+
+            vr_remaining = len - DLIS_VRL_SIZE;
+            pos += DLIS_VRL_SIZE;
+            continue;
+        }
+
+        /*
+         * Files are sometimes cut off after the last record, but before the
+         * end of the visible record. That is not a problem unless the last
+         * record was incomplete
+         */
+        char buffer[ DLIS_LRSH_SIZE ];
+        const auto n = file.read( buffer, pos, DLIS_LRSH_SIZE );
+        if (n == 0 and not successor) break;
+        if (n < DLIS_LRSH_SIZE)
+            throw std::runtime_error( "crawl: file truncated" );
+
+        int len, type;
+        std::uint8_t attrs;
+        dlis_lrsh( buffer, &len, &attrs, &type );
+
+        if (len < DLIS_LRSH_SIZE or len > vr_remaining) {
+            const auto msg = "crawl: visible record/segment inconsistency "
+                             "at tell {}";
+            throw std::runtime_error( fmt::format( msg, pos ) );
+        }
+
+        vr_remaining -= len;
+        pos += DLIS_LRSH_SIZE;
+        const auto bodylen = len - DLIS_LRSH_SIZE;
+
+        int explicit_formatting = 0;
+        int has_predecessor = 0;
+        int has_successor = 0;
+        int is_encrypted = 0;
+        int has_encryption_packet = 0;
+        int has_checksum = 0;
+        int has_trailing_length = 0;
+        int has_padding = 0;
+        dlis_segment_attributes( attrs, &explicit_formatting,
+                                        &has_predecessor,
+                                        &has_successor,
+                                        &is_encrypted,
+                                        &has_encryption_packet,
+                                        &has_checksum,
+                                        &has_trailing_length,
+                                        &has_padding );
+
+        if (not has_predecessor) {
+            /* the first IFLR marks the end of the header */
+            if (not explicit_formatting) break;
+
+            result.records += 1;
+            collecting = not is_encrypted;
+            data.clear();
+        }
+
+        /* the size of the segment body, sans padding and trailer */
+        const auto payload = [&]( const std::vector< char >& body ) {
+            int size = int(body.size());
+            if (has_trailing_length) size -= 2;
+            if (has_checksum)        size -= 2;
+            if (has_padding and size > 0)
+                size -= std::uint8_t( body[ size - 1 ] );
+            return std::size_t( (std::max)( size, 0 ) );
+        };
+
+        /*
+         * decide as early as possible if the set is interesting, so that
+         * unwanted sets are skipped without reading more than the set
+         * component. The body is read again if it is wanted, but that is
+         * cheap compared to reading every unwanted set in full.
+         *
+         * The set component is only ever at the start of the first segment
+         * of a record - the later segments start in the middle of the set. If
+         * the first segment is too short to tell, the type is checked on the
+         * complete record instead.
+         */
+        if (collecting and not has_predecessor and not types.empty()) {
+            segment.resize( (std::min)( bodylen, 256 ) );
+            segment.resize( file.read( segment.data(), pos, segment.size() ) );
+            if (segment.size() == std::size_t(bodylen))
+                segment.resize( payload( segment ) );
+
+            std::string settype;
+            if (peek_set_type( segment, settype ))
+                collecting = wanted( settype );
+        }
+
+        if (collecting) {
+            segment.resize( bodylen );
+            if (file.read( segment.data(), pos, bodylen ) < std::size_t(bodylen))
+                throw std::runtime_error( "crawl: file truncated" );
+
+            const auto size = payload( segment );
+            data.insert( data.end(), segment.begin(), segment.begin() + size );
+        }
+
+        pos += bodylen;
+        successor = has_successor;
+
+        if (has_successor or not collecting) continue;
+
+        auto set = parse_objects( data.data(), data.data() + data.size() );
+        const auto& settype = dl::decay( set.type );
+        if (not wanted( settype )) continue;
+
+        seen.push_back( settype );
+        result.sets.push_back( std::move( set ) );
+        collecting = false;
+
+        if (all_seen()) break;
+    }
+
+    result.bytes = file.bytes;
+    return result;
 }
 
 }
@@ -0,0 +1,374 @@
+#include <cerrno>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <fmt/format.h>
+#include <mpark/variant.hpp>
+
+#include <dlisio/ext/json.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+bool isutf8( const char* xs, std::size_t n ) noexcept (true) {
+    const auto* s = reinterpret_cast< const unsigned char* >( xs );
+    std::size_t i = 0;
+    while (i < n) {
+        const auto c = s[ i ];
+        if (c < 0x80) { ++i; continue; }
+
+        std::size_t len;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if      (c >= 0xC2 and c <= 0xDF) len = 2;
+        else if (c == 0xE0)               { len = 3; lo = 0xA0; }
+        else if (c >= 0xE1 and c <= 0xEC) len = 3;
+        else if (c == 0xED)               { len = 3; hi = 0x9F; }
+        else if (c >= 0xEE and c <= 0xEF) len = 3;
+        else if (c == 0xF0)               { len = 4; lo = 0x90; }
+        else if (c >= 0xF1 and c <= 0xF3) len = 4;
+        else if (c == 0xF4)               { len = 4; hi = 0x8F; }
+        else return false;
+
+        if (n - i < len) return false;
+        if (s[ i + 1 ] < lo or s[ i + 1 ] > hi) return false;
+        for (std::size_t k = 2; k < len; ++k) {
+            if (s[ i + k ] < 0x80 or s[ i + k ] > 0xBF) return false;
+        }
+
+        i += len;
+    }
+
+    return true;
+}
+
+namespace {
+
+void emit( std::string& out, const std::string& xs ) noexcept (false) {
+    const bool utf8 = isutf8( xs.data(), xs.size() );
+
+    out.push_back( '"' );
+    for (const auto x : xs) {
+        const auto c = static_cast< unsigned char >( x );
+        switch (c) {
+            case '"':  out.append( "\\\"" ); continue;
+            case '\\': out.append( "\\\\" ); continue;
+            case '\n': out.append( "\\n" );  continue;
+            case '\r': out.append( "\\r" );  continue;
+            case '\t': out.append( "\\t" );  continue;
+            default: break;
+        }
+
+        if (c < 0x20) {
+            fmt::format_to( std::back_inserter( out ), "\\u{:04x}", int(c) );
+        } else if (c >= 0x80 and not utf8) {
+            /* latin-1 to UTF-8 */
+            out.push_back( char( 0xC0 | (c >> 6) ) );
+            out.push_back( char( 0x80 | (c & 0x3F) ) );
+        } else {
+            out.push_back( x );
+        }
+    }
+    out.push_back( '"' );
+}
+
+template < typename T >
+typename std::enable_if< std::is_integral< T >::value >::type
+emit( std::string& out, T x ) noexcept (false) {
+    /* promote, so that the 8-bit types are numbers, not characters */
+    const auto str = fmt::format_int( +x );
+    out.append( str.data(), str.size() );
+}
+
+template < typename T >
+typename std::enable_if< std::is_floating_point< T >::value >::type
+emit( std::string& out, T x ) noexcept (false) {
+    if (not std::isfinite( x )) {
+        out.append( "null" );
+        return;
+    }
+
+    fmt::format_to( std::back_inserter( out ), "{}", x );
+}
+
+void emit( std::string& out, const dl::fshort& x ) { emit( out, decay( x ) ); }
+void emit( std::string& out, const dl::isingl& x ) { emit( out, decay( x ) ); }
+void emit( std::string& out, const dl::vsingl& x ) { emit( out, decay( x ) ); }
+void emit( std::string& out, const dl::uvari& x )  { emit( out, decay( x ) ); }
+void emit( std::string& out, const dl::origin& x ) { emit( out, decay( x ) ); }
+void emit( std::string& out, const dl::status& x ) { emit( out, decay( x ) ); }
+void emit( std::string& out, const dl::ident& x )  { emit( out, decay( x ) ); }
+void emit( std::string& out, const dl::ascii& x )  { emit( out, decay( x ) ); }
+void emit( std::string& out, const dl::units& x )  { emit( out, decay( x ) ); }
+
+template < typename T >
+void emit( std::string& out, const validated< T, 2 >& x ) noexcept (false) {
+    out.push_back( '[' );
+    emit( out, x.V );
+    out.push_back( ',' );
+    emit( out, x.A );
+    out.push_back( ']' );
+}
+
+template < typename T >
+void emit( std::string& out, const validated< T, 3 >& x ) noexcept (false) {
+    out.push_back( '[' );
+    emit( out, x.V );
+    out.push_back( ',' );
+    emit( out, x.A );
+    out.push_back( ',' );
+    emit( out, x.B );
+    out.push_back( ']' );
+}
+
+template < typename T >
+void emit( std::string& out, const std::complex< T >& x ) noexcept (false) {
+    out.push_back( '[' );
+    emit( out, x.real() );
+    out.push_back( ',' );
+    emit( out, x.imag() );
+    out.push_back( ']' );
+}
+
+void emit( std::string& out, const dl::dtime& x ) noexcept (false) {
+    fmt::format_to( std::back_inserter( out ),
+                    "\"{:04}-{:02}-{:02}T{:02}:{:02}:{:02}.{:03}{}\"",
+                    x.Y, x.M, x.D, x.H, x.MN, x.S, x.MS,
+                    x.TZ == DLIS_TZ_GMT ? "Z" : "" );
+}
+
+void emit( std::string& out, const dl::obname& x ) noexcept (false) {
+    out.append( "{\"id\":" );
+    emit( out, x.id );
+    out.append( ",\"origin\":" );
+    emit( out, x.origin );
+    out.append( ",\"copynumber\":" );
+    emit( out, x.copy );
+    out.push_back( '}' );
+}
+
+void emit( std::string& out, const dl::objref& x ) noexcept (false) {
+    out.append( "{\"type\":" );
+    emit( out, x.type );
+    out.append( ",\"name\":" );
+    emit( out, x.name );
+    out.push_back( '}' );
+}
+
+void emit( std::string& out, const dl::attref& x ) noexcept (false) {
+    out.append( "{\"type\":" );
+    emit( out, x.type );
+    out.append( ",\"name\":" );
+    emit( out, x.name );
+    out.append( ",\"label\":" );
+    emit( out, x.label );
+    out.push_back( '}' );
+}
+
+struct emit_values {
+    std::string& out;
+
+    void operator () ( const mpark::monostate& ) const noexcept (false) {
+        this->out.append( "null" );
+    }
+
+    template < typename T >
+    void operator () ( const std::vector< T >& xs ) const noexcept (false) {
+        this->out.push_back( '[' );
+        for (std::size_t i = 0; i < xs.size(); ++i) {
+            if (i > 0) this->out.push_back( ',' );
+            emit( this->out, xs[ i ] );
+        }
+        this->out.push_back( ']' );
+    }
+};
+
+/*
+ * The name of a representation code, from the typeinfo of the alternatives
+ * of value_vector
+ */
+template < std::size_t I,
+           std::size_t N = mpark::variant_size< value_vector >::value >
+struct reprc_name {
+    static const char* get( representation_code reprc ) noexcept (true) {
+        using vector = typename mpark::variant_alternative< I, value_vector >::type;
+        using T = typename vector::value_type;
+        if (typeinfo< T >::reprc == reprc) return typeinfo< T >::name;
+        return reprc_name< I + 1, N >::get( reprc );
+    }
+};
+
+template < std::size_t N >
+struct reprc_name< N, N > {
+    static const char* get( representation_code ) noexcept (true) {
+        return nullptr;
+    }
+};
+
+void emit( std::string& out, const object_attribute& x ) noexcept (false) {
+    out.append( "{\"count\":" );
+    emit( out, x.count );
+    out.append( ",\"reprc\":" );
+    /* 0 is monostate, which has no representation code */
+    const auto* name = reprc_name< 1 >::get( x.reprc );
+    if (name) emit( out, std::string( name ) );
+    else      emit( out, int( x.reprc ) );
+    out.append( ",\"units\":" );
+    emit( out, x.units );
+    out.append( ",\"value\":" );
+    mpark::visit( emit_values{ out }, x.value );
+    out.push_back( '}' );
+}
+
+void emit( std::string& out, const basic_object& x ) noexcept (false) {
+    out.append( "{\"name\":" );
+    emit( out, x.object_name );
+    out.append( ",\"attributes\":{" );
+    for (std::size_t i = 0; i < x.attributes.size(); ++i) {
+        if (i > 0) out.push_back( ',' );
+        emit( out, x.attributes[ i ].label );
+        out.push_back( ':' );
+        emit( out, x.attributes[ i ] );
+    }
+    out.append( "}}" );
+}
+
+/*
+ * Buffers the output, and passes it on to the sink when there is at least
+ * chunksize bytes of it. Objects are written whole, so pieces may be a bit
+ * larger than chunksize.
+ */
+struct chunked {
+    const json_sink& sink;
+    std::size_t chunksize;
+    std::string buffer;
+
+    void maybe_flush() noexcept (false) {
+        if (this->buffer.size() >= this->chunksize) this->flush();
+    }
+
+    void flush() noexcept (false) {
+        if (this->buffer.empty()) return;
+        this->sink( this->buffer.data(), this->buffer.size() );
+        this->buffer.clear();
+    }
+};
+
+void emit( chunked& out, const object_set& x ) noexcept (false) {
+    out.buffer.append( "{\"type\":" );
+    emit( out.buffer, x.type );
+    out.buffer.append( ",\"name\":" );
+    emit( out.buffer, x.name );
+    out.buffer.append( ",\"objects\":[" );
+    for (std::size_t i = 0; i < x.objects.size(); ++i) {
+        if (i > 0) out.buffer.push_back( ',' );
+        emit( out.buffer, x.objects[ i ] );
+        out.maybe_flush();
+    }
+    out.buffer.append( "]}" );
+}
+
+void write_all( int fd, const char* data, std::size_t size ) noexcept (false) {
+    while (size > 0) {
+#ifdef _WIN32
+        const auto chunk = size < (1U << 30) ? size : (1U << 30);
+        const auto n = ::_write( fd, data, unsigned( chunk ) );
+#else
+        const auto n = ::write( fd, data, size );
+#endif
+        if (n == -1 and errno == EINTR) continue;
+        if (n == -1) {
+            const auto msg = "write_json: unable to write to fd {}";
+            throw std::system_error( errno,
+                                     std::generic_category(),
+                                     fmt::format( msg, fd ) );
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+}
+
+void write_json( const std::vector< object_set >& sets,
+                 json_layout layout,
+                 const json_sink& sink,
+                 std::size_t chunksize )
+noexcept (false) {
+    if (chunksize == 0)
+        throw std::invalid_argument( "write_json: expected chunksize > 0" );
+
+    chunked out{ sink, chunksize, {} };
+    out.buffer.reserve( chunksize + (chunksize / 4) );
+
+    const bool document = layout == json_layout::document;
+    if (document) out.buffer.push_back( '[' );
+
+    for (std::size_t i = 0; i < sets.size(); ++i) {
+        if (document and i > 0) out.buffer.push_back( ',' );
+        emit( out, sets[ i ] );
+        if (not document) out.buffer.push_back( '\n' );
+        out.maybe_flush();
+    }
+
+    if (document) out.buffer.append( "]\n" );
+    out.flush();
+}
+
+std::string to_json( const std::vector< object_set >& sets,
+                     json_layout layout )
+noexcept (false) {
+    std::string out;
+    const auto append = [&out]( const char* xs, std::size_t n ) {
+        out.append( xs, n );
+    };
+    write_json( sets, layout, append );
+    return out;
+}
+
+void write_json( const std::vector< object_set >& sets,
+                 json_layout layout,
+                 int fd )
+noexcept (false) {
+    const auto write = [fd]( const char* xs, std::size_t n ) {
+        write_all( fd, xs, n );
+    };
+    write_json( sets, layout, write );
+}
+
+std::string to_json( const value_vector& x ) noexcept (false) {
+    std::string out;
+    mpark::visit( emit_values{ out }, x );
+    return out;
+}
+
+std::string as_utf8( const std::string& xs ) noexcept (false) {
+    if (isutf8( xs.data(), xs.size() )) return xs;
+
+    std::string out;
+    out.reserve( xs.size() + xs.size() / 4 );
+    for (const auto x : xs) {
+        const auto c = static_cast< unsigned char >( x );
+        if (c < 0x80) {
+            out.push_back( x );
+        } else {
+            out.push_back( char( 0xC0 | (c >> 6) ) );
+            out.push_back( char( 0x80 | (c & 0x3F) ) );
+        }
+    }
+    return out;
+}
+
+}
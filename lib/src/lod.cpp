@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <mio/mio.hpp>
+
+#include <dlisio/ext/frame.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/lod.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+namespace {
+
+/*
+ * The sidecar layout, all integers native-endian:
+ *
+ *  magic       char[8]     "dlislod" + version byte
+ *  byteorder   u32         0x01020304 as written
+ *  origin      i32
+ *  copy        u32
+ *  idlen       u32
+ *  id          char[idlen], padded with zeros to a multiple of 8
+ *  pyramids    u32
+ *  reserved    u32
+ *
+ * followed by a directory entry per pyramid:
+ *
+ *  column      i32
+ *  fanout      i32
+ *  samples     i64
+ *  levels      i32
+ *  reserved    i32
+ *  level       { size i64, offset i64 } * levels
+ *
+ * and then the bins of all levels of all pyramids, as float32 triplets, at
+ * the offsets given by the directory.
+ */
+const char magic[] = { 'd', 'l', 'i', 's', 'l', 'o', 'd', 1 };
+const std::uint32_t byteorder = 0x01020304;
+
+static_assert( sizeof( lod_bin ) == 3 * sizeof( float ),
+               "lod_bin is written as-is, and must not be padded" );
+
+struct accumulator {
+    double min =  std::numeric_limits< double >::infinity();
+    double max = -std::numeric_limits< double >::infinity();
+    double sum = 0;
+    std::int64_t count = 0;
+
+    void add( double x ) noexcept (true) {
+        if (std::isnan( x )) return;
+        this->min = (std::min)( this->min, x );
+        this->max = (std::max)( this->max, x );
+        this->sum += x;
+        this->count += 1;
+    }
+
+    void add( const accumulator& other ) noexcept (true) {
+        if (other.count == 0) return;
+        this->min = (std::min)( this->min, other.min );
+        this->max = (std::max)( this->max, other.max );
+        this->sum += other.sum;
+        this->count += other.count;
+    }
+};
+
+/*
+ * Converting a double outside the range of float is undefined, so saturate
+ * to infinity instead
+ */
+float narrow( double x ) noexcept (true) {
+    const auto big = double(std::numeric_limits< float >::max());
+    if (x >  big) return  std::numeric_limits< float >::infinity();
+    if (x < -big) return -std::numeric_limits< float >::infinity();
+    return float(x);
+}
+
+lod_bin tobin( const accumulator& acc ) noexcept (true) {
+    if (acc.count == 0) {
+        const auto nan = std::numeric_limits< float >::quiet_NaN();
+        return lod_bin{ nan, nan, nan };
+    }
+
+    return lod_bin{
+        narrow( acc.min ),
+        narrow( acc.max ),
+        narrow( acc.sum / acc.count ),
+    };
+}
+
+template < typename T >
+void put( std::ofstream& fs, const T& x ) noexcept (false) {
+    fs.write( reinterpret_cast< const char* >( &x ), sizeof( x ) );
+}
+
+std::size_t padded( std::size_t n ) noexcept (true) {
+    return (n + 7) & ~std::size_t(7);
+}
+
+class cursor {
+public:
+    cursor( const char* begin, std::size_t size ) :
+        pos( begin ), end( begin + size )
+    {}
+
+    template < typename T >
+    T get() noexcept (false) {
+        T x;
+        this->copy( &x, sizeof( x ) );
+        return x;
+    }
+
+    void copy( void* dst, std::size_t n ) noexcept (false) {
+        if (std::size_t(this->end - this->pos) < n)
+            throw std::runtime_error( "lod_file: unexpected end-of-file" );
+
+        std::memcpy( dst, this->pos, n );
+        this->pos += n;
+    }
+
+    void skip( std::size_t n ) noexcept (false) {
+        if (std::size_t(this->end - this->pos) < n)
+            throw std::runtime_error( "lod_file: unexpected end-of-file" );
+
+        this->pos += n;
+    }
+
+private:
+    const char* pos;
+    const char* end;
+};
+
+}
+
+std::vector< lod_pyramid > build_pyramids( stream& file,
+                                           const std::vector< int >& records,
+                                           const dl::obname& frame,
+                                           const std::string& fmt,
+                                           const std::vector< int >& selected,
+                                           int fanout )
+noexcept (false) {
+    if (fanout < 2) {
+        const auto msg = "build_pyramids: expected fanout >= 2, was {}";
+        throw std::invalid_argument( fmt::format( msg, fanout ) );
+    }
+
+    packed_layout layout( fmt );
+    const auto columns = orderable_columns( fmt, selected );
+
+    /*
+     * Only level 0 is built while walking the frames - the levels above are
+     * derived from it afterwards, which is cheap since it is already a factor
+     * fanout smaller than the data
+     */
+    std::vector< std::vector< accumulator > > base( columns.size() );
+    std::int64_t samples = 0;
+
+    const auto visit = [&]( int, std::int32_t, const char* packed ) {
+        const bool fresh = samples % fanout == 0;
+        const auto& offsets = layout.at( packed );
+        for (std::size_t i = 0; i < columns.size(); ++i) {
+            const auto col = columns[ i ];
+            if (fresh) base[ i ].emplace_back();
+            base[ i ].back().add(
+                packed_double( fmt[ col ], packed + offsets[ col ] )
+            );
+        }
+        samples += 1;
+    };
+
+    foreach_frame( file, records, frame, fmt, visit );
+
+    std::vector< lod_pyramid > pyramids;
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+        lod_pyramid pyr;
+        pyr.column = columns[ i ];
+        pyr.fanout = fanout;
+        pyr.samples = samples;
+
+        auto level = std::move( base[ i ] );
+        while (not level.empty()) {
+            std::vector< lod_bin > bins;
+            bins.reserve( level.size() );
+            for (const auto& acc : level)
+                bins.push_back( tobin( acc ) );
+            pyr.levels.push_back( std::move( bins ) );
+
+            if (level.size() == 1) break;
+
+            std::vector< accumulator > next( (level.size() + fanout - 1) / fanout );
+            for (std::size_t k = 0; k < level.size(); ++k)
+                next[ k / fanout ].add( level[ k ] );
+            level = std::move( next );
+        }
+
+        pyramids.push_back( std::move( pyr ) );
+    }
+
+    return pyramids;
+}
+
+void write_pyramids( const std::string& path,
+                     const dl::obname& frame,
+                     const std::vector< lod_pyramid >& pyramids )
+noexcept (false) {
+    std::ofstream fs;
+    fs.exceptions( fs.exceptions()
+                 | std::ios_base::failbit
+                 | std::ios_base::badbit
+    );
+    fs.open( path, std::ios::binary | std::ios::trunc );
+
+    const auto& id = dl::decay( frame.id );
+    const auto idlen = std::uint32_t( id.size() );
+    const char zeros[ 8 ] = {};
+
+    fs.write( magic, sizeof( magic ) );
+    put( fs, byteorder );
+    put( fs, std::int32_t( dl::decay( frame.origin ) ) );
+    put( fs, std::uint32_t( dl::decay( frame.copy ) ) );
+    put( fs, idlen );
+    fs.write( id.data(), id.size() );
+    fs.write( zeros, padded( id.size() ) - id.size() );
+    put( fs, std::uint32_t( pyramids.size() ) );
+    put( fs, std::uint32_t( 0 ) );
+
+    std::int64_t offset = sizeof( magic ) + 4 * sizeof( std::uint32_t )
+                        + padded( id.size() )
+                        + 2 * sizeof( std::uint32_t );
+    for (const auto& pyr : pyramids)
+        offset += 24 + 16 * pyr.levels.size();
+
+    for (const auto& pyr : pyramids) {
+        put( fs, std::int32_t( pyr.column ) );
+        put( fs, std::int32_t( pyr.fanout ) );
+        put( fs, std::int64_t( pyr.samples ) );
+        put( fs, std::int32_t( pyr.levels.size() ) );
+        put( fs, std::int32_t( 0 ) );
+
+        for (const auto& level : pyr.levels) {
+            put( fs, std::int64_t( level.size() ) );
+            put( fs, offset );
+            offset += level.size() * sizeof( lod_bin );
+        }
+    }
+
+    for (const auto& pyr : pyramids) {
+        for (const auto& level : pyr.levels) {
+            for (const auto& bin : level) {
+                put( fs, bin.min );
+                put( fs, bin.max );
+                put( fs, bin.mean );
+            }
+        }
+    }
+}
+
+lod_file::lod_file( const std::string& path ) noexcept (false) {
+    map_source( this->file, path );
+    cursor cur( this->file.data(), this->file.size() );
+
+    char mgc[ sizeof( magic ) ];
+    cur.copy( mgc, sizeof( mgc ) );
+    if (std::memcmp( mgc, magic, sizeof( magic ) ) != 0)
+        throw std::runtime_error( "lod_file: not a lod file, bad magic" );
+
+    if (cur.get< std::uint32_t >() != byteorder)
+        throw std::runtime_error( "lod_file: byte order mismatch" );
+
+    this->name.origin = dl::origin{ cur.get< std::int32_t >() };
+    this->name.copy = dl::ushort( cur.get< std::uint32_t >() );
+    const auto idlen = cur.get< std::uint32_t >();
+    std::string id( idlen, '\0' );
+    cur.copy( &id[ 0 ], idlen );
+    cur.skip( padded( idlen ) - idlen );
+    this->name.id = dl::ident{ std::move( id ) };
+
+    const auto count = cur.get< std::uint32_t >();
+    cur.skip( sizeof( std::uint32_t ) );
+
+    const auto size = std::int64_t( this->file.size() );
+    for (std::uint32_t i = 0; i < count; ++i) {
+        entry e;
+        e.column  = cur.get< std::int32_t >();
+        e.fanout  = cur.get< std::int32_t >();
+        e.samples = cur.get< std::int64_t >();
+        const auto levels = cur.get< std::int32_t >();
+        cur.skip( sizeof( std::int32_t ) );
+
+        if (e.fanout < 2 || e.samples < 0 || levels < 0)
+            throw std::runtime_error( "lod_file: corrupt directory" );
+
+        for (std::int32_t k = 0; k < levels; ++k) {
+            level lvl;
+            lvl.size   = cur.get< std::int64_t >();
+            lvl.offset = cur.get< std::int64_t >();
+
+            const auto bytes = lvl.size * std::int64_t( sizeof( lod_bin ) );
+            if (lvl.size < 0 || lvl.offset < 0 || lvl.offset > size
+                                               || bytes > size - lvl.offset) {
+                const auto msg = "lod_file: level {} of column {} "
+                                 "out of bounds of file";
+                throw std::runtime_error( fmt::format( msg, k, e.column ) );
+            }
+
+            e.levels.push_back( lvl );
+        }
+
+        this->cols.push_back( e.column );
+        this->entries.push_back( std::move( e ) );
+    }
+}
+
+const dl::obname& lod_file::frame() const noexcept (true) {
+    return this->name;
+}
+
+const std::vector< int >& lod_file::columns() const noexcept (true) {
+    return this->cols;
+}
+
+std::int64_t lod_file::samples( int column ) const noexcept (false) {
+    return this->find( column ).samples;
+}
+
+const lod_file::entry& lod_file::find( int column ) const noexcept (false) {
+    const auto itr = std::find( this->cols.begin(), this->cols.end(), column );
+    if (itr == this->cols.end()) {
+        const auto msg = "lod_file: column {} not in lod file";
+        throw std::out_of_range( fmt::format( msg, column ) );
+    }
+
+    return this->entries[ std::distance( this->cols.begin(), itr ) ];
+}
+
+lod_window lod_file::window( int column,
+                             std::int64_t begin,
+                             std::int64_t end,
+                             int pixels ) const noexcept (false) {
+    if (pixels < 1) {
+        const auto msg = "lod_file: expected pixels >= 1, was {}";
+        throw std::invalid_argument( fmt::format( msg, pixels ) );
+    }
+
+    const auto& e = this->find( column );
+    begin = (std::max)( begin, std::int64_t(0) );
+    end   = (std::min)( end, e.samples );
+
+    lod_window win;
+    win.level = 0;
+    win.span = e.fanout;
+    win.first = 0;
+
+    if (begin >= end || e.levels.empty()) return win;
+
+    /*
+     * Search from the top for the first level that resolves the window into
+     * enough bins. The spans of the levels grow geometrically, so this is at
+     * most log_fanout( samples ) iterations
+     */
+    std::vector< std::int64_t > spans( 1, e.fanout );
+    while (spans.size() < e.levels.size())
+        spans.push_back( spans.back() * e.fanout );
+
+    std::int64_t first = 0;
+    std::int64_t last = 0;
+    for (auto lvl = int(e.levels.size()) - 1; lvl >= 0; --lvl) {
+        const auto span = spans[ lvl ];
+        first = begin / span;
+        last  = (end + span - 1) / span;
+        win.level = lvl;
+        win.span = span;
+        if (last - first >= pixels) break;
+    }
+
+    const auto& level = e.levels[ win.level ];
+    last = (std::min)( last, level.size );
+    win.first = first * win.span;
+    win.bins.resize( last - first );
+
+    const auto* src = this->file.data()
+                    + level.offset
+                    + first * sizeof( lod_bin );
+    for (auto& bin : win.bins) {
+        std::memcpy( &bin.min,  src + 0, sizeof( float ) );
+        std::memcpy( &bin.max,  src + 4, sizeof( float ) );
+        std::memcpy( &bin.mean, src + 8, sizeof( float ) );
+        src += sizeof( lod_bin );
+    }
+
+    return win;
+}
+
+}
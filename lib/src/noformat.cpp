@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+#include <fcntl.h>
+#endif
+
+#include <fmt/core.h>
+#include <mio/mio.hpp>
+
+#include <dlisio/dlisio.h>
+#include <dlisio/types.h>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/noformat.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+namespace {
+
+const int noformat_type = 1;
+
+/* origin (uvari) + copy (ushort) + ident (ushort + 255 bytes) */
+const std::size_t max_obname_size = 4 + 1 + 1 + 255;
+
+/* a contiguous range of record body in the file */
+struct extent {
+    long long offset;
+    long long size;
+};
+
+/*
+ * True if the record at tell is an unencrypted NOFORMAT record, from the
+ * header of its first segment
+ */
+bool isnoformat( const char* base, long long tell, int residual )
+noexcept (true) {
+    auto* lrsh = base + tell;
+    if (residual == 0) lrsh += DLIS_VRL_SIZE;
+
+    int len, type;
+    std::uint8_t attrs;
+    dlis_lrsh( lrsh, &len, &attrs, &type );
+
+    if (attrs & DLIS_SEGATTR_EXFMTLR) return false;
+    if (attrs & DLIS_SEGATTR_ENCRYPT) return false;
+    return type == noformat_type;
+}
+
+/*
+ * The segment bodies of the record at tell, without headers, trailers and
+ * padding. The record has already been indexed, so the segments are known to
+ * be inside the file.
+ */
+std::vector< extent > bodies( const char* base, long long tell, int remaining )
+noexcept (false) {
+    std::vector< extent > xs;
+    auto pos = tell;
+
+    while (true) {
+        if (remaining == 0) {
+            int len, version;
+            dlis_vrl( base + pos, &len, &version );
+            remaining = len - DLIS_VRL_SIZE;
+            pos += DLIS_VRL_SIZE;
+        }
+
+        int len, type;
+        std::uint8_t attrs;
+        dlis_lrsh( base + pos, &len, &attrs, &type );
+
+        const auto* body = base + pos + DLIS_LRSH_SIZE;
+        int size = len - DLIS_LRSH_SIZE;
+        if (attrs & DLIS_SEGATTR_TRAILEN) size -= 2;
+        if (attrs & DLIS_SEGATTR_CHCKSUM) size -= 2;
+        if ((attrs & DLIS_SEGATTR_PADDING) and size > 0) {
+            std::uint8_t padcount = 0;
+            dlis_ushort( body + size - 1, &padcount );
+            size -= padcount;
+        }
+
+        if (size > 0) xs.push_back( { pos + DLIS_LRSH_SIZE, size } );
+
+        pos += len;
+        remaining -= len;
+        if (not (attrs & DLIS_SEGATTR_SUCCSEG)) return xs;
+    }
+}
+
+/*
+ * Split the record body into the name of the NO-FORMAT object and the
+ * payload. The name is usually in the first segment, but is read across
+ * segments to be safe.
+ */
+obname split_payload( const char* base,
+                      std::vector< extent >& xs,
+                      int record )
+noexcept (false) {
+    char buffer[ max_obname_size ] = {};
+    std::size_t available = 0;
+    for (const auto& x : xs) {
+        if (available == sizeof( buffer )) break;
+        const auto n = (std::min)( std::size_t( x.size ),
+                                   sizeof( buffer ) - available );
+        std::memcpy( buffer + available, base + x.offset, n );
+        available += n;
+    }
+
+    /*
+     * dlis_obname does not check bounds, so read from the zero-padded copy,
+     * and verify afterwards that it did not read past the actual body
+     */
+    std::int32_t origin, idlen;
+    std::uint8_t copy;
+    char id[ 256 ];
+    const auto* end = dlis_obname( buffer, &origin, &copy, &idlen, id );
+
+    auto consumed = std::size_t( end - buffer );
+    if (consumed > available) {
+        const auto msg = "findnoformat: NOFORMAT record {} too short for the "
+                         "object name, was {} bytes";
+        throw std::runtime_error( fmt::format( msg, record, available ) );
+    }
+
+    auto itr = xs.begin();
+    while (consumed > 0) {
+        const auto n = (std::min)( std::size_t( itr->size ), consumed );
+        itr->offset += n;
+        itr->size -= n;
+        consumed -= n;
+        if (itr->size == 0) ++itr;
+    }
+    xs.erase( xs.begin(), itr );
+
+    return obname {
+        dl::origin{ origin },
+        dl::ushort{ copy },
+        dl::ident{ std::string( id, id + idlen ) },
+    };
+}
+
+std::vector< extent > payload( const char* base,
+                               const stream_offsets& ofs,
+                               int record )
+noexcept (false) {
+    if (record < 0 or std::size_t( record ) >= ofs.tells.size()) {
+        const auto msg = "noformat: record {} not in index, size is {}";
+        throw std::out_of_range(
+            fmt::format( msg, record, ofs.tells.size() )
+        );
+    }
+
+    const auto tell = ofs.tells[ record ];
+    auto xs = bodies( base, tell, ofs.residuals[ record ] );
+    split_payload( base, xs, record );
+    return xs;
+}
+
+void write_all( int fd, const char* data, long long size ) noexcept (false) {
+    while (size > 0) {
+#ifdef _WIN32
+        const auto chunk = (std::min)( size, 1LL << 30 );
+        const auto n = ::_write( fd, data, unsigned( chunk ) );
+#else
+        const auto n = ::write( fd, data, size );
+#endif
+        if (n == -1 and errno == EINTR) continue;
+        if (n == -1) {
+            const auto msg = "copy_noformat: unable to write to fd {}";
+            throw std::system_error( errno,
+                                     std::generic_category(),
+                                     fmt::format( msg, fd ) );
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+/*
+ * Copy size bytes at offset from in to out in the kernel, or return false if
+ * copy_file_range is not supported for these files, and nothing was copied
+ */
+bool kernel_copy( int in, int out, long long offset, long long size )
+noexcept (false) {
+#ifdef HAVE_COPY_FILE_RANGE
+    if (in == -1) return false;
+
+    loff_t off = offset;
+    long long copied = 0;
+    while (copied < size) {
+        const auto n = ::copy_file_range( in, &off, out, nullptr,
+                                          size - copied, 0 );
+        if (n == -1 and errno == EINTR) continue;
+
+        if (n == -1 and copied == 0) {
+            const auto err = errno;
+            if (err == EXDEV or err == ENOSYS or err == EINVAL
+                or err == EOPNOTSUPP or err == EBADF) {
+                return false;
+            }
+        }
+
+        if (n == -1 or n == 0) {
+            const auto err = n == 0 ? EIO : errno;
+            const auto msg = "copy_noformat: unable to copy to fd {}";
+            throw std::system_error( err,
+                                     std::generic_category(),
+                                     fmt::format( msg, out ) );
+        }
+        copied += n;
+    }
+    return true;
+#else
+    (void)in;
+    (void)out;
+    (void)offset;
+    (void)size;
+    return false;
+#endif
+}
+
+}
+
+std::vector< noformat_object > findnoformat( const mio::mmap_source& file,
+                                             const stream_offsets& ofs,
+                                             const std::vector< int >& records )
+noexcept (false) {
+    const auto* base = file.data();
+
+    std::vector< noformat_object > objects;
+    for (const auto i : records) {
+        if (i < 0 or std::size_t( i ) >= ofs.tells.size()) {
+            const auto msg = "findnoformat: record {} not in index, size is {}";
+            throw std::out_of_range(
+                fmt::format( msg, i, ofs.tells.size() )
+            );
+        }
+
+        if (not isnoformat( base, ofs.tells[ i ], ofs.residuals[ i ] ))
+            continue;
+
+        auto xs = bodies( base, ofs.tells[ i ], ofs.residuals[ i ] );
+        const auto name = split_payload( base, xs, i );
+
+        long long size = 0;
+        for (const auto& x : xs) size += x.size;
+
+        const auto eq = [&name]( const noformat_object& obj ) {
+            return obj.name == name;
+        };
+        auto itr = std::find_if( objects.begin(), objects.end(), eq );
+        if (itr == objects.end()) {
+            noformat_object obj;
+            obj.name = name;
+            obj.size = 0;
+            objects.push_back( std::move( obj ) );
+            itr = objects.end() - 1;
+        }
+
+        itr->records.push_back( i );
+        itr->size += size;
+    }
+
+    return objects;
+}
+
+long long read_noformat( const mio::mmap_source& file,
+                         const stream_offsets& ofs,
+                         const noformat_object& obj,
+                         const noformat_sink& sink,
+                         std::size_t chunksize )
+noexcept (false) {
+    if (chunksize == 0)
+        throw std::invalid_argument( "read_noformat: expected chunksize > 0" );
+
+    const auto* base = file.data();
+    long long written = 0;
+    for (const auto record : obj.records) {
+        for (const auto& x : payload( base, ofs, record )) {
+            auto pos = x.offset;
+            auto left = std::size_t( x.size );
+            while (left > 0) {
+                const auto n = (std::min)( left, chunksize );
+                sink( base + pos, n );
+                pos += n;
+                left -= n;
+                written += n;
+            }
+        }
+    }
+
+    return written;
+}
+
+long long copy_noformat( const std::string& path,
+                         const mio::mmap_source& file,
+                         const stream_offsets& ofs,
+                         const noformat_object& obj,
+                         int fd )
+noexcept (false) {
+    int in = -1;
+#ifdef HAVE_COPY_FILE_RANGE
+    in = ::open( path.c_str(), O_RDONLY );
+#else
+    (void)path;
+#endif
+
+    const auto* base = file.data();
+    long long written = 0;
+    bool kernel = in != -1;
+
+    try {
+        for (const auto record : obj.records) {
+            for (const auto& x : payload( base, ofs, record )) {
+                if (kernel)
+                    kernel = kernel_copy( in, fd, x.offset, x.size );
+
+                if (not kernel)
+                    write_all( fd, base + x.offset, x.size );
+
+                written += x.size;
+            }
+        }
+    } catch (...) {
+#ifdef HAVE_COPY_FILE_RANGE
+        if (in != -1) ::close( in );
+#endif
+        throw;
+    }
+
+#ifdef HAVE_COPY_FILE_RANGE
+    if (in != -1) ::close( in );
+#endif
+    return written;
+}
+
+}
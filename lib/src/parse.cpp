@@ -1,8 +1,14 @@
 #include <algorithm>
 #include <bitset>
+#include <ciso646>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <iterator>
+#include <new>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 #include <fmt/core.h>
 
@@ -11,8 +17,43 @@
 
 namespace {
 
-void user_warning( const std::string& ) noexcept (true) {
-    // TODO:
+/*
+ * Where to record problems, or nullptr to throw on the first one. Protocol
+ * violations that are worked around are only recorded.
+ */
+struct context {
+    dl::diagnostics* diag;
+    const char* begin;
+};
+
+void report( const context* ctx,
+             const char* at,
+             dl::diagnostic_code code,
+             const std::string& msg ) noexcept (false) {
+    dl::diagnostic d;
+    d.record = ctx->diag->record;
+    d.offset = std::distance( ctx->begin, at );
+    d.code = code;
+    d.message = msg;
+    ctx->diag->entries.push_back( std::move( d ) );
+}
+
+void report( const context* ctx, const char* at, const std::exception& e )
+noexcept (false) {
+    using code = dl::diagnostic_code;
+
+    if (dynamic_cast< const std::out_of_range* >( &e ))
+        report( ctx, at, code::truncated, e.what() );
+    else if (dynamic_cast< const dl::not_implemented* >( &e ))
+        report( ctx, at, code::unsupported, e.what() );
+    else
+        report( ctx, at, code::invalid, e.what() );
+}
+
+void user_warning( const context* ctx,
+                   const char* at,
+                   const std::string& msg ) noexcept (false) {
+    if (ctx) report( ctx, at, dl::diagnostic_code::protocol, msg );
 }
 
 struct set_descriptor {
@@ -21,7 +62,8 @@ struct set_descriptor {
     bool name;
 };
 
-set_descriptor parse_set_descriptor( const char* cur ) noexcept (false) {
+set_descriptor parse_set_descriptor( const char* cur, const context* ctx )
+noexcept (false) {
     std::uint8_t attr;
     std::memcpy( &attr, cur, DLIS_DESCRIPTOR_SIZE );
 
@@ -59,7 +101,7 @@ set_descriptor parse_set_descriptor( const char* cur ) noexcept (false) {
              *  The Set Component contains the Set Type, which is not optional
              *  and must not be null, and the Set Name, which is optional.
              */
-            user_warning( "SET:type not set, but must be non-null." );
+            user_warning( ctx, cur, "SET:type not set, but must be non-null." );
             flags.type = true;
             break;
 
@@ -139,7 +181,8 @@ struct object_descriptor {
     bool name;
 };
 
-object_descriptor parse_object_descriptor( const char* cur ) {
+object_descriptor parse_object_descriptor( const char* cur,
+                                           const context* ctx ) {
     std::uint8_t attr;
     std::memcpy( &attr, cur, DLIS_DESCRIPTOR_SIZE );
 
@@ -157,7 +200,8 @@ object_descriptor parse_object_descriptor( const char* cur ) {
 
     int name;
     const auto err = dlis_component_object( attr, role, &name );
-    if (err) user_warning( "OBJECT:name was not set, but must be non-null" );
+    if (err) user_warning( ctx, cur, "OBJECT:name was not set, but must be "
+                                     "non-null" );
 
     return { true };
 }
@@ -343,13 +387,6 @@ const char* cast( const char* xs, dl::ascii& ascii ) noexcept (false) {
     return xs;
 }
 
-const char* cast( const char* xs, dl::origin& origin ) noexcept (true) {
-    dl::origin::value_type x;
-    xs = dlis_origin( xs, &x );
-    origin = dl::origin{ x };
-    return xs;
-}
-
 const char* cast( const char* xs, dl::obname& obname ) noexcept (false) {
     char str[ 256 ];
     std::int32_t len;
@@ -458,6 +495,115 @@ const char* cast( const char* xs,
     return xs;
 }
 
+/*
+ * The end of the element of type reprc at xs. Throws if it does not fit in
+ * [xs, end), so that the element can be decoded without reading past the
+ * end of the record.
+ */
+const char* skip( const char* xs,
+                  const char* end,
+                  dl::representation_code reprc ) noexcept (false) {
+    const auto need = [&]( std::ptrdiff_t n ) {
+        if (std::distance( xs, end ) < n)
+            throw std::out_of_range( "unexpected end-of-record" );
+    };
+
+    using rpc = dl::representation_code;
+    switch (reprc) {
+        case rpc::uvari:
+        case rpc::origin: {
+            need( 1 );
+            const auto x = std::uint8_t( *xs );
+            const std::ptrdiff_t len = not (x & 0x80) ? 1
+                                     : not (x & 0x40) ? 2
+                                     : 4;
+            need( len );
+            return xs + len;
+        }
+
+        case rpc::ident:
+        case rpc::units: {
+            need( 1 );
+            const std::ptrdiff_t len = 1 + std::uint8_t( *xs );
+            need( len );
+            return xs + len;
+        }
+
+        case rpc::ascii: {
+            std::int32_t len;
+            const auto* str = skip( xs, end, rpc::uvari );
+            dlis_uvari( xs, &len );
+            xs = str;
+            need( len );
+            return xs + len;
+        }
+
+        case rpc::obname:
+            xs = skip( xs, end, rpc::origin );
+            xs = skip( xs, end, rpc::ushort );
+            return skip( xs, end, rpc::ident );
+
+        case rpc::objref:
+            xs = skip( xs, end, rpc::ident );
+            return skip( xs, end, rpc::obname );
+
+        case rpc::attref:
+            xs = skip( xs, end, rpc::ident );
+            xs = skip( xs, end, rpc::obname );
+            return skip( xs, end, rpc::ident );
+
+        default: {
+            const auto size = dlis_sizeof_type( static_cast< int >( reprc ) );
+            if (size < 0) {
+                const auto msg = "invalid representation code {}";
+                const auto code = static_cast< int >( reprc );
+                throw std::invalid_argument( fmt::format( msg, code ) );
+            }
+            need( size );
+            return xs + size;
+        }
+    }
+}
+
+/*
+ * The end of the n uvaris at xs. Throws if they do not fit in [xs, end).
+ * Runs of one-byte uvaris are skipped eight at a time, like dlis_skipuvaris,
+ * which does not know where the record ends.
+ */
+const char* skip_uvaris( const char* xs,
+                         const char* end,
+                         std::int32_t n ) noexcept (false) {
+    if (n < 0 or n > std::distance( xs, end ))
+        throw std::out_of_range( "unexpected end-of-record" );
+
+    while (n > 0) {
+        if (n >= 8 and std::distance( xs, end ) >= 8) {
+            std::uint64_t x;
+            std::memcpy( &x, xs, sizeof( x ) );
+            if ((x & 0x8080808080808080ULL) == 0) {
+                xs += 8;
+                n  -= 8;
+                continue;
+            }
+        }
+
+        xs = skip( xs, end, dl::representation_code::uvari );
+        --n;
+    }
+
+    return xs;
+}
+
+/*
+ * xs, if an element of type reprc at xs fits in [xs, end), otherwise throw
+ */
+const char* fits( const char* xs,
+                  const char* end,
+                  dl::representation_code reprc ) noexcept (false) {
+    skip( xs, end, reprc );
+    return xs;
+}
+
 template < typename T >
 const char* extract( std::vector< T >& vec,
                      std::int32_t count,
@@ -474,12 +620,36 @@ const char* extract( std::vector< T >& vec,
     return xs;
 }
 
+/*
+ * uvari and origin are plain int32s, and arrays of them are decoded in bulk.
+ * Every uvari is at least one byte, so count is checked against the bytes
+ * left in the record before anything is allocated.
+ */
+template < typename T >
+const char* extract_uvaris( std::vector< T >& vec,
+                            std::int32_t count,
+                            const char* xs,
+                            const char* end ) noexcept (false) {
+    static_assert( sizeof( T ) == sizeof( std::int32_t ), "T must be int32" );
+
+    if (count < 0 || count > std::distance( xs, end ))
+        throw std::out_of_range( "unexpected end-of-record" );
+
+    std::vector< std::int32_t > tmp( count );
+    xs = dlis_uvaris( xs, count, tmp.data() );
+
+    std::vector< T > out( tmp.begin(), tmp.end() );
+    vec.swap( out );
+    return xs;
+}
+
 template < typename T >
 std::vector< T >& reset( dl::value_vector& value ) noexcept (false) {
     return value.emplace< std::vector< T > >();
 }
 
 const char* elements( const char* xs,
+                      const char* end,
                       dl::uvari count,
                       dl::representation_code reprc,
                       dl::value_vector& vec ) {
@@ -491,7 +661,40 @@ const char* elements( const char* xs,
         return xs;
     }
 
+    /*
+     * The elements are decoded without bounds checks, so make sure they all
+     * fit in the record first. Only the elements that carry their own length
+     * are walked one by one - fixed-size elements are checked all at once,
+     * and uvaris in runs.
+     */
     using rpc = dl::representation_code;
+    switch (reprc) {
+        case rpc::ident:
+        case rpc::ascii:
+        case rpc::units:
+        case rpc::obname:
+        case rpc::objref:
+        case rpc::attref: {
+            const char* last = xs;
+            for (std::int32_t i = 0; i < n; ++i)
+                last = skip( last, end, reprc );
+            break;
+        }
+
+        case rpc::uvari:
+        case rpc::origin:
+            skip_uvaris( xs, end, n );
+            break;
+
+        default: {
+            /* unknown codes are rejected when decoding */
+            const auto size = dlis_sizeof_type( static_cast< int >( reprc ) );
+            if (size > 0 and n > std::distance( xs, end ) / size)
+                throw std::out_of_range( "unexpected end-of-record" );
+            break;
+        }
+    }
+
     switch (reprc) {
         case rpc::fshort: return extract( reset< dl::fshort >( vec ), n, xs );
         case rpc::fsingl: return extract( reset< dl::fsingl >( vec ), n, xs );
@@ -510,11 +713,13 @@ const char* elements( const char* xs,
         case rpc::ushort: return extract( reset< dl::ushort >( vec ), n, xs );
         case rpc::unorm : return extract( reset< dl::unorm  >( vec ), n, xs );
         case rpc::ulong : return extract( reset< dl::ulong  >( vec ), n, xs );
-        case rpc::uvari : return extract( reset< dl::uvari  >( vec ), n, xs );
+        case rpc::uvari : return extract_uvaris( reset< dl::uvari  >( vec ),
+                                                 n, xs, end );
         case rpc::ident:  return extract( reset< dl::ident  >( vec ), n, xs );
         case rpc::ascii : return extract( reset< dl::ascii  >( vec ), n, xs );
         case rpc::dtime : return extract( reset< dl::dtime  >( vec ), n, xs );
-        case rpc::origin: return extract( reset< dl::origin >( vec ), n, xs );
+        case rpc::origin: return extract_uvaris( reset< dl::origin >( vec ),
+                                                 n, xs, end );
         case rpc::obname: return extract( reset< dl::obname >( vec ), n, xs );
         case rpc::objref: return extract( reset< dl::objref >( vec ), n, xs );
         case rpc::attref: return extract( reset< dl::attref >( vec ), n, xs );
@@ -590,9 +795,13 @@ const noexcept (false)
     return *itr;
 }
 
+namespace {
+
 const char* parse_template( const char* cur,
                             const char* end,
-                            object_template& out ) noexcept (false) {
+                            object_template& out,
+                            const context* ctx ) noexcept (false) {
+    using rpc = dl::representation_code;
     object_template tmp;
 
     while (true) {
@@ -609,7 +818,8 @@ const char* parse_template( const char* cur,
         cur += DLIS_DESCRIPTOR_SIZE;
 
         if (flags.absent) {
-            user_warning( "ABSATR in object template - skipping" );
+            user_warning( ctx, cur - DLIS_DESCRIPTOR_SIZE,
+                          "ABSATR in object template - skipping" );
             continue;
         }
 
@@ -624,22 +834,31 @@ const char* parse_template( const char* cur,
              *  Assume that if this isn't set properly it's a corrupted
              *  descriptor, so just try to read the label anyway
              */
-            user_warning( "Label not set, but must be non-null" );
+            user_warning( ctx, cur - DLIS_DESCRIPTOR_SIZE,
+                          "Label not set, but must be non-null" );
         }
 
-                         cur = cast( cur, attr.label );
-        if (flags.count) cur = cast( cur, attr.count );
-        if (flags.reprc) cur = cast( cur, attr.reprc );
-        if (flags.units) cur = cast( cur, attr.units );
-        if (flags.value) cur = elements( cur, attr.count,
-                                              attr.reprc,
-                                              attr.value );
+                         cur = cast( fits( cur, end, rpc::ident ), attr.label );
+        if (flags.count) cur = cast( fits( cur, end, rpc::uvari ), attr.count );
+        if (flags.reprc) cur = cast( fits( cur, end, rpc::ushort ), attr.reprc );
+        if (flags.units) cur = cast( fits( cur, end, rpc::units ), attr.units );
+        if (flags.value) cur = elements( cur, end, attr.count,
+                                                   attr.reprc,
+                                                   attr.value );
         attr.invariant = flags.invariant;
 
         tmp.push_back( std::move( attr ) );
     }
 }
 
+}
+
+const char* parse_template( const char* cur,
+                            const char* end,
+                            object_template& out ) noexcept (false) {
+    return parse_template( cur, end, out, nullptr );
+}
+
 namespace {
 
 basic_object defaulted_object( const object_template& tmpl ) noexcept (false) {
@@ -754,76 +973,121 @@ noexcept (false)
     }
 }
 
-object_vector parse_objects( const object_template& tmpl,
-                             const char* cur,
-                             const char* end ) noexcept (false) {
+const char* parse_object( const object_template& tmpl,
+                          const basic_object& default_object,
+                          const char* cur,
+                          const char* end,
+                          basic_object& current,
+                          const context* ctx ) noexcept (false) {
 
-    object_vector objs;
-    const auto default_object = defaulted_object( tmpl );
+    auto object_flags = parse_object_descriptor( cur, ctx );
+    cur += DLIS_DESCRIPTOR_SIZE;
 
-    while (true) {
-        if (std::distance( cur, end ) <= 0)
-            throw std::out_of_range( "unexpected end-of-record" );
+    using rpc = dl::representation_code;
+
+    current = default_object;
+    if (object_flags.name)
+        cur = cast( fits( cur, end, rpc::obname ), current.object_name );
+
+    for (const auto& template_attr : tmpl) {
+        if (template_attr.invariant) continue;
+        if (cur == end) break;
+
+        const auto flags = parse_attribute_descriptor( cur );
+        if (flags.object) break;
 
-        auto object_flags = parse_object_descriptor( cur );
+
+        /*
+         * only advance after this is surely not a new object, because if
+         * it's the next object we want to read it again
+         */
+        const auto* descriptor = cur;
         cur += DLIS_DESCRIPTOR_SIZE;
 
-        auto current = default_object;
-        if (object_flags.name) cur = cast( cur, current.object_name );
+        auto attr = template_attr;
+        // absent means no meaning, so *unset* whatever is there
+        if (flags.absent) {
+            current.remove( attr );
+            continue;
+        }
 
-        for (const auto& template_attr : tmpl) {
-            if (template_attr.invariant) continue;
-            if (cur == end) break;
+        if (flags.label) {
+            user_warning( ctx, descriptor, "ATTRIB:label set, but must be null");
+        }
 
-            const auto flags = parse_attribute_descriptor( cur );
-            if (flags.object) break;
+        if (flags.count) cur = cast( fits( cur, end, rpc::uvari ), attr.count );
+        if (flags.reprc) cur = cast( fits( cur, end, rpc::ushort ), attr.reprc );
+        if (flags.units) cur = cast( fits( cur, end, rpc::units ), attr.units );
+        if (flags.value) cur = elements( cur, end, attr.count,
+                                                   attr.reprc,
+                                                   attr.value );
 
+        const auto count = dl::decay( attr.count );
 
-            /*
-             * only advance after this is surely not a new object, because if
-             * it's the next object we want to read it again
-             */
-            cur += DLIS_DESCRIPTOR_SIZE;
+        /*
+         * 3.2.2.1 Component Descriptor
+         * When an object attribute count is zero, the value is explicitly
+         * undefined, even if a default exists.
+         *
+         * This is functionally equivalent to the value being marked absent
+         */
+        if (count == 0)
+            attr.value = mpark::monostate{};
 
-            auto attr = template_attr;
-            // absent means no meaning, so *unset* whatever is there
-            if (flags.absent) {
+        /*
+         * Count is non-zero, but there's no value for this attribute.
+         * Expand what's already defaulted, and if it is monostate, set the
+         * default of that value.
+         *
+         * The cursor is past the attribute either way, so when collecting
+         * diagnostics, an attribute that cannot be patched is dropped, and
+         * the object is otherwise fine
+         */
+        if (!flags.value) {
+            try {
+                patch_missing_value( attr.value, count, attr.reprc );
+            } catch (const std::bad_alloc&) {
+                throw;
+            } catch (const std::exception& e) {
+                if (not ctx) throw;
+                report( ctx, descriptor, e );
                 current.remove( attr );
                 continue;
             }
+        }
 
-            if (flags.label) {
-                user_warning( "ATTRIB:label set, but must be null");
-            }
+        current.set(attr);
+    }
 
-            if (flags.count) cur = cast( cur, attr.count );
-            if (flags.reprc) cur = cast( cur, attr.reprc );
-            if (flags.units) cur = cast( cur, attr.units );
-            if (flags.value) cur = elements( cur, attr.count,
-                                                  attr.reprc,
-                                                  attr.value );
+    return cur;
+}
 
-            const auto count = dl::decay( attr.count );
+object_vector parse_objects( const object_template& tmpl,
+                             const char* cur,
+                             const char* end,
+                             const context* ctx ) noexcept (false) {
 
-            /*
-             * 3.2.2.1 Component Descriptor
-             * When an object attribute count is zero, the value is explicitly
-             * undefined, even if a default exists.
-             *
-             * This is functionally equivalent to the value being marked absent
-             */
-            if (count == 0)
-                attr.value = mpark::monostate{};
+    object_vector objs;
+    const auto default_object = defaulted_object( tmpl );
+
+    while (true) {
+        if (std::distance( cur, end ) <= 0)
+            throw std::out_of_range( "unexpected end-of-record" );
 
+        basic_object current;
+        const auto* start = cur;
+        try {
+            cur = parse_object( tmpl, default_object, cur, end, current, ctx );
+        } catch (const std::bad_alloc&) {
+            throw;
+        } catch (const std::exception& e) {
             /*
-             * Count is non-zero, but there's no value for this attribute.
-             * Expand what's already defaulted, and if it is monostate, set the
-             * default of that value
+             * There is no telling where the next object starts, so keep the
+             * objects parsed so far, and end the set
              */
-            if (!flags.value)
-                patch_missing_value( attr.value, count, attr.reprc );
-
-            current.set(attr);
+            if (not ctx) throw;
+            report( ctx, start, e );
+            break;
         }
 
         objs.push_back( std::move( current ) );
@@ -834,15 +1098,14 @@ object_vector parse_objects( const object_template& tmpl,
     return objs;
 }
 
-}
-
-object_set parse_objects( const char* cur, const char* end ) {
+const char* parse_set_header( const char* cur,
+                              const char* end,
+                              object_set& set,
+                              const context* ctx ) noexcept (false) {
     if (std::distance( cur, end ) <= 0)
         throw std::out_of_range( "eflr must be non-empty" );
 
-    object_set set;
-
-    const auto flags = parse_set_descriptor( cur );
+    const auto flags = parse_set_descriptor( cur, ctx );
     cur += DLIS_DESCRIPTOR_SIZE;
 
     if (std::distance( cur, end ) <= 0) {
@@ -850,20 +1113,48 @@ object_set parse_objects( const char* cur, const char* end ) {
         throw std::out_of_range( msg );
     }
 
-    /*
-     * TODO: check for every read that inside [begin,end)?
-     */
+    using rpc = dl::representation_code;
     set.role = flags.role;
-    if (flags.type) cur = cast( cur, set.type );
-    if (flags.name) cur = cast( cur, set.name );
+    if (flags.type) cur = cast( fits( cur, end, rpc::ident ), set.type );
+    if (flags.name) cur = cast( fits( cur, end, rpc::ident ), set.name );
 
-    cur = parse_template( cur, end, set.tmpl );
+    cur = parse_template( cur, end, set.tmpl, ctx );
 
     if (std::distance( cur, end ) <= 0)
         throw std::out_of_range( "unexpected end-of-record after template" );
 
-    set.objects = parse_objects( set.tmpl, cur, end );
+    return cur;
+}
+
+}
+
+object_set parse_objects( const char* cur, const char* end ) {
+    object_set set;
+    cur = parse_set_header( cur, end, set, nullptr );
+    set.objects = parse_objects( set.tmpl, cur, end, nullptr );
     return set;
 }
 
+bool parse_objects( const char* begin,
+                    const char* end,
+                    object_set& out,
+                    diagnostics& diag ) noexcept (false) {
+    const context ctx = { &diag, begin };
+
+    object_set set;
+    const char* cur;
+    try {
+        cur = parse_set_header( begin, end, set, &ctx );
+    } catch (const std::bad_alloc&) {
+        throw;
+    } catch (const std::exception& e) {
+        report( &ctx, begin, e );
+        return false;
+    }
+
+    set.objects = parse_objects( set.tmpl, cur, end, &ctx );
+    out = std::move( set );
+    return true;
+}
+
 }
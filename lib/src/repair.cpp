@@ -0,0 +1,453 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include <dlisio/dlisio.h>
+#include <dlisio/types.h>
+
+#include <dlisio/ext/repair.hpp>
+
+namespace dl {
+
+namespace {
+
+/* larger than the largest visible record, so a whole record always fits */
+const std::size_t window_size = 1024 * 1024;
+
+/* records larger than this are written as they are read */
+const std::size_t holdback = 4 * 1024 * 1024;
+
+/* smallest legal segment, header included */
+const int min_segment = 16;
+
+/*
+ * A forward-moving window over the source file, so that streaming through
+ * it uses constant memory and mostly sequential reads
+ */
+class window {
+public:
+    explicit window( const std::string& path ) noexcept (false) :
+        buffer( window_size )
+    {
+        this->fs.open( path, std::ios::binary | std::ios::in );
+        if (!this->fs.good())
+            throw fmt::system_error(errno, "cannot to open file '{}'", path);
+
+        this->fs.seekg( 0, std::ios::end );
+        this->length = this->fs.tellg();
+    }
+
+    long long size() const noexcept (true) {
+        return this->length;
+    }
+
+    /*
+     * The n bytes at pos, or nullptr if the file ends before pos + n. n must
+     * not be larger than the window, and the pointer is valid until the next
+     * call.
+     */
+    const char* at( long long pos, std::size_t n ) noexcept (false) {
+        if (pos < 0 or pos + (long long)n > this->length) return nullptr;
+
+        const auto end = this->begin + (long long)this->valid;
+        if (pos >= this->begin and pos + (long long)n <= end)
+            return this->buffer.data() + (pos - this->begin);
+
+        const auto len = std::size_t( (std::min)(
+            (long long)this->buffer.size(),
+            this->length - pos
+        ));
+
+        this->fs.clear();
+        this->fs.seekg( pos );
+        this->fs.read( this->buffer.data(), len );
+        if (std::size_t( this->fs.gcount() ) != len)
+            throw std::runtime_error( "repair: unable to read source" );
+
+        this->begin = pos;
+        this->valid = len;
+        return this->buffer.data();
+    }
+
+private:
+    std::ifstream fs;
+    std::vector< char > buffer;
+    long long begin = 0;
+    std::size_t valid = 0;
+    long long length = 0;
+};
+
+/*
+ * Writes records as segments packed into visible records of at most maxlen
+ * bytes, buffering one visible record at a time
+ */
+class vrwriter {
+public:
+    vrwriter( std::ofstream& fs, int maxlen ) noexcept (true) :
+        fs( fs ),
+        maxlen( maxlen )
+    {}
+
+    /*
+     * Write a piece of a record. first is true for the first piece, and last
+     * for the last, so a record can be written in one or more calls. Pieces
+     * are split into segments as needed to fill the visible records.
+     */
+    void write( int type,
+                std::uint8_t attributes,
+                const char* data,
+                std::size_t size,
+                bool first,
+                bool last ) noexcept (false) {
+        if (size == 0 and not last) return;
+
+        bool head = first;
+        do {
+            auto avail = this->space();
+            if (avail < min_segment) {
+                this->flush();
+                avail = this->space();
+            }
+
+            const auto take = (std::min)( size, std::size_t( avail ) - 4 );
+            const auto final = last and take == size;
+
+            /* segments are even-sized and at least 16 bytes, pad as needed */
+            int pad = (DLIS_LRSH_SIZE + take) % 2;
+            if (DLIS_LRSH_SIZE + int(take) + pad < min_segment)
+                pad = min_segment - DLIS_LRSH_SIZE - int(take);
+
+            std::uint8_t attrs = attributes;
+            if (not head) attrs |= DLIS_SEGATTR_PREDSEG;
+            if (not final) attrs |= DLIS_SEGATTR_SUCCSEG;
+            if (pad > 0) attrs |= DLIS_SEGATTR_PADDING;
+            if (not head) attrs &= ~std::uint8_t( DLIS_SEGATTR_ENCRPKT );
+
+            const auto len = DLIS_LRSH_SIZE + int(take) + pad;
+            char lrsh[ DLIS_LRSH_SIZE ];
+            auto* xs = dlis_unormo( lrsh, std::uint16_t( len ) );
+            xs = dlis_ushorto( xs, attrs );
+            dlis_ushorto( xs, std::uint8_t( type ) );
+
+            auto& vr = this->vr;
+            vr.insert( vr.end(), lrsh, lrsh + sizeof( lrsh ) );
+            vr.insert( vr.end(), data, data + take );
+            if (pad > 0) {
+                vr.insert( vr.end(), pad - 1, 0 );
+                vr.push_back( char( pad ) );
+            }
+
+            this->bytes += take;
+            data += take;
+            size -= take;
+            head = false;
+        } while (size > 0);
+    }
+
+    void flush() noexcept (false) {
+        if (this->vr.empty()) return;
+
+        char vrl[ DLIS_VRL_SIZE ];
+        const auto len = DLIS_VRL_SIZE + this->vr.size();
+        auto* xs = dlis_unormo( vrl, std::uint16_t( len ) );
+        xs = dlis_ushorto( xs, 0xFF );
+        dlis_ushorto( xs, 0x01 );
+
+        this->fs.write( vrl, sizeof( vrl ) );
+        this->fs.write( this->vr.data(), this->vr.size() );
+        this->vr.clear();
+    }
+
+    long long bytes = 0;
+
+private:
+    int space() const noexcept (true) {
+        return this->maxlen - DLIS_VRL_SIZE - int(this->vr.size());
+    }
+
+    std::ofstream& fs;
+    int maxlen;
+    std::vector< char > vr;
+};
+
+class repair_log {
+public:
+    explicit repair_log( const std::string& path ) noexcept (false) {
+        if (path.empty()) return;
+
+        this->fs.exceptions( this->fs.exceptions()
+                           | std::ios_base::failbit
+                           | std::ios_base::badbit
+        );
+        this->fs.open( path, std::ios::trunc );
+    }
+
+    void operator () ( long long offset,
+                       long long dropped,
+                       const std::string& what ) noexcept (false) {
+        this->count += 1;
+        if (not this->fs.is_open()) return;
+
+        const auto line = fmt::format( "offset {}: {}, {} bytes dropped\n",
+                                       offset, what, dropped );
+        this->fs << line;
+    }
+
+    int count = 0;
+
+private:
+    std::ofstream fs;
+};
+
+/*
+ * A visible record header at pos whose first segment header fits inside it.
+ * The visible record may be cut short by end-of-file.
+ */
+bool plausible_vr( window& src, long long pos ) noexcept (false) {
+    const auto* xs = src.at( pos, DLIS_VRL_SIZE + DLIS_LRSH_SIZE );
+    if (not xs) return false;
+
+    /* the 0xFF 0x01 pattern findvrl looks for */
+    if (std::uint8_t( xs[ 2 ] ) != 0xFF) return false;
+    if (std::uint8_t( xs[ 3 ] ) != 0x01) return false;
+
+    int len, version;
+    dlis_vrl( xs, &len, &version );
+    if (len < 20) return false;
+
+    int seglen, type;
+    std::uint8_t attrs;
+    dlis_lrsh( xs + DLIS_VRL_SIZE, &seglen, &attrs, &type );
+    return seglen >= min_segment and seglen <= len - DLIS_VRL_SIZE;
+}
+
+long long resync( window& src, long long from ) noexcept (false) {
+    for (auto pos = from; pos < src.size(); ++pos) {
+        if (plausible_vr( src, pos )) return pos;
+    }
+    return src.size();
+}
+
+const char default_sul[] = "   1V1.00RECORD 8192Default Storage Set"
+                           "                                         ";
+
+}
+
+repair_result repair( const std::string& source,
+                      const std::string& target,
+                      const std::string& logpath )
+noexcept (false) {
+    window src( source );
+    repair_log log( logpath );
+
+    repair_result result;
+    result.records = 0;
+    result.truncated = 0;
+    result.dropped = 0;
+
+    std::ofstream fs;
+    fs.exceptions( fs.exceptions()
+                 | std::ios_base::failbit
+                 | std::ios_base::badbit
+    );
+    fs.open( target, std::ios::binary | std::ios::trunc );
+
+    /*
+     * The storage unit label, as findsul would find it. Anything before it
+     * is dropped, and if there is none, a default one is written
+     */
+    long long pos = 0;
+    int maxlen = 8192;
+    {
+        static const std::string needle = "RECORD";
+        const auto n = std::size_t( (std::min)( src.size(), 200LL ) );
+        const auto* head = src.at( 0, n );
+        const auto* itr = head ? std::search( head, head + n,
+                                              needle.begin(), needle.end() )
+                               : nullptr;
+
+        const auto sul = (head and itr != head + n) ? (itr - head) - 9 : -1;
+        const auto* label = sul >= 0 ? src.at( sul, DLIS_SUL_SIZE ) : nullptr;
+
+        if (label) {
+            if (sul > 0) {
+                log( 0, sul, "garbage before the storage unit label" );
+                result.dropped += sul;
+            }
+
+            int seqnum, major, minor, layout;
+            std::int64_t len;
+            char id[ 61 ] = {};
+            const auto err = dlis_sul( label, &seqnum, &major, &minor,
+                                              &layout, &len, id );
+            if ((err == DLIS_OK or err == DLIS_INCONSISTENT)
+                and len >= 64 and len <= 0xFFFF)
+                maxlen = int(len) & ~1;
+
+            fs.write( label, DLIS_SUL_SIZE );
+            pos = sul + DLIS_SUL_SIZE;
+        } else {
+            log( 0, 0, "no storage unit label, wrote a default one" );
+            fs.write( default_sul, DLIS_SUL_SIZE );
+        }
+    }
+
+    vrwriter out( fs, maxlen );
+
+    /* the record being read */
+    struct {
+        bool active = false;
+        bool streaming = false;
+        int type;
+        std::uint8_t attributes;
+        long long offset;
+        std::vector< char > body;
+    } rec;
+
+    static const auto fmtenc = DLIS_SEGATTR_EXFMTLR | DLIS_SEGATTR_ENCRYPT;
+
+    const auto abandon = [&]( const std::string& why ) {
+        if (not rec.active) return;
+
+        if (rec.streaming) {
+            out.write( rec.type, rec.attributes,
+                       rec.body.data(), rec.body.size(),
+                       false, true );
+            result.records += 1;
+            result.truncated += 1;
+            log( rec.offset, 0, why + ", record truncated" );
+        } else {
+            result.dropped += rec.body.size();
+            log( rec.offset, rec.body.size(), why + ", record dropped" );
+        }
+
+        rec.active = false;
+        rec.streaming = false;
+        rec.body.clear();
+    };
+
+    const auto segment = [&]( long long offset,
+                              const char* xs,
+                              int len,
+                              std::uint8_t attrs,
+                              int type ) {
+        const auto* body = xs + DLIS_LRSH_SIZE;
+        int size = len - DLIS_LRSH_SIZE;
+        if (attrs & DLIS_SEGATTR_TRAILEN) size -= 2;
+        if (attrs & DLIS_SEGATTR_CHCKSUM) size -= 2;
+        if ((attrs & DLIS_SEGATTR_PADDING) and size > 0)
+            size -= std::uint8_t( body[ size - 1 ] );
+
+        if (size < 0) {
+            abandon( "segment padding larger than the segment" );
+            result.dropped += len - DLIS_LRSH_SIZE;
+            return;
+        }
+
+        const auto predecessor = attrs & DLIS_SEGATTR_PREDSEG;
+        if (not predecessor) {
+            abandon( "record is missing its last segment" );
+
+            rec.active = true;
+            rec.type = type;
+            rec.attributes = attrs & (fmtenc | DLIS_SEGATTR_ENCRPKT);
+            rec.offset = offset;
+        } else if (not rec.active) {
+            log( offset, size, "segment is missing its predecessor" );
+            result.dropped += size;
+            return;
+        } else if (rec.type != type
+               or (rec.attributes & fmtenc) != (attrs & fmtenc)) {
+            abandon( "segment inconsistent with its predecessor" );
+            log( offset, size, "segment inconsistent with its predecessor" );
+            result.dropped += size;
+            return;
+        }
+
+        rec.body.insert( rec.body.end(), body, body + size );
+
+        if (not (attrs & DLIS_SEGATTR_SUCCSEG)) {
+            out.write( rec.type, rec.attributes,
+                       rec.body.data(), rec.body.size(),
+                       not rec.streaming, true );
+            result.records += 1;
+            rec.active = false;
+            rec.streaming = false;
+            rec.body.clear();
+            return;
+        }
+
+        if (rec.body.size() > holdback) {
+            out.write( rec.type, rec.attributes,
+                       rec.body.data(), rec.body.size(),
+                       not rec.streaming, false );
+            rec.streaming = true;
+            rec.body.clear();
+        }
+    };
+
+    while (pos < src.size()) {
+        if (not plausible_vr( src, pos )) {
+            const auto next = resync( src, pos + 1 );
+            abandon( "invalid visible record" );
+            log( pos, next - pos, "invalid visible record, skipped to the next" );
+            result.dropped += next - pos;
+            pos = next;
+            continue;
+        }
+
+        int len, version;
+        dlis_vrl( src.at( pos, DLIS_VRL_SIZE ), &len, &version );
+        const auto vrend = (std::min)( pos + len, src.size() );
+        auto p = pos + DLIS_VRL_SIZE;
+
+        while (p < vrend) {
+            if (vrend - p < min_segment) break;
+
+            int seglen, type;
+            std::uint8_t attrs;
+            dlis_lrsh( src.at( p, DLIS_LRSH_SIZE ), &seglen, &attrs, &type );
+            if (seglen < min_segment or p + seglen > vrend) break;
+
+            segment( p, src.at( p, seglen ), seglen, attrs, type );
+            p += seglen;
+        }
+
+        if (p == vrend) {
+            if (vrend < pos + len)
+                log( pos, 0, "visible record truncated by end-of-file" );
+            pos = vrend;
+            continue;
+        }
+
+        /*
+         * the segments do not add up to the visible record length. The
+         * visible record length is just as likely to be wrong as the segment
+         * length, so search for the next visible record from here
+         */
+        const auto next = resync( src, p );
+        abandon( "segments inconsistent with the visible record" );
+        log( p, next - p, "segments inconsistent with the visible record" );
+        result.dropped += next - p;
+        pos = next;
+    }
+
+    abandon( "file ends in the middle of a record" );
+
+    out.flush();
+    fs.close();
+
+    result.events = log.count;
+    result.bytes = out.bytes;
+    return result;
+}
+
+}
@@ -0,0 +1,526 @@
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include <mpark/variant.hpp>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/serialize.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+namespace {
+
+template < typename T >
+T load( const char* xs ) noexcept (true) {
+    T x;
+    std::memcpy( &x, xs, sizeof( x ) );
+    return x;
+}
+
+template < typename T >
+typename std::enable_if< std::is_arithmetic< T >::value >::type
+put( std::string& out, const T& x ) noexcept (false) {
+    out.append( reinterpret_cast< const char* >( &x ), sizeof( x ) );
+}
+
+void put( std::string& out, const std::string& x ) noexcept (false) {
+    put( out, std::uint32_t( x.size() ) );
+    out.append( x );
+}
+
+void put( std::string& out, const dl::fshort& x ) { put( out, decay( x ) ); }
+void put( std::string& out, const dl::isingl& x ) { put( out, decay( x ) ); }
+void put( std::string& out, const dl::vsingl& x ) { put( out, decay( x ) ); }
+void put( std::string& out, const dl::uvari& x )  { put( out, decay( x ) ); }
+void put( std::string& out, const dl::origin& x ) { put( out, decay( x ) ); }
+void put( std::string& out, const dl::status& x ) { put( out, decay( x ) ); }
+void put( std::string& out, const dl::ident& x )  { put( out, decay( x ) ); }
+void put( std::string& out, const dl::ascii& x )  { put( out, decay( x ) ); }
+void put( std::string& out, const dl::units& x )  { put( out, decay( x ) ); }
+
+template < typename T >
+void put( std::string& out, const validated< T, 2 >& x ) noexcept (false) {
+    put( out, x.V );
+    put( out, x.A );
+}
+
+template < typename T >
+void put( std::string& out, const validated< T, 3 >& x ) noexcept (false) {
+    put( out, x.V );
+    put( out, x.A );
+    put( out, x.B );
+}
+
+template < typename T >
+void put( std::string& out, const std::complex< T >& x ) noexcept (false) {
+    put( out, x.real() );
+    put( out, x.imag() );
+}
+
+void put( std::string& out, const dl::dtime& x ) noexcept (false) {
+    const std::int32_t xs[] = { x.Y, x.TZ, x.M, x.D, x.H, x.MN, x.S, x.MS };
+    for (const auto v : xs) put( out, v );
+}
+
+void put( std::string& out, const dl::obname& x ) noexcept (false) {
+    put( out, x.origin );
+    put( out, x.copy );
+    put( out, x.id );
+}
+
+void put( std::string& out, const dl::objref& x ) noexcept (false) {
+    put( out, x.type );
+    put( out, x.name );
+}
+
+void put( std::string& out, const dl::attref& x ) noexcept (false) {
+    put( out, x.type );
+    put( out, x.name );
+    put( out, x.label );
+}
+
+struct put_values {
+    std::string& out;
+
+    void operator () ( const mpark::monostate& ) const noexcept (true) {}
+
+    template < typename T >
+    void operator () ( const std::vector< T >& xs ) const noexcept (false) {
+        put( this->out, std::uint32_t( xs.size() ) );
+        for (const auto& x : xs) put( this->out, x );
+    }
+};
+
+void put( std::string& out, const object_attribute& x ) noexcept (false) {
+    put( out, x.label );
+    put( out, x.count );
+    put( out, std::uint8_t( x.reprc ) );
+    put( out, x.units );
+    put( out, std::uint8_t( x.invariant ) );
+    put( out, std::uint8_t( x.value.index() ) );
+    mpark::visit( put_values{ out }, x.value );
+}
+
+void put( std::string& out, const basic_object& x ) noexcept (false) {
+    put( out, x.object_name );
+    put( out, std::uint32_t( x.attributes.size() ) );
+    for (const auto& attr : x.attributes) put( out, attr );
+}
+
+void put( std::string& out, const object_set& x ) noexcept (false) {
+    put( out, std::int32_t( x.role ) );
+    put( out, x.type );
+    put( out, x.name );
+
+    put( out, std::uint32_t( x.tmpl.size() ) );
+    for (const auto& attr : x.tmpl) put( out, attr );
+
+    put( out, std::uint32_t( x.objects.size() ) );
+    for (const auto& obj : x.objects) put( out, obj );
+}
+
+void put( std::string& out, const record& x ) noexcept (false) {
+    put( out, std::int32_t( x.type ) );
+    put( out, x.attributes );
+    put( out, std::uint8_t( x.consistent ) );
+    put( out, std::uint32_t( x.data.size() ) );
+    out.append( x.data.data(), x.data.size() );
+}
+
+/*
+ * A bounds-checked reader. The data may come from another process or an
+ * old cache, so every length is checked against what is left before it is
+ * trusted.
+ */
+struct cursor {
+    const char* pos;
+    const char* end;
+
+    const char* take( std::size_t n ) noexcept (false) {
+        if (n > std::size_t( this->end - this->pos ))
+            throw std::runtime_error( "decode: data truncated" );
+        const auto* xs = this->pos;
+        this->pos += n;
+        return xs;
+    }
+
+    /* a count of elements that are at least one byte each */
+    std::size_t count() noexcept (false) {
+        const auto n = load< std::uint32_t >( this->take( 4 ) );
+        if (n > std::size_t( this->end - this->pos ))
+            throw std::runtime_error( "decode: data truncated" );
+        return n;
+    }
+};
+
+template < typename T >
+typename std::enable_if< std::is_arithmetic< T >::value >::type
+get( cursor& cur, T& x ) noexcept (false) {
+    x = load< T >( cur.take( sizeof( T ) ) );
+}
+
+void get( cursor& cur, std::string& x ) noexcept (false) {
+    const auto n = cur.count();
+    const auto* xs = cur.take( n );
+    x.assign( xs, xs + n );
+}
+
+template < typename T, typename Underlying >
+void get_alias( cursor& cur, T& x ) noexcept (false) {
+    Underlying v;
+    get( cur, v );
+    x = T( std::move( v ) );
+}
+
+void get( cursor& cur, dl::fshort& x ) { get_alias< dl::fshort, float >( cur, x ); }
+void get( cursor& cur, dl::isingl& x ) { get_alias< dl::isingl, float >( cur, x ); }
+void get( cursor& cur, dl::vsingl& x ) { get_alias< dl::vsingl, float >( cur, x ); }
+void get( cursor& cur, dl::uvari& x )  { get_alias< dl::uvari, std::int32_t >( cur, x ); }
+void get( cursor& cur, dl::origin& x ) { get_alias< dl::origin, std::int32_t >( cur, x ); }
+void get( cursor& cur, dl::status& x ) { get_alias< dl::status, std::uint8_t >( cur, x ); }
+void get( cursor& cur, dl::ident& x )  { get_alias< dl::ident, std::string >( cur, x ); }
+void get( cursor& cur, dl::ascii& x )  { get_alias< dl::ascii, std::string >( cur, x ); }
+void get( cursor& cur, dl::units& x )  { get_alias< dl::units, std::string >( cur, x ); }
+
+template < typename T >
+void get( cursor& cur, validated< T, 2 >& x ) noexcept (false) {
+    get( cur, x.V );
+    get( cur, x.A );
+}
+
+template < typename T >
+void get( cursor& cur, validated< T, 3 >& x ) noexcept (false) {
+    get( cur, x.V );
+    get( cur, x.A );
+    get( cur, x.B );
+}
+
+template < typename T >
+void get( cursor& cur, std::complex< T >& x ) noexcept (false) {
+    T re, im;
+    get( cur, re );
+    get( cur, im );
+    x = std::complex< T >( re, im );
+}
+
+void get( cursor& cur, dl::dtime& x ) noexcept (false) {
+    std::int32_t xs[ 8 ];
+    for (auto& v : xs) get( cur, v );
+    x = dl::dtime{ xs[0], xs[1], xs[2], xs[3], xs[4], xs[5], xs[6], xs[7] };
+}
+
+void get( cursor& cur, dl::obname& x ) noexcept (false) {
+    get( cur, x.origin );
+    get( cur, x.copy );
+    get( cur, x.id );
+}
+
+void get( cursor& cur, dl::objref& x ) noexcept (false) {
+    get( cur, x.type );
+    get( cur, x.name );
+}
+
+void get( cursor& cur, dl::attref& x ) noexcept (false) {
+    get( cur, x.type );
+    get( cur, x.name );
+    get( cur, x.label );
+}
+
+void get( cursor&, mpark::monostate& ) noexcept (true) {}
+
+template < typename T >
+void get( cursor& cur, std::vector< T >& xs ) noexcept (false) {
+    xs.resize( cur.count() );
+    for (auto& x : xs) get( cur, x );
+}
+
+/*
+ * Decode the alternative with the given index, by walking the alternatives
+ * of the variant at compile time
+ */
+template < std::size_t I,
+           std::size_t N = mpark::variant_size< value_vector >::value >
+struct get_values {
+    static void apply( cursor& cur, std::size_t index, value_vector& value )
+    noexcept (false) {
+        if (index != I)
+            return get_values< I + 1, N >::apply( cur, index, value );
+
+        typename mpark::variant_alternative< I, value_vector >::type xs;
+        get( cur, xs );
+        value = std::move( xs );
+    }
+};
+
+template < std::size_t N >
+struct get_values< N, N > {
+    static void apply( cursor&, std::size_t index, value_vector& )
+    noexcept (false) {
+        const auto msg = "decode: unknown value type {}";
+        throw std::runtime_error( fmt::format( msg, index ) );
+    }
+};
+
+void get( cursor& cur, object_attribute& x ) noexcept (false) {
+    get( cur, x.label );
+    get( cur, x.count );
+
+    std::uint8_t reprc, invariant, index;
+    get( cur, reprc );
+    x.reprc = representation_code( reprc );
+    get( cur, x.units );
+    get( cur, invariant );
+    x.invariant = invariant != 0;
+
+    get( cur, index );
+    get_values< 0 >::apply( cur, index, x.value );
+}
+
+void get( cursor& cur, basic_object& x ) noexcept (false) {
+    get( cur, x.object_name );
+    x.attributes.resize( cur.count() );
+    for (auto& attr : x.attributes) get( cur, attr );
+}
+
+void get( cursor& cur, object_set& x ) noexcept (false) {
+    std::int32_t role;
+    get( cur, role );
+    x.role = role;
+    get( cur, x.type );
+    get( cur, x.name );
+
+    x.tmpl.resize( cur.count() );
+    for (auto& attr : x.tmpl) get( cur, attr );
+
+    x.objects.resize( cur.count() );
+    for (auto& obj : x.objects) get( cur, obj );
+}
+
+void get( cursor& cur, record& x ) noexcept (false) {
+    std::int32_t type;
+    std::uint8_t consistent;
+    get( cur, type );
+    get( cur, x.attributes );
+    get( cur, consistent );
+    x.type = type;
+    x.consistent = consistent != 0;
+
+    const auto n = cur.count();
+    const auto* xs = cur.take( n );
+    x.data.assign( xs, xs + n );
+}
+
+/*
+ * The header of serialised buffers, a version and the type of what follows.
+ * Bump the version when the encoding changes.
+ */
+const std::uint8_t version = 1;
+
+enum class kind : std::uint8_t {
+    obname    = 1,
+    attribute = 2,
+    object    = 3,
+    set       = 4,
+    record    = 5,
+    sets      = 6,
+    objref    = 7,
+    attref    = 8,
+};
+
+template < typename T >
+std::string serialize_as( kind k, const T& x ) noexcept (false) {
+    std::string out;
+    put( out, version );
+    put( out, std::uint8_t( k ) );
+    put( out, x );
+    return out;
+}
+
+template < typename T >
+void deserialize_as( kind k, const char* xs, std::size_t size, T& x )
+noexcept (false) {
+    cursor cur{ xs, xs + size };
+
+    std::uint8_t v, tag;
+    get( cur, v );
+    get( cur, tag );
+    if (v != version) {
+        const auto msg = "deserialize: unsupported version {}, expected {}";
+        throw std::runtime_error( fmt::format( msg, v, version ) );
+    }
+
+    if (tag != std::uint8_t( k )) {
+        const auto msg = "deserialize: wrong type {}, expected {}";
+        throw std::invalid_argument( fmt::format( msg, tag, std::uint8_t(k) ) );
+    }
+
+    get( cur, x );
+    if (cur.pos != cur.end) {
+        const auto msg = "deserialize: {} trailing bytes";
+        throw std::runtime_error( fmt::format( msg, cur.end - cur.pos ) );
+    }
+}
+
+template < typename T >
+const char* decode_from( const char* begin, const char* end, T& x )
+noexcept (false) {
+    cursor cur{ begin, end };
+    get( cur, x );
+    return cur.pos;
+}
+
+}
+
+void encode( std::string& out, const dl::obname& x ) noexcept (false) {
+    put( out, x );
+}
+
+void encode( std::string& out, const dl::objref& x ) noexcept (false) {
+    put( out, x );
+}
+
+void encode( std::string& out, const dl::attref& x ) noexcept (false) {
+    put( out, x );
+}
+
+void encode( std::string& out, const dl::object_attribute& x )
+noexcept (false) {
+    put( out, x );
+}
+
+void encode( std::string& out, const dl::basic_object& x ) noexcept (false) {
+    put( out, x );
+}
+
+void encode( std::string& out, const dl::object_set& x ) noexcept (false) {
+    put( out, x );
+}
+
+void encode( std::string& out, const dl::record& x ) noexcept (false) {
+    put( out, x );
+}
+
+const char* decode( const char* begin, const char* end, dl::obname& x )
+noexcept (false) {
+    return decode_from( begin, end, x );
+}
+
+const char* decode( const char* begin, const char* end, dl::objref& x )
+noexcept (false) {
+    return decode_from( begin, end, x );
+}
+
+const char* decode( const char* begin, const char* end, dl::attref& x )
+noexcept (false) {
+    return decode_from( begin, end, x );
+}
+
+const char* decode( const char* begin, const char* end, dl::object_attribute& x )
+noexcept (false) {
+    return decode_from( begin, end, x );
+}
+
+const char* decode( const char* begin, const char* end, dl::basic_object& x )
+noexcept (false) {
+    return decode_from( begin, end, x );
+}
+
+const char* decode( const char* begin, const char* end, dl::object_set& x )
+noexcept (false) {
+    return decode_from( begin, end, x );
+}
+
+const char* decode( const char* begin, const char* end, dl::record& x )
+noexcept (false) {
+    return decode_from( begin, end, x );
+}
+
+std::string serialize( const dl::obname& x ) noexcept (false) {
+    return serialize_as( kind::obname, x );
+}
+
+std::string serialize( const dl::objref& x ) noexcept (false) {
+    return serialize_as( kind::objref, x );
+}
+
+std::string serialize( const dl::attref& x ) noexcept (false) {
+    return serialize_as( kind::attref, x );
+}
+
+std::string serialize( const dl::object_attribute& x ) noexcept (false) {
+    return serialize_as( kind::attribute, x );
+}
+
+std::string serialize( const dl::basic_object& x ) noexcept (false) {
+    return serialize_as( kind::object, x );
+}
+
+std::string serialize( const dl::object_set& x ) noexcept (false) {
+    return serialize_as( kind::set, x );
+}
+
+std::string serialize( const dl::record& x ) noexcept (false) {
+    return serialize_as( kind::record, x );
+}
+
+std::string serialize( const std::vector< dl::object_set >& xs )
+noexcept (false) {
+    std::string out;
+    put( out, version );
+    put( out, std::uint8_t( kind::sets ) );
+    put( out, std::uint32_t( xs.size() ) );
+    for (const auto& x : xs) put( out, x );
+    return out;
+}
+
+void deserialize( const char* xs, std::size_t size, dl::obname& x )
+noexcept (false) {
+    deserialize_as( kind::obname, xs, size, x );
+}
+
+void deserialize( const char* xs, std::size_t size, dl::objref& x )
+noexcept (false) {
+    deserialize_as( kind::objref, xs, size, x );
+}
+
+void deserialize( const char* xs, std::size_t size, dl::attref& x )
+noexcept (false) {
+    deserialize_as( kind::attref, xs, size, x );
+}
+
+void deserialize( const char* xs, std::size_t size, dl::object_attribute& x )
+noexcept (false) {
+    deserialize_as( kind::attribute, xs, size, x );
+}
+
+void deserialize( const char* xs, std::size_t size, dl::basic_object& x )
+noexcept (false) {
+    deserialize_as( kind::object, xs, size, x );
+}
+
+void deserialize( const char* xs, std::size_t size, dl::object_set& x )
+noexcept (false) {
+    deserialize_as( kind::set, xs, size, x );
+}
+
+void deserialize( const char* xs, std::size_t size, dl::record& x )
+noexcept (false) {
+    deserialize_as( kind::record, xs, size, x );
+}
+
+void deserialize( const char* xs,
+                  std::size_t size,
+                  std::vector< dl::object_set >& x )
+noexcept (false) {
+    deserialize_as( kind::sets, xs, size, x );
+}
+
+}
@@ -0,0 +1,329 @@
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <dlisio/ext/cache.hpp>
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/serialize.hpp>
+#include <dlisio/ext/snapshot.hpp>
+#include <dlisio/ext/types.hpp>
+
+namespace dl {
+
+namespace {
+
+/*
+ * The snapshot layout, all integers native-endian:
+ *
+ *  magic       char[8]     "dlissnp" + version byte
+ *  byteorder   u32         0x01020304 as written
+ *  reserved    u32
+ *  source      { size, hash u64 }
+ *  sul-offset  i64
+ *  sections    { count u64, offset u64 } * 7
+ *
+ * The sections, in order, each starting at a multiple of 8:
+ *
+ *  tells       i64[count]
+ *  residuals   i32[count]
+ *  explicits   i32[count]
+ *  implicits   i32[count]
+ *  encrypted   { record, company, packet i32 }[count]
+ *  sets        u64[count + 1]      offsets into heap, one per set + 1
+ *  heap        char[count]         the encoded object sets
+ *
+ * The object sets in the heap are encoded with dl::encode.
+ */
+const char magic[] = { 'd', 'l', 'i', 's', 's', 'n', 'p', 1 };
+const std::uint32_t byteorder = 0x01020304;
+
+const std::size_t encryptedsize = 12;
+const std::size_t sections      = 7;
+const std::size_t headersize    = 16 + 24 + sections * 16;
+
+template < typename T >
+T load( const char* xs ) noexcept (true) {
+    T x;
+    std::memcpy( &x, xs, sizeof( x ) );
+    return x;
+}
+
+std::uint64_t padded( std::uint64_t n ) noexcept (true) {
+    return (n + 7) & ~std::uint64_t(7);
+}
+
+template < typename T >
+void put( std::string& out, const T& x ) noexcept (false) {
+    out.append( reinterpret_cast< const char* >( &x ), sizeof( x ) );
+}
+
+
+template < typename T >
+void put_array( std::string& out, const std::vector< T >& xs )
+noexcept (false) {
+    if (xs.empty()) return;
+    out.append( reinterpret_cast< const char* >( xs.data() ),
+                xs.size() * sizeof( T ) );
+}
+
+}
+
+std::string write_snapshot( const snapshot& snap ) noexcept (false) {
+    std::string heap;
+    std::vector< std::uint64_t > setoffsets;
+    setoffsets.reserve( snap.sets.size() + 1 );
+    for (const auto& set : snap.sets) {
+        setoffsets.push_back( heap.size() );
+        encode( heap, set );
+    }
+    setoffsets.push_back( heap.size() );
+
+    const std::uint64_t counts[ sections ] = {
+        snap.tells.size(),
+        snap.residuals.size(),
+        snap.explicits.size(),
+        snap.implicits.size(),
+        snap.encrypted.size(),
+        snap.sets.size(),
+        heap.size(),
+    };
+    const std::uint64_t sizes[ sections ] = {
+        snap.tells.size() * sizeof( std::int64_t ),
+        snap.residuals.size() * sizeof( std::int32_t ),
+        snap.explicits.size() * sizeof( std::int32_t ),
+        snap.implicits.size() * sizeof( std::int32_t ),
+        snap.encrypted.size() * encryptedsize,
+        setoffsets.size() * sizeof( std::uint64_t ),
+        heap.size(),
+    };
+
+    std::uint64_t offsets[ sections ];
+    std::uint64_t offset = headersize;
+    for (std::size_t i = 0; i < sections; ++i) {
+        offsets[ i ] = offset;
+        offset = padded( offset + sizes[ i ] );
+    }
+
+    std::string out;
+    out.reserve( offset );
+
+    const auto align = [&]( std::size_t section ) {
+        out.resize( offsets[ section ], '\0' );
+    };
+
+    out.append( magic, sizeof( magic ) );
+    put( out, byteorder );
+    put( out, std::uint32_t( 0 ) );
+    put( out, snap.source.size );
+    put( out, snap.source.hash );
+    put( out, std::int64_t( snap.sul_offset ) );
+    for (std::size_t i = 0; i < sections; ++i) {
+        put( out, counts[ i ] );
+        put( out, offsets[ i ] );
+    }
+
+    align( 0 );
+    for (const auto tell : snap.tells) put( out, std::int64_t( tell ) );
+
+    align( 1 );
+    for (const auto x : snap.residuals) put( out, std::int32_t( x ) );
+
+    align( 2 );
+    for (const auto x : snap.explicits) put( out, std::int32_t( x ) );
+
+    align( 3 );
+    for (const auto x : snap.implicits) put( out, std::int32_t( x ) );
+
+    align( 4 );
+    for (const auto& x : snap.encrypted) {
+        put( out, std::int32_t( x.record ) );
+        put( out, std::int32_t( x.company ) );
+        put( out, std::int32_t( x.packet ) );
+    }
+
+    align( 5 );
+    put_array( out, setoffsets );
+
+    align( 6 );
+    out.append( heap );
+    out.resize( offset, '\0' );
+
+    return out;
+}
+
+snapshot_view::snapshot_view( const char* xs, std::size_t size )
+noexcept (false) :
+    data( xs ),
+    bytes( size )
+{
+    if (size < headersize)
+        throw std::runtime_error( "snapshot: buffer truncated" );
+
+    if (std::memcmp( xs, magic, sizeof( magic ) ) != 0)
+        throw std::runtime_error( "snapshot: not a snapshot, bad magic" );
+
+    if (load< std::uint32_t >( xs + 8 ) != byteorder)
+        throw std::runtime_error( "snapshot: byte order mismatch" );
+
+    this->fp.size = load< std::uint64_t >( xs + 16 );
+    this->fp.hash = load< std::uint64_t >( xs + 24 );
+    this->sul     = load< std::int64_t  >( xs + 32 );
+
+    section* all[ sections ] = {
+        &this->sec_tells,
+        &this->sec_residuals,
+        &this->sec_explicits,
+        &this->sec_implicits,
+        &this->sec_encrypted,
+        &this->sec_sets,
+        &this->sec_heap,
+    };
+
+    for (std::size_t i = 0; i < sections; ++i) {
+        all[ i ]->count  = load< std::uint64_t >( xs + 40 + i * 16 );
+        all[ i ]->offset = load< std::uint64_t >( xs + 40 + i * 16 + 8 );
+    }
+
+    /* the counts are checked against the size first, so that no product
+     * below can overflow */
+    for (std::size_t i = 0; i < sections; ++i) {
+        if (all[ i ]->count > size)
+            throw std::runtime_error( "snapshot: section out of bounds" );
+    }
+
+    const std::pair< const section*, std::uint64_t > extents[] = {
+        { &this->sec_tells,     this->sec_tells.count * 8 },
+        { &this->sec_residuals, this->sec_residuals.count * 4 },
+        { &this->sec_explicits, this->sec_explicits.count * 4 },
+        { &this->sec_implicits, this->sec_implicits.count * 4 },
+        { &this->sec_encrypted, this->sec_encrypted.count * encryptedsize },
+        { &this->sec_sets,      (this->sec_sets.count + 1) * 8 },
+        { &this->sec_heap,      this->sec_heap.count },
+    };
+
+    for (const auto& extent : extents) {
+        const auto& sec = *extent.first;
+        if (sec.offset > size or extent.second > size - sec.offset)
+            throw std::runtime_error( "snapshot: section out of bounds" );
+    }
+
+    if (this->sec_tells.count != this->sec_residuals.count)
+        throw std::runtime_error( "snapshot: corrupt index, "
+                                  "tells and residuals differ in size" );
+}
+
+const dl::fingerprint& snapshot_view::source() const noexcept (true) {
+    return this->fp;
+}
+
+long long snapshot_view::sul_offset() const noexcept (true) {
+    return this->sul;
+}
+
+namespace {
+
+template < typename T, typename Stored >
+std::vector< T > read_array( const char* xs, std::uint64_t count )
+noexcept (false) {
+    std::vector< T > out;
+    out.reserve( count );
+    for (std::uint64_t i = 0; i < count; ++i)
+        out.push_back( T( load< Stored >( xs + i * sizeof( Stored ) ) ) );
+    return out;
+}
+
+}
+
+std::vector< long long > snapshot_view::tells() const noexcept (false) {
+    return read_array< long long, std::int64_t >(
+        this->data + this->sec_tells.offset,
+        this->sec_tells.count
+    );
+}
+
+std::vector< int > snapshot_view::residuals() const noexcept (false) {
+    return read_array< int, std::int32_t >(
+        this->data + this->sec_residuals.offset,
+        this->sec_residuals.count
+    );
+}
+
+std::vector< int > snapshot_view::explicits() const noexcept (false) {
+    return read_array< int, std::int32_t >(
+        this->data + this->sec_explicits.offset,
+        this->sec_explicits.count
+    );
+}
+
+std::vector< int > snapshot_view::implicits() const noexcept (false) {
+    return read_array< int, std::int32_t >(
+        this->data + this->sec_implicits.offset,
+        this->sec_implicits.count
+    );
+}
+
+std::vector< encrypted_record > snapshot_view::encrypted() const
+noexcept (false) {
+    const auto* xs = this->data + this->sec_encrypted.offset;
+    std::vector< encrypted_record > out( this->sec_encrypted.count );
+    for (auto& x : out) {
+        x.record  = load< std::int32_t >( xs );
+        x.company = load< std::int32_t >( xs + 4 );
+        x.packet  = load< std::int32_t >( xs + 8 );
+        xs += encryptedsize;
+    }
+    return out;
+}
+
+std::size_t snapshot_view::size() const noexcept (true) {
+    return this->sec_sets.count;
+}
+
+object_set snapshot_view::set( std::size_t i ) const noexcept (false) {
+    if (i >= this->sec_sets.count) {
+        const auto msg = "snapshot: set {} out of range (size = {})";
+        throw std::out_of_range( fmt::format( msg, i, this->sec_sets.count ) );
+    }
+
+    const auto* offsets = this->data + this->sec_sets.offset;
+    const auto begin = load< std::uint64_t >( offsets + i * 8 );
+    const auto end   = load< std::uint64_t >( offsets + i * 8 + 8 );
+
+    if (begin > end or end > this->sec_heap.count)
+        throw std::runtime_error( "snapshot: corrupt set table" );
+
+    const auto* heap = this->data + this->sec_heap.offset;
+    object_set set;
+    const auto* last = dl::decode( heap + begin, heap + end, set );
+    if (last != heap + end)
+        throw std::runtime_error( "snapshot: corrupt set table" );
+    return set;
+}
+
+std::vector< object_set > snapshot_view::sets() const noexcept (false) {
+    std::vector< object_set > out;
+    out.reserve( this->size() );
+    for (std::size_t i = 0; i < this->size(); ++i)
+        out.push_back( this->set( i ) );
+    return out;
+}
+
+snapshot snapshot_view::decode() const noexcept (false) {
+    snapshot snap;
+    snap.source     = this->source();
+    snap.sul_offset = this->sul_offset();
+    snap.tells      = this->tells();
+    snap.residuals  = this->residuals();
+    snap.explicits  = this->explicits();
+    snap.implicits  = this->implicits();
+    snap.encrypted  = this->encrypted();
+    snap.sets       = this->sets();
+    return snap;
+}
+
+}
@@ -0,0 +1,545 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef HAVE_COPY_FILE_RANGE
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <fmt/core.h>
+#include <mio/mio.hpp>
+
+#include <dlisio/dlisio.h>
+#include <dlisio/types.h>
+
+#include <dlisio/ext/io.hpp>
+#include <dlisio/ext/subset.hpp>
+
+namespace dl {
+
+namespace {
+
+struct segment_ref {
+    long long offset;
+    int length;
+    /* the visible record of the segment, begin is -1 if not known */
+    long long vrbegin;
+    long long vrend;
+};
+
+/*
+ * Walk the segments of the record at tell, calling f( segment, attributes,
+ * type ) for every segment until f returns false. The record has already
+ * been indexed by findoffsets, so the segments are known to be inside the
+ * file.
+ */
+template < typename F >
+void walk_segments( const char* base, long long tell, int remaining, F f )
+noexcept (false) {
+    auto pos = tell;
+    long long vrbegin = -1;
+    long long vrend = tell + remaining;
+
+    while (true) {
+        if (remaining == 0) {
+            int len, version;
+            dlis_vrl( base + pos, &len, &version );
+            vrbegin = pos;
+            vrend = pos + len;
+            remaining = len - DLIS_VRL_SIZE;
+            pos += DLIS_VRL_SIZE;
+        }
+
+        int len, type;
+        std::uint8_t attrs;
+        dlis_lrsh( base + pos, &len, &attrs, &type );
+
+        const segment_ref seg = { pos, len, vrbegin, vrend };
+        if (not f( seg, attrs, type )) return;
+
+        pos += len;
+        remaining -= len;
+        if (not (attrs & DLIS_SEGATTR_SUCCSEG)) return;
+    }
+}
+
+/*
+ * The first bytes of the record body, with segment headers, trailers and
+ * padding removed, enough to read the set type of an EFLR or the frame name
+ * of an IFLR
+ */
+struct record_head {
+    int type;
+    std::uint8_t attributes;
+    std::string body;
+};
+
+record_head peek_record( const char* base,
+                         long long tell,
+                         int residual,
+                         std::size_t n )
+noexcept (false) {
+    record_head head;
+    bool first = true;
+
+    walk_segments( base, tell, residual,
+        [&]( const segment_ref& seg, std::uint8_t attrs, int type ) {
+            if (first) {
+                head.type = type;
+                head.attributes = attrs;
+                first = false;
+            }
+
+            const auto* body = base + seg.offset + DLIS_LRSH_SIZE;
+            int size = seg.length - DLIS_LRSH_SIZE;
+            if (attrs & DLIS_SEGATTR_TRAILEN) size -= 2;
+            if (attrs & DLIS_SEGATTR_CHCKSUM) size -= 2;
+            if ((attrs & DLIS_SEGATTR_PADDING) and size > 0)
+                size -= std::uint8_t( body[ size - 1 ] );
+
+            size = (std::max)( size, 0 );
+            const auto missing = n - head.body.size();
+            head.body.append( body, (std::min)( std::size_t( size ), missing ) );
+            return head.body.size() < n;
+        }
+    );
+
+    return head;
+}
+
+bool peek_set_type( const std::string& body, std::string& type )
+noexcept (true) {
+    if (body.size() < DLIS_DESCRIPTOR_SIZE + 1) return false;
+
+    const auto descriptor = std::uint8_t( body.front() );
+    int role, has_type, has_name;
+    dlis_component( descriptor, &role );
+    const auto err = dlis_component_set( descriptor, role, &has_type,
+                                                           &has_name );
+    if (err or not has_type) return false;
+
+    const auto* xs = body.data() + DLIS_DESCRIPTOR_SIZE;
+    const auto len = std::size_t( std::uint8_t( *xs ) );
+    if (body.size() < DLIS_DESCRIPTOR_SIZE + 1 + len) return false;
+
+    type.assign( xs + 1, len );
+    return true;
+}
+
+/* origin (uvari) + copy (ushort) + ident (ushort + 255 bytes) */
+const std::size_t max_obname_size = 4 + 1 + 1 + 255;
+
+bool peek_frame_name( const std::string& body, std::string& name )
+noexcept (true) {
+    /*
+     * dlis_obname does not check bounds, so read from a zero-padded copy,
+     * and verify afterwards that it did not read past the actual body
+     */
+    char buffer[ max_obname_size ] = {};
+    std::memcpy( buffer, body.data(), (std::min)( body.size(),
+                                                  sizeof( buffer ) ) );
+
+    std::int32_t origin, idlen;
+    std::uint8_t copy;
+    char id[ 256 ];
+    const auto* end = dlis_obname( buffer, &origin, &copy, &idlen, id );
+
+    if (std::size_t( end - buffer ) > body.size()) return false;
+    name.assign( id, idlen );
+    return true;
+}
+
+template < typename T, typename U >
+bool contains( const std::vector< T >& xs, const U& x ) noexcept (true) {
+    return std::find( xs.begin(), xs.end(), x ) != xs.end();
+}
+
+/*
+ * The output file. Bytes from the source are copied with copy_file_range
+ * when available, and with plain writes from the memory map otherwise.
+ * Copies of adjacent source ranges are merged, so that runs of whole
+ * visible records become a single, large copy.
+ */
+class sink {
+public:
+    sink( const std::string& target,
+          const std::string& source,
+          const mio::mmap_source& file ) noexcept (false);
+    ~sink();
+
+    sink( const sink& ) = delete;
+    sink& operator = ( const sink& ) = delete;
+
+    void write( const char* data, std::size_t size ) noexcept (false);
+    void copy( long long offset, long long size ) noexcept (false);
+    void close() noexcept (false);
+
+    long long bytes = 0;
+
+private:
+    void flush_copy() noexcept (false);
+    void flush_buffer() noexcept (false);
+    void put( const char* data, std::size_t size ) noexcept (false);
+    bool kernel_copy( long long offset, long long size ) noexcept (false);
+    [[noreturn]] void fail( int err ) const noexcept (false);
+
+    std::string target;
+    const mio::mmap_source& file;
+    std::vector< char > buffer;
+    long long pending_offset = 0;
+    long long pending_size = 0;
+
+#ifdef HAVE_COPY_FILE_RANGE
+    int in = -1;
+    int out = -1;
+    bool kernel = true;
+#else
+    std::ofstream fs;
+#endif
+};
+
+/* below this, copying through the buffer is cheaper than a system call */
+const long long small_copy = 64 * 1024;
+const std::size_t buffer_size = 1024 * 1024;
+
+void sink::fail( int err ) const noexcept (false) {
+    const auto msg = fmt::format( "subset: unable to write '{}'", this->target );
+    throw std::system_error( err, std::generic_category(), msg );
+}
+
+sink::sink( const std::string& target,
+            const std::string& source,
+            const mio::mmap_source& file ) noexcept (false) :
+    target( target ),
+    file( file )
+{
+    this->buffer.reserve( buffer_size );
+
+#ifdef HAVE_COPY_FILE_RANGE
+    this->in = ::open( source.c_str(), O_RDONLY );
+    if (this->in == -1) this->kernel = false;
+
+    this->out = ::open( target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    if (this->out == -1) {
+        const auto err = errno;
+        if (this->in != -1) ::close( this->in );
+        this->fail( err );
+    }
+#else
+    (void)source;
+    this->fs.exceptions( this->fs.exceptions()
+                       | std::ios_base::failbit
+                       | std::ios_base::badbit
+    );
+    this->fs.open( target, std::ios::binary | std::ios::trunc );
+#endif
+}
+
+sink::~sink() {
+#ifdef HAVE_COPY_FILE_RANGE
+    if (this->in  != -1) ::close( this->in );
+    if (this->out != -1) ::close( this->out );
+#endif
+}
+
+void sink::put( const char* data, std::size_t size ) noexcept (false) {
+#ifdef HAVE_COPY_FILE_RANGE
+    while (size > 0) {
+        const auto n = ::write( this->out, data, size );
+        if (n == -1 and errno == EINTR) continue;
+        if (n == -1) this->fail( errno );
+        data += n;
+        size -= n;
+    }
+#else
+    this->fs.write( data, size );
+#endif
+}
+
+bool sink::kernel_copy( long long offset, long long size ) noexcept (false) {
+#ifdef HAVE_COPY_FILE_RANGE
+    if (not this->kernel) return false;
+
+    loff_t off = offset;
+    long long copied = 0;
+    while (copied < size) {
+        const auto n = ::copy_file_range( this->in, &off,
+                                          this->out, nullptr,
+                                          size - copied, 0 );
+        if (n == -1 and errno == EINTR) continue;
+
+        if (n == -1 and copied == 0) {
+            /*
+             * not supported by the kernel or the file systems, so fall back
+             * to plain writes for the rest of the file
+             */
+            const auto err = errno;
+            if (err == EXDEV or err == ENOSYS or err == EINVAL
+                or err == EOPNOTSUPP) {
+                this->kernel = false;
+                return false;
+            }
+        }
+
+        if (n == -1) this->fail( errno );
+
+        /* source shrunk under us */
+        if (n == 0) this->fail( EIO );
+        copied += n;
+    }
+    return true;
+#else
+    (void)offset;
+    (void)size;
+    return false;
+#endif
+}
+
+void sink::flush_buffer() noexcept (false) {
+    if (this->buffer.empty()) return;
+    this->put( this->buffer.data(), this->buffer.size() );
+    this->buffer.clear();
+}
+
+void sink::flush_copy() noexcept (false) {
+    if (this->pending_size == 0) return;
+
+    const auto offset = this->pending_offset;
+    const auto size = this->pending_size;
+    this->pending_size = 0;
+
+    if (size >= small_copy) {
+        this->flush_buffer();
+        if (this->kernel_copy( offset, size )) return;
+        this->put( this->file.data() + offset, size );
+        return;
+    }
+
+    const auto* src = this->file.data() + offset;
+    this->buffer.insert( this->buffer.end(), src, src + size );
+    if (this->buffer.size() >= buffer_size) this->flush_buffer();
+}
+
+void sink::write( const char* data, std::size_t size ) noexcept (false) {
+    this->flush_copy();
+    this->buffer.insert( this->buffer.end(), data, data + size );
+    this->bytes += size;
+    if (this->buffer.size() >= buffer_size) this->flush_buffer();
+}
+
+void sink::copy( long long offset, long long size ) noexcept (false) {
+    this->bytes += size;
+    if (this->pending_size > 0
+        and this->pending_offset + this->pending_size == offset) {
+        this->pending_size += size;
+        return;
+    }
+
+    this->flush_copy();
+    this->pending_offset = offset;
+    this->pending_size = size;
+}
+
+void sink::close() noexcept (false) {
+    this->flush_copy();
+    this->flush_buffer();
+
+#ifdef HAVE_COPY_FILE_RANGE
+    const auto fd = this->out;
+    this->out = -1;
+    if (::close( fd ) == -1) this->fail( errno );
+#else
+    this->fs.close();
+#endif
+}
+
+/*
+ * Packs segments into new visible records of at most limit bytes. A segment
+ * that does not fit in a visible record with others gets one of its own.
+ */
+class packer {
+public:
+    packer( sink& out, int limit ) : out( out ), limit( limit ) {}
+
+    void add( const segment_ref& seg ) noexcept (false) {
+        const auto size = this->size + seg.length;
+        if (not this->segments.empty() and size + DLIS_VRL_SIZE > this->limit)
+            this->flush();
+
+        this->segments.push_back( seg );
+        this->size += seg.length;
+    }
+
+    void flush() noexcept (false) {
+        if (this->segments.empty()) return;
+
+        char vrl[ DLIS_VRL_SIZE ];
+        auto* xs = dlis_unormo( vrl, std::uint16_t( this->size + DLIS_VRL_SIZE ) );
+        xs = dlis_ushorto( xs, 0xFF );
+        dlis_ushorto( xs, 0x01 );
+        this->out.write( vrl, sizeof( vrl ) );
+
+        for (const auto& seg : this->segments)
+            this->out.copy( seg.offset, seg.length );
+
+        this->segments.clear();
+        this->size = 0;
+    }
+
+private:
+    sink& out;
+    int limit;
+    int size = 0;
+    std::vector< segment_ref > segments;
+};
+
+}
+
+std::vector< int > select_records( const mio::mmap_source& file,
+                                   const stream_offsets& ofs,
+                                   const subset_selection& sel )
+noexcept (false) {
+    const auto* base = file.data();
+    const auto& logical_files = sel.logical_files;
+    const auto& types = sel.types;
+    const auto& frames = sel.frames;
+
+    std::vector< int > selected;
+    int lf = -1;
+    std::string name;
+
+    for (std::size_t i = 0; i < ofs.tells.size(); ++i) {
+        const auto head = peek_record( base,
+                                       ofs.tells[ i ],
+                                       ofs.residuals[ i ],
+                                       max_obname_size );
+
+        const auto isexplicit = ofs.explicits[ i ] != 0;
+        const auto encrypted = head.attributes & DLIS_SEGATTR_ENCRYPT;
+        const auto fileheader = isexplicit and head.type == DLIS_FHLR;
+        if (fileheader) lf += 1;
+
+        const auto logical_file = (std::max)( lf, 0 );
+        if (not logical_files.empty() and not contains( logical_files,
+                                                        logical_file ))
+            continue;
+
+        if (isexplicit) {
+            const auto keep = fileheader
+                           or types.empty()
+                           or (not encrypted
+                               and peek_set_type( head.body, name )
+                               and contains( types, name ));
+            if (keep) selected.push_back( i );
+        } else {
+            const auto keep = frames.empty()
+                           or (not encrypted
+                               and peek_frame_name( head.body, name )
+                               and contains( frames, name ));
+            if (keep) selected.push_back( i );
+        }
+    }
+
+    return selected;
+}
+
+subset_result write_subset( const std::string& source,
+                            const std::string& target,
+                            const subset_selection& sel )
+noexcept (false) {
+    mio::mmap_source file;
+    map_source( file, source );
+
+    const auto sul = findsul( file );
+    if (std::size_t( sul + DLIS_SUL_SIZE ) > file.size())
+        throw std::runtime_error( "file truncated in storage label" );
+
+    const auto vrl = findvrl( file, sul + DLIS_SUL_SIZE );
+    const auto ofs = findoffsets( file, vrl );
+    const auto records = select_records( file, ofs, sel );
+
+    /*
+     * Re-wrapped visible records respect the maximum record length of the
+     * label. 0 means unlimited, but stick to a modest size anyway
+     */
+    int limit = 8192;
+    {
+        int seqnum, major, minor, layout;
+        std::int64_t maxlen;
+        char id[ 61 ] = {};
+        const auto err = dlis_sul( file.data() + sul, &seqnum,
+                                                      &major,
+                                                      &minor,
+                                                      &layout,
+                                                      &maxlen,
+                                                      id );
+        if ((err == DLIS_OK or err == DLIS_INCONSISTENT) and maxlen > 0)
+            limit = int( (std::min)( maxlen, std::int64_t( 0xFFFE ) ) );
+    }
+
+    std::vector< segment_ref > segments;
+    for (const auto i : records) {
+        walk_segments( file.data(), ofs.tells[ i ], ofs.residuals[ i ],
+            [&]( const segment_ref& seg, std::uint8_t, int ) {
+                segments.push_back( seg );
+                return true;
+            }
+        );
+    }
+
+    subset_result result;
+    result.records = records.size();
+    result.verbatim = 0;
+
+    try {
+        sink out( target, source, file );
+        out.write( file.data() + sul, DLIS_SUL_SIZE );
+
+        packer pack( out, limit );
+        std::size_t i = 0;
+        while (i < segments.size()) {
+            /* the selected segments of the same visible record */
+            const auto vrend = segments[ i ].vrend;
+            long long vrbegin = -1;
+            long long size = 0;
+            auto j = i;
+            for (; j < segments.size() and segments[ j ].vrend == vrend; ++j) {
+                size += segments[ j ].length;
+                vrbegin = (std::max)( vrbegin, segments[ j ].vrbegin );
+            }
+
+            const auto whole = vrbegin != -1
+                           and segments[ i ].offset == vrbegin + DLIS_VRL_SIZE
+                           and size == vrend - vrbegin - DLIS_VRL_SIZE;
+
+            if (whole) {
+                pack.flush();
+                out.copy( vrbegin, vrend - vrbegin );
+                result.verbatim += vrend - vrbegin;
+            } else {
+                for (auto k = i; k < j; ++k) pack.add( segments[ k ] );
+            }
+
+            i = j;
+        }
+
+        pack.flush();
+        out.close();
+        result.bytes = out.bytes;
+    } catch (...) {
+        std::remove( target.c_str() );
+        throw;
+    }
+
+    return result;
+}
+
+}
@@ -178,6 +178,63 @@ const char* dlis_uvari( const char* xs, std::int32_t* out ) {
     return xs + len;
 }
 
+namespace {
+
+/*
+ * The length of a uvari, from its first byte. With the two high bits as h,
+ * 0x -> 1, 10 -> 2 and 11 -> 4, without branching
+ */
+int uvarilen( std::uint8_t x ) noexcept (true) {
+    const int h = x >> 6;
+    return 1 + (h >> 1) + (h & (h >> 1)) * 2;
+}
+
+/*
+ * True if the next 8 bytes are all one-byte uvaris, i.e. none of them have
+ * the high bit set
+ */
+bool shortrun( const char* xs ) noexcept (true) {
+    std::uint64_t x;
+    std::memcpy( &x, xs, sizeof( x ) );
+    return (x & 0x8080808080808080ULL) == 0;
+}
+
+}
+
+const char* dlis_uvaris( const char* xs, int n, std::int32_t* out ) {
+    int i = 0;
+    while (i < n) {
+        if (n - i >= 8 && shortrun( xs )) {
+            for (int k = 0; k < 8; ++k)
+                out[ i + k ] = std::uint8_t( xs[ k ] );
+
+            xs += 8;
+            i  += 8;
+            continue;
+        }
+
+        xs = dlis_uvari( xs, out + i );
+        ++i;
+    }
+
+    return xs;
+}
+
+const char* dlis_skipuvaris( const char* xs, int n ) {
+    while (n > 0) {
+        if (n >= 8 && shortrun( xs )) {
+            xs += 8;
+            n  -= 8;
+            continue;
+        }
+
+        xs += uvarilen( xs[ 0 ] );
+        --n;
+    }
+
+    return xs;
+}
+
 const char* dlis_ident( const char* xs, std::int32_t* len, char* out ) {
     std::uint8_t ln;
     xs = dlis_ushort( xs, &ln );
@@ -236,6 +293,51 @@ const char* dlis_dtime( const char* xs, int* Y,
     return xs + sizeof( ms );
 }
 
+namespace {
+
+/*
+ * Days since 1970-01-01 in the proleptic gregorian calendar, from Howard
+ * Hinnant's days_from_civil. The year starts in March, so that the leap day
+ * is the last day of the year.
+ */
+std::int64_t days_from_civil( std::int64_t y, int m, int d ) noexcept (true) {
+    y -= m <= 2;
+    const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const std::int64_t yoe = y - era * 400;
+    const std::int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const std::int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+int days_in_month( int y, int m ) noexcept (true) {
+    constexpr const int days[] = {
+        31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31,
+    };
+
+    const bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    if (m == 2 && leap) return 29;
+    return days[ m - 1 ];
+}
+
+}
+
+std::int64_t dlis_dtime_ns( int Y, int TZ, int M, int D, int H, int MN, int S,
+                            int MS ) {
+    const int year = dlis_year( Y );
+    if (M < 1 || M > 12) return DLIS_NAT;
+    if (D < 1 || D > days_in_month( year, M )) return DLIS_NAT;
+    if (H < 0 || H > 23) return DLIS_NAT;
+    if (MN < 0 || MN > 59) return DLIS_NAT;
+    if (S < 0 || S > 59) return DLIS_NAT;
+    if (MS < 0 || MS > 999) return DLIS_NAT;
+
+    const std::int64_t days = days_from_civil( year, M, D );
+    std::int64_t seconds = days * 86400 + H * 3600 + MN * 60 + S;
+    if (TZ == DLIS_TZ_DST) seconds -= 3600;
+
+    return seconds * 1000000000 + std::int64_t( MS ) * 1000000;
+}
+
 const char* dlis_origin( const char* xs, std::int32_t* out ) {
     return dlis_uvari( xs, out );
 }
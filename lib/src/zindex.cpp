@@ -0,0 +1,490 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include <mio/mio.hpp>
+
+#include <dlisio/ext/cache.hpp>
+#include <dlisio/ext/types.hpp>
+#include <dlisio/ext/zindex.hpp>
+
+namespace dl {
+
+bool iscompressed( const mio::mmap_source& file ) noexcept (true) {
+    if (file.size() < 2) return false;
+    const auto* xs = reinterpret_cast< const unsigned char* >( file.data() );
+
+    /* gzip magic */
+    if (xs[ 0 ] == 0x1F and xs[ 1 ] == 0x8B) return true;
+
+    /*
+     * zlib header: deflate with at most a 32K window, and a check sum that
+     * makes the header a multiple of 31. A DLIS file starts with the storage
+     * unit label, which is ascii and never matches
+     */
+    const auto cmf = xs[ 0 ];
+    const auto flg = xs[ 1 ];
+    return (cmf & 0x0F) == 8 and (cmf >> 4) <= 7 and (cmf * 256 + flg) % 31 == 0;
+}
+
+namespace {
+
+/*
+ * The index layout, all integers native-endian:
+ *
+ *  magic       char[8]     "dliszix" + version byte
+ *  byteorder   u32         0x01020304 as written
+ *  reserved    u32
+ *  size        u64         fingerprint of the compressed file
+ *  hash        u64
+ *  size        i64         size of the uncompressed stream
+ *  span        i64
+ *  count       u64         number of checkpoints
+ *
+ * followed by the checkpoints:
+ *
+ *  in          i64
+ *  out         i64
+ *  bits        i32
+ *  header      i32
+ *  windowlen   u64
+ *  window      char[windowlen]
+ */
+const char magic[] = { 'd', 'l', 'i', 's', 'z', 'i', 'x', 1 };
+const std::uint32_t byteorder = 0x01020304;
+
+template < typename T >
+void put( std::ofstream& fs, const T& x ) noexcept (false) {
+    fs.write( reinterpret_cast< const char* >( &x ), sizeof( x ) );
+}
+
+template < typename T >
+T get( std::ifstream& fs ) noexcept (false) {
+    T x;
+    fs.read( reinterpret_cast< char* >( &x ), sizeof( x ) );
+    return x;
+}
+
+}
+
+void write_zindex( const std::string& path, const zindex& index )
+noexcept (false) {
+    std::ofstream fs;
+    fs.exceptions( fs.exceptions()
+                 | std::ios_base::failbit
+                 | std::ios_base::badbit
+    );
+    fs.open( path, std::ios::binary | std::ios::trunc );
+
+    fs.write( magic, sizeof( magic ) );
+    put( fs, byteorder );
+    put( fs, std::uint32_t( 0 ) );
+    put( fs, std::uint64_t( index.source.size ) );
+    put( fs, std::uint64_t( index.source.hash ) );
+    put( fs, std::int64_t( index.size ) );
+    put( fs, std::int64_t( index.span ) );
+    put( fs, std::uint64_t( index.checkpoints.size() ) );
+
+    for (const auto& cp : index.checkpoints) {
+        put( fs, std::int64_t( cp.in ) );
+        put( fs, std::int64_t( cp.out ) );
+        put( fs, std::int32_t( cp.bits ) );
+        put( fs, std::int32_t( cp.header ) );
+        put( fs, std::uint64_t( cp.window.size() ) );
+        fs.write( cp.window.data(), cp.window.size() );
+    }
+}
+
+zindex read_zindex( const std::string& path ) noexcept (false) {
+    std::ifstream fs;
+    fs.exceptions( fs.exceptions()
+                 | std::ios_base::failbit
+                 | std::ios_base::badbit
+    );
+    fs.open( path, std::ios::binary | std::ios::ate );
+    const auto filesize = std::uint64_t( fs.tellg() );
+    fs.seekg( 0 );
+
+    const auto corrupt = []( const char* what ) {
+        const auto msg = "zindex: corrupt index, {}";
+        return std::runtime_error( fmt::format( msg, what ) );
+    };
+
+    if (filesize < sizeof( magic ))
+        throw std::runtime_error( "zindex: not an index file, bad magic" );
+
+    char mgc[ sizeof( magic ) ];
+    fs.read( mgc, sizeof( mgc ) );
+    if (std::memcmp( mgc, magic, sizeof( magic ) ) != 0)
+        throw std::runtime_error( "zindex: not an index file, bad magic" );
+
+    try {
+        if (get< std::uint32_t >( fs ) != byteorder)
+            throw std::runtime_error( "zindex: byte order mismatch" );
+        get< std::uint32_t >( fs );
+
+        zindex index;
+        index.source.size = get< std::uint64_t >( fs );
+        index.source.hash = get< std::uint64_t >( fs );
+        index.size = get< std::int64_t >( fs );
+        index.span = get< std::int64_t >( fs );
+        const auto count = get< std::uint64_t >( fs );
+
+        /* every checkpoint is at least 32 bytes */
+        if (index.size < 0 or count == 0 or count > filesize / 32)
+            throw corrupt( "invalid header" );
+
+        index.checkpoints.reserve( count );
+        long long prev = 0;
+        for (std::uint64_t i = 0; i < count; ++i) {
+            zcheckpoint cp;
+            cp.in     = get< std::int64_t >( fs );
+            cp.out    = get< std::int64_t >( fs );
+            cp.bits   = get< std::int32_t >( fs );
+            cp.header = get< std::int32_t >( fs ) != 0;
+            const auto len = get< std::uint64_t >( fs );
+
+            if (cp.in < 0 or cp.out < prev or cp.out > index.size)
+                throw corrupt( "checkpoint out of order" );
+            if (cp.bits < 0 or cp.bits > 7 or len > filesize)
+                throw corrupt( "invalid checkpoint" );
+
+            cp.window.resize( len );
+            fs.read( &cp.window[ 0 ], len );
+            prev = cp.out;
+            index.checkpoints.push_back( std::move( cp ) );
+        }
+
+        return index;
+    } catch (const std::ios_base::failure&) {
+        throw corrupt( "unexpected end-of-file" );
+    }
+}
+
+#ifndef HAVE_ZLIB
+
+zindex build_zindex( const std::string&, long long ) noexcept (false) {
+    throw dl::not_implemented( "compressed files, dlisio built without zlib" );
+}
+
+zreader::zreader( const std::string&, const zindex&, int ) noexcept (false) {
+    throw dl::not_implemented( "compressed files, dlisio built without zlib" );
+}
+
+long long zreader::size() const noexcept (true) {
+    return this->index.size;
+}
+
+void zreader::read( char*, long long, std::size_t ) noexcept (false) {
+    throw dl::not_implemented( "compressed files, dlisio built without zlib" );
+}
+
+#else
+
+namespace {
+
+const int window_size = 32768;
+const std::size_t chunk_size = 64 * 1024;
+
+/* z_stream that is always cleaned up */
+class inflater {
+public:
+    explicit inflater( int windowbits ) noexcept (false) {
+        std::memset( &this->strm, 0, sizeof( this->strm ) );
+        if (inflateInit2( &this->strm, windowbits ) != Z_OK)
+            throw std::runtime_error( "zindex: unable to initialise zlib" );
+    }
+
+    ~inflater() {
+        inflateEnd( &this->strm );
+    }
+
+    z_stream strm;
+};
+
+std::string deflate_window( const unsigned char* window ) noexcept (false) {
+    auto len = compressBound( window_size );
+    std::string out( len, '\0' );
+    auto* dst = reinterpret_cast< Bytef* >( &out[ 0 ] );
+    if (compress( dst, &len, window, window_size ) != Z_OK)
+        throw std::runtime_error( "zindex: unable to compress window" );
+
+    out.resize( len );
+    return out;
+}
+
+std::vector< unsigned char > inflate_window( const std::string& deflated )
+noexcept (false) {
+    std::vector< unsigned char > window( window_size );
+    uLongf len = window_size;
+    const auto* src = reinterpret_cast< const Bytef* >( deflated.data() );
+    const auto err = uncompress( window.data(), &len, src, deflated.size() );
+    if (err != Z_OK or len != uLongf( window_size ))
+        throw std::runtime_error( "zindex: corrupt window" );
+
+    return window;
+}
+
+std::runtime_error zerror( const char* who, const z_stream& strm, long long at )
+noexcept (true) {
+    const auto msg = "{}: {} at compressed offset {}";
+    const auto* what = strm.msg ? strm.msg : "invalid compressed data";
+    return std::runtime_error( fmt::format( msg, who, what, at ) );
+}
+
+}
+
+zindex build_zindex( const std::string& path, long long span )
+noexcept (false) {
+    if (span < window_size) {
+        const auto msg = "build_zindex: expected span (which is {}) >= {}";
+        throw std::invalid_argument( fmt::format( msg, span, window_size ) );
+    }
+
+    std::ifstream fs( path, std::ios::binary );
+    if (!fs.good())
+        throw fmt::system_error(errno, "cannot to open file '{}'", path);
+
+    zindex index;
+    index.source = file_fingerprint( path );
+    index.span = span;
+
+    /* 32 + 15 detects both zlib and gzip headers */
+    inflater z( 47 );
+    auto& strm = z.strm;
+
+    std::vector< unsigned char > input( chunk_size );
+    std::vector< unsigned char > window( window_size );
+
+    long long totin = 0;
+    long long totout = 0;
+    long long last = 0;
+
+    const auto checkpoint = [&]( int bits, bool header ) {
+        zcheckpoint cp;
+        cp.in = totin;
+        cp.out = totout;
+        cp.bits = bits;
+        cp.header = header;
+
+        /*
+         * window is written round-robin, so the oldest bytes are after the
+         * write position
+         */
+        if (not header) {
+            std::vector< unsigned char > linear( window_size );
+            const auto left = strm.avail_out;
+            std::copy( window.end() - left, window.end(), linear.begin() );
+            std::copy( window.begin(), window.end() - left,
+                       linear.begin() + left );
+            cp.window = deflate_window( linear.data() );
+        }
+
+        index.checkpoints.push_back( std::move( cp ) );
+        last = totout;
+    };
+
+    const auto refill = [&] {
+        std::copy_n( strm.next_in, strm.avail_in, input.begin() );
+        auto* dst = reinterpret_cast< char* >( input.data() ) + strm.avail_in;
+        fs.read( dst, input.size() - strm.avail_in );
+        if (fs.bad())
+            throw std::runtime_error( "build_zindex: unable to read file" );
+
+        strm.next_in = input.data();
+        strm.avail_in += uInt( fs.gcount() );
+    };
+
+    /*
+     * gzip members can be concatenated, and anything else after the end of
+     * the stream is ignored, like gzip does
+     */
+    const auto another_member = [&] {
+        if (strm.avail_in < 2) refill();
+        return strm.avail_in >= 2
+           and strm.next_in[ 0 ] == 0x1F
+           and strm.next_in[ 1 ] == 0x8B;
+    };
+
+    strm.avail_out = 0;
+    checkpoint( 0, true );
+
+    while (true) {
+        if (strm.avail_in == 0) {
+            refill();
+            if (strm.avail_in == 0)
+                throw std::runtime_error( "build_zindex: file truncated" );
+        }
+
+        if (strm.avail_out == 0) {
+            strm.next_out = window.data();
+            strm.avail_out = window_size;
+        }
+
+        totin += strm.avail_in;
+        totout += strm.avail_out;
+        auto err = inflate( &strm, Z_BLOCK );
+        totin -= strm.avail_in;
+        totout -= strm.avail_out;
+
+        if (err == Z_NEED_DICT) err = Z_DATA_ERROR;
+        if (err == Z_DATA_ERROR or err == Z_MEM_ERROR or err == Z_STREAM_ERROR)
+            throw zerror( "build_zindex", strm, totin );
+
+        if (err == Z_STREAM_END) {
+            if (not another_member()) break;
+            inflateReset( &strm );
+            checkpoint( 0, true );
+            continue;
+        }
+
+        /*
+         * Only deflate block boundaries can be resumed from. Bit 7 of
+         * data_type is set at the end of a block, and bit 6 at the end of the
+         * last block, where there is nothing more to resume
+         */
+        const auto boundary = (strm.data_type & 128)
+                          and not (strm.data_type & 64);
+
+        if (boundary and totout - last > span)
+            checkpoint( strm.data_type & 7, false );
+    }
+
+    index.size = totout;
+    return index;
+}
+
+zreader::zreader( const std::string& path, const zindex& index, int blocks )
+noexcept (false) :
+    index( index ),
+    capacity( std::size_t( (std::max)( blocks, 1 ) ) )
+{
+    if (this->index.checkpoints.empty())
+        throw std::invalid_argument( "zreader: index has no checkpoints" );
+
+    this->fs.open( path, std::ios::binary | std::ios::in );
+    if (!this->fs.good())
+        throw fmt::system_error(errno, "cannot to open file '{}'", path);
+}
+
+long long zreader::size() const noexcept (true) {
+    return this->index.size;
+}
+
+const std::string& zreader::block( std::size_t i ) noexcept (false) {
+    const auto hit = [i]( const std::pair< std::size_t, std::string >& x ) {
+        return x.first == i;
+    };
+
+    auto itr = std::find_if( this->cache.begin(), this->cache.end(), hit );
+    if (itr != this->cache.end()) {
+        this->cache.splice( this->cache.begin(), this->cache, itr );
+        return this->cache.front().second;
+    }
+
+    const auto& checkpoints = this->index.checkpoints;
+    const auto& cp = checkpoints[ i ];
+    const auto end = i + 1 < checkpoints.size()
+                   ? checkpoints[ i + 1 ].out
+                   : this->index.size;
+
+    std::string out( std::size_t( end - cp.out ), '\0' );
+
+    /* resume raw deflate in the middle, or start over at a gzip header */
+    inflater z( cp.header ? 47 : -15 );
+    auto& strm = z.strm;
+
+    this->fs.clear();
+    this->fs.seekg( cp.in - (cp.bits ? 1 : 0) );
+
+    if (cp.bits) {
+        const auto c = this->fs.get();
+        if (c == std::char_traits< char >::eof())
+            throw std::runtime_error( "zreader: file truncated" );
+        inflatePrime( &strm, cp.bits, c >> (8 - cp.bits) );
+    }
+
+    if (not cp.header) {
+        const auto window = inflate_window( cp.window );
+        inflateSetDictionary( &strm, window.data(), window_size );
+    }
+
+    std::vector< unsigned char > input( chunk_size );
+    strm.next_out = reinterpret_cast< Bytef* >( &out[ 0 ] );
+    strm.avail_out = uInt( out.size() );
+
+    while (strm.avail_out > 0) {
+        if (strm.avail_in == 0) {
+            this->fs.read( reinterpret_cast< char* >( input.data() ),
+                           input.size() );
+            strm.next_in = input.data();
+            strm.avail_in = uInt( this->fs.gcount() );
+            if (strm.avail_in == 0)
+                throw std::runtime_error( "zreader: file truncated" );
+        }
+
+        auto err = inflate( &strm, Z_NO_FLUSH );
+        if (err == Z_NEED_DICT) err = Z_DATA_ERROR;
+        if (err == Z_DATA_ERROR or err == Z_MEM_ERROR or err == Z_STREAM_ERROR)
+            throw zerror( "zreader", strm, cp.in );
+
+        if (err == Z_STREAM_END) break;
+    }
+
+    if (strm.avail_out != 0) {
+        const auto msg = "zreader: block {} ends early, the index does not "
+                         "match the file"
+        ;
+        throw std::runtime_error( fmt::format( msg, i ) );
+    }
+
+    this->cache.emplace_front( i, std::move( out ) );
+    if (this->cache.size() > this->capacity) this->cache.pop_back();
+    return this->cache.front().second;
+}
+
+void zreader::read( char* dst, long long offset, std::size_t n )
+noexcept (false) {
+    if (offset < 0 or offset + (long long)n > this->size()) {
+        const auto msg = "zreader: read of {} bytes at {} past end (at {})";
+        throw std::out_of_range( fmt::format( msg, n, offset, this->size() ) );
+    }
+
+    const auto& checkpoints = this->index.checkpoints;
+    const auto cmp = []( long long x, const zcheckpoint& cp ) {
+        return x < cp.out;
+    };
+
+    while (n > 0) {
+        const auto itr = std::upper_bound( checkpoints.begin(),
+                                           checkpoints.end(),
+                                           offset,
+                                           cmp );
+        const auto i = std::size_t( std::distance( checkpoints.begin(), itr ) )
+                     - 1;
+
+        const auto& data = this->block( i );
+        const auto skip = std::size_t( offset - checkpoints[ i ].out );
+        const auto len = (std::min)( data.size() - skip, n );
+        std::copy_n( data.data() + skip, len, dst );
+
+        dst += len;
+        offset += len;
+        n -= len;
+    }
+}
+
+#endif // HAVE_ZLIB
+
+}
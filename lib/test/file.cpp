@@ -0,0 +1,309 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include <dlisio/dlisio.h>
+#include <dlisio/file.h>
+
+namespace {
+
+const char* path = "data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS";
+
+struct handle {
+    handle() {
+        this->err = dlis_file_open( path, &this->f );
+    }
+
+    ~handle() {
+        dlis_file_close( this->f );
+    }
+
+    dlis_file* f = nullptr;
+    int err;
+};
+
+}
+
+TEST_CASE("Opening a missing file", "[file]") {
+    dlis_file* f = nullptr;
+    const auto err = dlis_file_open( "data/no-such-file.dlis", &f );
+    CHECK( err == DLIS_IO_ERROR );
+    REQUIRE( f );
+    CHECK( std::string( dlis_file_errmsg( f ) ) != "" );
+    dlis_file_close( f );
+}
+
+TEST_CASE("The index and frames of a file", "[file]") {
+    handle h;
+    REQUIRE( h.err == DLIS_OK );
+    CHECK( std::string( dlis_file_errmsg( h.f ) ) == "" );
+
+    int records = 0;
+    CHECK( dlis_file_nrecords( h.f, &records ) == DLIS_OK );
+    CHECK( records == 3252 );
+
+    std::vector< long long > tells( records );
+    std::vector< int > explicits( records );
+    CHECK( dlis_file_records( h.f, records - 1, tells.data(), nullptr,
+                              explicits.data() ) == DLIS_INVALID_ARGS );
+    CHECK( dlis_file_records( h.f, records, tells.data(), nullptr,
+                              explicits.data() ) == DLIS_OK );
+    CHECK( tells.front() == 80 );
+    CHECK( explicits.front() != 0 );
+
+    int frames = 0;
+    CHECK( dlis_file_nframes( h.f, &frames ) == DLIS_OK );
+    CHECK( frames == 2 );
+
+    std::size_t idlen = 0;
+    std::int32_t origin = -1;
+    std::uint8_t copy = 1;
+    CHECK( dlis_file_frame_name( h.f, 0, nullptr, 0, &idlen,
+                                 &origin, &copy ) == DLIS_OK );
+    CHECK( idlen == 5 );
+    CHECK( origin == 2 );
+    CHECK( copy == 0 );
+
+    char small[ 5 ];
+    CHECK( dlis_file_frame_name( h.f, 0, small, sizeof( small ), &idlen,
+                                 nullptr, nullptr ) == DLIS_INVALID_ARGS );
+
+    char id[ 6 ];
+    CHECK( dlis_file_frame_name( h.f, 0, id, sizeof( id ), nullptr,
+                                 nullptr, nullptr ) == DLIS_OK );
+    CHECK( std::string( id ) == "2000T" );
+
+    CHECK( dlis_file_frame_name( h.f, 2, id, sizeof( id ), nullptr,
+                                 nullptr, nullptr ) == DLIS_INVALID_ARGS );
+    CHECK( std::string( dlis_file_errmsg( h.f ) ) != "" );
+}
+
+TEST_CASE("The channels of a frame", "[file]") {
+    handle h;
+    REQUIRE( h.err == DLIS_OK );
+
+    int channels = 0;
+    CHECK( dlis_file_frame_nchannels( h.f, 0, &channels ) == DLIS_OK );
+    CHECK( channels == 4 );
+
+    char id[ 32 ];
+    char fmt = 0;
+    int elements = 0;
+    std::size_t itemsize = 0;
+    CHECK( dlis_file_channel( h.f, 0, 0, id, sizeof( id ), nullptr,
+                              nullptr, nullptr,
+                              &fmt, &elements, &itemsize ) == DLIS_OK );
+    CHECK( std::string( id ) == "TIME" );
+    CHECK( fmt == DLIS_FMT_FSINGL );
+    CHECK( elements == 1 );
+    CHECK( itemsize == 4 );
+
+    CHECK( dlis_file_channel( h.f, 0, -1, id, sizeof( id ), nullptr,
+                              nullptr, nullptr,
+                              &fmt, &elements, &itemsize ) == DLIS_OK );
+    CHECK( std::string( id ) == "" );
+    CHECK( fmt == DLIS_FMT_UVARI );
+    CHECK( itemsize == 4 );
+
+    CHECK( dlis_file_channel( h.f, 0, 4, nullptr, 0, nullptr,
+                              nullptr, nullptr,
+                              nullptr, nullptr, nullptr )
+           == DLIS_INVALID_ARGS );
+}
+
+TEST_CASE("Reading rows of a frame", "[file]") {
+    handle h;
+    REQUIRE( h.err == DLIS_OK );
+
+    std::int64_t rows = 0;
+    CHECK( dlis_file_frame_rows( h.f, 0, &rows ) == DLIS_OK );
+    REQUIRE( rows == 921 );
+
+    std::vector< std::int32_t > framenos( rows );
+    std::vector< float > index( rows );
+    std::vector< float > tens( rows );
+
+    const int channels[] = { -1, 0, 2 };
+    void* const dst[] = { framenos.data(), index.data(), tens.data() };
+    const std::size_t dstsize[] = {
+        framenos.size() * sizeof( std::int32_t ),
+        index.size() * sizeof( float ),
+        tens.size() * sizeof( float ),
+    };
+
+    SECTION("all rows") {
+        std::int64_t nread = 0;
+        CHECK( dlis_file_read( h.f, 0, 0, rows, 3, channels, dst, dstsize,
+                               &nread ) == DLIS_OK );
+        CHECK( nread == rows );
+        CHECK( framenos.front() == 1 );
+        CHECK( framenos.back() == 921 );
+        CHECK( index.front() == 16677259.0f );
+        CHECK( index[ 1 ] == 16678259.0f );
+        CHECK( tens[ 0 ] == 2233.0f );
+        CHECK( tens[ 1 ] == 2237.0f );
+        CHECK( tens[ 2 ] == 2211.0f );
+    }
+
+    SECTION("a range, which is clamped at the last row") {
+        std::int64_t nread = 0;
+        CHECK( dlis_file_read( h.f, 0, 919, 10, 3, channels, dst, dstsize,
+                               &nread ) == DLIS_OK );
+        CHECK( nread == 2 );
+        CHECK( framenos[ 0 ] == 920 );
+        CHECK( framenos[ 1 ] == 921 );
+
+        CHECK( dlis_file_read( h.f, 0, rows, 10, 3, channels, dst, dstsize,
+                               &nread ) == DLIS_OK );
+        CHECK( nread == 0 );
+
+        CHECK( dlis_file_read( h.f, 0, 1, 2, 3, channels, dst, dstsize,
+                               &nread ) == DLIS_OK );
+        CHECK( nread == 2 );
+        CHECK( framenos[ 0 ] == 2 );
+        CHECK( framenos[ 1 ] == 3 );
+        CHECK( tens[ 0 ] == 2237.0f );
+    }
+
+    SECTION("too small buffers leave the buffers untouched") {
+        const std::size_t small[] = { 4, 4, 4 };
+        framenos[ 1 ] = -1;
+        std::int64_t nread = -1;
+        CHECK( dlis_file_read( h.f, 0, 0, 2, 3, channels, dst, small,
+                               &nread ) == DLIS_INVALID_ARGS );
+        CHECK( nread == -1 );
+        CHECK( framenos[ 1 ] == -1 );
+    }
+
+    SECTION("past the end") {
+        std::int64_t nread = 0;
+        CHECK( dlis_file_read( h.f, 0, rows + 1, 1, 3, channels, dst,
+                               dstsize, &nread ) == DLIS_INVALID_ARGS );
+    }
+}
+
+TEST_CASE("Logical files that reuse frame and channel names", "[file]") {
+    /*
+     * Both logical files have a frame MAIN of the channels INDEX and VAL,
+     * but with different representation codes, and the first also has a
+     * frame TEXT with a string channel
+     */
+    dlis_file* f = nullptr;
+    REQUIRE( dlis_file_open( "data/multiple-logical-files.dlis", &f )
+             == DLIS_OK );
+
+    int frames = 0;
+    CHECK( dlis_file_nframes( f, &frames ) == DLIS_OK );
+    CHECK( frames == 3 );
+
+    char id[ 8 ];
+    CHECK( dlis_file_frame_name( f, 0, id, sizeof( id ), nullptr,
+                                 nullptr, nullptr ) == DLIS_OK );
+    CHECK( std::string( id ) == "MAIN" );
+    CHECK( dlis_file_frame_name( f, 2, id, sizeof( id ), nullptr,
+                                 nullptr, nullptr ) == DLIS_OK );
+    CHECK( std::string( id ) == "MAIN" );
+
+    char fmt = 0;
+    std::size_t itemsize = 0;
+    CHECK( dlis_file_channel( f, 0, 1, nullptr, 0, nullptr, nullptr, nullptr,
+                              &fmt, nullptr, &itemsize ) == DLIS_OK );
+    CHECK( fmt == DLIS_FMT_FSINGL );
+    CHECK( itemsize == 4 );
+    CHECK( dlis_file_channel( f, 2, 1, nullptr, 0, nullptr, nullptr, nullptr,
+                              &fmt, nullptr, &itemsize ) == DLIS_OK );
+    CHECK( fmt == DLIS_FMT_FDOUBL );
+    CHECK( itemsize == 8 );
+
+    const int channels[] = { 0, 1 };
+    std::int64_t rows = 0;
+    std::int64_t nread = 0;
+
+    SECTION("the first logical file") {
+        CHECK( dlis_file_frame_rows( f, 0, &rows ) == DLIS_OK );
+        CHECK( rows == 3 );
+
+        float index[ 3 ];
+        float val[ 3 ];
+        void* const dst[] = { index, val };
+        const std::size_t dstsize[] = { sizeof( index ), sizeof( val ) };
+        CHECK( dlis_file_read( f, 0, 0, 3, 2, channels, dst, dstsize,
+                               &nread ) == DLIS_OK );
+        CHECK( nread == 3 );
+        CHECK( index[ 0 ] == 1.0f );
+        CHECK( index[ 2 ] == 3.0f );
+        CHECK( val[ 0 ] == 0.5f );
+        CHECK( val[ 1 ] == 1.5f );
+        CHECK( val[ 2 ] == 2.5f );
+    }
+
+    SECTION("the second logical file") {
+        CHECK( dlis_file_frame_rows( f, 2, &rows ) == DLIS_OK );
+        CHECK( rows == 2 );
+
+        std::int32_t index[ 2 ];
+        double val[ 2 ];
+        void* const dst[] = { index, val };
+        const std::size_t dstsize[] = { sizeof( index ), sizeof( val ) };
+        CHECK( dlis_file_read( f, 2, 0, 2, 2, channels, dst, dstsize,
+                               &nread ) == DLIS_OK );
+        CHECK( nread == 2 );
+        CHECK( index[ 0 ] == 100 );
+        CHECK( index[ 1 ] == 200 );
+        CHECK( val[ 0 ] == 0.25 );
+        CHECK( val[ 1 ] == 0.75 );
+    }
+
+    SECTION("a frame with strings") {
+        CHECK( dlis_file_frame_rows( f, 1, &rows ) == DLIS_OK );
+        CHECK( rows == 3 );
+
+        CHECK( dlis_file_channel( f, 1, 1, nullptr, 0, nullptr, nullptr,
+                                  nullptr, &fmt, nullptr, &itemsize )
+               == DLIS_OK );
+        CHECK( fmt == DLIS_FMT_ASCII );
+        CHECK( itemsize == 0 );
+
+        CHECK( dlis_file_channel( f, 1, 2, nullptr, 0, nullptr, nullptr,
+                                  nullptr, &fmt, nullptr, &itemsize )
+               == DLIS_OK );
+        CHECK( fmt == DLIS_FMT_FSINGL );
+        CHECK( itemsize == 4 );
+
+        float index[ 3 ];
+        float val[ 3 ];
+        void* const dst[] = { index, val };
+        const std::size_t dstsize[] = { sizeof( index ), sizeof( val ) };
+        CHECK( dlis_file_read( f, 1, 0, 3, 2, channels, dst, dstsize,
+                               &nread ) == DLIS_NOT_IMPLEMENTED );
+    }
+
+    dlis_file_close( f );
+}
+
+TEST_CASE("A frame that is truncated in the length of a string", "[file]") {
+    dlis_file* f = nullptr;
+    REQUIRE( dlis_file_open( "data/truncated-frame.dlis", &f ) == DLIS_OK );
+
+    std::int64_t rows = 0;
+    CHECK( dlis_file_frame_rows( f, 0, &rows ) == DLIS_UNEXPECTED_VALUE );
+    const auto msg = std::string( dlis_file_errmsg( f ) );
+    CHECK( msg.find( "truncated" ) != std::string::npos );
+
+    dlis_file_close( f );
+}
+
+TEST_CASE("A channel with zero elements", "[file]") {
+    dlis_file* f = nullptr;
+    REQUIRE( dlis_file_open( "data/zero-dimension.dlis", &f ) == DLIS_OK );
+
+    int channels = 0;
+    CHECK( dlis_file_frame_nchannels( f, 0, &channels )
+           == DLIS_UNEXPECTED_VALUE );
+    const auto msg = std::string( dlis_file_errmsg( f ) );
+    CHECK( msg.find( "elements" ) != std::string::npos );
+
+    dlis_file_close( f );
+}
@@ -1342,3 +1342,59 @@ TEST_CASE("pack size single values") {
     CHECK( packsize( "J" ) == 4 );
     CHECK( packsize( "q" ) == 1 );
 }
+
+TEST_CASE("pack length of fixed-size values") {
+    const unsigned char source[] = {
+        0x59,                   // sshort
+        0x00, 0x01,             // unorm
+        0x3F, 0x80, 0x00, 0x00, // fsingl
+    };
+
+    int nread, nwrite;
+    const auto err = dlis_packflen( "dUf", source, &nread, &nwrite );
+    CHECK( err == DLIS_OK );
+    CHECK( nread == sizeof(source) );
+    CHECK( nwrite == 1 + 2 + 4 );
+}
+
+TEST_CASE("pack length of variable-size values") {
+    const unsigned char source[] = {
+        0x01,                   // uvari, 1 byte
+        0x80, 0x01,             // uvari, 2 bytes
+        0xC0, 0x00, 0x00, 0x01, // origin, 4 bytes
+        0x03, 0x41, 0x42, 0x43, // ident "ABC"
+        0x02, 0x44, 0x45,       // ascii "DE"
+        0x01, 0x00, 0x01, 0x46, // obname (1, 0, "F")
+    };
+
+    int nread, nwrite;
+    const auto err = dlis_packflen( "iiJsSo", source, &nread, &nwrite );
+    CHECK( err == DLIS_OK );
+    CHECK( nread == sizeof(source) );
+    CHECK( nwrite == 4 + 4 + 4 + (4 + 3) + (4 + 2) + (4 + 1 + 4 + 1) );
+
+    std::vector< char > dst( nwrite );
+    CHECK( dlis_packf( "iiJsSo", source, dst.data() ) == DLIS_OK );
+}
+
+TEST_CASE("pack length with optional output arguments") {
+    const unsigned char source[] = { 0x03, 0x41, 0x42, 0x43 };
+
+    int nread = -1;
+    int nwrite = -1;
+    CHECK( dlis_packflen( "s", source, &nread, nullptr ) == DLIS_OK );
+    CHECK( nread == 4 );
+
+    CHECK( dlis_packflen( "s", source, nullptr, &nwrite ) == DLIS_OK );
+    CHECK( nwrite == 7 );
+}
+
+TEST_CASE("pack length fails with invalid specifier") {
+    const unsigned char source[] = { 0x00, 0x00, 0x00, 0x00 };
+
+    int nread = -1;
+    int nwrite = -1;
+    CHECK( dlis_packflen( "uw", source, &nread, &nwrite ) == DLIS_INVALID_ARGS );
+    CHECK( nread == -1 );
+    CHECK( nwrite == -1 );
+}
@@ -462,6 +462,49 @@ TEST_CASE("variable-length unsigned int", "[type]") {
             }
         }
     }
+
+    SECTION("array") {
+        /*
+         * A run of one-byte uvaris long enough for the eight-at-a-time path,
+         * broken up by longer ones, and a short tail
+         */
+        const bytes< 27 > in = {
+            0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x7F,
+            0x80, 0x2E,             // 46
+            0xC0, 0x00, 0x01, 0x00, // 256
+            0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10,
+            0xBF, 0xFF,             // 16383
+            0x2E,
+        };
+
+        const std::array< std::int32_t, 22 > expected = {
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 127,
+            46,
+            256,
+            9, 10, 11, 12, 13, 14, 15, 16,
+            16383,
+            46,
+        };
+
+        SECTION("to native") {
+            std::array< std::int32_t, expected.size() > out;
+            const char* end = dlis_uvaris( in, out.size(), out.data() );
+            CHECK( out == expected );
+            CHECK( std::intptr_t(end) == std::intptr_t(in + sizeof( in )) );
+        }
+
+        SECTION("skip") {
+            for( std::size_t n = 0; n <= expected.size(); ++n ) {
+                const char* cur = in;
+                std::int32_t v;
+                for( std::size_t i = 0; i < n; ++i )
+                    cur = dlis_uvari( cur, &v );
+
+                const char* end = dlis_skipuvaris( in, n );
+                CHECK( std::intptr_t(end) == std::intptr_t(cur) );
+            }
+        }
+    }
 }
 
 TEST_CASE("short float (16-bit)", "[type]") {
@@ -1320,6 +1363,58 @@ TEST_CASE("date-time", "[type]") {
         CHECK( intptr_t(end) == intptr_t(&x) + sizeof( x ) );
         CHECK_THAT( input, BytesEquals( x ) );
     }
+
+    SECTION("to nanoseconds since epoch") {
+        // DST is moved back an hour, to 8:20:15.62 PM
+        const std::int64_t expected = 545862015620000000;
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_DST, 4, 19, 21, 20, 15, 620 )
+               == expected );
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_LST, 4, 19, 20, 20, 15, 620 )
+               == expected );
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 4, 19, 20, 20, 15, 620 )
+               == expected );
+
+        CHECK( dlis_dtime_ns( 0, DLIS_TZ_GMT, 1, 1, 0, 0, 0, 0 )
+               == -2208988800000000000 );
+        CHECK( dlis_dtime_ns( 100, DLIS_TZ_GMT, 2, 29, 23, 59, 59, 0 )
+               == 951868799000000000 );
+
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 0, 19, 0, 0, 0, 0 )
+               == DLIS_NAT );
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 4, 0, 0, 0, 0, 0 )
+               == DLIS_NAT );
+    }
+
+    SECTION("invalid dates and times are NaT") {
+        // 1987-04-31
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 4, 31, 0, 0, 0, 0 )
+               == DLIS_NAT );
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 4, 30, 0, 0, 0, 0 )
+               != DLIS_NAT );
+
+        // 1987 and 1900 are not leap years, 1988 and 2000 are
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 2, 29, 0, 0, 0, 0 )
+               == DLIS_NAT );
+        CHECK( dlis_dtime_ns( 0, DLIS_TZ_GMT, 2, 29, 0, 0, 0, 0 )
+               == DLIS_NAT );
+        CHECK( dlis_dtime_ns( 88, DLIS_TZ_GMT, 2, 29, 0, 0, 0, 0 )
+               != DLIS_NAT );
+        CHECK( dlis_dtime_ns( 100, DLIS_TZ_GMT, 2, 29, 0, 0, 0, 0 )
+               != DLIS_NAT );
+        CHECK( dlis_dtime_ns( 100, DLIS_TZ_GMT, 2, 30, 0, 0, 0, 0 )
+               == DLIS_NAT );
+
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 4, 19, 24, 0, 0, 0 )
+               == DLIS_NAT );
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 4, 19, 0, 60, 0, 0 )
+               == DLIS_NAT );
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 4, 19, 0, 0, 60, 0 )
+               == DLIS_NAT );
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 4, 19, 0, 0, 0, 1000 )
+               == DLIS_NAT );
+        CHECK( dlis_dtime_ns( 87, DLIS_TZ_GMT, 4, 19, 23, 59, 59, 999 )
+               != DLIS_NAT );
+    }
 }
 
 TEST_CASE( "obname", "[type]" ) {
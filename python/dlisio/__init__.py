@@ -1,3 +1,7 @@
+import os
+import warnings
+from collections import OrderedDict
+
 import numpy as np
 from . import core
 from .objectpool import Objectpool
@@ -8,12 +12,57 @@ try:
 except pkg_resources.DistributionNotFound:
     pass
 
+def _partition(explicits, encrypted):
+    """ Split the records into explicit and implicit records
+
+    The record types are given by explicits, as returned by findoffsets.
+    Encrypted records are in neither, so they are never read.
+
+    Returns
+    -------
+    explicits : list of int
+    implicits : list of int
+    """
+    skip = set(x.record for x in encrypted)
+    implicits = [i for i, x in enumerate(explicits) if x == 0 and i not in skip]
+    explicits = [i for i, x in enumerate(explicits) if x != 0 and i not in skip]
+    return explicits, implicits
+
+class arrowdata(object):
+    """ Arrow data exported from C++
+
+    A record batch, exported through the Arrow C data interface when asked
+    for by a consumer of the Arrow PyCapsule interface, e.g.
+    pyarrow.record_batch. Every request makes a fresh export.
+    """
+    def __init__(self, export):
+        self._export = export
+
+    def __arrow_c_schema__(self):
+        schema, _ = self._export()
+        return schema
+
+    def __arrow_c_array__(self, requested_schema = None):
+        return self._export()
+
 class dlis(object):
-    def __init__(self, stream, explicits, sul_offset = 80):
+    def __init__(self, stream, explicits, sul_offset = 80, implicits = None,
+                 path = None, index = None, sets = None, hashes = None,
+                 diagnostics = None, encrypted = None):
         self.file = stream
+        self.path = path
+        self.index = index
+        self.hashes = hashes
+        self.diagnostics = diagnostics
+        self._encrypted = encrypted
         self.explicit_indices = explicits
+        self._implicits = implicits
         self.object_sets = None
-        self._objects = Objectpool(self.objectsets())
+        if sets is None: sets = self.objectsets()
+        self._sets = sets
+        self._objects = Objectpool(sets)
+        self._zonemaps = {}
+        self._fileheaders = None
         self.sul_offset = sul_offset
 
     def __enter__(self):
@@ -22,11 +71,176 @@ class dlis(object):
     def __exit__(self, type, value, traceback):
         self.file.close()
 
+    @property
+    def implicit_indices(self):
+        """ Indices of the implicitly formatted (frame data) records
+
+        For lazily loaded files, accessing this indexes the rest of the file.
+        """
+        if self._implicits is None:
+            self.index_all()
+        return self._implicits or []
+
+    def index_all(self):
+        """ Index all records in the file
+
+        Files opened with dlisio.load(path, lazy = True) are only indexed as
+        far as the logical file header. The rest of the file is indexed on
+        first access to the frame data, or by calling this function. To index
+        in the background, run index.index_all() in a separate thread - it
+        does not hold the GIL - and call index_all() when done.
+
+        The metadata found when indexing the rest of the file, e.g. the
+        object sets of later logical files, is loaded too, so that afterwards
+        the file has the same objects as if it was loaded eagerly.
+
+        Examples
+        --------
+        >>> import threading
+        >>> f = dlisio.load('file.dlis', lazy = True)
+        >>> t = threading.Thread(target = f.index.index_all)
+        >>> t.start()
+        >>> # read metadata
+        >>> t.join()
+        >>> f.index_all()
+        """
+        if self.index is None: return
+
+        self.index.index_all()
+        tells, residuals, explicits, encrypted = self.index.offsets()
+        self.file.reindex(tells, residuals)
+        explicits, self._implicits = _partition(explicits, encrypted)
+        self._encrypted = encrypted
+
+        loaded = set(self.explicit_indices)
+        rest = [i for i in explicits if i not in loaded]
+        self.explicit_indices = explicits
+        self.object_sets = None
+        self._fileheaders = None
+        if not rest: return
+
+        if self.diagnostics is not None:
+            sets = core.parse_objects(self.file, rest, self.diagnostics)
+        else:
+            sets = core.parse_objects(self.file.extract(rest))
+
+        self._sets = list(self._sets) + list(sets)
+        self._objects = Objectpool(self._sets)
+
+    def encryption(self):
+        """ The encrypted records, by the company that encrypted them
+
+        Encrypted records are noted when the file is indexed, and are never
+        read. Runs of consecutive encrypted records with the same company code
+        are reported as one range [begin, end) of record indices. The company
+        code is taken from the encryption packet, and is -1 for records
+        without one.
+
+        For lazily loaded files, this indexes the rest of the file.
+
+        Returns
+        -------
+        ranges : list of dlisio.core.encrypted_range
+
+        Examples
+        --------
+        >>> for r in f.encryption():
+        ...     print('records {}-{} by {}'.format(r.begin, r.end, r.company))
+        """
+        if self._encrypted is None:
+            self.index_all()
+        return core.encrypted_ranges(self._encrypted or [])
+
+    def snapshot(self):
+        """ The index and the object sets, as a flat buffer
+
+        The snapshot is the record index and the parsed object sets of the
+        file, serialised without pointers, so it can be copied anywhere, e.g.
+        into shared memory or a file, and be attached to from other processes
+        with dlisio.attach, without indexing or parsing the file again.
+
+        The snapshot is native-endian and tied to the file by its
+        fingerprint. For lazily loaded files, this indexes the rest of the
+        file and loads its metadata first, see index_all, so the snapshot
+        is the same as for an eagerly loaded file. Hashes are not included.
+
+        Returns
+        -------
+        snapshot : bytes
+
+        Examples
+        --------
+        Share a loaded file with a pool of workers
+
+        >>> from multiprocessing import shared_memory
+        >>> snap = f.snapshot()
+        >>> shm = shared_memory.SharedMemory(create = True, size = len(snap))
+        >>> shm.buf[:len(snap)] = snap
+        >>> # in the workers
+        >>> shm = shared_memory.SharedMemory(name = name)
+        >>> f = dlisio.attach(path, shm.buf)
+        """
+        if self.path is None:
+            raise NotImplementedError('snapshot: file has no path')
+
+        self.index_all()
+        return core.write_snapshot(core.file_fingerprint(self.path),
+                                   self.sul_offset,
+                                   self.file,
+                                   self.explicit_indices,
+                                   self.implicit_indices,
+                                   self._encrypted or [],
+                                   self._sets)
+
+    def to_json(self, fd = None, lines = False):
+        """ The object sets as JSON
+
+        Every object set is a JSON object with its type, name and objects,
+        and every object has its name and its attributes, keyed by label.
+        Names are {"id", "origin", "copynumber"} objects, and date-times ISO
+        8601 strings. The JSON is written in C++, straight from the parsed
+        object sets.
+
+        Parameters
+        ----------
+        fd : int or file object, optional
+            Write the JSON to this file descriptor, or object with fileno(),
+            instead of returning it
+        lines : bool, optional
+            Write NDJSON, i.e. one object set per line, instead of a single
+            JSON array
+
+        Returns
+        -------
+        json : bytes or None
+            The UTF-8 encoded JSON, or None if written to fd
+
+        Examples
+        --------
+        >>> sets = json.loads(f.to_json())
+        >>> with open('metadata.ndjson', 'wb') as out:
+        ...     f.to_json(out, lines = True)
+        """
+        layout = core.json_layout.lines if lines else core.json_layout.document
+
+        if fd is None:
+            return core.to_json(self._sets, layout)
+
+        if hasattr(fd, 'fileno'):
+            if hasattr(fd, 'flush'): fd.flush()
+            fd = fd.fileno()
+
+        core.write_json(self._sets, layout, int(fd))
+
     def storage_label(self):
         blob = self.file.get(bytearray(80), self.sul_offset, 80)
         return core.storage_label(blob)
 
     def objectsets(self, reload = False):
+        if self.diagnostics is not None:
+            indices = self.explicit_indices
+            return core.parse_objects(self.file, indices, self.diagnostics)
+
         if self.object_sets is None:
             self.object_sets = self.file.extract(self.explicit_indices)
 
@@ -35,6 +249,467 @@ class dlis(object):
     def getobject(self, name, type):
         return self._objects.getobject(name, type)
 
+    def _logical_file(self, frame):
+        """ The logical file of frame, and the channels of frame in it
+
+        Logical files start at a FILE-HEADER, and commonly reuse the names of
+        frames and channels, so a frame is only resolved against the channels
+        and frame data records of its own logical file. Anything before the
+        first FILE-HEADER is in the first logical file. Channels that are not
+        in the logical file are None.
+
+        Returns
+        -------
+        lf : int
+            Index of the logical file
+        framechannels : list of Channel
+            The channels of frame, in frame order
+        """
+        # the pool has the objects in the order of the sets
+        files = []
+        lf = 0
+        for i, os in enumerate(self._sets):
+            if os.type == 'FILE-HEADER' and i > 0: lf += 1
+            files.extend([lf] * len(os.objects))
+
+        objects = self._objects.objects
+        match = [x for o, x in zip(objects, files) if o is frame]
+        if not match:
+            match = [x for o, x in zip(objects, files)
+                     if o.type == 'frame' and o.name == frame.name]
+        if not match:
+            msg = 'frame {} is not in the file'
+            raise ValueError(msg.format(frame.name.id))
+        lf = match[0]
+
+        channels = [o for o, x in zip(objects, files)
+                    if x == lf and o.type == 'channel']
+        framechannels = []
+        for name in frame.attic['CHANNELS'].value:
+            ch = [o for o in channels if o.name == name]
+            framechannels.append(ch[0] if ch else None)
+
+        return lf, framechannels
+
+    def _logical_file_implicits(self, lf):
+        """ The implicit records of the logical file lf
+
+        For lazily loaded files, this indexes the rest of the file.
+        """
+        implicits = self.implicit_indices
+
+        if self._fileheaders is None:
+            # file header logical records (FHLR) have record type 0
+            explicits = self.explicit_indices
+            headers = [i for i in explicits if self.file[i].type == 0]
+            if headers and headers[0] == min(explicits):
+                headers = headers[1:]
+            self._fileheaders = headers
+
+        headers = self._fileheaders
+        begin = headers[lf - 1] if lf > 0 else -1
+        end = headers[lf] if lf < len(headers) else None
+        return [i for i in implicits if begin < i and (end is None or i < end)]
+
+    def _columns(self, frame, channels):
+        """ The frame's logical file, format string, and the positions of
+        channels in it
+
+        Only the first element of multi-dimensional channels is used. The
+        channels default to the index, i.e. the first channel of the frame.
+        """
+        lf, framechannels = self._logical_file(frame)
+        fmt = core.fmtstr(frame.attic, [ch.attic for ch in framechannels])
+
+        if channels is None:
+            channels = framechannels[:1]
+
+        positions = []
+        pos = 0
+        for ch in framechannels:
+            positions.append(pos)
+            elements = 1
+            for dim in ch.dimension: elements *= dim
+            pos += elements
+
+        columns = []
+        for ch in channels:
+            index = [i for i, x in enumerate(framechannels) if x.name == ch.name]
+            if len(index) == 0:
+                msg = 'channel {} is not in frame {}'
+                raise ValueError(msg.format(ch.name.id, frame.name.id))
+            columns.append(positions[index[0]])
+
+        return lf, fmt, columns
+
+    def columns(self, frame, cachedir):
+        """ Decoded channel data of a frame, through an on-disk cache
+
+        Decode all the frame data (FDATA) records of frame once, and write the
+        channels column-wise to a cache file in cachedir. The cache file is
+        keyed by a fingerprint of this file, the logical file of the frame and
+        the frame name, and later calls, also from other processes and
+        sessions, memory-map the columns straight from the cache without
+        indexing or decoding anything.
+
+        The columns are native-endian, and the validated floats (fsing1,
+        fdoub2 etc.) are cached as their value only. Times (dtime) are cached
+        as datetime64[ns], with local daylight savings time moved back an
+        hour to local standard time - the time zone itself is not recorded in
+        the file. Channels without a fixed-size numerical representation are
+        not cached. The cache is opt-in, and it is safe to delete cachedir at
+        any time.
+
+        Parameters
+        ----------
+        frame : Frame
+        cachedir : str_like
+            Directory of the cache files. Created if it does not exist.
+
+        Returns
+        -------
+        columns : OrderedDict of str -> numpy.ndarray
+            The frame numbers as 'FRAMENO', followed by the channels by name,
+            in frame order. Multi-dimensional channels have shape
+            (rows, elements), and all arrays are read-only.
+
+        Examples
+        --------
+        >>> columns = f.columns(frame, '~/.cache/dlisio')
+        >>> depth = columns['TDEP']
+        """
+        path, cache, framechannels = self._column_cache(frame, cachedir)
+
+        columns = OrderedDict()
+        for col in cache.columns:
+            if col.channel == -1:
+                key = 'FRAMENO'
+            else:
+                key = framechannels[col.channel].name.id
+
+            shape = (cache.rows,)
+            if col.elements > 1:
+                shape = (cache.rows, col.elements)
+
+            dtype = np.dtype(col.dtype)
+            if cache.rows == 0:
+                # empty files cannot be memory mapped
+                columns[key] = np.empty(shape, dtype = dtype)
+            else:
+                columns[key] = np.memmap(path, dtype = dtype,
+                                               mode = 'r',
+                                               offset = col.offset,
+                                               shape = shape)
+
+        return columns
+
+    def arrow_columns(self, frame, cachedir):
+        """ Decoded channel data of a frame, as an Arrow record batch
+
+        The columns of columns(frame, cachedir), exported through the Arrow
+        C data interface without copying - the arrays point straight into the
+        memory mapped cache file. Multi-dimensional channels are fixed size
+        lists of their elements, complex numbers fixed size lists of [real,
+        imag], and times timestamp[ns], where times that are not valid dates
+        (NaT in columns) are null.
+
+        Parameters
+        ----------
+        frame : Frame
+        cachedir : str_like
+            Directory of the cache files. Created if it does not exist.
+
+        Returns
+        -------
+        batch : arrowdata
+            Implements __arrow_c_array__, and can be passed to any consumer of
+            the Arrow PyCapsule interface
+
+        Examples
+        --------
+        >>> import pyarrow as pa
+        >>> batch = pa.record_batch(f.arrow_columns(frame, '~/.cache/dlisio'))
+        """
+        path, cache, framechannels = self._column_cache(frame, cachedir)
+
+        names = []
+        for col in cache.columns:
+            if col.channel == -1: names.append('FRAMENO')
+            else: names.append(framechannels[col.channel].name.id)
+
+        return arrowdata(lambda: core.arrow_columns(path, names))
+
+    def arrow_objects(self, type):
+        """ The objects of a type, as an Arrow record batch
+
+        A table with a row per object of type, e.g. 'CHANNEL', and the
+        columns id, origin and copynumber, followed by every attribute label
+        in order of appearance. Attribute values are lists, null when the
+        attribute is absent, and object names are structs of id, origin and
+        copynumber. Attributes with values of different types in different
+        objects are exported as their values in JSON, see to_json. The table
+        is built in C++, straight from the parsed object sets.
+
+        Parameters
+        ----------
+        type : str
+
+        Returns
+        -------
+        batch : arrowdata
+            Implements __arrow_c_array__, and can be passed to any consumer of
+            the Arrow PyCapsule interface
+
+        Examples
+        --------
+        >>> import pyarrow as pa
+        >>> channels = pa.record_batch(f.arrow_objects('CHANNEL'))
+        """
+        sets = self._sets
+        return arrowdata(lambda: core.arrow_objects(sets, type))
+
+    def _column_cache(self, frame, cachedir):
+        """ The path of the column cache of frame, the cache, and the channels
+
+        The cache is written if missing or stale.
+        """
+        if self.path is None:
+            msg = 'columns: no path to fingerprint, use dlisio.load'
+            raise ValueError(msg)
+
+        cachedir = os.path.expanduser(str(cachedir))
+        if not os.path.isdir(cachedir):
+            os.makedirs(cachedir)
+
+        lf, framechannels = self._logical_file(frame)
+
+        fingerprint = core.file_fingerprint(self.path)
+        name = frame.name
+        ident = ''.join(c if c.isalnum() or c in '-_' else '_' for c in name.id)
+        fname = '{:016x}-{}-{}-{}-{}.dlc'.format(fingerprint.hash,
+                                                 lf,
+                                                 name.origin,
+                                                 name.copynumber,
+                                                 ident)
+
+        # storage units in the same file share the fingerprint, and may well
+        # have frames of the same name, and so do logical files
+        if self.sul_offset:
+            fname = '{}@{}'.format(self.sul_offset, fname)
+        path = os.path.join(cachedir, fname)
+
+        try:
+            cache = core.column_cache(path)
+            if cache.source != fingerprint or cache.frame != name:
+                cache = None
+        except RuntimeError:
+            # missing, truncated or written by an incompatible platform
+            cache = None
+
+        if cache is None:
+            fmt = core.fmtstr(frame.attic, [ch.attic for ch in framechannels])
+            dimensions = []
+            for ch in framechannels:
+                elements = 1
+                for dim in ch.dimension: elements *= dim
+                dimensions.append(elements)
+
+            # write to a private file and move it in place, so that readers
+            # never see a partially written cache
+            tmp = '{}.{}.tmp'.format(path, os.getpid())
+            implicits = self._logical_file_implicits(lf)
+            try:
+                core.write_column_cache(tmp,
+                                        fingerprint,
+                                        self.file,
+                                        implicits,
+                                        name,
+                                        fmt,
+                                        dimensions)
+                try:
+                    os.rename(tmp, path)
+                except OSError:
+                    # windows does not rename over existing files
+                    os.remove(path)
+                    os.rename(tmp, path)
+            except:
+                if os.path.exists(tmp): os.remove(tmp)
+                raise
+
+            cache = core.column_cache(path)
+
+        return path, cache, framechannels
+
+    def lod(self, frame, path, channels = None, fanout = 8):
+        """ Level-of-detail pyramid of a frame, for drawing curves
+
+        Scan all the frame data (FDATA) records of frame once, and write a
+        multi-resolution min/max/mean summary of the channels to the sidecar
+        file path. Level 0 summarises fanout consecutive samples, and every
+        level above fanout bins of the level below. Drawing a window of a
+        curve at screen resolution then reads roughly one bin per pixel from
+        the sidecar, regardless of the number of samples.
+
+        The sidecar is a cache - it is native-endian and not meant to be
+        moved between machines. Re-open an existing sidecar with
+        dlisio.core.lodfile(path).
+
+        Only the first element of multi-dimensional channels is summarised.
+        Channels without an ordering, e.g. strings, are left out.
+
+        Parameters
+        ----------
+        frame : Frame
+        path : str
+            Path of the sidecar file. An existing file is overwritten.
+        channels : list of Channel, optional
+            Channels to summarise. Defaults to the index channel, i.e. the
+            first channel of the frame.
+        fanout : int, optional
+            Number of bins (or samples) merged into a single bin of the level
+            above. Must be at least 2.
+
+        Returns
+        -------
+        lodfile : dlisio.core.lodfile
+
+        Examples
+        --------
+        Get the min/max envelope of the samples [1000, 50000) of a channel,
+        for a plot 800 pixels wide
+
+        >>> lod = f.lod(frame, 'frame.lod', channels = [channel])
+        >>> window = lod.window(lod.columns[0], 1000, 50000, 800)
+        >>> lo, hi = window.min, window.max
+        """
+        lf, fmt, columns = self._columns(frame, channels)
+        core.write_lod(self.file,
+                       self._logical_file_implicits(lf),
+                       frame.name,
+                       fmt,
+                       columns,
+                       fanout,
+                       path)
+        return core.lodfile(path)
+
+    def zonemap(self, frame, channels = None):
+        """ Per-record value ranges of a frame
+
+        Scan all the frame data (FDATA) records of frame once, and summarise
+        every record with its frame numbers and the [min, max] range of the
+        channels. Use the zone map to find the records that can possibly hold
+        values in a range, and skip the rest without decoding them. The zone
+        map is kept with the record index, so only the first call for a
+        (frame, channels) pair scans the file.
+
+        Only the first element of multi-dimensional channels is summarised.
+        Channels without an ordering, e.g. strings, are left out of the zone
+        map.
+
+        Parameters
+        ----------
+        frame : Frame
+        channels : list of Channel, optional
+            Channels to summarise. Defaults to the index channel, i.e. the
+            first channel of the frame.
+
+        Returns
+        -------
+        zonemap : dlisio.core.zonemap
+
+        Examples
+        --------
+        Find the records that may have depths in [1000, 1500]
+
+        >>> zm = f.zonemap(frame)
+        >>> records = zm.candidates(zm.columns[0], 1000, 1500)
+        """
+        lf, fmt, columns = self._columns(frame, channels)
+        key = (lf, frame.name.id, frame.name.origin, frame.name.copynumber,
+               tuple(columns))
+
+        if key not in self._zonemaps:
+            implicits = self._logical_file_implicits(lf)
+            self._zonemaps[key] = core.build_zonemap(self.file,
+                                                     implicits,
+                                                     frame.name,
+                                                     fmt,
+                                                     columns)
+        return self._zonemaps[key]
+
+    def noformat(self):
+        """ The NO-FORMAT objects with payload in the file
+
+        NOFORMAT records carry the binary payload of NO-FORMAT objects, e.g.
+        images or vendor documents. The records are grouped by the name of
+        their object, without reading the payloads. Read a payload with
+        read_noformat.
+
+        Only files on disk are supported, not tape images or compressed
+        files. For lazily loaded files, this indexes the rest of the file.
+
+        Returns
+        -------
+        objects : list of dlisio.core.noformat_object
+
+        Examples
+        --------
+        >>> for obj in f.noformat():
+        ...     print(obj.name.id, obj.size)
+        """
+        if self.path is None or self.file.remapped:
+            raise NotImplementedError('noformat: only plain files are supported')
+
+        mmap = core.mmap_source()
+        mmap.map(self.path)
+        return core.findnoformat(mmap, self.file, self.implicit_indices)
+
+    def read_noformat(self, obj, sink, chunksize = 1 << 20):
+        """ Stream the payload of a NO-FORMAT object
+
+        The payload is written piece by piece, and is never assembled in
+        memory. When sink is a file descriptor, or has one, the payload is
+        copied in the kernel where the platform supports it.
+
+        Parameters
+        ----------
+        obj : dlisio.core.noformat_object
+            As returned by noformat()
+        sink : int, file object or callable
+            A file descriptor, an object with fileno(), or a callable that is
+            called with a bytes object per piece
+        chunksize : int, optional
+            Largest piece passed to a callable sink
+
+        Returns
+        -------
+        size : int
+            Number of bytes written
+
+        Examples
+        --------
+        >>> obj = f.noformat()[0]
+        >>> with open('payload.bin', 'wb') as out:
+        ...     f.read_noformat(obj, out)
+        """
+        if self.path is None or self.file.remapped:
+            raise NotImplementedError('noformat: only plain files are supported')
+
+        mmap = core.mmap_source()
+        mmap.map(self.path)
+
+        if callable(sink):
+            return core.read_noformat(mmap, self.file, obj, sink, chunksize)
+
+        if hasattr(sink, 'fileno'):
+            # anything buffered must be written before the payload
+            if hasattr(sink, 'flush'): sink.flush()
+            fd = sink.fileno()
+        else:
+            fd = int(sink)
+
+        return core.copy_noformat(self.path, mmap, self.file, obj, fd)
+
     @property
     def objects(self):
         return self._objects.allobjects
@@ -156,33 +831,562 @@ def open(path):
     """
     return core.stream(str(path))
 
-def load(path):
+def attach(path, snapshot, zindex = None):
+    """ Load a file from a snapshot
+
+    Open the file at path with the index and object sets of a snapshot, as
+    made by dlis.snapshot, instead of indexing and parsing it. The snapshot
+    is read in place, and can be anything that supports the buffer protocol,
+    e.g. bytes, mmap.mmap, or the buf of a
+    multiprocessing.shared_memory.SharedMemory. It is not needed after
+    attach returns.
+
+    Parameters
+    ----------
+    path : str_like
+    snapshot : bytes_like
+    zindex : str_like, optional
+        Where to keep the index of a compressed file, see load
+
+    Returns
+    -------
+    dlis : dlisio.dlis
+
+    Raises
+    ------
+    ValueError
+        If the snapshot is of a different file, or the file has changed since
+        the snapshot was taken
+
+    See Also
+    --------
+    dlis.snapshot
+    """
+    path = str(path)
+    snap = core.read_snapshot(snapshot)
+    source, sulpos, tells, residuals, explicits, implicits, encrypted, sets = snap
+
+    if source != core.file_fingerprint(path):
+        raise ValueError('snapshot is not of {}, fingerprint '
+                         'mismatch'.format(path))
+
+    mmap = core.mmap_source()
+    mmap.map(path)
+
+    remap = None
+    if core.istapeimage(mmap):
+        remap = core.tapeimage(mmap)
+    elif core.iscompressed(mmap):
+        remap = load_zindex(path, zindex)
+
+    stream = open(path)
+
+    try:
+        if remap is not None:
+            stream.remap(remap)
+        stream.reindex(tells, residuals)
+        f = dlis(stream, explicits, sul_offset = sulpos, implicits = implicits,
+                 path = path, sets = sets, encrypted = encrypted)
+    except:
+        stream.close()
+        raise
+
+    return f
+
+def crawl(path, types = ('FILE-HEADER', 'ORIGIN'), limit = 0):
+    """ Quick-scan the header of a file
+
+    Read the storage label and the metadata sets of the given types, without
+    loading the file. Only the explicitly formatted records before the first
+    frame data are considered, and the crawl stops as soon as all the types
+    have been seen. Records of other types are skipped without being read,
+    so the cost is a handful of small reads regardless of file size. This is
+    useful for cataloging large archives, where dlisio.load would index and
+    parse every file in full.
+
+    Parameters
+    ----------
+    path : str_like
+    types : iterable of str, optional
+        Set types to read. If empty, all sets before the first frame data are
+        read.
+    limit : int, optional
+        Do not read past this file offset. 0 means no limit.
+
+    Returns
+    -------
+    label : dict
+        The storage unit label, as dlis.storage_label
+    objects : dlisio.Objectpool
+
+    Examples
+    --------
+    >>> label, objects = dlisio.crawl('file.dlis')
+    >>> origin = next(objects.origin)
+    >>> origin.file_set_name
+    'FAROE_PETROLEUM/206_05A-3'
+    """
+    result = core.crawl(str(path), list(types), limit)
+    return core.storage_label(result.label), Objectpool(result.sets)
+
+def load_batch(paths, workers = 0):
+    """ Load many files in parallel
+
+    Load the files on a pool of worker threads, and yield them in order of
+    completion. Finding the storage label, indexing and parsing the metadata
+    all happen in the workers, without holding the GIL. A file that fails to
+    load does not stop the batch - its error is reported instead.
+
+    Parameters
+    ----------
+    paths : iterable of str_like
+    workers : int, optional
+        Number of worker threads. 0 means one per CPU.
+
+    Yields
+    ------
+    path : str
+    dlis : dlisio.dlis or None
+        None if loading failed
+    error : str or None
+        The error message if loading failed
+
+    Examples
+    --------
+    >>> for path, f, error in dlisio.load_batch(glob.glob('*.dlis')):
+    ...     if error is not None:
+    ...         print('{}: {}'.format(path, error))
+    ...         continue
+    ...     with f:
+    ...         print(next(f.origin).well_name)
+    """
+    loader = core.batch_loader([str(path) for path in paths], workers)
+
+    for result in loader:
+        if not result.ok:
+            yield result.path, None, result.error
+            continue
+
+        tells, residuals, explicits, encrypted = result.offsets
+        explicits, implicits = _partition(explicits, encrypted)
+
+        try:
+            stream = open(result.path)
+        except RuntimeError as e:
+            yield result.path, None, str(e)
+            continue
+
+        try:
+            stream.reindex(tells, residuals)
+            f = dlis(stream, explicits, sul_offset = result.sul,
+                                        implicits = implicits,
+                                        path = result.path,
+                                        sets = result.sets,
+                                        encrypted = encrypted)
+        except Exception as e:
+            stream.close()
+            yield result.path, None, str(e)
+            continue
+
+        yield result.path, f, None
+
+def catalog(path, paths = None, workers = 0):
+    """ Open or build a metadata catalog
+
+    A catalog summarises the logical files, frames, channels (with units,
+    representation code, dimension and frame) and parameters of many files in
+    a single, memory mapped file, with an index from object names to the
+    files they are in.
+
+    When paths is given, the catalog at path is brought up to date with paths
+    first. Only files that are new or changed since the catalog was last
+    written are loaded (in parallel, see load_batch), files no longer in paths
+    are dropped, and files that fail to load are left out with a warning.
+
+    Parameters
+    ----------
+    path : str_like
+        Path of the catalog file
+    paths : iterable of str_like, optional
+        Files to include in the catalog
+    workers : int, optional
+        Number of worker threads. 0 means one per CPU.
+
+    Returns
+    -------
+    catalog : dlisio.core.catalog
+
+    Examples
+    --------
+    >>> cat = dlisio.catalog('logs.catalog', glob.glob('*.dlis'))
+    >>> for hit in cat.lookup('DTCO'):
+    ...     entry = cat.file(hit.file)
+    ...     print(entry.path, entry.channels[hit.row].units)
+    """
+    path = str(path)
+
+    if paths is not None:
+        update = core.update_catalog(path, [str(x) for x in paths], workers)
+        for failed, error in update.failed:
+            msg = 'catalog: unable to load {}: {}'.format(failed, error)
+            warnings.warn(msg, RuntimeWarning)
+
+    return core.catalog(path)
+
+def subset(source, target, logical_files = None, types = None, frames = None):
+    """ Write a subset of the records of a file to a new file
+
+    The new file has the storage label of source, followed by the selected
+    records. The records are copied verbatim, without decoding, and visible
+    records are only rebuilt where the selection splits them. This is
+    typically as fast as copying the selected bytes.
+
+    Parameters
+    ----------
+    source : str_like
+    target : str_like
+    logical_files : list of int, optional
+        Keep only these logical files, counting from 0
+    types : list of str, optional
+        Keep only the metadata sets of these types, e.g. ['CHANNEL',
+        'FRAME']. FILE-HEADER records are always kept.
+    frames : list of str, optional
+        Keep only the frame data of the frames with these names
+
+    Returns
+    -------
+    records : int
+        Number of records written
+
+    Examples
+    --------
+    >>> dlisio.subset('delivery.dlis', 'gr.dlis', logical_files = [1],
+    ...               frames = ['60B'])
+    """
+    result = core.write_subset(str(source),
+                               str(target),
+                               list(logical_files or []),
+                               list(types or []),
+                               list(frames or []))
+    return result.records
+
+def repair(source, target, log = None):
+    """ Rewrite a damaged file into a clean one
+
+    The source is read once, front to back, and everything that can be
+    recovered is written to target as a clean file that load accepts.
+    Unreadable ranges and incomplete records are dropped, the remaining
+    records are re-segmented into new visible records, and padding,
+    checksums and trailing lengths are cleaned up. Records themselves are
+    never changed, only dropped.
+
+    Parameters
+    ----------
+    source : str_like
+    target : str_like
+    log : str_like, optional
+        Write a line for every repair, with its offset in source, to this
+        file
+
+    Returns
+    -------
+    result : dlisio.core.repair_result
+        The number of records written and repairs made, and the number of
+        bytes dropped
+
+    Examples
+    --------
+    >>> result = dlisio.repair('damaged.dlis', 'repaired.dlis',
+    ...                        log = 'repaired.log')
+    >>> with dlisio.load('repaired.dlis') as f:
+    ...     pass
+    """
+    return core.repair(str(source), str(target), str(log or ''))
+
+def read_stream(f, objects = None, frames = None, records = None,
+                label = None):
+    """ Read a file front to back from a stream, such as a pipe
+
+    Unlike load, this does not need a path or random access, and only keeps
+    a small buffer of the stream in memory. Instead of returning a file, the
+    contents are passed to the callbacks as they are read. The metadata must
+    come before the frame data it describes, as the standard requires, for
+    the frames to be decoded.
+
+    Parameters
+    ----------
+    f : file-like
+        Opened in binary mode, e.g. sys.stdin.buffer. Only f.read(n) is used
+    objects : callable, optional
+        Called with a dlisio.Objectpool of every metadata set
+    frames : callable, optional
+        Called with (name, fmt, frame number, packed) for every frame in the
+        frame data, where name is the frame's dlisio.core.obname. packed is
+        the bytes of the frame's values in native byte order, laid out as by
+        the format string fmt, as given by dlisio.core.fmtstr
+    records : callable, optional
+        Called with every other record as a dlisio.core.record, e.g.
+        encrypted records and frame data of unknown frames
+    label : callable, optional
+        Called with the storage unit label, as dlis.storage_label
+
+    Returns
+    -------
+    result : dlisio.core.forward_result
+        The number of records and frames read, and the number of bytes read
+        from f
+
+    Examples
+    --------
+    >>> def frame(name, fmt, number, packed):
+    ...     pass
+    >>> dlisio.read_stream(sys.stdin.buffer, frames = frame)
+    """
+    def storage_label(blob):
+        label(core.storage_label(blob))
+
+    def sets(objectset):
+        objects(Objectpool([objectset]))
+
+    return core.read_forward(f,
+                             storage_label if label is not None else None,
+                             sets if objects is not None else None,
+                             frames,
+                             records)
+
+def load_zindex(path, zindex = None, span = 1 << 20):
+    """ Index a compressed file for random access
+
+    Parameters
+    ----------
+    path : str_like
+        gzip or zlib compressed file
+    zindex : str_like, optional
+        Index file. If it exists and was built from the same file, it is read
+        instead of decompressing the file. Otherwise, the index is built and
+        written here.
+    span : int, optional
+        Distance between checkpoints in the decompressed stream. Reads
+        decompress on average span/2 bytes to get to an offset.
+
+    Returns
+    -------
+    index : dlisio.core.zindex
+    """
+    path = str(path)
+    fingerprint = core.file_fingerprint(path)
+
+    if zindex is not None:
+        zindex = os.path.expanduser(str(zindex))
+        try:
+            index = core.read_zindex(zindex)
+            if index.source == fingerprint:
+                return index
+        except RuntimeError:
+            # missing, truncated or written by an incompatible platform
+            pass
+
+    index = core.build_zindex(path, span)
+    if zindex is None:
+        return index
+
+    # write to a private file and move it in place, so that readers never see
+    # a partially written index
+    tmp = '{}.{}.tmp'.format(zindex, os.getpid())
+    try:
+        core.write_zindex(tmp, index)
+        try:
+            os.rename(tmp, zindex)
+        except OSError:
+            # windows does not rename over existing files
+            os.remove(zindex)
+            os.rename(tmp, zindex)
+    except:
+        if os.path.exists(tmp): os.remove(tmp)
+        raise
+
+    return index
+
+def loadall(path, workers = 0):
+    """ Load every storage unit in a file
+
+    Some files are several storage units, each with its own storage unit
+    label, copied back to back. load only reads the first, while loadall
+    finds all of them and loads them as separate files. Garbage between the
+    storage units is skipped. The storage units are indexed in parallel,
+    without holding the GIL.
+
+    The storage units are independent, and a damaged one, e.g. one that is
+    cut off in the middle of a record, is left out with a warning. Only if
+    no storage unit can be indexed is the error raised.
+
+    Parameters
+    ----------
+    path : str_like
+    workers : int, optional
+        Number of threads to index with. 0 means one per CPU.
+
+    Returns
+    -------
+    files : list of dlisio.dlis
+        One per storage unit, in file order. A file with a single storage unit
+        gives a list of one.
+
+    Examples
+    --------
+    >>> for f in dlisio.loadall('concatenated.dlis'):
+    ...     with f:
+    ...         print(f.storage_label()['id'])
+    """
+    path = str(path)
+
+    mmap = core.mmap_source()
+    mmap.map(path)
+
+    units = core.findunits(mmap)
+    offsets, errors = core.findoffsets(mmap, units, workers)
+
+    if errors and all(errors):
+        raise RuntimeError(errors[0])
+
+    files = []
+    try:
+        for unit, offset, error in zip(units, offsets, errors):
+            if error:
+                msg = 'loadall: unable to index storage unit at {}: {}'
+                warnings.warn(msg.format(unit.sul, error), RuntimeWarning)
+                continue
+
+            tells, residuals, explicits, encrypted = offset
+            explicits, implicits = _partition(explicits, encrypted)
+
+            stream = open(path)
+            try:
+                stream.reindex(tells, residuals)
+                f = dlis(stream, explicits, sul_offset = unit.sul,
+                                            implicits = implicits,
+                                            path = path,
+                                            encrypted = encrypted)
+            except:
+                stream.close()
+                raise
+
+            files.append(f)
+    except:
+        for f in files: f.file.close()
+        raise
+
+    return files
+
+def load(path, lazy = False, hashes = False, zindex = None,
+         diagnostics = None):
     """ Load a file
 
     Parameters
     ----------
     path : str_like
+    lazy : bool, optional
+        Only index the file as far as the metadata at the start of the file,
+        i.e. up to the first frame data record. The rest of the file is
+        indexed when frame data is first accessed, or with dlis.index_all.
+        Metadata after the first frame data, e.g. in later logical files, is
+        loaded when the rest of the file is indexed.
+    hashes : bool, optional
+        Compute content hashes (XXH64) of all the logical records and logical
+        files while indexing, available as dlis.hashes. The hashes do not
+        depend on the file name, the storage label or how the records are
+        split into visible records, so byte-identical logical files have the
+        same hash. Cannot be combined with lazy.
+    zindex : str_like, optional
+        Where to keep the index of a compressed file, see load_zindex. If
+        None, the index is built every time the file is loaded.
+    diagnostics : dlisio.core.diagnostics, optional
+        Parse damaged metadata leniently. Instead of raising on the first
+        problem, problems are recorded in diagnostics, with the record index,
+        the offset in the record and a message, and parsing continues with
+        the next object set. Objects read before a problem in a set are
+        kept. The same collector can be shared by many files.
 
     Returns
     -------
     dlis : dlisio.dlis
+
+    Notes
+    -----
+    TIF-wrapped (tape image) files are read directly, without unwrapping
+    them first. Offsets, e.g. dlis.sul_offset, are then offsets in the
+    unwrapped DLIS stream. Tape images are always indexed eagerly, and do not
+    support hashes.
+
+    Likewise, gzip and zlib compressed files are read without decompressing
+    them to disk. Only the parts of the file that are read are decompressed,
+    from the closest checkpoint in the zindex. Offsets are in the decompressed
+    stream.
+
+    Only the first storage unit is loaded. Use loadall for files that are
+    several storage units copied back to back.
     """
     path = str(path)
 
+    if lazy and hashes:
+        raise ValueError('hashes requires the whole file to be indexed, '
+                         'it cannot be combined with lazy')
+
     mmap = core.mmap_source()
     mmap.map(path)
 
-    sulpos = core.findsul(mmap)
-    vrlpos = core.findvrl(mmap, sulpos + 80)
+    # Tape images are indexed and read through the chunk table, which maps
+    # offsets in the DLIS stream to offsets in the file, and compressed files
+    # through the zindex
+    source = mmap
+    remap = None
+    if core.istapeimage(mmap):
+        if hashes:
+            raise NotImplementedError('hashes are not supported for tape '
+                                      'image (TIF) files')
+        remap = core.tapeimage(mmap)
+        source = remap
+        lazy = False
+    elif core.iscompressed(mmap):
+        if hashes:
+            raise NotImplementedError('hashes are not supported for '
+                                      'compressed files')
+        remap = load_zindex(path, zindex)
+        source = core.zreader(path, remap)
+        lazy = False
+
+    sulpos = core.findsul(source)
+    vrlpos = core.findvrl(source, sulpos + 80)
 
-    tells, residuals, explicits = core.findoffsets(mmap, vrlpos)
-    explicits = [i for i, explicit in enumerate(explicits) if explicit != 0]
+    index = None
+    implicits = None
+    encrypted = None
+    recordhashes = None
+    if lazy:
+        index = core.record_index(path, vrlpos)
+        index.extend_to_implicit()
+        tells, residuals, explicits, header = index.offsets()
+        if 0 in explicits:
+            explicits = explicits[:explicits.index(0)]
+        explicits, _ = _partition(explicits, header)
+    else:
+        if hashes:
+            offsets = core.findoffsets_hashed(mmap, vrlpos)
+            tells, residuals, explicits, encrypted, recordhashes = offsets
+        else:
+            offsets = core.findoffsets(source, vrlpos)
+            tells, residuals, explicits, encrypted = offsets
+        explicits, implicits = _partition(explicits, encrypted)
 
     stream = open(path)
 
     try:
+        if remap is not None:
+            stream.remap(remap)
         stream.reindex(tells, residuals)
-        f = dlis(stream, explicits, sul_offset = sulpos)
+        f = dlis(stream, explicits, sul_offset = sulpos, implicits = implicits,
+                 path = path, index = index, hashes = recordhashes,
+                 diagnostics = diagnostics, encrypted = encrypted)
     except:
         stream.close()
         raise
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <bitset>
 #include <cerrno>
+#include <ciso646>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
@@ -22,9 +24,24 @@
 namespace py = pybind11;
 using namespace py::literals;
 
+#include <dlisio/ext/arrow.hpp>
+#include <dlisio/ext/batch.hpp>
+#include <dlisio/ext/cache.hpp>
+#include <dlisio/ext/catalog.hpp>
 #include <dlisio/ext/exception.hpp>
+#include <dlisio/ext/forward.hpp>
+#include <dlisio/ext/frame.hpp>
+#include <dlisio/ext/hash.hpp>
 #include <dlisio/ext/io.hpp>
+#include <dlisio/ext/json.hpp>
+#include <dlisio/ext/lod.hpp>
+#include <dlisio/ext/noformat.hpp>
+#include <dlisio/ext/repair.hpp>
+#include <dlisio/ext/serialize.hpp>
+#include <dlisio/ext/snapshot.hpp>
+#include <dlisio/ext/subset.hpp>
 #include <dlisio/ext/types.hpp>
+#include <dlisio/ext/zindex.hpp>
 
 namespace pybind11 { namespace detail {
 
@@ -87,46 +104,89 @@ handle dlis_caster< dl::dtime >::cast( const dl::dtime& src, return_value_policy
 
 namespace {
 
+/*
+ * Strings are checked before they are handed to python, so that decoding
+ * never fails, and no exceptions are thrown for the odd string that is not
+ * UTF-8. Almost all strings are plain ascii, which is checked 8 bytes at a
+ * time.
+ */
+enum class encoding { ascii, utf8, other };
+
+bool isascii( const char* xs, std::size_t n ) noexcept (true) {
+    std::uint64_t acc = 0;
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t word;
+        std::memcpy( &word, xs + i, sizeof( word ) );
+        acc |= word;
+    }
+
+    for (; i < n; ++i) acc |= static_cast< unsigned char >( xs[ i ] );
+    return (acc & 0x8080808080808080ULL) == 0;
+}
+
+encoding classify( const std::string& src ) noexcept (true) {
+    if (isascii( src.data(), src.size() ))    return encoding::ascii;
+    if (dl::isutf8( src.data(), src.size() )) return encoding::utf8;
+    return encoding::other;
+}
+
+handle checked( PyObject* obj ) noexcept (false) {
+    if (!obj) throw py::error_already_set();
+    return obj;
+}
+
 handle maybe_decode(const std::string& src) noexcept (false) {
-    try {
-        /* was valid UTF-8, all is well*/
-        return py::str(src).inc_ref();
-    } catch(std::runtime_error& e) {
-        PyErr_Clear();
-        /*
-         * The degree symbol is weird in UTF-8, but often shows up
-         *
-         * https://stackoverflow.com/questions/8732025/why-degree-symbol-differs-from-utf-8-from-unicode
-         *
-         * Look for this symbol in the string - if it's there, replace it with
-         * the UTF-8 one and try to return that string. If _that_ fails, return
-         * bytes
-         */
-        auto pos = src.find('\xB0');
-
-        // Ok, so it wasn't the degree symbol being encoded wrong - return the
-        // string as bytes and defer decoding to caller
-        if (pos == std::string::npos)
-            return py::bytes(src).inc_ref();
-
-        std::string source(src);
-        source.insert(pos, 1, '\xC2');
-        while ((pos = source.find('\xB0', pos + 2)) != std::string::npos) {
-            source.insert(pos, 1, '\xC2');
-        }
+    switch (classify( src )) {
+        case encoding::ascii:
+            /* ascii is latin-1 too, so the bytes are copied as-is */
+            return checked( PyUnicode_FromKindAndData( PyUnicode_1BYTE_KIND,
+                                                       src.data(),
+                                                       src.size() ) );
 
-        /*
-         * Now this should be proper unicode. If it isn't, return bytes again
-         *
-         * TODO: Return-as-bytes should probably not be a silent conversion
-         */
-        try {
-            return py::str(source).inc_ref();
-        } catch (std::runtime_error&) {
-            PyErr_Clear();
-            return py::bytes(src).inc_ref();
-        }
+        case encoding::utf8:
+            return checked( PyUnicode_DecodeUTF8( src.data(),
+                                                  src.size(),
+                                                  nullptr ) );
+
+        case encoding::other:
+            break;
     }
+
+    /*
+     * The degree symbol is weird in UTF-8, but often shows up
+     *
+     * https://stackoverflow.com/questions/8732025/why-degree-symbol-differs-from-utf-8-from-unicode
+     *
+     * Look for this symbol in the string - if it's there, replace it with
+     * the UTF-8 one and try to return that string. If _that_ fails, return
+     * bytes
+     */
+    const auto degrees = std::count( src.begin(), src.end(), '\xB0' );
+
+    // Ok, so it wasn't the degree symbol being encoded wrong - return the
+    // string as bytes and defer decoding to caller
+    if (degrees == 0)
+        return py::bytes(src).inc_ref();
+
+    std::string source;
+    source.reserve( src.size() + degrees );
+    for (const auto c : src) {
+        if (c == '\xB0') source.push_back( '\xC2' );
+        source.push_back( c );
+    }
+
+    /*
+     * Now this should be proper unicode. If it isn't, return bytes again
+     *
+     * TODO: Return-as-bytes should probably not be a silent conversion
+     */
+    if (not dl::isutf8( source.data(), source.size() ))
+        return py::bytes(src).inc_ref();
+
+    return checked( PyUnicode_DecodeUTF8( source.data(),
+                                          source.size(),
+                                          nullptr ) );
 }
 
 }
@@ -234,6 +294,69 @@ py::dict storage_label( py::buffer b ) {
     );
 }
 
+/*
+ * Pickle support, with the binary encoding from dl::serialize as state
+ */
+template < typename T >
+py::bytes getstate( const T& x ) {
+    return py::bytes( dl::serialize( x ) );
+}
+
+template < typename T >
+T setstate( py::buffer b ) {
+    const auto info = b.request();
+    T x;
+    dl::deserialize( static_cast< const char* >( info.ptr ),
+                     std::size_t( info.size * info.itemsize ),
+                     x );
+    return x;
+}
+
+/*
+ * The arrow PyCapsule interface - the exported structs are passed on in
+ * capsules named arrow_schema and arrow_array, that release them unless the
+ * consumer has moved them out
+ */
+void release_schema_capsule( PyObject* capsule ) {
+    auto* schema = static_cast< ArrowSchema* >(
+        PyCapsule_GetPointer( capsule, "arrow_schema" )
+    );
+    if (schema->release) schema->release( schema );
+    delete schema;
+}
+
+void release_array_capsule( PyObject* capsule ) {
+    auto* array = static_cast< ArrowArray* >(
+        PyCapsule_GetPointer( capsule, "arrow_array" )
+    );
+    if (array->release) array->release( array );
+    delete array;
+}
+
+py::tuple arrow_capsules( std::unique_ptr< ArrowSchema > schema,
+                          std::unique_ptr< ArrowArray > array ) {
+    auto s = py::reinterpret_steal< py::object >(
+        PyCapsule_New( schema.get(), "arrow_schema", release_schema_capsule )
+    );
+    if (not s) {
+        schema->release( schema.get() );
+        array->release( array.get() );
+        throw py::error_already_set();
+    }
+    schema.release();
+
+    auto a = py::reinterpret_steal< py::object >(
+        PyCapsule_New( array.get(), "arrow_array", release_array_capsule )
+    );
+    if (not a) {
+        array->release( array.get() );
+        throw py::error_already_set();
+    }
+    array.release();
+
+    return py::make_tuple( s, a );
+}
+
 }
 
 PYBIND11_MODULE(core, m) {
@@ -259,6 +382,7 @@ PYBIND11_MODULE(core, m) {
      * TODO: fmtlib for strings
      */
     py::class_< dl::obname >( m, "obname" )
+        .def( py::pickle( &getstate< dl::obname >, &setstate< dl::obname > ) )
         .def_readonly( "origin",     &dl::obname::origin )
         .def_readonly( "copynumber", &dl::obname::copy )
         .def_readonly( "id",         &dl::obname::id )
@@ -273,6 +397,7 @@ PYBIND11_MODULE(core, m) {
     ;
 
     py::class_< dl::objref >( m, "objref" )
+        .def( py::pickle( &getstate< dl::objref >, &setstate< dl::objref > ) )
         .def_readonly( "type", &dl::objref::type )
         .def_readonly( "name", &dl::objref::name )
         .def( "__repr__", []( const dl::objref& o ) {
@@ -286,6 +411,7 @@ PYBIND11_MODULE(core, m) {
     ;
 
     py::class_< dl::attref >( m, "attref" )
+        .def( py::pickle( &getstate< dl::attref >, &setstate< dl::attref > ) )
         .def_readonly( "type", &dl::attref::type )
         .def_readonly( "name", &dl::attref::name )
         .def_readonly( "label", &dl::attref::label )
@@ -300,6 +426,8 @@ PYBIND11_MODULE(core, m) {
     ;
 
     py::class_< dl::basic_object >( m, "basic_object" )
+        .def( py::pickle( &getstate< dl::basic_object >,
+                          &setstate< dl::basic_object > ) )
         .def_readonly( "name", &dl::basic_object::object_name )
         .def( "__len__",       &dl::basic_object::len )
         .def( "__getitem__",   &dl::basic_object::at )
@@ -311,12 +439,16 @@ PYBIND11_MODULE(core, m) {
     ;
 
     py::class_< dl::object_set >( m, "object_set" )
+        .def( py::pickle( &getstate< dl::object_set >,
+                          &setstate< dl::object_set > ) )
         .def_readonly( "type",    &dl::object_set::type )
         .def_readonly( "name",    &dl::object_set::name )
         .def_readonly( "objects", &dl::object_set::objects )
     ;
 
     py::class_< dl::object_attribute >( m, "object_attribute" )
+        .def( py::pickle( &getstate< dl::object_attribute >,
+                          &setstate< dl::object_attribute > ) )
         .def_readonly( "label", &dl::object_attribute::label )
         .def_readonly( "count", &dl::object_attribute::count )
         .def_readonly( "reprc", &dl::object_attribute::reprc )
@@ -366,6 +498,7 @@ PYBIND11_MODULE(core, m) {
     ;
 
     py::class_< dl::record >( m, "record", py::buffer_protocol() )
+        .def( py::pickle( &getstate< dl::record >, &setstate< dl::record > ) )
         .def_property_readonly( "explicit",  &dl::record::isexplicit )
         .def_property_readonly( "encrypted", &dl::record::isencrypted )
         .def_readonly( "consistent", &dl::record::consistent )
@@ -383,9 +516,14 @@ PYBIND11_MODULE(core, m) {
         })
     ;
 
+    using remap_tapeimage = void (dl::stream::*)( const dl::tapeimage& );
+    using remap_zindex    = void (dl::stream::*)( const dl::zindex& );
+
     py::class_< dl::stream >( m, "stream" )
         .def( py::init< const std::string& >() )
         .def( "reindex", &dl::stream::reindex )
+        .def( "remap", static_cast< remap_tapeimage >( &dl::stream::remap ) )
+        .def( "remap", static_cast< remap_zindex >( &dl::stream::remap ) )
         .def( "__getitem__", [](dl::stream& o, int i) { return o.at(i); })
         .def( "close", &dl::stream::close )
         .def( "get", []( dl::stream& s, py::buffer b, long long off, int n ) {
@@ -402,6 +540,7 @@ PYBIND11_MODULE(core, m) {
             s.read( static_cast< char* >( info.ptr ), off, n );
             return b;
         })
+        .def_property_readonly( "remapped", &dl::stream::remapped )
         .def( "extract", [](dl::stream& s, const std::vector< long long >& tells) {
             std::vector< dl::record > recs;
             recs.reserve( tells.size() );
@@ -425,19 +564,703 @@ PYBIND11_MODULE(core, m) {
         return objects;
     });
 
+    /*
+     * Many object sets in one go, cheaper than pickling them one by one
+     */
+    m.def( "serialize_sets", []( const std::vector< dl::object_set >& sets ) {
+        std::string buffer;
+        {
+            py::gil_scoped_release release;
+            buffer = dl::serialize( sets );
+        }
+        return py::bytes( buffer );
+    });
+
+    m.def( "deserialize_sets", []( py::buffer b ) {
+        const auto info = b.request();
+        std::vector< dl::object_set > sets;
+        {
+            py::gil_scoped_release release;
+            dl::deserialize( static_cast< const char* >( info.ptr ),
+                             std::size_t( info.size * info.itemsize ),
+                             sets );
+        }
+        return sets;
+    });
+
+    py::enum_< dl::json_layout >( m, "json_layout" )
+        .value( "document", dl::json_layout::document )
+        .value( "lines",    dl::json_layout::lines )
+    ;
+
+    /*
+     * The JSON is returned as bytes (UTF-8), ready to be sent on, rather
+     * than decoded to str
+     */
+    m.def( "to_json", []( const std::vector< dl::object_set >& sets,
+                          dl::json_layout layout ) {
+        std::string doc;
+        {
+            py::gil_scoped_release release;
+            doc = dl::to_json( sets, layout );
+        }
+        return py::bytes( doc );
+    });
+
+    m.def( "write_json", []( const std::vector< dl::object_set >& sets,
+                             dl::json_layout layout,
+                             int fd ) {
+        py::gil_scoped_release release;
+        dl::write_json( sets, layout, fd );
+    });
+
+    py::enum_< dl::diagnostic_code >( m, "diagnostic_code" )
+        .value( "protocol",    dl::diagnostic_code::protocol )
+        .value( "unsupported", dl::diagnostic_code::unsupported )
+        .value( "truncated",   dl::diagnostic_code::truncated )
+        .value( "invalid",     dl::diagnostic_code::invalid )
+    ;
+
+    py::class_< dl::diagnostic >( m, "diagnostic" )
+        .def_readonly( "record",  &dl::diagnostic::record )
+        .def_readonly( "offset",  &dl::diagnostic::offset )
+        .def_readonly( "code",    &dl::diagnostic::code )
+        .def_readonly( "message", &dl::diagnostic::message )
+        .def( "__repr__", []( const dl::diagnostic& x ) {
+            return "dlisio.core.diagnostic(record="
+                 + std::to_string( x.record ) + ", offset="
+                 + std::to_string( x.offset ) + ", message='"
+                 + x.message + "')"
+            ;
+        })
+    ;
+
+    py::class_< dl::diagnostics >( m, "diagnostics" )
+        .def( py::init<>() )
+        .def_readonly( "entries", &dl::diagnostics::entries )
+        .def( "__len__", []( const dl::diagnostics& x ) {
+            return x.entries.size();
+        })
+        .def( "clear", []( dl::diagnostics& x ) { x.entries.clear(); } )
+    ;
+
+    /*
+     * Parse the explicit records at indices, and record problems in diag
+     * rather than throwing. Sets that cannot be parsed at all are left out
+     */
+    m.def( "parse_objects", []( dl::stream& file,
+                                const std::vector< int >& indices,
+                                dl::diagnostics& diag ) {
+        std::vector< dl::object_set > objects;
+        dl::record rec;
+        for (const auto i : indices) {
+            file.at( i, rec );
+            if (rec.isencrypted()) continue;
+
+            diag.record = i;
+            const auto* begin = rec.data.data();
+            const auto* end = begin + rec.data.size();
+            dl::object_set set;
+            if (dl::parse_objects( begin, end, set, diag ))
+                objects.push_back( std::move( set ) );
+        }
+        return objects;
+    });
+
     py::class_< mio::mmap_source >( m, "mmap_source" )
         .def( py::init<>() )
         .def( "map", dl::map_source )
     ;
 
-    m.def( "findsul", dl::findsul );
-    m.def( "findvrl", dl::findvrl );
+    py::class_< dl::logical_file >( m, "logical_file" )
+        .def( "__len__", &dl::logical_file::size )
+    ;
+
+    py::class_< dl::tapeimage, dl::logical_file >( m, "tapeimage" )
+        .def( py::init< const mio::mmap_source& >(), py::keep_alive< 1, 2 >() )
+        .def( "physical", &dl::tapeimage::physical )
+    ;
+
+    m.def( "istapeimage", dl::istapeimage );
+
+    py::class_< dl::zindex >( m, "zindex" )
+        .def_readonly( "source", &dl::zindex::source )
+        .def_readonly( "size",   &dl::zindex::size )
+        .def_readonly( "span",   &dl::zindex::span )
+        .def( "__len__", []( const dl::zindex& x ) {
+            return x.checkpoints.size();
+        })
+        .def( "__repr__", []( const dl::zindex& x ) {
+            return "dlisio.core.zindex(size="
+                 + std::to_string( x.size ) + ", checkpoints="
+                 + std::to_string( x.checkpoints.size() ) + ")"
+            ;
+        })
+    ;
+
+    py::class_< dl::zreader, dl::logical_file >( m, "zreader" )
+        .def( py::init< const std::string&, const dl::zindex&, int >(),
+              py::arg( "path" ),
+              py::arg( "index" ),
+              py::arg( "blocks" ) = 8 )
+    ;
+
+    m.def( "iscompressed", dl::iscompressed );
+    m.def( "build_zindex",
+           dl::build_zindex,
+           py::call_guard< py::gil_scoped_release >() );
+    m.def( "write_zindex", dl::write_zindex );
+    m.def( "read_zindex",  dl::read_zindex );
+
+    using mmap_findsul = long long (*)( mio::mmap_source& );
+    using mmap_findvrl = long long (*)( mio::mmap_source&, long long );
+    using view_findsul = long long (*)( dl::logical_file& );
+    using view_findvrl = long long (*)( dl::logical_file&, long long );
+    m.def( "findsul", static_cast< mmap_findsul >( dl::findsul ) );
+    m.def( "findsul", static_cast< view_findsul >( dl::findsul ) );
+    m.def( "findvrl", static_cast< mmap_findvrl >( dl::findvrl ) );
+    m.def( "findvrl", static_cast< view_findvrl >( dl::findvrl ) );
+
+    py::class_< dl::encrypted_record >( m, "encrypted_record" )
+        .def_readonly( "record",  &dl::encrypted_record::record )
+        .def_readonly( "company", &dl::encrypted_record::company )
+        .def_readonly( "packet",  &dl::encrypted_record::packet )
+    ;
+
+    py::class_< dl::encrypted_range >( m, "encrypted_range" )
+        .def_readonly( "begin",   &dl::encrypted_range::begin )
+        .def_readonly( "end",     &dl::encrypted_range::end )
+        .def_readonly( "company", &dl::encrypted_range::company )
+        .def( "__repr__", []( const dl::encrypted_range& x ) {
+            return "dlisio.core.encrypted_range(begin="
+                 + std::to_string( x.begin ) + ", end="
+                 + std::to_string( x.end ) + ", company="
+                 + std::to_string( x.company ) + ")"
+            ;
+        })
+    ;
+
+    m.def( "encrypted_ranges", dl::encrypted_ranges );
 
     m.def( "findoffsets", []( mio::mmap_source& file, long long from ) {
         const auto ofs = dl::findoffsets( file, from );
-        return py::make_tuple( ofs.tells, ofs.residuals, ofs.explicits );
+        return py::make_tuple( ofs.tells, ofs.residuals, ofs.explicits,
+                               ofs.encrypted );
+    });
+
+    m.def( "findoffsets", []( dl::logical_file& file, long long from ) {
+        const auto ofs = dl::findoffsets( file, from );
+        return py::make_tuple( ofs.tells, ofs.residuals, ofs.explicits,
+                               ofs.encrypted );
+    });
+
+    py::class_< dl::storage_unit >( m, "storage_unit" )
+        .def_readonly( "sul", &dl::storage_unit::sul )
+        .def_readonly( "vrl", &dl::storage_unit::vrl )
+        .def_readonly( "end", &dl::storage_unit::end )
+        .def( "__repr__", []( const dl::storage_unit& x ) {
+            return "dlisio.core.storage_unit(sul="
+                 + std::to_string( x.sul ) + ", vrl="
+                 + std::to_string( x.vrl ) + ", end="
+                 + std::to_string( x.end ) + ")"
+            ;
+        })
+    ;
+
+    m.def( "findunits", dl::findunits );
+
+    m.def( "findoffsets", []( mio::mmap_source& file,
+                              const std::vector< dl::storage_unit >& units,
+                              int workers ) {
+        std::vector< dl::stream_offsets > offsets;
+        std::vector< std::string > errors;
+        {
+            py::gil_scoped_release release;
+            offsets = dl::findoffsets( file, units, workers, errors );
+        }
+
+        py::list xs;
+        for (const auto& ofs : offsets)
+            xs.append( py::make_tuple( ofs.tells, ofs.residuals, ofs.explicits,
+                                       ofs.encrypted ) );
+        return py::make_tuple( xs, errors );
+    });
+
+    py::class_< dl::record_hashes >( m, "record_hashes" )
+        .def_readonly( "records",       &dl::record_hashes::records )
+        .def_readonly( "logical_files", &dl::record_hashes::logical_files )
+        .def_readonly( "files",         &dl::record_hashes::files )
+    ;
+
+    m.def( "xxh64", []( py::buffer b, std::uint64_t seed ) {
+        const auto info = b.request();
+        const auto* data = static_cast< const char* >( info.ptr );
+        const auto size = std::size_t( info.size * info.itemsize );
+        py::gil_scoped_release release;
+        return dl::xxh64sum( data, size, seed );
+    }, py::arg( "data" ), py::arg( "seed" ) = 0 );
+
+    m.def( "findoffsets_hashed", []( mio::mmap_source& file, long long from ) {
+        dl::record_hashes hashes;
+        const auto ofs = dl::findoffsets( file, from, hashes );
+        return py::make_tuple( ofs.tells, ofs.residuals, ofs.explicits,
+                               ofs.encrypted, hashes );
+    });
+
+    /*
+     * Indexing does not touch any python objects, so release the GIL to allow
+     * indexing in a background thread
+     */
+    using nogil = py::call_guard< py::gil_scoped_release >;
+    py::class_< dl::record_index >( m, "record_index" )
+        .def( py::init< const std::string&, long long >() )
+        .def( "extend_to",          &dl::record_index::extend_to, nogil() )
+        .def( "extend_to_implicit", &dl::record_index::extend_to_implicit,
+                                    nogil() )
+        .def( "index_all",          &dl::record_index::index_all, nogil() )
+        .def_property_readonly( "complete", &dl::record_index::complete )
+        .def( "__len__",            &dl::record_index::size )
+        .def( "offsets", []( const dl::record_index& index ) {
+            const auto ofs = index.offsets();
+            return py::make_tuple( ofs.tells, ofs.residuals, ofs.explicits,
+                                   ofs.encrypted );
+        })
+    ;
+
+    py::class_< dl::loaded_file >( m, "loaded_file" )
+        .def_readonly( "path",  &dl::loaded_file::path )
+        .def_readonly( "ok",    &dl::loaded_file::ok )
+        .def_readonly( "error", &dl::loaded_file::error )
+        .def_readonly( "sul",   &dl::loaded_file::sul )
+        .def_property_readonly( "label", []( const dl::loaded_file& f ) {
+            return py::bytes( f.label );
+        })
+        .def_property_readonly( "offsets", []( const dl::loaded_file& f ) {
+            const auto& ofs = f.offsets;
+            return py::make_tuple( ofs.tells, ofs.residuals, ofs.explicits,
+                                   ofs.encrypted );
+        })
+        .def_readonly( "sets",  &dl::loaded_file::sets )
+    ;
+
+    py::class_< dl::batch_loader >( m, "batch_loader" )
+        .def( py::init< std::vector< std::string >, int >(), nogil() )
+        .def( "__len__",  &dl::batch_loader::size )
+        .def( "__iter__", []( py::object self ) { return self; } )
+        .def( "__next__", []( dl::batch_loader& b ) {
+            dl::loaded_file f;
+            bool more;
+            {
+                py::gil_scoped_release release;
+                more = b.next( f );
+            }
+            if (not more) throw py::stop_iteration();
+            return f;
+        })
+    ;
+
+    py::class_< dl::crawl_result >( m, "crawl_result" )
+        .def_readonly( "sul",      &dl::crawl_result::sul )
+        .def_property_readonly( "label", []( const dl::crawl_result& r ) {
+            return py::bytes( r.label );
+        })
+        .def_readonly( "sets",     &dl::crawl_result::sets )
+        .def_readonly( "records",  &dl::crawl_result::records )
+        .def_readonly( "bytes",    &dl::crawl_result::bytes )
+        .def_readonly( "complete", &dl::crawl_result::complete )
+    ;
+
+    m.def( "crawl", dl::crawl );
+
+    py::class_< dl::subset_result >( m, "subset_result" )
+        .def_readonly( "records",  &dl::subset_result::records )
+        .def_readonly( "bytes",    &dl::subset_result::bytes )
+        .def_readonly( "verbatim", &dl::subset_result::verbatim )
+    ;
+
+    m.def( "write_subset", []( const std::string& source,
+                               const std::string& target,
+                               const std::vector< int >& logical_files,
+                               const std::vector< std::string >& types,
+                               const std::vector< std::string >& frames ) {
+        dl::subset_selection sel;
+        sel.logical_files = logical_files;
+        sel.types = types;
+        sel.frames = frames;
+        return dl::write_subset( source, target, sel );
+    }, nogil() );
+
+    py::class_< dl::noformat_object >( m, "noformat_object" )
+        .def_readonly( "name",    &dl::noformat_object::name )
+        .def_readonly( "records", &dl::noformat_object::records )
+        .def_readonly( "size",    &dl::noformat_object::size )
+        .def( "__repr__", []( const dl::noformat_object& x ) {
+            return "dlisio.core.noformat_object(name={}, records={}, size={})"_s
+                    .format( x.name, x.records.size(), x.size );
+        })
+    ;
+
+    /*
+     * The NOFORMAT functions read the records straight from the memory mapped
+     * file, so the tells of the stream must be plain file offsets
+     */
+    const auto offsets = []( const dl::stream& s ) {
+        if (s.remapped()) {
+            throw std::invalid_argument(
+                "noformat: stream is a tape image or compressed, expected "
+                "a plain file"
+            );
+        }
+
+        dl::stream_offsets ofs;
+        ofs.tells = s.record_tells();
+        ofs.residuals = s.record_residuals();
+        return ofs;
+    };
+
+    m.def( "findnoformat", [offsets]( const mio::mmap_source& file,
+                                      const dl::stream& s,
+                                      const std::vector< int >& records ) {
+        return dl::findnoformat( file, offsets( s ), records );
     });
 
+    /*
+     * The sink is called with a bytes object per chunk, with the GIL held
+     */
+    m.def( "read_noformat", [offsets]( const mio::mmap_source& file,
+                                       const dl::stream& s,
+                                       const dl::noformat_object& obj,
+                                       py::object sink,
+                                       std::size_t chunksize ) {
+        dl::noformat_sink f = [&sink]( const char* data, std::size_t n ) {
+            sink( py::bytes( data, n ) );
+        };
+        return dl::read_noformat( file, offsets( s ), obj, f, chunksize );
+    });
+
+    m.def( "copy_noformat", [offsets]( const std::string& path,
+                                       const mio::mmap_source& file,
+                                       const dl::stream& s,
+                                       const dl::noformat_object& obj,
+                                       int fd ) {
+        const auto ofs = offsets( s );
+        py::gil_scoped_release release;
+        return dl::copy_noformat( path, file, ofs, obj, fd );
+    });
+
+    py::class_< dl::repair_result >( m, "repair_result" )
+        .def_readonly( "records",   &dl::repair_result::records )
+        .def_readonly( "events",    &dl::repair_result::events )
+        .def_readonly( "truncated", &dl::repair_result::truncated )
+        .def_readonly( "dropped",   &dl::repair_result::dropped )
+        .def_readonly( "bytes",     &dl::repair_result::bytes )
+    ;
+
+    m.def( "repair", dl::repair, nogil() );
+
+    py::class_< dl::forward_result >( m, "forward_result" )
+        .def_readonly( "records", &dl::forward_result::records )
+        .def_readonly( "frames",  &dl::forward_result::frames )
+        .def_readonly( "bytes",   &dl::forward_result::bytes )
+    ;
+
+    /*
+     * The source is a binary file-like object, read with read(n), so that
+     * pipes and sys.stdin.buffer work. The callbacks are python callables or
+     * None, and are called with the GIL held
+     */
+    m.def( "read_forward", []( py::object file,
+                               py::object label,
+                               py::object objects,
+                               py::object frame,
+                               py::object record ) {
+        const auto read = file.attr( "read" );
+        dl::byte_source source = [&read]( char* dst, std::size_t n ) {
+            const auto chunk = read( n ).cast< std::string >();
+            if (chunk.size() > n) {
+                std::string msg =
+                      "read_forward: read(" + std::to_string( n ) + ") "
+                    + "returned " + std::to_string( chunk.size() ) + " bytes"
+                ;
+                throw std::runtime_error( msg );
+            }
+
+            std::copy( chunk.begin(), chunk.end(), dst );
+            return chunk.size();
+        };
+
+        dl::forward_handler handler;
+        if (not label.is_none()) {
+            handler.label = [&label]( const std::string& sul ) {
+                label( py::bytes( sul ) );
+            };
+        }
+
+        if (not objects.is_none()) {
+            handler.objects = [&objects]( const dl::object_set& set ) {
+                objects( set );
+            };
+        }
+
+        if (not frame.is_none()) {
+            handler.frame = [&frame]( const dl::obname& name,
+                                      const std::string& fmt,
+                                      std::int32_t frame_number,
+                                      const char* packed,
+                                      std::size_t size ) {
+                frame( name, fmt, frame_number, py::bytes( packed, size ) );
+            };
+        }
+
+        if (not record.is_none()) {
+            handler.record = [&record]( const dl::record& rec ) {
+                record( rec );
+            };
+        }
+
+        return dl::read_forward( source, handler );
+    });
+
+    m.def( "fmtstr", dl::fmtstr );
+
+    py::class_< dl::zone >( m, "zone" )
+        .def_readonly( "record", &dl::zone::record )
+        .def_readonly( "frames", &dl::zone::frames )
+        .def_readonly( "first",  &dl::zone::first )
+        .def_readonly( "last",   &dl::zone::last )
+        .def_readonly( "min",    &dl::zone::min )
+        .def_readonly( "max",    &dl::zone::max )
+        .def( "__repr__", []( const dl::zone& z ) {
+            return "dlisio.core.zone(record={}, frames={}, first={}, last={})"_s
+                    .format( z.record, z.frames, z.first, z.last );
+        })
+    ;
+
+    py::class_< dl::zonemap >( m, "zonemap" )
+        .def_readonly( "frame",   &dl::zonemap::frame )
+        .def_readonly( "fmt",     &dl::zonemap::fmt )
+        .def_readonly( "columns", &dl::zonemap::columns )
+        .def_readonly( "zones",   &dl::zonemap::zones )
+        .def( "candidates",       &dl::zonemap::candidates )
+    ;
+
+    m.def( "build_zonemap", dl::build_zonemap );
+
+    m.def( "write_lod", []( dl::stream& file,
+                            const std::vector< int >& records,
+                            const dl::obname& frame,
+                            const std::string& fmt,
+                            const std::vector< int >& columns,
+                            int fanout,
+                            const std::string& path ) {
+        const auto pyramids = dl::build_pyramids( file,
+                                                  records,
+                                                  frame,
+                                                  fmt,
+                                                  columns,
+                                                  fanout );
+        dl::write_pyramids( path, frame, pyramids );
+    });
+
+    py::class_< dl::lod_window >( m, "lodwindow" )
+        .def_readonly( "level", &dl::lod_window::level )
+        .def_readonly( "span",  &dl::lod_window::span )
+        .def_readonly( "first", &dl::lod_window::first )
+        .def_property_readonly( "min", []( const dl::lod_window& w ) {
+            std::vector< float > xs;
+            for (const auto& bin : w.bins) xs.push_back( bin.min );
+            return xs;
+        })
+        .def_property_readonly( "max", []( const dl::lod_window& w ) {
+            std::vector< float > xs;
+            for (const auto& bin : w.bins) xs.push_back( bin.max );
+            return xs;
+        })
+        .def_property_readonly( "mean", []( const dl::lod_window& w ) {
+            std::vector< float > xs;
+            for (const auto& bin : w.bins) xs.push_back( bin.mean );
+            return xs;
+        })
+        .def( "__len__", []( const dl::lod_window& w ) {
+            return w.bins.size();
+        })
+        .def( "__repr__", []( const dl::lod_window& w ) {
+            return "dlisio.core.lodwindow(level={}, span={}, first={}, bins={})"_s
+                    .format( w.level, w.span, w.first, w.bins.size() );
+        })
+    ;
+
+    py::class_< dl::lod_file >( m, "lodfile" )
+        .def( py::init< const std::string& >() )
+        .def_property_readonly( "frame",   &dl::lod_file::frame )
+        .def_property_readonly( "columns", &dl::lod_file::columns )
+        .def( "samples", &dl::lod_file::samples )
+        .def( "window",  &dl::lod_file::window )
+    ;
+
+    py::class_< dl::fingerprint >( m, "fingerprint" )
+        .def_readonly( "size", &dl::fingerprint::size )
+        .def_readonly( "hash", &dl::fingerprint::hash )
+        .def( "__eq__",        &dl::fingerprint::operator == )
+        .def( "__repr__", []( const dl::fingerprint& fp ) {
+            return "dlisio.core.fingerprint(size={}, hash={:016x})"_s
+                    .format( fp.size, fp.hash );
+        })
+    ;
+
+    m.def( "file_fingerprint", dl::file_fingerprint );
+
+    m.def( "write_snapshot", []( const dl::fingerprint& source,
+                                 long long sul_offset,
+                                 const dl::stream& file,
+                                 const std::vector< int >& explicits,
+                                 const std::vector< int >& implicits,
+                                 const std::vector< dl::encrypted_record >& enc,
+                                 const std::vector< dl::object_set >& sets ) {
+        dl::snapshot snap;
+        snap.source = source;
+        snap.sul_offset = sul_offset;
+        snap.tells = file.record_tells();
+        snap.residuals = file.record_residuals();
+        snap.explicits = explicits;
+        snap.implicits = implicits;
+        snap.encrypted = enc;
+        snap.sets = sets;
+
+        std::string buffer;
+        {
+            py::gil_scoped_release release;
+            buffer = dl::write_snapshot( snap );
+        }
+        return py::bytes( buffer );
+    });
+
+    /*
+     * Decode a snapshot in any object that supports the buffer protocol, e.g.
+     * bytes, mmap.mmap or the buf of a multiprocessing.shared_memory, in
+     * place. The buffer is held for the duration of the call only
+     */
+    m.def( "read_snapshot", []( py::buffer b ) {
+        const auto info = b.request();
+        const auto size = std::size_t( info.size * info.itemsize );
+
+        dl::snapshot snap;
+        {
+            py::gil_scoped_release release;
+            const auto* data = static_cast< const char* >( info.ptr );
+            snap = dl::snapshot_view( data, size ).decode();
+        }
+
+        return py::make_tuple( snap.source,
+                               snap.sul_offset,
+                               snap.tells,
+                               snap.residuals,
+                               snap.explicits,
+                               snap.implicits,
+                               snap.encrypted,
+                               snap.sets );
+    });
+    m.def( "write_column_cache", dl::write_column_cache );
+
+    py::class_< dl::cache_column >( m, "cache_column" )
+        .def_readonly( "channel",  &dl::cache_column::channel )
+        .def_readonly( "position", &dl::cache_column::position )
+        .def_readonly( "elements", &dl::cache_column::elements )
+        .def_readonly( "dtype",    &dl::cache_column::dtype )
+        .def_readonly( "offset",   &dl::cache_column::offset )
+        .def_readonly( "size",     &dl::cache_column::size )
+    ;
+
+    py::class_< dl::column_cache >( m, "column_cache" )
+        .def( py::init< const std::string& >() )
+        .def_property_readonly( "source",  &dl::column_cache::source )
+        .def_property_readonly( "frame",   &dl::column_cache::frame )
+        .def_property_readonly( "rows",    &dl::column_cache::rows )
+        .def_property_readonly( "columns", &dl::column_cache::columns )
+    ;
+
+    m.def( "arrow_columns", []( const std::string& path,
+                                const std::vector< std::string >& names ) {
+        std::unique_ptr< ArrowSchema > schema( new ArrowSchema() );
+        std::unique_ptr< ArrowArray > array( new ArrowArray() );
+        {
+            py::gil_scoped_release release;
+            dl::export_columns( path, names, schema.get(), array.get() );
+        }
+        return arrow_capsules( std::move( schema ), std::move( array ) );
+    });
+
+    m.def( "arrow_objects", []( const std::vector< dl::object_set >& sets,
+                                const std::string& type ) {
+        std::unique_ptr< ArrowSchema > schema( new ArrowSchema() );
+        std::unique_ptr< ArrowArray > array( new ArrowArray() );
+        {
+            py::gil_scoped_release release;
+            dl::export_objects( sets, type, schema.get(), array.get() );
+        }
+        return arrow_capsules( std::move( schema ), std::move( array ) );
+    });
+
+    py::class_< dl::catalog_frame >( m, "catalog_frame" )
+        .def_readonly( "name",         &dl::catalog_frame::name )
+        .def_readonly( "logical_file", &dl::catalog_frame::logical_file )
+    ;
+
+    py::class_< dl::catalog_channel >( m, "catalog_channel" )
+        .def_readonly( "name",         &dl::catalog_channel::name )
+        .def_readonly( "logical_file", &dl::catalog_channel::logical_file )
+        .def_readonly( "units",        &dl::catalog_channel::units )
+        .def_readonly( "reprc",        &dl::catalog_channel::reprc )
+        .def_readonly( "dimension",    &dl::catalog_channel::dimension )
+        .def_readonly( "frame",        &dl::catalog_channel::frame )
+    ;
+
+    py::class_< dl::catalog_parameter >( m, "catalog_parameter" )
+        .def_readonly( "name",         &dl::catalog_parameter::name )
+        .def_readonly( "logical_file", &dl::catalog_parameter::logical_file )
+    ;
+
+    py::class_< dl::catalog_file >( m, "catalog_file" )
+        .def_readonly( "path",          &dl::catalog_file::path )
+        .def_readonly( "fingerprint",   &dl::catalog_file::fingerprint )
+        .def_readonly( "logical_files", &dl::catalog_file::logical_files )
+        .def_readonly( "frames",        &dl::catalog_file::frames )
+        .def_readonly( "channels",      &dl::catalog_file::channels )
+        .def_readonly( "parameters",    &dl::catalog_file::parameters )
+    ;
+
+    py::enum_< dl::catalog_kind >( m, "catalog_kind" )
+        .value( "channel",   dl::catalog_kind::channel )
+        .value( "parameter", dl::catalog_kind::parameter )
+        .value( "frame",     dl::catalog_kind::frame )
+    ;
+
+    py::class_< dl::catalog_hit >( m, "catalog_hit" )
+        .def_readonly( "kind",         &dl::catalog_hit::kind )
+        .def_readonly( "file",         &dl::catalog_hit::file )
+        .def_readonly( "row",          &dl::catalog_hit::row )
+        .def_readonly( "logical_file", &dl::catalog_hit::logical_file )
+        .def_readonly( "name",         &dl::catalog_hit::name )
+    ;
+
+    py::class_< dl::catalog >( m, "catalog" )
+        .def( py::init< const std::string& >() )
+        .def( "__len__",     &dl::catalog::size )
+        .def( "path",        &dl::catalog::path )
+        .def( "fingerprint", &dl::catalog::fingerprint )
+        .def( "file",        &dl::catalog::file )
+        .def( "lookup",      &dl::catalog::lookup )
+    ;
+
+    py::class_< dl::catalog_update >( m, "catalog_update" )
+        .def_readonly( "loaded",    &dl::catalog_update::loaded )
+        .def_readonly( "unchanged", &dl::catalog_update::unchanged )
+        .def_readonly( "removed",   &dl::catalog_update::removed )
+        .def_readonly( "failed",    &dl::catalog_update::failed )
+    ;
+
+    m.def( "update_catalog", dl::update_catalog, nogil() );
+
     m.def( "marks", [] ( const std::string& path ) {
         mio::mmap_source file;
         dl::map_source( file, path );
@@ -1,4 +1,9 @@
+import gzip
+import os
+import struct
+import zlib
 import pytest
+import numpy as np
 from datetime import datetime
 
 import dlisio
@@ -144,6 +149,694 @@ def test_objects():
         objects = f.objects
         assert len(list(objects)) == 876
 
+def test_load_lazy():
+    path = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    with dlisio.load(path) as f:
+        channels = len(list(f.channels))
+
+    with dlisio.load(path, lazy = True) as f:
+        assert not f.index.complete
+        assert len(f.index) < 3252
+        # 30 explicit records, of which 11 are encrypted
+        assert len(f.explicit_indices) == 19
+        assert len(list(f.channels)) == channels
+
+        assert len(f.implicit_indices) == 3222
+        assert f.index.complete
+        assert len(f.index) == 3252
+
+        frame = f.getobject(("2000T", 2, 0), type="frame")
+        assert len(f.zonemap(frame).zones) == 921
+
+def test_load_lazy_multiple_logical_files():
+    path = 'data/multiple-logical-files.dlis'
+    with dlisio.load(path) as f:
+        explicits = f.explicit_indices
+        objects = len(list(f.objects))
+
+    with dlisio.load(path, lazy = True) as f:
+        # only the sets before the first frame data are loaded up front
+        assert f.explicit_indices == [0, 1, 2]
+        assert len(list(f.fileheader)) == 1
+
+        f.index_all()
+        assert f.explicit_indices == explicits
+        assert len(list(f.fileheader)) == 2
+        assert len(list(f.objects)) == objects
+
+        seqnr = sorted(fh.sequencenr for fh in f.fileheader)
+        assert seqnr == ['1', '2']
+
+def test_encryption():
+    path = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    with dlisio.load(path) as f:
+        ranges = f.encryption()
+        assert [(r.begin, r.end) for r in ranges] == [
+            (3, 5), (6, 8), (10, 11), (12, 13), (14, 15), (16, 17), (20, 23),
+        ]
+        assert all(r.company == 440 for r in ranges)
+
+        encrypted = set()
+        for r in ranges: encrypted.update(range(r.begin, r.end))
+        assert len(encrypted) == 11
+        assert not encrypted & set(f.explicit_indices)
+        assert not encrypted & set(f.implicit_indices)
+
+    with dlisio.load(path, lazy = True) as f:
+        assert len(f.encryption()) == 7
+
+    with dlisio.load('data/only-channels.dlis') as f:
+        assert f.encryption() == []
+
+def test_snapshot(tmpdir):
+    path = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    with dlisio.load(path) as f:
+        snap = f.snapshot()
+        channels = sorted(ch.name for ch in f.channels)
+        explicits = f.explicit_indices
+        implicits = f.implicit_indices
+
+    # relocated, i.e. not at the start of the buffer
+    with dlisio.attach(path, memoryview(b'\0' + snap)[1:]) as f:
+        assert sorted(ch.name for ch in f.channels) == channels
+        assert f.explicit_indices == explicits
+        assert f.implicit_indices == implicits
+        assert len(f.encryption()) == 7
+
+        frame = f.getobject(("2000T", 2, 0), type="frame")
+        assert len(f.zonemap(frame).zones) == 921
+
+    with dlisio.load(path, lazy = True) as f:
+        with dlisio.attach(path, f.snapshot()) as g:
+            assert g.implicit_indices == implicits
+
+    # the metadata of later logical files is in the snapshot of a lazily
+    # loaded file too
+    path = 'data/multiple-logical-files.dlis'
+    with dlisio.load(path) as f:
+        explicits = f.explicit_indices
+        objects = len(list(f.objects))
+
+    with dlisio.load(path, lazy = True) as f:
+        with dlisio.attach(path, f.snapshot()) as g:
+            assert g.explicit_indices == explicits
+            assert len(list(g.objects)) == objects
+            assert len(list(g.fileheader)) == 2
+
+    path = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    with pytest.raises(ValueError):
+        dlisio.attach('data/only-channels.dlis', snap)
+
+    with pytest.raises(RuntimeError):
+        dlisio.attach(path, snap[:100])
+
+def test_pickle():
+    import pickle
+
+    with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
+        objects = list(f.objects)
+        copies = pickle.loads(pickle.dumps(objects))
+        assert len(copies) == len(objects)
+        for obj, copy in zip(objects, copies):
+            assert type(copy) is type(obj)
+            assert copy.name == obj.name
+            assert copy.attic.__getstate__() == obj.attic.__getstate__()
+
+        channel = f.getobject(("TDEP", 2, 0), type="channel")
+        copy = pickle.loads(pickle.dumps(channel))
+        assert copy.units == channel.units
+        assert copy.dimension == channel.dimension
+
+        record = f.file[0]
+        copy = pickle.loads(pickle.dumps(record))
+        assert copy.type == record.type
+        assert copy.explicit == record.explicit
+        assert bytes(copy) == bytes(record)
+
+        sets = f.file.extract(f.explicit_indices)
+        sets = dlisio.core.parse_objects(sets)
+        blob = dlisio.core.serialize_sets(sets)
+        copies = dlisio.core.deserialize_sets(blob)
+        assert len(copies) == len(sets)
+        assert dlisio.core.serialize_sets(copies) == blob
+
+        with pytest.raises(ValueError):
+            dlisio.core.deserialize_sets(channel.name.__getstate__())
+
+        with pytest.raises(RuntimeError):
+            dlisio.core.deserialize_sets(blob[:-1])
+
+def test_json(tmpdir):
+    import json
+
+    with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
+        sets = json.loads(f.to_json().decode('utf-8'))
+        assert len(sets) == 19
+        assert sets[0]['type'] == 'FILE-HEADER'
+
+        channels = [s for s in sets if s['type'] == 'CHANNEL'][0]['objects']
+        tdep = channels[0]
+        assert tdep['name'] == {'id': 'TDEP', 'origin': 2, 'copynumber': 0}
+        assert tdep['attributes']['LONG-NAME']['value'] == ['6-Inch Frame Depth']
+        assert tdep['attributes']['UNITS']['reprc'] == 'units'
+        assert tdep['attributes']['DIMENSION']['value'] == [1]
+
+        path = str(tmpdir.join('metadata.ndjson'))
+        with open(path, 'wb') as out:
+            assert f.to_json(out, lines = True) is None
+
+        with open(path, 'rb') as out:
+            lines = [json.loads(line.decode('utf-8')) for line in out]
+        assert lines == sets
+
+    with dlisio.load('data/broken-degree-symbol.dlis') as f:
+        sets = json.loads(f.to_json().decode('utf-8'))
+        values = [a['value'] for s in sets
+                             for o in s['objects']
+                             for a in o['attributes'].values()
+                             if a['reprc'] == 'ascii']
+        assert ['56\u00b0 33\' 56.2" N'] in values
+
+        times = [a['value'] for s in sets
+                            for o in s['objects']
+                            for a in o['attributes'].values()
+                            if a['reprc'] == 'dtime']
+        assert times == [['2013-12-04T17:30:48.625']]
+
+def test_xxh64():
+    # the reference digests of the xxHash distribution, seed 0
+    xxh64 = dlisio.core.xxh64
+    assert xxh64(b'') == 0xef46db3751d8e999
+    assert xxh64(b'abc') == 0x44bc2cf5ad770999
+
+    # longer than a stripe (32 bytes), for the accumulators
+    fox = b'The quick brown fox jumps over the lazy dog'
+    assert xxh64(fox) == 0x0b242d361fda71bc
+    assert xxh64(bytes(range(100))) == 0x6ac1e58032166597
+
+    assert xxh64(b'abc', seed = 1) == 0xbea9ca8199328908
+
+def test_load_hashes():
+    with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS',
+                     hashes = True) as f:
+        assert len(f.hashes.records) == 3252
+        assert f.hashes.logical_files == [0]
+        assert len(f.hashes.files) == 1
+
+    with dlisio.load('data/only-channels.dlis') as f:
+        assert f.hashes is None
+
+    # the same logical file, behind different garbage before the SUL
+    paths = [
+        'data/only-channels.dlis',
+        'data/pre-sul-garbage.dlis',
+        'data/pre-sul-pre-vrl-garbage.dlis',
+    ]
+    hashes = []
+    for path in paths:
+        with dlisio.load(path, hashes = True) as f:
+            hashes.append(f.hashes.files)
+
+    assert hashes[0] == hashes[1] == hashes[2]
+
+    with pytest.raises(ValueError):
+        dlisio.load(paths[0], lazy = True, hashes = True)
+
+def test_subset(tmpdir):
+    source = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    target = str(tmpdir.join('subset.dlis'))
+
+    assert dlisio.subset(source, target) == 3252
+    with dlisio.load(source, hashes = True) as f:
+        with dlisio.load(target, hashes = True) as g:
+            assert g.storage_label() == f.storage_label()
+            assert g.hashes.records == f.hashes.records
+
+    assert dlisio.subset(source, target, frames = ['2000T']) == 951
+    with dlisio.load(target) as f:
+        assert len(f.explicit_indices) == 30
+        assert len(f.implicit_indices) == 921
+        frame = f.getobject(('2000T', 2, 0), type = 'frame')
+        assert len(f.zonemap(frame).zones) == 921
+
+    assert dlisio.subset(source, target, types = ['CHANNEL']) == 3224
+    with dlisio.load(target) as f:
+        assert len(list(f.channels)) > 0
+        assert len(list(f.frames)) == 0
+        assert next(f.fileheader, None) is not None
+
+    assert dlisio.subset(source, target, logical_files = [1]) == 0
+
+def test_repair(tmpdir):
+    source = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    target = str(tmpdir.join('repaired.dlis'))
+    log = str(tmpdir.join('repaired.log'))
+
+    result = dlisio.repair(source, target, log)
+    assert result.records == 3252
+    assert result.events == 0
+    assert result.dropped == 0
+    with dlisio.load(source, hashes = True) as f:
+        with dlisio.load(target, hashes = True) as g:
+            assert g.hashes.records == f.hashes.records
+            original = set(f.hashes.records)
+
+    damaged = str(tmpdir.join('damaged.dlis'))
+    with open(source, 'rb') as f:
+        data = bytearray(f.read())
+    data[84:84 + 37] = b'Z' * 37
+    with open(damaged, 'wb') as f:
+        f.write(data)
+
+    with pytest.raises(RuntimeError):
+        _ = dlisio.load(damaged)
+
+    result = dlisio.repair(damaged, target, log)
+    assert result.records == 3243
+    assert result.events == 2
+    with open(log) as f:
+        assert f.readline().startswith('offset 80: invalid visible record')
+
+    with dlisio.load(target, hashes = True) as f:
+        assert len(f.hashes.records) == 3243
+        assert set(f.hashes.records) <= original
+
+def test_load_tapeimage(tmpdir):
+    source = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    target = str(tmpdir.join('wrapped.tif'))
+
+    with open(source, 'rb') as f:
+        data = f.read()
+
+    # 1000-byte tape records, so that records straddle the tape marks, and
+    # two tape marks at the end
+    records = [data[i:i + 1000] for i in range(0, len(data), 1000)]
+    wrapped = bytearray()
+    prev = 0
+    for record in records + [b'', b'']:
+        here = len(wrapped)
+        kind = 0 if record else 1
+        wrapped += struct.pack('<3I', kind, prev, here + 12 + len(record))
+        wrapped += record
+        prev = here
+
+    with open(target, 'wb') as f:
+        f.write(wrapped)
+
+    with dlisio.load(source) as f:
+        with dlisio.load(target) as g:
+            assert g.storage_label() == f.storage_label()
+            assert g.explicit_indices == f.explicit_indices
+            assert g.implicit_indices == f.implicit_indices
+            assert len(list(g.objects)) == len(list(f.objects))
+
+            frame = g.getobject(('2000T', 2, 0), type = 'frame')
+            assert len(g.zonemap(frame).zones) == 921
+
+    with pytest.raises(NotImplementedError):
+        dlisio.load(target, hashes = True)
+
+def test_load_compressed(tmpdir):
+    source = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    gz = str(tmpdir.join('compressed.dlis.gz'))
+    zindex = str(tmpdir.join('compressed.zix'))
+
+    with open(source, 'rb') as f:
+        data = f.read()
+
+    # two gzip members, like concatenated files or pigz output
+    half = len(data) // 2
+    with open(gz, 'wb') as f:
+        for member in [data[:half], data[half:]]:
+            with gzip.GzipFile(fileobj = f, mode = 'wb') as g:
+                g.write(member)
+
+    with dlisio.load(source) as f:
+        for _ in range(2):
+            # the second time, the index is read from zindex
+            with dlisio.load(gz, zindex = zindex) as g:
+                assert g.storage_label() == f.storage_label()
+                assert g.explicit_indices == f.explicit_indices
+                assert g.implicit_indices == f.implicit_indices
+                assert len(list(g.objects)) == len(list(f.objects))
+
+                frame = g.getobject(('2000T', 2, 0), type = 'frame')
+                assert len(g.zonemap(frame).zones) == 921
+
+    index = dlisio.load_zindex(gz, zindex)
+    assert index.size == len(data)
+    assert index.source == dlisio.core.file_fingerprint(gz)
+    assert len(index) > 2
+
+    with pytest.raises(NotImplementedError):
+        dlisio.load(gz, hashes = True)
+
+def test_load_zlib(tmpdir):
+    source = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    target = str(tmpdir.join('compressed.dlis.z'))
+
+    with open(source, 'rb') as f:
+        data = f.read()
+
+    with open(target, 'wb') as f:
+        f.write(zlib.compress(data))
+
+    with dlisio.load(source) as f:
+        with dlisio.load(target) as g:
+            assert g.implicit_indices == f.implicit_indices
+            assert len(list(g.objects)) == len(list(f.objects))
+
+def test_loadall(tmpdir):
+    first = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    second = 'data/only-channels.dlis'
+    target = str(tmpdir.join('concatenated.dlis'))
+
+    with open(first, 'rb') as f:
+        a = f.read()
+    with open(second, 'rb') as f:
+        b = f.read()
+
+    # garbage between storage units is skipped
+    with open(target, 'wb') as f:
+        f.write(a + b + b'garbage' + a)
+
+    files = dlisio.loadall(target)
+    try:
+        assert len(files) == 3
+        assert files[0].sul_offset == 0
+        assert files[1].sul_offset == len(a)
+        assert files[2].sul_offset == len(a) + len(b) + len('garbage')
+
+        with dlisio.load(first) as f:
+            for g in [files[0], files[2]]:
+                assert g.storage_label() == f.storage_label()
+                assert g.explicit_indices == f.explicit_indices
+                assert len(g.implicit_indices) == len(f.implicit_indices)
+
+            frame = files[2].getobject(('2000T', 2, 0), type = 'frame')
+            assert len(files[2].zonemap(frame).zones) == 921
+
+        with dlisio.load(second) as f:
+            assert len(list(files[1].channels)) == len(list(f.channels))
+    finally:
+        for f in files: f.file.close()
+
+    # a plain file is a single storage unit
+    files = dlisio.loadall(first, workers = 1)
+    assert len(files) == 1
+    files[0].file.close()
+
+def test_loadall_truncated_unit(tmpdir):
+    source = 'data/multiple-logical-files.dlis'
+    target = str(tmpdir.join('truncated.dlis'))
+
+    with open(source, 'rb') as f:
+        a = f.read()
+
+    # the first storage unit is cut off in the middle of a visible record,
+    # which leaves it out but not the storage unit after it
+    with open(target, 'wb') as f:
+        f.write(a[:200] + a)
+
+    with pytest.warns(RuntimeWarning, match = 'truncated'):
+        files = dlisio.loadall(target)
+
+    try:
+        assert len(files) == 1
+        assert files[0].sul_offset == 200
+        with dlisio.load(source) as f:
+            assert files[0].explicit_indices == f.explicit_indices
+    finally:
+        for f in files: f.file.close()
+
+    # with no storage unit to load, the error is raised
+    with open(target, 'wb') as f:
+        f.write(a[:200])
+
+    with pytest.raises(RuntimeError, match = 'truncated'):
+        _ = dlisio.loadall(target)
+
+def test_load_diagnostics(tmpdir):
+    source = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    target = str(tmpdir.join('damaged.dlis'))
+
+    # an intact file parses the same, with or without diagnostics
+    diag = dlisio.core.diagnostics()
+    with dlisio.load(source) as f:
+        with dlisio.load(source, diagnostics = diag) as g:
+            assert len(list(g.objects)) == len(list(f.objects))
+            origins = len(list(f.origin))
+
+    entries = [x for x in diag.entries
+               if x.code != dlisio.core.diagnostic_code.protocol]
+    assert entries == []
+
+    mmap = dlisio.core.mmap_source()
+    mmap.map(source)
+    tells, residuals, explicits, _ = dlisio.core.findoffsets(mmap, 80)
+    index = [i for i, explicit in enumerate(explicits) if explicit][1]
+
+    # break the set descriptor of the second explicit record, which is then
+    # skipped, instead of failing the whole file
+    body = tells[index] + (4 if residuals[index] == 0 else 0) + 4
+    with open(source, 'rb') as f:
+        data = bytearray(f.read())
+    data[body] = 0
+    with open(target, 'wb') as f:
+        f.write(data)
+
+    with pytest.raises(ValueError):
+        dlisio.load(target)
+
+    diag = dlisio.core.diagnostics()
+    with dlisio.load(target, diagnostics = diag) as f:
+        assert len(list(f.origin)) == origins - 1
+
+    assert len(diag) == 1
+    entry = diag.entries[0]
+    assert entry.record == index
+    assert entry.offset == 0
+    assert entry.code == dlisio.core.diagnostic_code.invalid
+    assert 'SET' in entry.message
+
+def test_load_attribute_past_end_of_record(tmpdir):
+    target = str(tmpdir.join('truncated-attribute.dlis'))
+
+    # the DIMENSION of TDEP claims 64 uvaris, but only one is left in the
+    # record, which must be caught before the values are read
+    body = (b'\xF0\x07CHANNEL'
+            b'\x30\x09DIMENSION'
+            b'\x70\x01\x00\x04TDEP'
+            b'\x2D\x40\x12\x01')
+    segment = struct.pack('>HBB', len(body) + 4, 0x80, 3) + body
+    vr = struct.pack('>HBB', len(segment) + 4, 0xFF, 1) + segment
+    sul = b'   1V1.00RECORD 8192' + b'Default Storage Set'.ljust(60)
+    with open(target, 'wb') as f:
+        f.write(sul + vr)
+
+    with pytest.raises(IndexError, match = 'end-of-record'):
+        dlisio.load(target)
+
+    diag = dlisio.core.diagnostics()
+    with dlisio.load(target, diagnostics = diag) as f:
+        assert len(list(f.channels)) == 0
+
+    assert len(diag) == 1
+    entry = diag.entries[0]
+    assert entry.record == 0
+    assert entry.offset == 20
+    assert entry.code == dlisio.core.diagnostic_code.truncated
+
+def test_read_stream():
+    path = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+
+    class pipe(object):
+        """ A stream that only gives out small, uneven pieces """
+        def __init__(self, path):
+            self.f = open(path, 'rb')
+        def read(self, n):
+            return self.f.read(min(n, 777))
+
+    labels = []
+    channels = []
+    frames = {}
+    records = []
+    def frame(name, fmt, number, packed):
+        frames.setdefault(name.id, []).append(number)
+
+    stream = pipe(path)
+    result = dlisio.read_stream(stream,
+                                objects = lambda pool: channels.extend(pool.channels),
+                                frames = frame,
+                                records = records.append,
+                                label = labels.append)
+    stream.f.close()
+
+    with dlisio.load(path) as f:
+        assert labels == [f.storage_label()]
+        assert len(channels) == len(list(f.channels))
+
+    assert result.records == 3252
+    assert result.bytes == os.path.getsize(path)
+    assert len(frames['2000T']) == 921
+    assert result.frames == sum(len(x) for x in frames.values())
+    assert all(rec.encrypted for rec in records)
+
+def test_read_stream_multiple_logical_files():
+    # MAIN is defined in both logical files, with different channels
+    frames = []
+    def frame(name, fmt, number, packed):
+        frames.append((name.id, fmt, number, len(packed)))
+
+    with open('data/multiple-logical-files.dlis', 'rb') as stream:
+        result = dlisio.read_stream(stream, frames = frame)
+
+    assert result.frames == 8
+    main = [x for x in frames if x[0] == 'MAIN']
+    assert main == [
+        ('MAIN', 'ff', 1, 8),
+        ('MAIN', 'ff', 2, 8),
+        ('MAIN', 'ff', 3, 8),
+        ('MAIN', 'lF', 1, 12),
+        ('MAIN', 'lF', 2, 12),
+    ]
+
+def test_load_batch():
+    paths = [
+        'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS',
+        'data/only-channels.dlis',
+        'data/padbytes-large-as-record.dlis',
+        'data/pre-sul-garbage.dlis',
+    ]
+
+    results = {}
+    for path, f, error in dlisio.load_batch(paths, workers = 2):
+        results[path] = (f, error)
+
+    assert sorted(results.keys()) == sorted(paths)
+
+    f, error = results['data/padbytes-large-as-record.dlis']
+    assert f is None
+    assert 'storage label' in error
+
+    f, error = results['data/pre-sul-garbage.dlis']
+    assert error is None
+    assert f.sul_offset == 12
+    f.file.close()
+
+    f, error = results['data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS']
+    with f:
+        with dlisio.load(paths[0]) as g:
+            assert f.storage_label() == g.storage_label()
+            assert f.explicit_indices == g.explicit_indices
+            assert f.implicit_indices == g.implicit_indices
+            assert len(list(f.channels)) == len(list(g.channels))
+            assert next(f.origin).name == next(g.origin).name
+
+    results[paths[1]][0].file.close()
+
+def test_catalog(tmpdir):
+    path = str(tmpdir.join('logs.catalog'))
+    paths = [
+        'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS',
+        'data/only-channels.dlis',
+        'data/padbytes-large-as-record.dlis',
+        'data/missing.dlis',
+    ]
+
+    with pytest.warns(RuntimeWarning):
+        cat = dlisio.catalog(path, paths)
+    assert len(cat) == 2
+    assert cat.path(0) == paths[0]
+
+    entry = cat.file(0)
+    assert entry.fingerprint == dlisio.core.file_fingerprint(paths[0])
+    assert entry.logical_files == 1
+    assert len(entry.channels) == 104
+    assert [frame.name.id for frame in entry.frames] == ['2000T', '800T']
+
+    hits = cat.lookup('2000T')
+    assert len(hits) == 1
+    assert hits[0].kind == dlisio.core.catalog_kind.frame
+    assert hits[0].file == 0
+    assert hits[0].name.origin == 2
+
+    with dlisio.load(paths[0]) as f:
+        frame = f.getobject(('2000T', 2, 0), type = 'frame')
+        channel = f.getobject(frame.channels[0], type = 'channel')
+
+        hits = [h for h in cat.lookup(channel.name.id)
+                if h.kind == dlisio.core.catalog_kind.channel and h.file == 0]
+        ch = entry.channels[hits[0].row]
+        assert ch.units.strip() == channel.units
+        assert ch.reprc == channel.reprc
+        assert ch.dimension == channel.dimension
+        assert entry.frames[ch.frame].name.id == '2000T'
+
+    assert len(cat.lookup('no such channel')) == 0
+
+    del cat
+    cat = dlisio.catalog(path, paths[1:2])
+    assert len(cat) == 1
+    assert cat.file(0).path == paths[1]
+    assert len(cat.lookup('2000T')) == 0
+
+def test_crawl():
+    path = 'data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS'
+    label, objects = dlisio.crawl(path)
+
+    with dlisio.load(path) as f:
+        assert label == f.storage_label()
+
+    assert len(objects) == 2
+    fh = next(objects.fileheader)
+    assert fh.name.origin == 2
+    origin = next(objects.origin)
+    assert origin.name.id       == "DLIS_DEFINING_ORIGIN"
+    assert origin.file_set_name == "FAROE_PETROLEUM/206_05A-3"
+
+    _, objects = dlisio.crawl(path, types = ['ORIGIN'])
+    assert len(objects) == 1
+
+    _, objects = dlisio.crawl(path, types = [])
+    assert len(list(objects.channels)) > 0
+
+def test_crawl_truncated_visible_record():
+    label, objects = dlisio.crawl('data/only-channels.dlis', types = [])
+    assert label['id'].rstrip() == 'Default Storage Set'
+    assert len(list(objects.channels)) > 0
+
+def test_crawl_set_split_over_segments(tmpdir):
+    def segment(body, attrs):
+        pad = max(12 - len(body), len(body) % 2)
+        if (len(body) + pad) % 2: pad += 1
+        if pad:
+            body += bytes([pad]) * pad
+            attrs |= 0x01
+        return struct.pack('>HBB', len(body) + 4, attrs, 4) + body
+
+    # The first segment is too short for the set type, and the last starts
+    # with values that look like a CHANNEL set component
+    head = b'\xF0\x05FRAME' + b'\x30\x05CODES' + b'\x70\x01\x00\x01F'
+    head += b'\x2D\x09\x0F'
+    values = b'\xF0\x07CHANNEL'
+    segments = (segment(head[:4], 0xA0)
+              + segment(head[4:], 0xE0)
+              + segment(values, 0xC0))
+    vr = struct.pack('>HBB', len(segments) + 4, 0xFF, 1) + segments
+    sul = b'   1V1.00RECORD 8192' + b'Default Storage Set'.ljust(60)
+
+    path = str(tmpdir.join('split.dlis'))
+    with open(path, 'wb') as f:
+        f.write(sul + vr)
+
+    _, objects = dlisio.crawl(path, types = ['FRAME'])
+    frame = next(objects.frames)
+    assert frame.name.id == 'F'
+
+    _, objects = dlisio.crawl(path, types = ['CHANNEL'])
+    assert len(objects) == 0
+
 def test_fileheader():
     with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
         fh = next(f.fileheader)
@@ -216,6 +909,310 @@ def test_frames():
         fchannels = [ch for ch in f.channels if frame.haschannel(ch.name)]
         assert len(fchannels) == len(frame.channels)
 
+def test_zonemap():
+    with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
+        frame = f.getobject(("2000T", 2, 0), type="frame")
+        zm = f.zonemap(frame)
+        assert zm.fmt == "ffff"
+        assert zm.columns == [0]
+        assert len(zm.zones) == 921
+
+        first = zm.zones[0]
+        assert first.record == 30
+        assert first.frames == 1
+        assert first.first == 1
+        assert first.last == 1
+        assert first.min[0] == first.max[0]
+
+        records = zm.candidates(0, first.min[0], first.max[0])
+        assert first.record in records
+
+        with pytest.raises(IndexError):
+            zm.candidates(1, 0, 1)
+
+        assert f.zonemap(frame) is zm
+
+def test_zonemap_string_channel():
+    with dlisio.load('data/multiple-logical-files.dlis') as f:
+        frame = f.getobject(("TEXT", 1, 0), type="frame")
+        channels = [f.getobject(name, type="channel")
+                    for name in frame.attic['CHANNELS'].value]
+        zm = f.zonemap(frame, channels = channels)
+        assert zm.fmt == "fSf"
+        assert zm.columns == [0, 2]
+        assert [z.record for z in zm.zones] == [4, 5]
+        assert zm.zones[0].min == [1, 10]
+        assert zm.zones[0].max == [2, 20]
+        assert zm.zones[1].min == [3, 30]
+
+        assert zm.candidates(2, 25, 35) == [5]
+        with pytest.raises(IndexError):
+            zm.candidates(1, 0, 1)
+
+def test_zonemap_multiple_logical_files():
+    # both logical files have a frame MAIN, with different channels
+    with dlisio.load('data/multiple-logical-files.dlis') as f:
+        first, second = [fr for fr in f.frames if fr.name.id == 'MAIN']
+        channels = [ch for ch in f.channels if ch.name.id == 'VAL']
+
+        zm = f.zonemap(first)
+        assert zm.fmt == "ff"
+        assert [z.record for z in zm.zones] == [3]
+        assert zm.zones[0].min == [1]
+        assert zm.zones[0].max == [3]
+
+        zm = f.zonemap(second, channels = channels[1:])
+        assert zm.fmt == "lF"
+        assert zm.columns == [1]
+        assert [z.record for z in zm.zones] == [9]
+        assert zm.zones[0].min == [0.25]
+        assert zm.zones[0].max == [0.75]
+        assert f.zonemap(first) is not f.zonemap(second)
+
+def test_columns(tmpdir):
+    cachedir = str(tmpdir.join('cache'))
+    with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
+        frame = f.getobject(("2000T", 2, 0), type="frame")
+        columns = f.columns(frame, cachedir)
+        keys = list(columns.keys())
+        assert len(keys) == 5
+        assert keys[0] == 'FRAMENO'
+        assert len(os.listdir(cachedir)) == 1
+
+        framenos = columns['FRAMENO']
+        assert len(framenos) == 921
+        assert framenos[0] == 1
+        assert framenos[-1] == 921
+
+        index = columns[keys[1]]
+        assert index.dtype == np.float32
+        assert index[0] == f.zonemap(frame).zones[0].min[0]
+
+        cached = f.columns(frame, cachedir)
+        assert isinstance(cached[keys[1]], np.memmap)
+        assert np.array_equal(cached[keys[1]], index)
+        assert len(os.listdir(cachedir)) == 1
+
+def test_columns_string_channel(tmpdir):
+    cachedir = str(tmpdir.join('cache'))
+    with dlisio.load('data/multiple-logical-files.dlis') as f:
+        frame = f.getobject(("TEXT", 1, 0), type="frame")
+        columns = f.columns(frame, cachedir)
+        assert list(columns.keys()) == ['FRAMENO', 'INDEX', 'VAL']
+        assert list(columns['FRAMENO']) == [1, 2, 3]
+        assert list(columns['INDEX']) == [1, 2, 3]
+        assert list(columns['VAL']) == [10, 20, 30]
+
+def test_columns_multiple_logical_files(tmpdir):
+    cachedir = str(tmpdir.join('cache'))
+    with dlisio.load('data/multiple-logical-files.dlis') as f:
+        first, second = [fr for fr in f.frames if fr.name.id == 'MAIN']
+
+        columns = f.columns(second, cachedir)
+        assert list(columns.keys()) == ['FRAMENO', 'INDEX', 'VAL']
+        assert columns['INDEX'].dtype == np.int32
+        assert list(columns['INDEX']) == [100, 200]
+        assert list(columns['VAL']) == [0.25, 0.75]
+
+        columns = f.columns(first, cachedir)
+        assert columns['INDEX'].dtype == np.float32
+        assert list(columns['INDEX']) == [1, 2, 3]
+        assert list(columns['VAL']) == [0.5, 1.5, 2.5]
+        assert len(os.listdir(cachedir)) == 2
+
+        columns = f.columns(second, cachedir)
+        assert list(columns['INDEX']) == [100, 200]
+
+def test_arrow_capsules(tmpdir):
+    cachedir = str(tmpdir.join('cache'))
+    with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
+        frame = f.getobject(("2000T", 2, 0), type="frame")
+        for data in [f.arrow_columns(frame, cachedir),
+                     f.arrow_objects('CHANNEL')]:
+            schema, array = data.__arrow_c_array__()
+            assert type(schema).__name__ == 'PyCapsule'
+            assert type(array).__name__ == 'PyCapsule'
+            assert type(data.__arrow_c_schema__()).__name__ == 'PyCapsule'
+
+def test_arrow(tmpdir):
+    pa = pytest.importorskip('pyarrow')
+
+    cachedir = str(tmpdir.join('cache'))
+    with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
+        frame = f.getobject(("2000T", 2, 0), type="frame")
+        columns = f.columns(frame, cachedir)
+        batch = pa.record_batch(f.arrow_columns(frame, cachedir))
+        batch.validate(full = True)
+        assert batch.schema.names == list(columns.keys())
+        assert batch.num_rows == 921
+        assert batch.column(0).type == pa.int32()
+        for name, column in columns.items():
+            assert np.array_equal(batch.column(name).to_numpy(), column)
+
+        channels = pa.record_batch(f.arrow_objects('CHANNEL'))
+        channels.validate(full = True)
+        assert channels.num_rows == 104
+        assert channels.schema.names[:3] == ['id', 'origin', 'copynumber']
+        tdep = channels.slice(0, 1).to_pylist()[0]
+        assert tdep['id'] == 'TDEP'
+        assert tdep['LONG-NAME'] == ['6-Inch Frame Depth']
+        assert tdep['DIMENSION'] == [1]
+        assert tdep['SOURCE'] is None
+
+        frames = pa.record_batch(f.arrow_objects('FRAME')).to_pylist()
+        assert frames[0]['CHANNELS'][0] == {
+            'id': 'TIME', 'origin': 2, 'copynumber': 4
+        }
+
+        origin = pa.record_batch(f.arrow_objects('ORIGIN')).to_pylist()[0]
+        assert origin['CREATION-TIME'] == [datetime(2011, 8, 20, 21, 48, 50)]
+
+        # the values of parameters differ in type, and are exported as JSON
+        parameters = pa.record_batch(f.arrow_objects('PARAMETER'))
+        assert parameters.schema.field('VALUES').type == pa.string()
+
+        empty = pa.record_batch(f.arrow_objects('NO-SUCH-TYPE'))
+        assert empty.num_rows == 0
+        assert empty.schema.names == ['id', 'origin', 'copynumber']
+
+def test_arrow_nat(tmpdir):
+    pa = pytest.importorskip('pyarrow')
+
+    # the second TIME is February 30th, which is NaT in the cache, and null
+    # in the arrow export
+    cachedir = str(tmpdir.join('cache'))
+    with dlisio.load('data/dtime-channel.dlis') as f:
+        frame = f.getobject('MAIN', type = 'frame')
+        columns = f.columns(frame, cachedir)
+        assert np.isnat(columns['TIME']).tolist() == [False, True, False]
+
+        batch = pa.record_batch(f.arrow_columns(frame, cachedir))
+        batch.validate(full = True)
+        time = batch.column('TIME')
+        assert time.type == pa.timestamp('ns')
+        assert time.null_count == 1
+        assert time.to_pylist() == [
+            datetime(1987, 4, 19, 20, 20, 15, 620000),
+            None,
+            datetime(2000, 2, 29),
+        ]
+        assert batch.column('INDEX').null_count == 0
+
+def test_lod(tmpdir):
+    path = str(tmpdir.join('2000T.lod'))
+    with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
+        frame = f.getobject(("2000T", 2, 0), type="frame")
+        lod = f.lod(frame, path)
+        assert lod.frame == frame.name
+        assert lod.columns == [0]
+        assert lod.samples(0) == 921
+
+        window = lod.window(0, 0, 921, 1)
+        assert window.level == 3
+        assert window.first == 0
+        assert len(window) == 1
+        assert window.min[0] <= window.mean[0] <= window.max[0]
+
+        window = lod.window(0, 0, 921, 100)
+        assert window.level == 0
+        assert window.span == 8
+        assert len(window) == 116
+
+        window = lod.window(0, 20, 30, 100)
+        assert window.first == 16
+        assert len(window) == 2
+
+        with pytest.raises(IndexError):
+            lod.window(1, 0, 921, 1)
+
+        with pytest.raises(ValueError):
+            f.lod(frame, path, fanout = 1)
+
+    lod = dlisio.core.lodfile(path)
+    assert lod.samples(0) == 921
+
+def test_lod_string_channel(tmpdir):
+    path = str(tmpdir.join('TEXT.lod'))
+    with dlisio.load('data/multiple-logical-files.dlis') as f:
+        frame = f.getobject(("TEXT", 1, 0), type="frame")
+        channels = [f.getobject(name, type="channel")
+                    for name in frame.attic['CHANNELS'].value]
+        lod = f.lod(frame, path, channels = channels, fanout = 2)
+        assert lod.columns == [0, 2]
+        assert lod.samples(2) == 3
+
+        window = lod.window(2, 0, 3, 1)
+        assert window.level == 1
+        assert window.min == [10]
+        assert window.max == [30]
+        assert window.mean == [20]
+
+def test_lod_multiple_logical_files(tmpdir):
+    path = str(tmpdir.join('MAIN.lod'))
+    with dlisio.load('data/multiple-logical-files.dlis') as f:
+        _, frame = [fr for fr in f.frames if fr.name.id == 'MAIN']
+        lod = f.lod(frame, path, fanout = 2)
+        assert lod.columns == [0]
+        assert lod.samples(0) == 2
+
+        window = lod.window(0, 0, 2, 1)
+        assert window.min == [100]
+        assert window.max == [200]
+        assert window.mean == [150]
+
+def test_noformat(tmpdir):
+    def segment(body, attrs = 0):
+        # pad to an even length, and at least the minimum segment length
+        pad = max(12 - len(body), len(body) % 2)
+        if (len(body) + pad) % 2: pad += 1
+        if pad:
+            body += bytes([pad]) * pad
+            attrs |= 0x01
+        return struct.pack('>HBB', len(body) + 4, attrs, 1) + body
+
+    def obname(ident):
+        return b'\x01\x00' + bytes([len(ident)]) + ident
+
+    # IMG is split over two records, the second with two segments
+    segments = (segment(obname(b'IMG') + b'hello ')
+              + segment(obname(b'IMG') + b'wor', attrs = 0x20)
+              + segment(b'ld!', attrs = 0x40)
+              + segment(obname(b'DOC') + b'xyz!'))
+    vr = struct.pack('>HBB', len(segments) + 4, 0xFF, 1) + segments
+
+    path = str(tmpdir.join('noformat.dlis'))
+    with open('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS', 'rb') as src:
+        with open(path, 'wb') as dst:
+            dst.write(src.read() + vr)
+
+    with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
+        assert f.noformat() == []
+
+    with dlisio.load(path) as f:
+        img, doc = f.noformat()
+        assert img.name.id == 'IMG'
+        assert img.name.origin == 1
+        assert img.records == [3252, 3253]
+        assert img.size == 12
+        assert doc.name.id == 'DOC'
+        assert doc.size == 4
+
+        chunks = []
+        assert f.read_noformat(img, chunks.append, chunksize = 4) == 12
+        assert chunks == [b'hell', b'o ', b'wor', b'ld!']
+
+        out = str(tmpdir.join('img.bin'))
+        with open(out, 'wb') as fd:
+            fd.write(b'<')
+            assert f.read_noformat(img, fd) == 12
+            fd.write(b'>')
+
+        with open(out, 'rb') as fd:
+            assert fd.read() == b'<hello world!>'
+
+        with pytest.raises(ValueError):
+            f.read_noformat(img, chunks.append, chunksize = 0)
+
 def test_tools():
     with dlisio.load('data/206_05a-_3_DWL_DWL_WIRE_258276498.DLIS') as f:
         tool = next(f.tools)